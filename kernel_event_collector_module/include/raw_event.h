@@ -174,6 +174,7 @@ typedef struct _CB_EVENT_FILE_GENERIC {
     uint16_t path_offset;
     uint64_t device;
     uint64_t inode;
+    uint32_t op_count; // Number of write cycles this event summarizes (1 unless coalesced)
 } CB_EVENT_FILE_GENERIC, *PCB_EVENT_FILE_GENERIC;
 
 typedef struct _CB_EVENT_HEARTBEAT {
@@ -328,6 +329,7 @@ typedef struct _CB_EVENT_DNS_RESPONSE {
     uint16_t       record_offset;
     uint16_t       nscount;
     uint16_t       arcount;
+    uint32_t       suppressed_count; // Repeated responses dropped since the last event for this name
 } CB_EVENT_DNS_RESPONSE;
 
 enum ProcessBlockType {
@@ -376,7 +378,8 @@ typedef enum CB_EVENT_API_VERSION {
   CB_EVENT_API_1_6       = 0x0106,
   CB_EVENT_API_1_7       = 0x0107,
   CB_EVENT_API_2_0       = 0x0200,
-  CB_EVENT_API_2_1       = 0x0201
+  CB_EVENT_API_2_1       = 0x0201,
+  CB_EVENT_API_2_2       = 0x0202  // Adds CB_EVENT_FILE_GENERIC.op_count and CB_EVENT_DNS_RESPONSE.suppressed_count
 } CB_EVENT_API_VERSION;
 
 typedef struct _CB_EVENT_GENERIC_DATA {
@@ -424,6 +427,15 @@ struct CB_EVENT_UM {
     struct CB_EVENT   event;
 };
 
+// When enabled with CB_DRIVER_REQUEST_SET_EVENT_TRAILER this follows the variable length
+//  data of each event and is included in CB_EVENT_UM::payload, so it always ends the event.
+#define CB_EVENT_TRAILER_MAGIC 0x43455451 // "QTEC"
+typedef struct CB_EVENT_TRAILER {
+    uint32_t          magic;
+    uint32_t          queue_priority; // 0 - 2
+    uint64_t          queue_ns;       // Time between being queued in the kernel and read
+} CB_EVENT_TRAILER;
+
 // This struct is meant for userspace until
 // multiple events are sent through a single read.
 struct CB_EVENT_UM_BLOB {
@@ -475,6 +487,19 @@ typedef struct {
   protectionData data[KERNMSG_MAX];
 } CB_PROTECTION_CONTROL, *PCB_PROTECTION_CONTROL;
 
+// Flags for CB_PROTECTION_LIST
+#define CB_PROTECTION_LIST_REPLACE  0x01 // Replace all current bans with this list
+#define CB_PROTECTION_LIST_KILL     0x02 // Also kill running processes of the listed inodes
+#define CB_PROTECTION_LIST_MAX      (128 * 1024)
+
+// Sent with CB_DRIVER_REQUEST_SET_BANNED_INODE_LIST through a CB_EVENT_DYNAMIC
+//  whose size covers the header and all count entries.
+typedef struct {
+  uint32_t flags;
+  uint32_t count; // 1 - CB_PROTECTION_LIST_MAX
+  protectionData data[0];
+} CB_PROTECTION_LIST, *PCB_PROTECTION_LIST;
+
 typedef struct CB_TRUSTED_PATH {
   char path[PATH_MAX + 1];
 } *PCB_TRUSTED_PATH;
@@ -501,6 +526,16 @@ typedef enum CB_DRIVER_REQUEST {
   CB_DRIVER_REQUEST_ACTION = 14,             // two way
   CB_DRIVER_REQUEST_CONFIG = 15, // one way
   CB_DRIVER_REQUEST_SET_BANNED_INODE_WITHOUT_KILL = 16, // one way but called multiple times
+  // Both lists match by prefix only and are reset to the built-in defaults when the
+  //  module is re-enabled, so they must be sent again after every enable.
+  CB_DRIVER_REQUEST_SET_SPECIAL_FILES = 17,      // one way, CB_EVENT_DYNAMIC list of NUL terminated path prefixes
+  CB_DRIVER_REQUEST_SET_INTERPRETER_NAMES = 18,  // one way, CB_EVENT_DYNAMIC list of NUL terminated name prefixes
+  CB_DRIVER_REQUEST_SET_BANNED_INODE_LIST = 19,  // one way, CB_EVENT_DYNAMIC holding a CB_PROTECTION_LIST
+  CB_DRIVER_REQUEST_CLR_IGNORED_PID = 20,        // one way
+  CB_DRIVER_REQUEST_CLR_IGNORED_UID = 21,        // one way
+  CB_DRIVER_REQUEST_SET_EVENT_TRAILER = 22,      // one way, non-zero value appends a CB_EVENT_TRAILER to each event
+  CB_DRIVER_REQUEST_PERM_RESPONSE_LIST = 23,     // one way, CB_EVENT_DYNAMIC holding an array of CB_PERM_RESPONSE
+  CB_DRIVER_REQUEST_PERM_ABORT_LIST = 24,        // one way, CB_EVENT_DYNAMIC holding an array of CB_PERM_RESPONSE, response is ignored
 
   CB_DRIVER_REQUEST_MAX
 
@@ -524,6 +559,10 @@ typedef struct CB_REQUEST_MESSAGE {
 #define CB_PERM_RESPONSE_TYPE_EACCES  0x02
 #define CB_PERM_RESPONSE_TYPE_ENOENT  0x04
 
+// CB_PERM_RESPONSE.cacheFlags, a non-zero TTL keeps the verdict for the stalled file
+#define CB_PERM_CACHE_TTL_MASK        0x0000FFFF // Seconds to keep the verdict
+#define CB_PERM_CACHE_MATCH_TIMES     0x00010000 // Only while the file mtime and ctime are unchanged
+
 
 struct CB_PERM_RESPONSE {
     uint64_t perm_id;
@@ -533,4 +572,7 @@ struct CB_PERM_RESPONSE {
     uint8_t response;
 };
 
+// Most responses accepted by one CB_DRIVER_REQUEST_PERM_RESPONSE_LIST or CB_DRIVER_REQUEST_PERM_ABORT_LIST
+#define CB_PERM_RESPONSE_LIST_MAX     4096
+
 #pragma pack(pop)
@@ -8,10 +8,15 @@
 #include <linux/cred.h>
 #endif
 #include <linux/signal.h>
+#include <linux/jhash.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
 
 #include "hash-table-generic.h"
 #include "process-tracking.h"
 #include "event-factory.h"
+#include "InodeState.h"
+#include "id-set.h"
 
 typedef struct bl_table_key {
     uint64_t    device;
@@ -26,66 +31,144 @@ typedef struct banning_entry_s {
     uint64_t    inode;
 } BanningEntry;
 
-#define CB_BANNING_CACHE_OBJ_SZ 64
-HashTbl * g_banning_table = NULL;
-int64_t  g_banned_process_by_inode_count;
+// The banned inodes live in a hash table with a bloom filter in front of it. Most execs
+//  are not banned, and the bloom filter answers that without taking a lock.
+//
+// The table and its filter are published together through RCU so that a whole ban list
+//  can be swapped in at once. Bits are never cleared for a single unban, which only
+//  costs a table lookup for that inode.
+//
+// The number of bans is the entry count of the set's own table, so a check never sees
+//  the count of one set with the entries of another.
+typedef struct banning_set {
+    HashTbl       *table;
+    unsigned long *bloom;
+    uint32_t       bloom_mask;
+    const char    *name;
+} BanningSet;
+
+#define CB_BANNING_CACHE_OBJ_SZ       64
+#define BANNING_BLOOM_HASHES          3
+#define BANNING_BLOOM_BITS_PER_ENTRY  16
+#define BANNING_BLOOM_MIN_BITS        (1 << 17)
+#define BANNING_BLOOM_MAX_BITS        (1 << 24)
+#define BANNING_TABLE_MIN_BUCKETS     8192
+#define BANNING_TABLE_MAX_BUCKETS     (1 << 20)
+
+// A replacement set is built while the current one is live, so alternate the cache names
+static const char *s_banning_cache_names[] = { "banning_cache", "banning_cache_b" };
+
+static BanningSet __rcu *s_banning_set;
+static DEFINE_MUTEX(s_banning_update_lock);
+static uint32_t    s_banning_bloom_seed;
+
+#define BANNING_SET_LOCKED() rcu_dereference_protected(s_banning_set, lockdep_is_held(&s_banning_update_lock))
+
+// These live for the life of the module, like the agent's own pids and uids they hold
+DEFINE_ID_SET(s_ignored_pids, CB_SENSOR_MAX_PIDS);
+DEFINE_ID_SET(s_ignored_uids, CB_SENSOR_MAX_UIDS);
 uint32_t g_protectionModeEnabled = PROTECTION_ENABLED; // Default to enabled
 
 void ec_banning_KillRunningBannedProcessByInode(ProcessContext *context, uint64_t device, uint64_t ino);
 
-bool ec_banning_initialize(ProcessContext *context)
+static void __ec_banning_set_free(BanningSet *set, ProcessContext *context)
 {
-    g_protectionModeEnabled = PROTECTION_ENABLED;
-    g_banned_process_by_inode_count = 0;
-    g_banning_table = ec_hashtbl_init_generic(context,
-                                           8192,
-                                           sizeof(BanningEntry),
-                                           CB_BANNING_CACHE_OBJ_SZ,
-                                           "banning_cache",
-                                           sizeof(BL_TBL_KEY),
-                                           offsetof(BanningEntry, key),
-                                           offsetof(BanningEntry, link),
-                                           HASHTBL_DISABLE_REF_COUNT,
-                                           NULL,
-                                           NULL);
-
-    if (!g_banning_table)
+    if (set)
     {
-        return false;
+        ec_hashtbl_shutdown_generic(set->table, context);
+        ec_mem_cache_free_generic(set->bloom);
+        ec_mem_cache_free_generic(set);
     }
-
-    return true;
 }
 
-void ec_banning_shutdown(ProcessContext *context)
+static BanningSet *__ec_banning_set_alloc(const char *name, uint64_t expected, ProcessContext *context)
 {
-    if (g_banning_table)
+    BanningSet *set  = NULL;
+    uint64_t    bits = BANNING_BLOOM_MIN_BITS;
+
+    if (expected * BANNING_BLOOM_BITS_PER_ENTRY > bits)
     {
-        ec_hashtbl_shutdown_generic(g_banning_table, context);
+        bits = min_t(uint64_t, roundup_pow_of_two(expected * BANNING_BLOOM_BITS_PER_ENTRY), BANNING_BLOOM_MAX_BITS);
     }
+
+    set = ec_mem_cache_alloc_generic(sizeof(BanningSet), context);
+    CANCEL(set, NULL);
+
+    set->name       = name;
+    set->bloom_mask = (uint32_t)(bits - 1);
+    set->bloom      = ec_mem_cache_valloc_generic(BITS_TO_LONGS(bits) * sizeof(unsigned long), context);
+    set->table      = ec_hashtbl_init_generic(context,
+                                              clamp_t(uint64_t, expected, BANNING_TABLE_MIN_BUCKETS, BANNING_TABLE_MAX_BUCKETS),
+                                              sizeof(BanningEntry),
+                                              CB_BANNING_CACHE_OBJ_SZ,
+                                              name,
+                                              sizeof(BL_TBL_KEY),
+                                              offsetof(BanningEntry, key),
+                                              offsetof(BanningEntry, link),
+                                              HASHTBL_DISABLE_REF_COUNT,
+                                              NULL,
+                                              NULL);
+    TRY(set->bloom && set->table);
+
+    bitmap_zero(set->bloom, bits);
+    return set;
+
+CATCH_DEFAULT:
+    if (set->table)
+    {
+        ec_hashtbl_shutdown_generic(set->table, context);
+    }
+    ec_mem_cache_free_generic(set->bloom);
+    ec_mem_cache_free_generic(set);
+    return NULL;
 }
 
-void ec_banning_SetProtectionState(ProcessContext *context, uint32_t new_state)
+static int64_t __ec_banning_set_count(BanningSet *set)
 {
-    uint32_t current_state = atomic_read((atomic_t *)&g_protectionModeEnabled);
+    return set ? atomic64_read(&set->table->tableInstance) : 0;
+}
 
-    if (current_state == new_state)
+// Double hashing gives the BANNING_BLOOM_HASHES bit positions from two hashes of the key
+static inline void __ec_banning_bloom_hash(BL_TBL_KEY *key, uint32_t *h1, uint32_t *h2)
+{
+    *h1 = jhash(key, sizeof(*key), s_banning_bloom_seed);
+    *h2 = jhash(key, sizeof(*key), ~s_banning_bloom_seed) | 1;
+}
+
+static void __ec_banning_bloom_add(BanningSet *set, BL_TBL_KEY *key)
+{
+    uint32_t h1, h2;
+    int      i;
+
+    __ec_banning_bloom_hash(key, &h1, &h2);
+    for (i = 0; i < BANNING_BLOOM_HASHES; ++i)
     {
-        return;
+        set_bit((h1 + i * h2) & set->bloom_mask, set->bloom);
     }
+}
 
-    TRACE(DL_INFO, "Setting protection state to %u", new_state);
-    atomic_set((atomic_t *)&g_protectionModeEnabled, new_state);
+static bool __ec_banning_bloom_may_contain(BanningSet *set, BL_TBL_KEY *key)
+{
+    uint32_t h1, h2;
+    int      i;
+
+    __ec_banning_bloom_hash(key, &h1, &h2);
+    for (i = 0; i < BANNING_BLOOM_HASHES; ++i)
+    {
+        if (!test_bit((h1 + i * h2) & set->bloom_mask, set->bloom))
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-bool ec_banning_SetBannedProcessInodeWithoutKillingProcs(ProcessContext *context, uint64_t device, uint64_t ino)
+// Caller must hold s_banning_update_lock or own a set that is not published yet
+static bool __ec_banning_set_insert(BanningSet *set, uint64_t device, uint64_t ino, ProcessContext *context)
 {
     BanningEntry *bep;
-    int64_t i = atomic64_read((atomic64_t *)&g_banned_process_by_inode_count);
 
-    TRACE(DL_INFO, "Recevied [%llu:%llu] inode count=%lld", device, ino, i);
-
-    bep = (BanningEntry *)ec_hashtbl_alloc_generic(g_banning_table, context);
+    bep = (BanningEntry *)ec_hashtbl_alloc_generic(set->table, context);
     if (bep == NULL)
     {
         return false;
@@ -97,16 +180,80 @@ bool ec_banning_SetBannedProcessInodeWithoutKillingProcs(ProcessContext *context
     bep->device = device;
     bep->inode = ino;
 
-    if (ec_hashtbl_add_generic_safe(g_banning_table, bep, context) < 0)
+    // Set the filter bits first so a reader that finds the entry always gets past the filter
+    __ec_banning_bloom_add(set, &bep->key);
+
+    if (ec_hashtbl_add_generic_safe(set->table, bep, context) < 0)
     {
-        ec_hashtbl_free_generic(g_banning_table, bep, context);
+        ec_hashtbl_free_generic(set->table, bep, context);
         return false;
     }
+    return true;
+}
+
+bool ec_banning_initialize(ProcessContext *context)
+{
+    BanningSet *set;
+
+    g_protectionModeEnabled = PROTECTION_ENABLED;
+    get_random_bytes(&s_banning_bloom_seed, sizeof(s_banning_bloom_seed));
+
+    set = __ec_banning_set_alloc(s_banning_cache_names[0], 0, context);
+    if (!set)
+    {
+        return false;
+    }
+    RCU_INIT_POINTER(s_banning_set, set);
 
-    atomic64_inc((atomic64_t *)&g_banned_process_by_inode_count);
     return true;
 }
 
+void ec_banning_shutdown(ProcessContext *context)
+{
+    BanningSet *set;
+
+    mutex_lock(&s_banning_update_lock);
+    set = BANNING_SET_LOCKED();
+    RCU_INIT_POINTER(s_banning_set, NULL);
+    mutex_unlock(&s_banning_update_lock);
+
+    if (set)
+    {
+        synchronize_rcu();
+        __ec_banning_set_free(set, context);
+    }
+}
+
+void ec_banning_SetProtectionState(ProcessContext *context, uint32_t new_state)
+{
+    uint32_t current_state = atomic_read((atomic_t *)&g_protectionModeEnabled);
+
+    if (current_state == new_state)
+    {
+        return;
+    }
+
+    TRACE(DL_INFO, "Setting protection state to %u", new_state);
+    atomic_set((atomic_t *)&g_protectionModeEnabled, new_state);
+}
+
+bool ec_banning_SetBannedProcessInodeWithoutKillingProcs(ProcessContext *context, uint64_t device, uint64_t ino)
+{
+    bool retval = false;
+    BanningSet *set;
+
+    mutex_lock(&s_banning_update_lock);
+    set = BANNING_SET_LOCKED();
+    TRACE(DL_INFO, "Recevied [%llu:%llu] inode count=%lld", device, ino, __ec_banning_set_count(set));
+    if (set && __ec_banning_set_insert(set, device, ino, context))
+    {
+        retval = true;
+    }
+    mutex_unlock(&s_banning_update_lock);
+
+    return retval;
+}
+
 bool ec_banning_SetBannedProcessInode(ProcessContext *context, uint64_t device, uint64_t ino)
 {
     bool retval;
@@ -117,48 +264,133 @@ bool ec_banning_SetBannedProcessInode(ProcessContext *context, uint64_t device,
     return retval;
 }
 
+// Load a whole ban list in one call. With CB_PROTECTION_LIST_REPLACE a new set is built
+//  off to the side and swapped in, so an exec never sees a partially loaded list.
+int64_t ec_banning_SetBannedProcessInodeList(ProcessContext *context, PCB_PROTECTION_LIST list)
+{
+    BanningSet *old   = NULL;
+    BanningSet *set   = NULL;
+    int64_t     added = 0;
+    uint32_t    i;
+
+    CANCEL(list, -EINVAL);
+
+    mutex_lock(&s_banning_update_lock);
+    old = BANNING_SET_LOCKED();
+
+    if (list->flags & CB_PROTECTION_LIST_REPLACE)
+    {
+        const char *name = s_banning_cache_names[old && old->name == s_banning_cache_names[0]];
+
+        set = __ec_banning_set_alloc(name, list->count, context);
+        if (!set)
+        {
+            mutex_unlock(&s_banning_update_lock);
+            return -ENOMEM;
+        }
+    } else
+    {
+        set = old;
+        old = NULL;
+    }
+
+    for (i = 0; set && i < list->count; ++i)
+    {
+        if (list->data[i].action == InodeBanned &&
+            __ec_banning_set_insert(set, list->data[i].device, list->data[i].inode, context))
+        {
+            ++added;
+        }
+    }
+
+    if (list->flags & CB_PROTECTION_LIST_REPLACE)
+    {
+        rcu_assign_pointer(s_banning_set, set);
+    }
+
+    mutex_unlock(&s_banning_update_lock);
+
+    TRACE(DL_INFO, "%s: loaded %lld of %u banned inodes flags=%x", __func__, added, list->count, list->flags);
+
+    if (old)
+    {
+        // Wait for any exec still checking against the old set
+        synchronize_rcu();
+        __ec_banning_set_free(old, context);
+    }
+
+    if (list->flags & CB_PROTECTION_LIST_KILL)
+    {
+        for (i = 0; i < list->count; ++i)
+        {
+            if (list->data[i].action == InodeBanned)
+            {
+                ec_banning_KillRunningBannedProcessByInode(context, list->data[i].device, list->data[i].inode);
+            }
+        }
+    }
+
+    return added;
+}
+
 inline bool ec_banning_ClearBannedProcessInode(ProcessContext *context, uint64_t device, uint64_t ino)
 {
-    int64_t count = atomic64_read((atomic64_t *)&g_banned_process_by_inode_count);
-    BanningEntry *bep;
+    int64_t count = 0;
+    BanningSet *set;
+    BanningEntry *bep = NULL;
     BL_TBL_KEY key = { device, ino };
 
-    if (count == 0 || ino == 0)
+    if (ino == 0)
     {
         return false;
     }
 
-    bep = (BanningEntry *) ec_hashtbl_del_by_key_generic(g_banning_table, &key, context);
+    // This runs from the file write hook, so it only takes the bucket lock of the current
+    //  set.  A set being replaced stays valid until the read section ends.
+    rcu_read_lock();
+    set = rcu_dereference(s_banning_set);
+    count = __ec_banning_set_count(set);
+    if (count && __ec_banning_bloom_may_contain(set, &key))
+    {
+        bep = (BanningEntry *) ec_hashtbl_del_by_key_generic(set->table, &key, context);
+        if (bep)
+        {
+            ec_hashtbl_free_generic(set->table, bep, context);
+        }
+    }
+    rcu_read_unlock();
+
     if (!bep)
     {
         return false;
     }
     TRACE(DL_INFO, "Clearing banned file [%llu:%llu] count=%lld", device, ino, count);
 
-    ec_hashtbl_free_generic(g_banning_table, bep, context);
-    atomic64_dec((atomic64_t *)&g_banned_process_by_inode_count);
     return true;
 }
 
 void ec_banning_ClearAllBans(ProcessContext *context)
 {
-    int64_t count = atomic64_read((atomic64_t *)&g_banned_process_by_inode_count);
+    BanningSet *set;
 
-    if (count == 0)
+    mutex_lock(&s_banning_update_lock);
+    set = BANNING_SET_LOCKED();
+    if (__ec_banning_set_count(set))
     {
-        return;
+        TRACE(DL_INFO, "Clearing all bans");
+        ec_hashtbl_clear_generic(set->table, context);
+        bitmap_zero(set->bloom, set->bloom_mask + 1);
     }
-
-    TRACE(DL_INFO, "Clearing all bans");
-    atomic64_set((atomic64_t *)&g_banned_process_by_inode_count, 0);
-    ec_hashtbl_clear_generic(g_banning_table, context);
+    mutex_unlock(&s_banning_update_lock);
 }
 
 bool ec_banning_KillBannedProcessByInode(ProcessContext *context, uint64_t device, uint64_t ino)
 {
     int64_t count;
+    BanningSet *set;
     BanningEntry *bep;
     BL_TBL_KEY key = { device, ino };
+    bool banned = false;
 
     if (atomic_read((atomic_t *)&g_protectionModeEnabled) == PROTECTION_DISABLED)
     {
@@ -166,28 +398,31 @@ bool ec_banning_KillBannedProcessByInode(ProcessContext *context, uint64_t devic
         goto kbpbi_exit;
     }
 
-    count = atomic64_read((atomic64_t *)&g_banned_process_by_inode_count);
-    TRACE(DL_VERBOSE, "Check for banned file [%llu:%llu] count=%lld", device, ino, count);
-    if (count == 0 || ino == 0)
-    {
-        goto kbpbi_exit;
-    }
-
-    bep = (BanningEntry *) ec_hashtbl_get_generic(g_banning_table, &key, context);
-    if (!bep)
+    if (ino == 0)
     {
-        TRACE(DL_INFO, "kill banned process failed to find [%llu:%llu]", device, ino);
         goto kbpbi_exit;
     }
 
-    if (device == bep->device && ino == bep->inode)
+    rcu_read_lock();
+    set = rcu_dereference(s_banning_set);
+    count = __ec_banning_set_count(set);
+    TRACE(DL_VERBOSE, "Check for banned file [%llu:%llu] count=%lld", device, ino, count);
+    if (count && __ec_banning_bloom_may_contain(set, &key))
     {
-        TRACE(DL_INFO, "Banned [%llu:%llu]", device, ino);
-        return true;
+        bep = (BanningEntry *) ec_hashtbl_get_generic(set->table, &key, context);
+        if (!bep)
+        {
+            TRACE(DL_INFO, "kill banned process failed to find [%llu:%llu]", device, ino);
+        } else if (device == bep->device && ino == bep->inode)
+        {
+            TRACE(DL_INFO, "Banned [%llu:%llu]", device, ino);
+            banned = true;
+        }
     }
+    rcu_read_unlock();
 
 kbpbi_exit:
-    return false;
+    return banned;
 }
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0) && RHEL_MINOR >= 1  //{
@@ -279,98 +514,63 @@ void ec_banning_KillRunningBannedProcessByInode(ProcessContext *context, uint64_
 
 bool ec_banning_IgnoreProcess(ProcessContext *context, pid_t pid)
 {
-    int64_t i;
-    int64_t max = atomic64_read((atomic64_t *)&g_cb_ignored_pid_count);
-
-    TRACE(DL_TRACE, "Test if pid=%u should be ignored count=%lld", pid, max);
-
-    if (max == 0)
-    {
-        goto ignore_process_exit;
-    }
-
-    for (i = 0; i < max; ++i)
+    if (ec_id_set_contains(&s_ignored_pids, pid))
     {
-        if (g_cb_ignored_pids[i] == pid)
-        {
-            TRACE(DL_TRACE, "Ignore pid=%u", pid);
-            return true;
-        }
+        TRACE(DL_TRACE, "Ignore pid=%u", pid);
+        return true;
     }
-
-ignore_process_exit:
     return false;
 }
 
 void ec_banning_SetIgnoredProcess(ProcessContext *context, pid_t pid)
 {
-    int64_t i;
-    int64_t max = atomic64_read((atomic64_t *)&g_cb_ignored_pid_count);
-
-    // Search for pid
-    for (i = 0; i < max; ++i)
+    if (ec_id_set_add(&s_ignored_pids, pid))
     {
-        if (g_cb_ignored_pids[i] == pid)
-        {
-            TRACE(DL_VERBOSE, "already ignoring pid=%u", pid);
-            return;
-        }
-    }
-
-    if (max < CB_SENSOR_MAX_PIDS)
+        TRACE(DL_INFO, "Ignoring pid=%u count=%u", pid, ec_id_set_count(&s_ignored_pids));
+    } else
     {
-        g_cb_ignored_pids[max] = pid;
-        max += 1;
-        atomic64_set((atomic64_t *)&g_cb_ignored_pid_count, max);
-        TRACE(DL_INFO, "Adding pid=%u at %lld", pid, max);
+        TRACE(DL_WARNING, "Failed to ignore pid=%u, %u pids already ignored", pid, ec_id_set_count(&s_ignored_pids));
     }
 }
 
-bool ec_banning_IgnoreUid(ProcessContext *context, pid_t uid)
+// Safe from any context, the exit hook uses this so that a reused pid is not ignored
+bool ec_banning_ClearIgnoredProcess(ProcessContext *context, pid_t pid)
 {
-    int64_t i;
-    int64_t max = atomic64_read((atomic64_t *)&g_cb_ignored_uid_count);
-
-    TRACE(DL_TRACE, "Test if uid=%u should be ignored", uid);
-
-    if (max == 0)
+    if (ec_id_set_remove(&s_ignored_pids, pid))
     {
-        goto ignore_uid_exit;
+        TRACE(DL_INFO, "No longer ignoring pid=%u", pid);
+        return true;
     }
+    return false;
+}
 
-    for (i = 0; i < max; ++i)
+bool ec_banning_IgnoreUid(ProcessContext *context, pid_t uid)
+{
+    if (ec_id_set_contains(&s_ignored_uids, uid))
     {
-        if (g_cb_ignored_uids[i] == uid)
-        {
-            TRACE(DL_TRACE, "Ignore uid=%u", uid);
-            return true;
-        }
+        TRACE(DL_TRACE, "Ignore uid=%u", uid);
+        return true;
     }
-
-ignore_uid_exit:
     return false;
 }
 
 void ec_banning_SetIgnoredUid(ProcessContext *context, uid_t uid)
 {
-    int64_t i;
-    int64_t max = atomic64_read((atomic64_t *)&g_cb_ignored_uid_count);
-
-    // Search for uid
-    for (i = 0; i < max; ++i)
+    if (ec_id_set_add(&s_ignored_uids, uid))
     {
-        if (g_cb_ignored_uids[i] == uid)
-        {
-            TRACE(DL_VERBOSE, "already ignoring uid=%u", uid);
-            return;
-        }
+        TRACE(DL_WARNING, "Ignoring uid=%u count=%u", uid, ec_id_set_count(&s_ignored_uids));
+    } else
+    {
+        TRACE(DL_WARNING, "Failed to ignore uid=%u, %u uids already ignored", uid, ec_id_set_count(&s_ignored_uids));
     }
+}
 
-    if (max < CB_SENSOR_MAX_UIDS)
+bool ec_banning_ClearIgnoredUid(ProcessContext *context, uid_t uid)
+{
+    if (ec_id_set_remove(&s_ignored_uids, uid))
     {
-        g_cb_ignored_uids[max] = uid;
-        max += 1;
-        atomic64_set((atomic64_t *)&g_cb_ignored_uid_count, max);
-        TRACE(DL_WARNING, "Adding uid=%u at %lld", uid, max);
+        TRACE(DL_INFO, "No longer ignoring uid=%u", uid);
+        return true;
     }
+    return false;
 }
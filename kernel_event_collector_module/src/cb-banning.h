@@ -9,11 +9,14 @@ extern void ec_banning_shutdown(ProcessContext *context);
 extern void ec_banning_SetProtectionState(ProcessContext *context, uint32_t new_mode);
 extern bool ec_banning_SetBannedProcessInode(ProcessContext *context, uint64_t device, uint64_t ino);
 extern bool ec_banning_SetBannedProcessInodeWithoutKillingProcs(ProcessContext *context, uint64_t device, uint64_t ino);
+extern int64_t ec_banning_SetBannedProcessInodeList(ProcessContext *context, PCB_PROTECTION_LIST list);
 extern inline bool ec_banning_ClearBannedProcessInode(ProcessContext *context, uint64_t device, uint64_t ino);
 extern bool ec_banning_KillBannedProcessByInode(ProcessContext *context, uint64_t device, uint64_t ino);
 extern bool ec_banning_IgnoreProcess(ProcessContext *context, pid_t pid);
 extern void ec_banning_SetIgnoredProcess(ProcessContext *context, pid_t pid);
+extern bool ec_banning_ClearIgnoredProcess(ProcessContext *context, pid_t pid);
 extern bool ec_banning_IgnoreUid(ProcessContext *context, pid_t uid);
 extern void ec_banning_SetIgnoredUid(ProcessContext *context, uid_t uid);
+extern bool ec_banning_ClearIgnoredUid(ProcessContext *context, uid_t uid);
 extern void ec_banning_ClearAllBans(ProcessContext *context);
 extern bool ec_banning_KillBannedProcessByPid(ProcessContext *context, pid_t pid);
@@ -10,6 +10,8 @@
 
 #include "priv.h"
 #include "mem-cache.h"
+#include "trusted-path.h"
+#include "dns-dedup.h"
 
 typedef int     (*fp_readCallback)  (struct seq_file *m, void *v);
 typedef ssize_t (*fp_writeCallback) (struct file *, const char __user *, size_t, loff_t *);
@@ -26,16 +28,27 @@ static const struct _ec_procs proc_callbacks[] = {
     { "events-avg",               ec_proc_show_events_avg,          NULL                            },
     { "events-detail",            ec_proc_show_events_det,          NULL                            },
     { "events-reset",             NULL,                             ec_proc_show_events_rst         },
+    { "queue-latency",            ec_proc_show_queue_latency,       NULL                            },
     { "net-track-old",            ec_net_track_show_old,            NULL                            },
     { "net-track-new",            ec_net_track_show_new,            NULL                            },
     { "net-track-purge-age",      NULL,                             ec_net_track_purge_age          },
     { "net-track-purge-all",      NULL,                             ec_net_track_purge_all          },
+    { "net-track-peer-cache",     ec_net_track_show_peer_cache,     NULL                            },
+    { "net-proxy-check",          ec_net_proxy_show,                NULL                            },
+    { "net-recvmmsg-check",       ec_net_recvmmsg_check_show,       ec_net_recvmmsg_check_run       },
+    { "dns-dedup",                ec_dns_dedup_show,                NULL                            },
+    { "stall-verdict-cache",      ec_stall_verdict_show,            ec_stall_verdict_clear          },
+    { "stall-latency",            ec_stall_latency_show,            ec_stall_latency_reset          },
     { "proc-track-table",         ec_proc_track_show_table,         NULL                            },
-    { "proc-track-stats",         ec_proc_track_show_stats,         NULL                            },
+    { "proc-track-stats",         ec_proc_track_show_stats,         ec_proc_track_set_stats         },
+    { "proc-track-discovery",     ec_proc_track_show_discovery,     NULL                            },
+    { "task-enumeration",         ec_show_task_enumeration,         NULL                            },
     { "file-track-table",         ec_file_track_show_table,         NULL                            },
     { "mem",                      ec_proc_current_memory_avg,       NULL                            },
     { "mem-detail",               ec_proc_current_memory_det,       NULL                            },
     { "active-hooks",             ec_show_active_hooks,             NULL                            },
+    { "hook-latency",             ec_show_hook_latency,             ec_reset_hook_latency           },
+    { "trusted-paths",            ec_trusted_path_show,             NULL                            },
 
 #ifdef HOOK_SELECTOR
     { "syscall-clone",            ec_get_syscall_clone,             ec_set_syscall_clone            },
@@ -60,6 +73,7 @@ static const struct _ec_procs proc_callbacks[] = {
     { "lsm-socket_post_create",   ec_get_lsm_socket_post_create,    ec_set_lsm_socket_post_create   },
     { "lsm-socket_sendmsg",       ec_get_lsm_socket_sendmsg,        ec_set_lsm_socket_sendmsg       },
     { "lsm-socket_recvmsg",       ec_get_lsm_socket_recvmsg,        ec_set_lsm_socket_recvmsg       },
+    { "lsm-sk_free_security",     ec_get_lsm_sk_free_security,      ec_set_lsm_sk_free_security     },
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 10, 0)
     { "lsm-mmap_file",            ec_get_lsm_mmap_file,             ec_set_lsm_mmap_file            },
@@ -1,5 +1,5 @@
 
-SET(API_VERSION CB_EVENT_API_2_1)
+SET(API_VERSION CB_EVENT_API_2_2)
 SET(EVENT_COLLECTOR_PROC_DIR event_collector)
 SET(EVENT_COLLECTOR_DEBUG_PREFIX EventCollector)
 SET(EVENT_COLLECTOR_MEM_CACHE_PREFIX ec_)
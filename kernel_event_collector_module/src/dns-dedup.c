@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "dns-dedup.h"
+#include "priv.h"
+
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/spinlock.h>
+
+// Direct mapped, a new name simply takes over the slot of whatever was there
+#define DNS_DEDUP_BITS  10
+
+typedef struct dns_dedup_entry {
+    uint32_t  qname_hash;
+    uint32_t  answer_hash;
+    uint64_t  expires;
+    uint32_t  suppressed;
+} DNS_DEDUP_ENTRY;
+
+static DNS_DEDUP_ENTRY s_dns_dedup[1 << DNS_DEDUP_BITS];
+static DEFINE_SPINLOCK(s_dns_dedup_lock);
+
+static atomic64_t s_dns_dedup_hits    = ATOMIC64_INIT(0);
+static atomic64_t s_dns_dedup_misses  = ATOMIC64_INIT(0);
+static atomic64_t s_dns_dedup_evicted = ATOMIC64_INIT(0);
+
+// The answers are hashed in any order, a resolver is free to rotate them
+static uint32_t __ec_dns_dedup_answer_hash(CB_EVENT_DNS_RESPONSE *response, uint32_t *min_ttl)
+{
+    uint32_t hash = response->qtype;
+    int      i;
+
+    *min_ttl = UINT_MAX;
+    for (i = 0; i < response->record_count; ++i)
+    {
+        CB_DNS_RECORD *record = &response->records[i];
+        uint32_t       record_hash;
+
+        // Records the parser skipped have no name
+        if (!record->name[0])
+        {
+            continue;
+        }
+
+        record_hash = jhash(record->name, strnlen(record->name, DNS_MAX_NAME), record->dnstype);
+        if (record->dnstype == QT_A)
+        {
+            record_hash = jhash(&record->A.as_in4.sin_addr, sizeof(struct in_addr), record_hash);
+        } else if (record->dnstype == QT_AAAA)
+        {
+            record_hash = jhash(&record->AAAA.as_in6.sin6_addr, sizeof(struct in6_addr), record_hash);
+        } else if (record->dnstype == QT_CNAME)
+        {
+            record_hash = jhash(record->CNAME, strnlen(record->CNAME, DNS_MAX_NAME), record_hash);
+        }
+
+        hash     += record_hash;
+        *min_ttl  = min(*min_ttl, record->ttl);
+    }
+
+    return hash;
+}
+
+bool ec_dns_dedup_check(CB_EVENT_DNS_RESPONSE *response)
+{
+    DNS_DEDUP_ENTRY *entry;
+    uint32_t         window_ms = READ_ONCE(g_dns_dedup_ms);
+    uint32_t         qname_hash;
+    uint32_t         answer_hash;
+    uint32_t         min_ttl;
+    uint64_t         now = get_jiffies_64();
+    uint32_t         evicted = 0;
+    unsigned long    flags;
+    bool             send = true;
+
+    CANCEL(response, true);
+    response->suppressed_count = 0;
+    CANCEL(window_ms, true);
+
+    qname_hash  = jhash(response->qname, strnlen(response->qname, DNS_MAX_NAME), 0);
+    answer_hash = __ec_dns_dedup_answer_hash(response, &min_ttl);
+
+    // Never hold on to an answer longer than the resolver would
+    if (min_ttl != UINT_MAX)
+    {
+        window_ms = min_t(uint64_t, window_ms, (uint64_t)min_ttl * MSEC_PER_SEC);
+    }
+
+    entry = &s_dns_dedup[hash_32(qname_hash, DNS_DEDUP_BITS)];
+
+    spin_lock_irqsave(&s_dns_dedup_lock, flags);
+    if (entry->qname_hash == qname_hash &&
+        entry->answer_hash == answer_hash &&
+        time_before64(now, entry->expires))
+    {
+        entry->suppressed += 1;
+        send = false;
+    } else
+    {
+        // Repeats of this name leave with the next event for it, even when the answer
+        //  changed.  Repeats of another name that held the slot only go to the Evicted
+        //  stat, they must not be reported against a name they never belonged to.
+        if (entry->qname_hash == qname_hash)
+        {
+            response->suppressed_count = entry->suppressed;
+        } else
+        {
+            evicted = entry->suppressed;
+        }
+        entry->qname_hash  = qname_hash;
+        entry->answer_hash = answer_hash;
+        entry->expires     = now + msecs_to_jiffies(window_ms);
+        entry->suppressed  = 0;
+    }
+    spin_unlock_irqrestore(&s_dns_dedup_lock, flags);
+
+    atomic64_inc(send ? &s_dns_dedup_misses : &s_dns_dedup_hits);
+    if (evicted)
+    {
+        atomic64_add(evicted, &s_dns_dedup_evicted);
+    }
+
+    return send;
+}
+
+void ec_dns_dedup_clear(void)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&s_dns_dedup_lock, flags);
+    memset(s_dns_dedup, 0, sizeof(s_dns_dedup));
+    spin_unlock_irqrestore(&s_dns_dedup_lock, flags);
+
+    atomic64_set(&s_dns_dedup_hits, 0);
+    atomic64_set(&s_dns_dedup_misses, 0);
+    atomic64_set(&s_dns_dedup_evicted, 0);
+}
+
+int ec_dns_dedup_show(struct seq_file *m, void *v)
+{
+    uint64_t hits    = atomic64_read(&s_dns_dedup_hits);
+    uint64_t misses  = atomic64_read(&s_dns_dedup_misses);
+    uint64_t evicted = atomic64_read(&s_dns_dedup_evicted);
+    uint64_t now     = get_jiffies_64();
+    int      active  = 0;
+    int      i;
+
+    for (i = 0; i < ARRAY_SIZE(s_dns_dedup); ++i)
+    {
+        if (time_before64(now, READ_ONCE(s_dns_dedup[i].expires)))
+        {
+            active += 1;
+        }
+    }
+
+    seq_printf(m, "%12s | %10u |\n",   "Window ms", READ_ONCE(g_dns_dedup_ms));
+    seq_printf(m, "%12s | %10llu |\n", "Hits", hits);
+    seq_printf(m, "%12s | %10llu |\n", "Misses", misses);
+    seq_printf(m, "%12s | %10llu |\n", "Hit %", (hits + misses) ? (hits * 100) / (hits + misses) : 0);
+    seq_printf(m, "%12s | %10llu |\n", "Evicted", evicted);
+    seq_printf(m, "%12s | %10d |\n",   "Active", active);
+    seq_printf(m, "%12s | %10lu |\n",  "Slots", ARRAY_SIZE(s_dns_dedup));
+    seq_printf(m, "%12s | %10lu |\n",  "Bytes", sizeof(s_dns_dedup));
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#pragma once
+
+#include "process-context.h"
+#include "raw_event.h"
+
+#include <linux/seq_file.h>
+
+// Identical DNS responses (same name and the same set of answers) are only reported once
+//  per g_dns_dedup_ms, or until the shortest TTL in the answer expires if that comes
+//  first.  The next event sent for the name carries the number of responses dropped.
+//  Names share a slot, and the drops of a name that loses its slot are only counted in
+//  the Evicted stat.
+
+// Returns false if the response should be dropped, otherwise sets
+//  response->suppressed_count and returns true.
+bool ec_dns_dedup_check(CB_EVENT_DNS_RESPONSE *response);
+void ec_dns_dedup_clear(void);
+
+int ec_dns_dedup_show(struct seq_file *m, void *v);
@@ -10,6 +10,7 @@
 #include "mem-cache.h"
 
 #include <linux/inet.h>
+#include <linux/skbuff.h>
 
 //My defines
 #define MAX_UDP_DATA_SIZE 65539 //max ushort + 4 bytes from the UDP header
@@ -57,7 +58,7 @@ int ec_dns_parse_data(char                *dns_data,
     int             i;
 
     TRY(dns_data);
-    TRY(dns_data_len >= 12 && dns_data_len <= 512);
+    TRY(dns_data_len >= 12 && dns_data_len <= DNS_MAX_MESSAGE);
     TRY(response);
     TRY(context);
 
@@ -65,7 +66,7 @@ int ec_dns_parse_data(char                *dns_data,
     TRY_SET(!__ec_dns_check_overrun(dns_data, dataPos, dns_data_len), E_NOT_SUFFICIENT_BUFFER);
 
     response->xid          = ntohs(header->xid);
-    response->record_count = ntohs(header->ancount);
+    response->record_count = min_t(uint16_t, ntohs(header->ancount), DNS_MAX_RECORDS);
     response->nscount      = ntohs(header->nscount);
     response->arcount      = ntohs(header->arcount);
 
@@ -117,6 +118,37 @@ CATCH_DEFAULT:
     return xcode;
 }
 
+int ec_dns_parse_skb(
+    struct sk_buff        *skb,
+    int                    offset,
+    int                    dns_data_len,
+    CB_EVENT_DNS_RESPONSE *response,
+    ProcessContext        *context)
+{
+    int   xcode = E_UNEXPECTED;
+    char *copy  = NULL;
+    char *dns_data;
+
+    TRY(skb);
+    TRY(offset >= 0 && dns_data_len > 0);
+
+    // skb_header_pointer hands back the linear data without touching the buffer
+    if (offset + dns_data_len > skb_headlen(skb))
+    {
+        copy = ec_mem_cache_alloc_generic(dns_data_len, context);
+        TRY_SET(copy, E_OUTOFMEMORY);
+    }
+
+    dns_data = skb_header_pointer(skb, offset, dns_data_len, copy);
+    TRY_SET(dns_data, E_NOT_SUFFICIENT_BUFFER);
+
+    xcode = ec_dns_parse_data(dns_data, dns_data_len, response, context);
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(copy);
+    return xcode;
+}
+
 int __ec_dns_parse_name(char     *to,
                     uint8_t  *from,
                     uint8_t  *dns_data,
@@ -7,8 +7,26 @@
 #include "process-context.h"
 #include "raw_event.h"
 
+// EDNS0 lets a UDP response grow past 512 bytes and TCP allows up to 64k
+#define DNS_MAX_MESSAGE  65535
+
+// Answers kept from one response.  The event and its records are handed to the reader
+//  with a 16 bit payload size, further answers are dropped.
+#define DNS_MAX_RECORDS  ((U16_MAX - sizeof(struct CB_EVENT_UM) - sizeof(CB_EVENT_TRAILER)) / sizeof(CB_DNS_RECORD))
+
+struct sk_buff;
+
 int ec_dns_parse_data(
     char                  *dns_data,
     int                    dns_data_len,
     CB_EVENT_DNS_RESPONSE *response,
     ProcessContext        *context);
+
+// Parses a DNS message in place in the skb, the payload is only copied when some of it
+//  is in paged data
+int ec_dns_parse_skb(
+    struct sk_buff        *skb,
+    int                    offset,
+    int                    dns_data_len,
+    CB_EVENT_DNS_RESPONSE *response,
+    ProcessContext        *context);
@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "dns-stream.h"
+#include "priv.h"
+#include "mem-cache.h"
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+
+// Smallest valid message is a bare header
+#define DNS_HEADER_SIZE          12
+
+// A flow that has not seen a segment in this long is abandoned
+#define DNS_TCP_FLOW_TTL         (10 * HZ)
+
+// Messages completed by a single segment, anything past this is dropped
+#define DNS_TCP_MAX_PER_SEGMENT  8
+
+typedef struct dns_flow {
+    struct list_head  lru;
+    DNS_FLOW_KEY      key;
+    uint32_t          next_seq;
+    unsigned long     last_seen;
+
+    // The length prefix can itself be split across segments
+    uint8_t           prefix[2];
+    int               prefix_len;
+
+    char             *message;
+    int               message_len;
+    int               have;
+} DNS_FLOW;
+
+typedef struct dns_completed {
+    char  *data;
+    int    len;
+    bool   owned;
+} DNS_COMPLETED;
+
+// Most recently used first
+static LIST_HEAD(s_dns_flows);
+static int s_dns_flow_count;
+static DEFINE_SPINLOCK(s_dns_flow_lock);
+
+static void __ec_dns_flow_free(DNS_FLOW *flow)
+{
+    list_del(&flow->lru);
+    s_dns_flow_count -= 1;
+    ec_mem_cache_free_generic(flow->message);
+    ec_mem_cache_free_generic(flow);
+}
+
+static void __ec_dns_flow_reset(DNS_FLOW *flow)
+{
+    flow->prefix_len  = 0;
+    flow->message     = NULL;
+    flow->message_len = 0;
+    flow->have        = 0;
+}
+
+static DNS_FLOW *__ec_dns_flow_find(DNS_FLOW_KEY *key)
+{
+    DNS_FLOW *flow;
+    DNS_FLOW *tmp;
+
+    list_for_each_entry_safe(flow, tmp, &s_dns_flows, lru)
+    {
+        if (!memcmp(&flow->key, key, sizeof(*key)))
+        {
+            return flow;
+        }
+        if (time_after(jiffies, flow->last_seen + DNS_TCP_FLOW_TTL))
+        {
+            __ec_dns_flow_free(flow);
+        }
+    }
+    return NULL;
+}
+
+static DNS_FLOW *__ec_dns_flow_new(DNS_FLOW_KEY *key, ProcessContext *context)
+{
+    DNS_FLOW *flow;
+
+    if (s_dns_flow_count >= DNS_TCP_MAX_FLOWS)
+    {
+        __ec_dns_flow_free(list_entry(s_dns_flows.prev, DNS_FLOW, lru));
+    }
+
+    flow = ec_mem_cache_alloc_generic(sizeof(*flow), context);
+    if (flow)
+    {
+        memset(flow, 0, sizeof(*flow));
+        flow->key = *key;
+        list_add(&flow->lru, &s_dns_flows);
+        s_dns_flow_count += 1;
+    }
+    return flow;
+}
+
+static bool __ec_dns_valid_length(int message_len)
+{
+    return message_len >= DNS_HEADER_SIZE && message_len <= DNS_TCP_MAX_MESSAGE;
+}
+
+// Appends bytes to the partial message in flow.  Returns the number of bytes used, or
+//  -1 if the message can not be kept.
+static int __ec_dns_flow_append(DNS_FLOW *flow, char *data, int len, ProcessContext *context)
+{
+    int used = 0;
+    int copy;
+
+    while (flow->prefix_len < 2 && used < len)
+    {
+        flow->prefix[flow->prefix_len++] = data[used++];
+    }
+    if (flow->prefix_len < 2)
+    {
+        return used;
+    }
+
+    if (!flow->message)
+    {
+        flow->message_len = (flow->prefix[0] << 8) | flow->prefix[1];
+        if (!__ec_dns_valid_length(flow->message_len))
+        {
+            return -1;
+        }
+        flow->message = ec_mem_cache_alloc_generic(flow->message_len, context);
+        if (!flow->message)
+        {
+            return -1;
+        }
+    }
+
+    copy = min(flow->message_len - flow->have, len - used);
+    memcpy(flow->message + flow->have, data + used, copy);
+    flow->have += copy;
+
+    return used + copy;
+}
+
+void ec_dns_stream_input(
+    DNS_FLOW_KEY   *key,
+    uint32_t        seq,
+    bool            fin,
+    char           *data,
+    int             len,
+    dns_message_cb  cb,
+    void           *priv,
+    ProcessContext *context)
+{
+    DNS_COMPLETED  completed[DNS_TCP_MAX_PER_SEGMENT];
+    int            completed_count = 0;
+    DNS_FLOW      *flow;
+    unsigned long  flags;
+    int            pos = 0;
+    int            i;
+
+    CANCEL_VOID(key && (data || !len));
+
+    spin_lock_irqsave(&s_dns_flow_lock, flags);
+
+    flow = __ec_dns_flow_find(key);
+    if (flow)
+    {
+        int32_t delta = (int32_t)(seq - flow->next_seq);
+
+        if (delta > 0)
+        {
+            // We missed a segment, the message boundaries are lost
+            __ec_dns_flow_free(flow);
+            goto CATCH_DEFAULT;
+        }
+
+        // Skip whatever part of a retransmit we have already seen
+        pos = min(-delta, len);
+        if (pos < len)
+        {
+            flow->next_seq = seq + len;
+        }
+        flow->last_seen = jiffies;
+        list_move(&flow->lru, &s_dns_flows);
+    }
+
+    while (pos < len && completed_count < DNS_TCP_MAX_PER_SEGMENT)
+    {
+        int used;
+
+        // Whole messages inside this segment are passed on without copying
+        if ((!flow || !flow->prefix_len) && len - pos >= 2)
+        {
+            int message_len = ((uint8_t)data[pos] << 8) | (uint8_t)data[pos + 1];
+
+            if (!__ec_dns_valid_length(message_len))
+            {
+                break;
+            }
+            if (len - pos - 2 >= message_len)
+            {
+                completed[completed_count++] = (DNS_COMPLETED) { data + pos + 2, message_len, false };
+                pos += message_len + 2;
+                continue;
+            }
+        }
+
+        if (!flow)
+        {
+            flow = __ec_dns_flow_new(key, context);
+            if (!flow)
+            {
+                break;
+            }
+            flow->next_seq  = seq + len;
+            flow->last_seen = jiffies;
+        }
+
+        used = __ec_dns_flow_append(flow, data + pos, len - pos, context);
+        if (used < 0)
+        {
+            break;
+        }
+        pos += used;
+
+        if (flow->message && flow->have == flow->message_len)
+        {
+            completed[completed_count++] = (DNS_COMPLETED) { flow->message, flow->message_len, true };
+            __ec_dns_flow_reset(flow);
+        }
+    }
+
+    // Whatever is left over can not be placed in a message any more
+    if (flow && (fin || pos < len))
+    {
+        __ec_dns_flow_free(flow);
+    }
+
+CATCH_DEFAULT:
+    spin_unlock_irqrestore(&s_dns_flow_lock, flags);
+
+    for (i = 0; i < completed_count; ++i)
+    {
+        if (cb)
+        {
+            cb(completed[i].data, completed[i].len, priv, context);
+        }
+        if (completed[i].owned)
+        {
+            ec_mem_cache_free_generic(completed[i].data);
+        }
+    }
+}
+
+int ec_dns_stream_flow_count(void)
+{
+    return READ_ONCE(s_dns_flow_count);
+}
+
+void ec_dns_stream_shutdown(ProcessContext *context)
+{
+    DNS_FLOW      *flow;
+    DNS_FLOW      *tmp;
+    unsigned long  flags;
+
+    spin_lock_irqsave(&s_dns_flow_lock, flags);
+    list_for_each_entry_safe(flow, tmp, &s_dns_flows, lru)
+    {
+        __ec_dns_flow_free(flow);
+    }
+    spin_unlock_irqrestore(&s_dns_flow_lock, flags);
+}
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#pragma once
+
+#include "process-context.h"
+
+// DNS over TCP prefixes every message with a two byte length, and a response may be
+//  split across several segments.  Partial messages are kept per flow until the rest
+//  arrives.
+
+// Largest message a flow will buffer, anything bigger is skipped
+#define DNS_TCP_MAX_MESSAGE  16384
+
+// Flows with a partial message, the least recently used one is dropped to make room
+#define DNS_TCP_MAX_FLOWS    64
+
+typedef struct dns_flow_key {
+    uint16_t  family;
+    uint16_t  sport;
+    uint16_t  dport;
+    uint8_t   saddr[16];
+    uint8_t   daddr[16];
+} DNS_FLOW_KEY;
+
+typedef void (*dns_message_cb)(char *dns_data, int dns_data_len, void *priv, ProcessContext *context);
+
+// Feeds the payload of one TCP segment to the flow.  cb is called without any lock held
+//  for every message completed by this segment.
+void ec_dns_stream_input(
+    DNS_FLOW_KEY   *key,
+    uint32_t        seq,
+    bool            fin,
+    char           *data,
+    int             len,
+    dns_message_cb  cb,
+    void           *priv,
+    ProcessContext *context);
+
+void ec_dns_stream_shutdown(ProcessContext *context);
+int ec_dns_stream_flow_count(void);
@@ -9,6 +9,8 @@
 #include "process-tracking.h"
 #include "net-tracking.h"
 #include "net-hooks.h"
+#include "dns-stream.h"
+#include "dns-dedup.h"
 #include "file-process-tracking.h"
 #include "cb-isolation.h"
 #include "mem-cache.h"
@@ -18,6 +20,7 @@
 #include "hook-tracking.h"
 #include "tests/run-tests.h"
 #include "stall-event.h"
+#include "trusted-path.h"
 
 #ifdef HOOK_SELECTOR
 #define HOOK_MASK  0x0000000000000000
@@ -31,15 +34,13 @@ static char enableHooksStr[HOOK_MASK_LEN];
 uint32_t g_traceLevel = (uint32_t)(DL_INIT | DL_SHUTDOWN | DL_WARNING | DL_ERROR);
 uint64_t g_enableHooks = HOOK_MASK;
 uid_t    g_edr_server_uid = (uid_t)-1;
-int64_t  g_cb_ignored_pid_count;
-pid_t    g_cb_ignored_pids[CB_SENSOR_MAX_PIDS];
-int64_t  g_cb_ignored_uid_count;
-uid_t    g_cb_ignored_uids[CB_SENSOR_MAX_UIDS];
 bool     g_exiting;
 uint32_t g_max_queue_size_pri0 = DEFAULT_P0_QUEUE_SIZE;
 uint32_t g_max_queue_size_pri1 = DEFAULT_P1_QUEUE_SIZE;
 uint32_t g_max_queue_size_pri2 = DEFAULT_P2_QUEUE_SIZE;
 uint32_t ec_prsock_buflen;
+uint32_t g_file_write_coalesce_ms;
+uint32_t g_dns_dedup_ms;
 bool     g_run_self_tests;
 
 CB_DRIVER_CONFIG g_driver_config = {
@@ -56,6 +57,8 @@ module_param(g_max_queue_size_pri0, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)
 module_param(g_max_queue_size_pri1, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param(g_max_queue_size_pri2, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param(ec_prsock_buflen, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+module_param(g_file_write_coalesce_ms, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+module_param(g_dns_dedup_ms, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param(g_run_self_tests, bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 // Store string param to later on convert to unsigned long long
 module_param_string(g_enableHooks, enableHooksStr, HOOK_MASK_LEN,
@@ -190,9 +193,6 @@ int __init ec_init(void)
     //
     // Initialize Subsystems
     //
-    memset(&g_cb_ignored_pids[0], 0, sizeof(pid_t)*CB_SENSOR_MAX_PIDS);
-    memset(&g_cb_ignored_uids[0], 0xFF, sizeof(uid_t)*CB_SENSOR_MAX_PIDS);
-
 
     // Allow hooks to be enabled via module param
     ec_set_enableHooks();
@@ -497,8 +497,6 @@ int ec_enable_module(ProcessContext *context)
             ec_write_unlock(&g_module_state_info.module_state_lock, context);
 
             {
-                DECLARE_ATOMIC_CONTEXT(atomic_context, ec_getpid(current));
-
                 int result = ec_sensor_enable_module_initialize_memory(context);
 
                 if (result != 0)
@@ -511,7 +509,7 @@ int ec_enable_module(ProcessContext *context)
                     return result;
                 }
 
-                ec_enumerate_and_track_all_tasks(&atomic_context);
+                ec_enumerate_and_track_all_tasks(context);
             }
 
             ec_set_module_state(context, ModuleStateEnabled);
@@ -539,12 +537,15 @@ int ec_sensor_enable_module_initialize_memory(ProcessContext *context)
     TRY_STEP(NET_IS,    ec_file_helper_init(context));
     TRY_STEP(NET_IS,    ec_task_initialize(context));
     TRY_STEP(TASK,      ec_file_tracking_init(context));
-    TRY_STEP(FILE_PROC, ec_stats_proc_initialize(context));
+    TRY_STEP(FILE_PROC, ec_special_files_initialize(context));
+    TRY_STEP(SPECIAL,   ec_stats_proc_initialize(context));
     TRY_STEP(STALL,     ec_stall_events_initialize(context));
 
     return 0;
 CATCH_STALL:
     ec_stats_proc_shutdown(context);
+CATCH_SPECIAL:
+    ec_special_files_shutdown(context);
 CATCH_FILE_PROC:
     ec_file_tracking_shutdown(context);
 CATCH_TASK:
@@ -578,14 +579,20 @@ void ec_sensor_disable_module_shutdown(ProcessContext *context)
      * Need to shutdown subsystems in the reverse order of dependency.
      */
     ec_stall_events_shutdown(context);
+    ec_file_coalesce_shutdown(context);
     ec_stats_proc_shutdown(context);
+    ec_trusted_path_clear(context);
     ec_task_shutdown(context);
+    ec_task_enumeration_shutdown(context);
     ec_DestroyNetworkIsolation(context);
     ec_banning_shutdown(context);
     ec_user_comm_shutdown(context);
     ec_net_tracking_shutdown(context);
+    ec_dns_stream_shutdown(context);
+    ec_dns_dedup_clear();
     ec_process_tracking_shutdown(context);
     ec_logger_shutdown(context);
+    ec_special_files_shutdown(context);
     ec_file_tracking_shutdown(context);
     ec_path_buffers_shutdown(context);
     ec_proc_shutdown(context);
@@ -5,6 +5,7 @@
 #include "event-factory.h"
 #include "net-helper.h"
 #include "priv.h"
+#include "trusted-path.h"
 
 const char *ec_StartAction_ToString(int start_action)
 {
@@ -45,7 +46,11 @@ PCB_EVENT ec_factory_alloc_event(
     }
 
     // This will return a NULL event if we are configured to not send this event type
-    event = ec_alloc_event(intentType, eventType, context);
+    //  or the process is running from a trusted path
+    if (!ec_trusted_path_should_suppress(process_handle, intentType, eventType))
+    {
+        event = ec_alloc_event(intentType, eventType, context);
+    }
 
     // We still call this even for a NULL event to give the process_tracking a chance
     //  to clean up any private data
@@ -80,6 +85,8 @@ void ec_event_send_start(
     event->processStart.start_action   = start_action;
     event->processStart.observed       = ec_process_posix_identity(process_handle)->is_real_start;
 
+    // Processes found at load only read their cmdline when first reported
+    ec_task_fill_pending_cmdline(process_handle, context);
     event->processStart.path  = ec_mem_cache_get_generic(ec_process_cmdline(process_handle), context);// take reference
     event->processStart.path_size = ec_mem_cache_get_size_generic(event->processStart.path);
 
@@ -205,7 +212,22 @@ void ec_event_send_file(
     const char      *path,
     ProcessContext  *context)
 {
-    size_t path_size = 0;
+    char *path_copy = ec_mem_cache_strdup(path, context);
+
+    ec_event_send_file_coalesced(process_handle, event_type, intent, device, inode, path_copy, 1, context);
+    ec_mem_cache_put_generic(path_copy);
+}
+
+void ec_event_send_file_coalesced(
+    ProcessHandle  * process_handle,
+    CB_EVENT_TYPE    event_type,
+    CB_INTENT_TYPE   intent,
+    uint64_t         device,
+    uint64_t         inode,
+    char            *path,
+    uint32_t         op_count,
+    ProcessContext  *context)
+{
     char status_message[MSG_SIZE + 1];
     PCB_EVENT event;
     char *status_msgp = NULL;
@@ -215,10 +237,11 @@ void ec_event_send_file(
         status_msgp = status_message;
         snprintf(status_msgp,
              MSG_SIZE,
-             " [%llu:%llu] %s by",
+             " [%llu:%llu] %s (x%u) by",
              device,
              inode,
-             path);
+             path,
+             op_count);
         status_msgp[MSG_SIZE] = 0;
     }
 
@@ -236,14 +259,13 @@ void ec_event_send_file(
     // Populate the event
     event->fileGeneric.device    = device;
     event->fileGeneric.inode     = inode;
+    event->fileGeneric.op_count  = op_count;
 
-    if (path)
+    // The event shares the caller's string rather than copying it
+    event->fileGeneric.path = ec_mem_cache_get_generic(path, context);
+    if (event->fileGeneric.path)
     {
-        event->fileGeneric.path = ec_mem_cache_strdup_x(path, &path_size, context);
-        if (event->fileGeneric.path && path_size)
-        {
-            event->fileGeneric.path_size = (uint16_t)path_size;
-        }
+        event->fileGeneric.path_size = (uint16_t)(strlen(event->fileGeneric.path) + 1);
     }
 
     // Queue it to be sent to usermode
@@ -34,6 +34,17 @@ void ec_event_send_file(ProcessHandle  *process_handle,
                         const char *path,
                         ProcessContext *context);
 
+// Same as ec_event_send_file, but reports how many write cycles the event summarizes.
+//  path must be a mem-cache generic string; the event takes a reference instead of a copy.
+void ec_event_send_file_coalesced(ProcessHandle  *process_handle,
+                                  CB_EVENT_TYPE    event_type,
+                                  CB_INTENT_TYPE   intent,
+                                  uint64_t         device,
+                                  uint64_t         inode,
+                                  char            *path,
+                                  uint32_t         op_count,
+                                  ProcessContext  *context);
+
 void ec_event_send_modload(ProcessHandle  *process_handle,
                            CB_EVENT_TYPE    event_type,
                            uint64_t         device,
@@ -9,6 +9,7 @@
 #include "path-buffers.h"
 #include "cb-banning.h"
 #include "event-factory.h"
+#include "prefix-trie.h"
 
 #include <linux/file.h>
 #include <linux/namei.h>
@@ -25,13 +26,6 @@ bool ec_file_exists(int dfd, const char __user *filename);
 // checkpatch-no-ignore: COMPLEX_MACRO
 #endif
 
-typedef struct special_file_t_ {
-    char *name;
-    int   len;
-    int   enabled;
-
-} special_file_t;
-
 // We collect data about a file in some of the syscall hooks.  We use this struct
 //  so that we can collect data before modifying the file, but not actually use
 //  it to send an event until the operation completes successfully
@@ -48,37 +42,50 @@ file_data_t *__ec_get_file_data_from_name_at(ProcessContext *context, int dfd, c
 file_data_t *__ec_get_file_data_from_fd(ProcessContext *context, const char __user *filename, unsigned int fd);
 void __ec_put_file_data(ProcessContext *context, file_data_t *file_data);
 
-#define ENABLE_SPECIAL_FILE_SETUP(x)   {x, sizeof(x)-1, 1}
-#define DISABLE_SPECIAL_FILE_SETUP(x)  {x, sizeof(x)-1, 0}
-
-
 //
-// be sure to keep this value set to the smallest 'len' value in the
-// special_files[] array below
+// Files that live below any of these directories are not reported. This is the
+// default list, which the agent can replace with CB_DRIVER_REQUEST_SET_SPECIAL_FILES.
 //
-#define MIN_SPECIAL_FILE_LEN 5
-static const special_file_t special_files[] = {
-
-    ENABLE_SPECIAL_FILE_SETUP("/var/log/messages"),
-    ENABLE_SPECIAL_FILE_SETUP("/var/lib/cb"),
-    ENABLE_SPECIAL_FILE_SETUP("/var/log"),
-    ENABLE_SPECIAL_FILE_SETUP("/srv/bit9/data"),
-    ENABLE_SPECIAL_FILE_SETUP("/sys"),
-    ENABLE_SPECIAL_FILE_SETUP("/proc"),
-    ENABLE_SPECIAL_FILE_SETUP("/var/opt/carbonblack"),
-    DISABLE_SPECIAL_FILE_SETUP(""),
-    DISABLE_SPECIAL_FILE_SETUP(""),
-    DISABLE_SPECIAL_FILE_SETUP(""),
-    DISABLE_SPECIAL_FILE_SETUP(""),
+const char * const g_special_file_names[] = {
+    "/var/log/messages",
+    "/var/lib/cb",
+    "/var/log",
+    "/srv/bit9/data",
+    "/sys",
+    "/proc",
+    "/var/opt/carbonblack",
 };
+const int g_special_file_names_count = N_ELEM(g_special_file_names);
+
+static PrefixTrieHolder s_special_files;
+
+bool ec_special_files_initialize(ProcessContext *context)
+{
+    return ec_prefix_trie_holder_load(&s_special_files, g_special_file_names, g_special_file_names_count, context);
+}
+
+void ec_special_files_shutdown(ProcessContext *context)
+{
+    ec_prefix_trie_holder_clear(&s_special_files);
+}
+
+// An empty list restores the defaults
+bool ec_special_files_set(const char *list, size_t size, ProcessContext *context)
+{
+    if (!size)
+    {
+        return ec_special_files_initialize(context);
+    }
+    return ec_prefix_trie_holder_load_list(&s_special_files, list, size, context);
+}
 
 //
 // FUNCTION:
 //   ec_is_special_file()
 //
 // DESCRIPTION:
-//   we'll skip any file that lives below any of the directories listed in
-//   in the special_files[] array.
+//   we'll skip any file that lives below any of the directories in the
+//   special files list.
 //
 // PARAMS:
 //   char *pathname - full path + filename to test
@@ -90,48 +97,7 @@ static const special_file_t special_files[] = {
 //
 int ec_is_special_file(char *pathname, int len)
 {
-    int i;
-
-    //
-    // bail out if we've got no chance of a match
-    //
-    if (len < MIN_SPECIAL_FILE_LEN)
-    {
-        return 0;
-    }
-
-    for (i = 0; i < N_ELEM(special_files); i++)
-    {
-        //
-        // Skip disabled elements
-        //
-        if (!special_files[i].enabled)
-        {
-            continue;
-        }
-
-        //
-        // if the length of the path we're testing is shorter than this special
-        // file, it can't possibly be a match
-        //
-        if (special_files[i].len > len)
-        {
-            continue;
-        }
-
-        //
-        // still here, do the compare. We know that the path passed in is >=
-        // this special_file[].len so we'll just compare up the length of the
-        // special file itself. If we match up to that point, the path being
-        // tested is or is below this special_file[].name
-        //
-        if (strncmp(pathname, special_files[i].name, special_files[i].len) == 0)
-        {
-            return -1;
-        }
-    }
-
-    return 0;
+    return ec_prefix_trie_holder_match(&s_special_files, pathname, len) ? -1 : 0;
 }
 
 bool ec_is_interesting_file(struct file *file)
@@ -393,33 +359,17 @@ void __ec_do_file_event(ProcessContext *context, struct file *file, CB_EVENT_TYP
     } else //status == CLOSED
     {
         char *path          = NULL;
-        char *string_buffer = NULL;
 
         TRY(eventType == CB_EVENT_TYPE_FILE_WRITE || eventType == CB_EVENT_TYPE_FILE_CREATE);
 
         // If this file is deleted already, then just skip it
         TRY(!d_unlinked(file->f_path.dentry));
 
-        string_buffer = ec_get_path_buffer(context);
-        if (string_buffer)
-        {
-            // ec_file_get_path() uses dpath which builds the path efficently
-            //  by walking back to the root. It starts with a string terminator
-            //  in the last byte of the target buffer and needs to be copied
-            //  with memmove to adjust
-            // Note for CB-6707: The 3.10 kernel occasionally crashed in d_path when the file was closed.
-            //  The workaround used dentry->d_iname instead. But this only provided the short name and
-            //  not the whole path.  The daemon could no longer match the lastWrite to the firstWrite.
-            //  I am now only calling this with an open file now so we should be fine.
-            ec_file_get_path(file, string_buffer, PATH_MAX, &path);
-        }
-
+        // The path is looked up (or shared from the intern table) by the tracking entry
         fileProcess = ec_file_process_status_open(
             file,
             pid,
-            path,
             context);
-        ec_put_path_buffer(string_buffer);
 
         if (fileProcess)
         {
@@ -456,14 +406,50 @@ void __ec_do_file_event(ProcessContext *context, struct file *file, CB_EVENT_TYP
             //
             if (!fileProcess->isSpecialFile)
             {
-                ec_event_send_file(
-                    process_handle,
-                    eventType,
-                    INTENT_REPORT,
-                    fileProcess->device,
-                    fileProcess->inode,
-                    fileProcess->path,
-                    context);
+                uint32_t op_count   = 1;
+                bool     send_event = true;
+
+                if (eventType == CB_EVENT_TYPE_FILE_WRITE)
+                {
+                    // Log writers that reopen the same file over and over only report once per window
+                    ec_file_coalesce_write(fileProcess, process_handle, context);
+                    op_count   = fileProcess->writeOpCount;
+                    send_event = op_count > 0;
+                } else if (eventType == CB_EVENT_TYPE_FILE_CLOSE)
+                {
+                    // Report the write cycles folded into an expired window before this close
+                    uint32_t folded = ec_file_coalesce_close(fileProcess, process_handle, &send_event, context);
+
+                    if (folded)
+                    {
+                        ec_event_send_file_coalesced(
+                            process_handle,
+                            CB_EVENT_TYPE_FILE_WRITE,
+                            INTENT_REPORT,
+                            fileProcess->device,
+                            fileProcess->inode,
+                            fileProcess->path,
+                            folded,
+                            context);
+                    }
+                }
+
+                if (send_event)
+                {
+                    ec_event_send_file_coalesced(
+                        process_handle,
+                        eventType,
+                        INTENT_REPORT,
+                        fileProcess->device,
+                        fileProcess->inode,
+                        fileProcess->path,
+                        op_count,
+                        context);
+                } else
+                {
+                    TRACE(DL_FILE, "%s [%llu:%llu] process:%u %s coalesced", fileProcess->path, fileProcess->device,
+                          fileProcess->inode, pid, ec_event_type_to_str(eventType));
+                }
             }
         } else if (fileProcess->path[0] == '[' && eventType == CB_EVENT_TYPE_FILE_WRITE)
         {
@@ -522,6 +508,45 @@ CATCH_DEFAULT:
     MODULE_PUT_AND_FINISH_MODULE_DISABLE_CHECK(&context);
 }
 
+// The paths interned for the file, or for everything below a directory, are about to change
+int ec_lsm_inode_rename(struct inode *old_dir, struct dentry *old_dentry,
+                        struct inode *new_dir, struct dentry *new_dentry)
+{
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    MODULE_GET_AND_BEGIN_MODULE_DISABLE_CHECK_IF_DISABLED_GOTO(&context, CATCH_DEFAULT);
+
+    ec_file_path_intern_invalidate(old_dentry, true, &context);
+
+    // An existing target is replaced
+    ec_file_path_intern_invalidate(new_dentry, true, &context);
+
+CATCH_DEFAULT:
+    MODULE_PUT_AND_FINISH_MODULE_DISABLE_CHECK(&context);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 0, 0)  //{
+    return g_original_ops_ptr->inode_rename(old_dir, old_dentry, new_dir, new_dentry);
+#else  //}{
+    return 0;
+#endif  //}
+}
+
+int ec_lsm_inode_unlink(struct inode *dir, struct dentry *dentry)
+{
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    MODULE_GET_AND_BEGIN_MODULE_DISABLE_CHECK_IF_DISABLED_GOTO(&context, CATCH_DEFAULT);
+
+    ec_file_path_intern_invalidate(dentry, false, &context);
+
+CATCH_DEFAULT:
+    MODULE_PUT_AND_FINISH_MODULE_DISABLE_CHECK(&context);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 0, 0)  //{
+    return g_original_ops_ptr->inode_unlink(dir, dentry);
+#else  //}{
+    return 0;
+#endif  //}
+}
+
 asmlinkage long ec_sys_open(const char __user *filename, int flags, umode_t mode)
 {
     long                fd;
@@ -2,17 +2,100 @@
 // Copyright (c) 2019-2020 VMware, Inc. All rights reserved.
 // Copyright (c) 2016-2019 Carbon Black, Inc. All rights reserved.
 
+#include <linux/dcache.h>
+#include <linux/jiffies.h>
+#include <linux/workqueue.h>
 #include "file-process-tracking.h"
 #include "process-tracking.h"
 #include "process-tracking-private.h"
 #include "hash-table-generic.h"
+#include "path-buffers.h"
+#include "event-factory.h"
 #include "priv.h"
 
 void __ec_file_tracking_delete_callback(void *posix_identity, ProcessContext *context);
+void __ec_path_intern_delete_callback(void *data, ProcessContext *context);
+void __ec_file_coalesce_delete_callback(void *data, ProcessContext *context);
+static void __ec_file_coalesce_flush_task(struct work_struct *work);
 int __ec_file_tracking_show(HashTbl *hashTblp, HashTableNode *nodep, void *priv, ProcessContext *context);
 
 static HashTbl      *s_file_hash_table;
 
+// Coalescing window for repeated write cycles of the same file by the same process.
+//  The start time keeps a reused pid from inheriting the window of an exited process.
+typedef struct FILE_COALESCE_KEY {
+    uint64_t            device;
+    uint64_t            inode;
+    uint64_t            pid;
+    uint64_t            start_time;
+} FILE_COALESCE_KEY;
+
+typedef struct FILE_COALESCE_VALUE {
+    HashTableNode       node;
+    FILE_COALESCE_KEY   key;
+    uint64_t            window_start;   // jiffies
+    uint32_t            folded;         // write cycles not yet reported
+    char               *path;           // referenced, used to report the folded cycles
+    struct list_head    flush_list;
+} FILE_COALESCE_VALUE;
+
+#define FILE_COALESCE_MAX_ENTRIES  8192
+
+// Expired windows are reported and released by a periodic flush rather than
+//  by the next write, which may never come
+#define FILE_COALESCE_FLUSH_DELAY  msecs_to_jiffies(1000)
+
+// Interned paths so that repeated opens of the same file share one string with
+//  the tracking entries and the events sent for them.  Files with more than one link
+//  are not interned, so the inode alone identifies the path.
+typedef struct PATH_INTERN_KEY {
+    uint64_t            device;
+    uint64_t            inode;
+} PATH_INTERN_KEY;
+
+typedef struct PATH_INTERN_VALUE {
+    HashTableNode       node;
+    PATH_INTERN_KEY     key;
+
+    // The mount the path was built through and the inode generation, so that another
+    //  mount of the device or a reused inode number does not match.  Never dereferenced.
+    uint64_t            mnt;
+    uint32_t            generation;
+
+    // s_path_intern_dir_gen when the path was built
+    uint64_t            dir_gen;
+
+    char               *path;
+} PATH_INTERN_VALUE;
+
+#define PATH_INTERN_MAX_ENTRIES  4096
+
+// A full table is pruned at most this often, misses in between are not interned
+#define PATH_INTERN_PRUNE_DELAY  msecs_to_jiffies(1000)
+
+static HashTbl      *s_path_intern_table;
+static atomic64_t    s_path_intern_hits;
+static atomic64_t    s_path_intern_misses;
+static atomic64_t    s_path_intern_bytes_saved;
+static atomic64_t    s_path_intern_last_prune;
+
+// Renaming a file drops its own entry.  Renaming a directory moves every path below it,
+//  which can not be found from the directory, so it starts a new generation instead.
+static atomic64_t    s_path_intern_dir_gen;
+
+// rename_lock sequence seen by the last rename hook.  The hook runs before the rename
+//  is done, nothing is interned until the sequence moves on so that a path built in
+//  between is not kept.  Only the last rename is remembered, a path built while two
+//  renames overlap can still be interned before the first one is done.
+static atomic_t      s_path_intern_rename_seq;
+
+static HashTbl      *s_file_coalesce_table;
+static atomic64_t    s_file_coalesce_reported;
+static atomic64_t    s_file_coalesce_folded_writes;
+static atomic64_t    s_file_coalesce_folded_closes;
+static atomic64_t    s_file_coalesce_lost;
+static DECLARE_DELAYED_WORK(s_file_coalesce_work, __ec_file_coalesce_flush_task);
+
 bool ec_file_tracking_init(ProcessContext *context)
 {
     s_file_hash_table = ec_hashtbl_init_generic(
@@ -27,13 +110,77 @@ bool ec_file_tracking_init(ProcessContext *context)
         offsetof(FILE_PROCESS_VALUE, reference_count),
         __ec_file_tracking_delete_callback,
         NULL);
+    TRY(s_file_hash_table);
 
-    return s_file_hash_table != NULL;
+    s_file_coalesce_table = ec_hashtbl_init_generic(
+        context,
+        1024,
+        sizeof(FILE_COALESCE_VALUE),
+        0,
+        "file_coalesce_table",
+        sizeof(FILE_COALESCE_KEY),
+        offsetof(FILE_COALESCE_VALUE, key),
+        offsetof(FILE_COALESCE_VALUE, node),
+        HASHTBL_DISABLE_REF_COUNT,
+        __ec_file_coalesce_delete_callback,
+        NULL);
+    TRY(s_file_coalesce_table);
+
+    s_path_intern_table = ec_hashtbl_init_generic(
+        context,
+        1024,
+        sizeof(PATH_INTERN_VALUE),
+        0,
+        "path_intern_table",
+        sizeof(PATH_INTERN_KEY),
+        offsetof(PATH_INTERN_VALUE, key),
+        offsetof(PATH_INTERN_VALUE, node),
+        HASHTBL_DISABLE_REF_COUNT,
+        __ec_path_intern_delete_callback,
+        NULL);
+    TRY(s_path_intern_table);
+
+    atomic64_set(&s_path_intern_hits, 0);
+    atomic64_set(&s_path_intern_misses, 0);
+    atomic64_set(&s_path_intern_bytes_saved, 0);
+    atomic64_set(&s_path_intern_last_prune, 0);
+    atomic64_set(&s_path_intern_dir_gen, 0);
+    atomic_set(&s_path_intern_rename_seq, -1);
+    atomic64_set(&s_file_coalesce_reported, 0);
+    atomic64_set(&s_file_coalesce_folded_writes, 0);
+    atomic64_set(&s_file_coalesce_folded_closes, 0);
+    atomic64_set(&s_file_coalesce_lost, 0);
+
+    schedule_delayed_work(&s_file_coalesce_work, FILE_COALESCE_FLUSH_DELAY);
+
+    return true;
+
+CATCH_DEFAULT:
+    ec_file_tracking_shutdown(context);
+    return false;
 }
 
 void ec_file_tracking_shutdown(ProcessContext *context)
 {
-    ec_hashtbl_shutdown_generic(s_file_hash_table, context);
+    if (s_path_intern_table)
+    {
+        ec_hashtbl_shutdown_generic(s_path_intern_table, context);
+        s_path_intern_table = NULL;
+    }
+
+    ec_file_coalesce_shutdown(context);
+
+    if (s_file_coalesce_table)
+    {
+        ec_hashtbl_shutdown_generic(s_file_coalesce_table, context);
+        s_file_coalesce_table = NULL;
+    }
+
+    if (s_file_hash_table)
+    {
+        ec_hashtbl_shutdown_generic(s_file_hash_table, context);
+        s_file_hash_table = NULL;
+    }
 }
 
 void __ec_file_tracking_delete_callback(void *data, ProcessContext *context)
@@ -48,10 +195,182 @@ void __ec_file_tracking_delete_callback(void *data, ProcessContext *context)
 }
 
 
+void __ec_path_intern_delete_callback(void *data, ProcessContext *context)
+{
+    if (data)
+    {
+        PATH_INTERN_VALUE *value = (PATH_INTERN_VALUE *)data;
+
+        ec_mem_cache_put_generic(value->path);
+        value->path = NULL;
+    }
+}
+
+static bool __ec_path_intern_matches(PATH_INTERN_VALUE *value, struct file *file)
+{
+    return value->mnt == (uint64_t)file->f_path.mnt &&
+           value->generation == file->f_path.dentry->d_inode->i_generation &&
+           value->dir_gen == atomic64_read(&s_path_intern_dir_gen);
+}
+
+int __ec_path_intern_prune(HashTbl *hashTblp, HashTableNode *nodep, void *priv, ProcessContext *context)
+{
+    // Drop the strings nobody else holds anymore
+    if (nodep && ec_mem_cache_ref_count_generic(((PATH_INTERN_VALUE *)nodep)->path) <= 1)
+    {
+        return ACTION_DELETE;
+    }
+
+    return ACTION_CONTINUE;
+}
+
+static void __ec_path_intern_delete(PATH_INTERN_KEY *key, ProcessContext *context)
+{
+    ec_hashtbl_free_generic(s_path_intern_table, ec_hashtbl_del_by_key_generic(s_path_intern_table, key, context), context);
+}
+
+void __ec_path_intern_insert(PATH_INTERN_KEY *key, struct file *file, uint64_t dir_gen, char *path, ProcessContext *context)
+{
+    PATH_INTERN_VALUE *value = NULL;
+
+    // Replace a stale entry
+    __ec_path_intern_delete(key, context);
+
+    if (atomic64_read(&s_path_intern_table->tableInstance) >= PATH_INTERN_MAX_ENTRIES)
+    {
+        uint64_t now  = get_jiffies_64();
+        uint64_t last = atomic64_read(&s_path_intern_last_prune);
+
+        // Only the first miss of an interval walks the table
+        CANCEL_VOID(time_after_eq64(now, last + PATH_INTERN_PRUNE_DELAY));
+        CANCEL_VOID(atomic64_cmpxchg(&s_path_intern_last_prune, last, now) == last);
+
+        ec_hashtbl_write_for_each_generic(s_path_intern_table, __ec_path_intern_prune, NULL, context);
+        CANCEL_VOID(atomic64_read(&s_path_intern_table->tableInstance) < PATH_INTERN_MAX_ENTRIES);
+    }
+
+    value = ec_hashtbl_alloc_generic(s_path_intern_table, context);
+    CANCEL_VOID(value);
+
+    value->key        = *key;
+    value->mnt        = (uint64_t)file->f_path.mnt;
+    value->generation = file->f_path.dentry->d_inode->i_generation;
+    value->dir_gen    = dir_gen;
+    value->path       = ec_mem_cache_get_generic(path, context);
+
+    if (ec_hashtbl_add_generic_safe(s_path_intern_table, value, context) < 0)
+    {
+        // Somebody else interned it first
+        ec_hashtbl_free_generic(s_path_intern_table, value, context);
+    }
+}
+
+// Returns a referenced generic string holding the path of file.  Repeated calls for
+//  the same file share one string instead of calling d_path again.
+char *ec_file_path_intern_get(struct file *file, uint64_t device, uint64_t inode, ProcessContext *context)
+{
+    PATH_INTERN_KEY    key        = {};
+    PATH_INTERN_VALUE *value      = NULL;
+    HashTableBkt      *bkt        = NULL;
+    struct inode      *f_inode    = NULL;
+    char              *path       = NULL;
+    char              *raw_path   = NULL;
+    char              *buffer     = NULL;
+    bool               path_found = false;
+    bool               internable = false;
+    unsigned           rename_seq = 0;
+    uint64_t           dir_gen    = 0;
+
+    CANCEL(file, NULL);
+
+    f_inode    = file->f_path.dentry->d_inode;
+    key.device = device;
+    key.inode  = inode;
+
+    // Another link to the file has another path, and without the rename and unlink hooks
+    //  nothing would notice that a path changed
+    internable = s_path_intern_table && f_inode && f_inode->i_nlink == 1 &&
+                 (g_enableHooks & CB__LSM_inode_rename) && (g_enableHooks & CB__LSM_inode_unlink);
+
+    if (internable &&
+        ec_hashtbl_read_bkt_lock(s_path_intern_table, &key, (void **)&value, &bkt, context))
+    {
+        if (__ec_path_intern_matches(value, file))
+        {
+            path = ec_mem_cache_get_generic(value->path, context);
+        }
+        ec_hashtbl_read_bkt_unlock(bkt, context);
+    }
+
+    if (path)
+    {
+        atomic64_inc(&s_path_intern_hits);
+        atomic64_add(ec_mem_cache_get_size_generic(path), &s_path_intern_bytes_saved);
+        return path;
+    }
+    atomic64_inc(&s_path_intern_misses);
+
+    // Taken before building the path so that a rename racing with d_path is not interned
+    dir_gen    = atomic64_read(&s_path_intern_dir_gen);
+    rename_seq = read_seqbegin(&rename_lock);
+
+    buffer = ec_get_path_buffer(context);
+    if (buffer)
+    {
+        // ec_file_get_path() uses dpath which builds the path efficently
+        //  by walking back to the root. It starts with a string terminator
+        //  in the last byte of the target buffer and needs to be copied
+        //  with memmove to adjust
+        // Note for CB-6707: The 3.10 kernel occasionally crashed in d_path when the file was closed.
+        //  The workaround used dentry->d_iname instead. But this only provided the short name and
+        //  not the whole path.  The daemon could no longer match the lastWrite to the firstWrite.
+        //  I am now only calling this with an open file now so we should be fine.
+        path_found = ec_file_get_path(file, buffer, PATH_MAX, &raw_path);
+        path = ec_mem_cache_strdup(raw_path, context);
+    }
+    ec_put_path_buffer(buffer);
+
+    // Only complete paths are worth sharing
+    if (path && path_found && internable &&
+        !read_seqretry(&rename_lock, rename_seq) &&
+        (int)rename_seq != atomic_read(&s_path_intern_rename_seq))
+    {
+        __ec_path_intern_insert(&key, file, dir_gen, path, context);
+    }
+
+    return path;
+}
+
+// Called before dentry is renamed or unlinked
+void ec_file_path_intern_invalidate(struct dentry *dentry, bool rename, ProcessContext *context)
+{
+    PATH_INTERN_KEY key  = {};
+    struct path     path = { .dentry = dentry };
+
+    CANCEL_VOID(s_path_intern_table && dentry && dentry->d_inode);
+
+    if (rename)
+    {
+        atomic_set(&s_path_intern_rename_seq, (int)read_seqbegin(&rename_lock));
+    }
+
+    if (S_ISDIR(dentry->d_inode->i_mode))
+    {
+        // Removing an empty directory moves nothing
+        if (rename)
+        {
+            atomic64_inc(&s_path_intern_dir_gen);
+        }
+        return;
+    }
+
+    ec_get_devinfo_from_path(&path, &key.device, &key.inode);
+    __ec_path_intern_delete(&key, context);
+}
+
 FILE_PROCESS_VALUE *ec_file_process_status_open(
     struct file    *file,
     uint32_t        pid,
-    char           *path,
     ProcessContext *context)
 {
     FILE_PROCESS_VALUE *value = ec_file_process_get(file, context);
@@ -66,11 +385,13 @@ FILE_PROCESS_VALUE *ec_file_process_status_open(
 
         value->key.file      = (uint64_t)file;
         value->pid           = pid;
-        value->path          = ec_mem_cache_strdup(path, context);
-        value->isSpecialFile = ec_is_special_file(value->path, ec_mem_cache_get_size_generic(value->path));
+        value->writeOpCount  = 1;
 
         ec_get_devinfo_from_file(file, &value->device, &value->inode);
 
+        value->path          = ec_file_path_intern_get(file, value->device, value->inode, context);
+        value->isSpecialFile = ec_is_special_file(value->path, ec_mem_cache_get_size_generic(value->path));
+
         if (ec_hashtbl_add_generic(s_file_hash_table, value, context) < 0)
         {
             if (MAY_TRACE_LEVEL(DL_FILE))
@@ -78,7 +399,7 @@ FILE_PROCESS_VALUE *ec_file_process_status_open(
                 // We are racing against other threads or processes
                 // to insert a similar entry on the same rb_tree.
                 TRACE(DL_FILE, "File entry already exists: [%llu:%llu] %s pid:%u",
-                      value->device, value->inode, path ? path : "<unknown>", pid);
+                      value->device, value->inode, value->path ? value->path : "<unknown>", pid);
             }
 
             // If the insert failed we free the local reference and clear
@@ -120,11 +441,314 @@ void ec_file_process_put_ref(FILE_PROCESS_VALUE *value, ProcessContext *context)
     ec_hashtbl_put_generic(s_file_hash_table, value, context);
 }
 
+static bool __ec_file_coalesce_window_open(FILE_COALESCE_VALUE *entry)
+{
+    return g_file_write_coalesce_ms &&
+           time_before64(get_jiffies_64(), entry->window_start + msecs_to_jiffies(g_file_write_coalesce_ms));
+}
+
+void __ec_file_coalesce_delete_callback(void *data, ProcessContext *context)
+{
+    if (data)
+    {
+        FILE_COALESCE_VALUE *entry = (FILE_COALESCE_VALUE *)data;
+
+        ec_mem_cache_put_generic(entry->path);
+        entry->path = NULL;
+    }
+}
+
+static void __ec_file_coalesce_init_key(FILE_COALESCE_KEY *key, FILE_PROCESS_VALUE *value, ProcessHandle *process_handle)
+{
+    PosixIdentity *posix_identity = ec_process_posix_identity(process_handle);
+
+    memset(key, 0, sizeof(*key));
+    key->device     = value->device;
+    key->inode      = value->inode;
+    key->pid        = posix_identity->posix_details.pid;
+    key->start_time = posix_identity->posix_details.start_time;
+}
+
+void ec_file_coalesce_write(FILE_PROCESS_VALUE *value, ProcessHandle *process_handle, ProcessContext *context)
+{
+    FILE_COALESCE_KEY    key    = {};
+    FILE_COALESCE_VALUE *entry  = NULL;
+    HashTableBkt        *bkt    = NULL;
+
+    CANCEL_VOID(value);
+    value->writeOpCount = 1;
+
+    // Nothing to do when coalescing is off and no window is left to drain
+    CANCEL_VOID(s_file_coalesce_table && process_handle);
+    CANCEL_VOID(g_file_write_coalesce_ms || atomic64_read(&s_file_coalesce_table->tableInstance));
+
+    __ec_file_coalesce_init_key(&key, value, process_handle);
+
+    if (ec_hashtbl_write_bkt_lock(s_file_coalesce_table, &key, (void **)&entry, &bkt, context))
+    {
+        if (__ec_file_coalesce_window_open(entry))
+        {
+            entry->folded += 1;
+            value->writeOpCount = 0;
+            atomic64_inc(&s_file_coalesce_folded_writes);
+        } else
+        {
+            // The window has expired so this write reports everything folded into it
+            //  and opens the next window.
+            value->writeOpCount += entry->folded;
+            entry->folded = 0;
+            entry->window_start = get_jiffies_64();
+        }
+        ec_hashtbl_write_bkt_unlock(bkt, context);
+    } else if (g_file_write_coalesce_ms &&
+               atomic64_read(&s_file_coalesce_table->tableInstance) < FILE_COALESCE_MAX_ENTRIES)
+    {
+        // A full table is drained by the periodic flush, until then this file is not coalesced
+        entry = ec_hashtbl_alloc_generic(s_file_coalesce_table, context);
+        if (entry)
+        {
+            entry->key          = key;
+            entry->window_start = get_jiffies_64();
+            entry->folded       = 0;
+            entry->path         = ec_mem_cache_get_generic(value->path, context);
+            INIT_LIST_HEAD(&entry->flush_list);
+
+            // Losing the race to another writer only costs us one uncoalesced event
+            if (ec_hashtbl_add_generic_safe(s_file_coalesce_table, entry, context) < 0)
+            {
+                ec_hashtbl_free_generic(s_file_coalesce_table, entry, context);
+            } else
+            {
+                ec_process_posix_identity(process_handle)->has_coalesce_window = true;
+            }
+        }
+    }
+
+    if (value->writeOpCount)
+    {
+        atomic64_inc(&s_file_coalesce_reported);
+    }
+}
+
+uint32_t ec_file_coalesce_close(FILE_PROCESS_VALUE *value, ProcessHandle *process_handle, bool *send_close, ProcessContext *context)
+{
+    FILE_COALESCE_KEY    key    = {};
+    FILE_COALESCE_VALUE *entry  = NULL;
+    HashTableBkt        *bkt    = NULL;
+    uint32_t             folded = 0;
+    bool                 expired = false;
+
+    CANCEL(value && send_close, 0);
+    *send_close = true;
+
+    CANCEL(s_file_coalesce_table && process_handle, 0);
+    CANCEL(atomic64_read(&s_file_coalesce_table->tableInstance), 0);
+
+    __ec_file_coalesce_init_key(&key, value, process_handle);
+
+    if (ec_hashtbl_write_bkt_lock(s_file_coalesce_table, &key, (void **)&entry, &bkt, context))
+    {
+        expired = !__ec_file_coalesce_window_open(entry);
+        if (expired)
+        {
+            // Drain the window now rather than waiting for the flush
+            folded = entry->folded;
+            ec_hashtbl_del_generic_lockheld(s_file_coalesce_table, entry, context);
+        }
+        ec_hashtbl_write_bkt_unlock(bkt, context);
+
+        if (expired)
+        {
+            ec_hashtbl_free_generic(s_file_coalesce_table, entry, context);
+        }
+    }
+
+    // The close of a folded write cycle is folded as well, unless it carries the summary
+    if (value->writeOpCount == 0 && folded == 0)
+    {
+        *send_close = false;
+        atomic64_inc(&s_file_coalesce_folded_closes);
+    }
+
+    if (folded)
+    {
+        atomic64_inc(&s_file_coalesce_reported);
+    }
+
+    return folded;
+}
+
+typedef struct file_coalesce_flush {
+    uint64_t          pid;          // 0 flushes the expired windows of every process
+    uint64_t          start_time;
+    struct list_head  list;
+} FILE_COALESCE_FLUSH;
+
+int __ec_file_coalesce_collect(HashTbl *hashTblp, HashTableNode *nodep, void *priv, ProcessContext *context)
+{
+    FILE_COALESCE_FLUSH *flush = (FILE_COALESCE_FLUSH *)priv;
+    FILE_COALESCE_VALUE *entry = (FILE_COALESCE_VALUE *)nodep;
+
+    if (!entry)
+    {
+        return ACTION_CONTINUE;
+    }
+
+    if (flush->pid)
+    {
+        if (entry->key.pid != flush->pid || entry->key.start_time != flush->start_time)
+        {
+            return ACTION_CONTINUE;
+        }
+    } else if (__ec_file_coalesce_window_open(entry))
+    {
+        return ACTION_CONTINUE;
+    }
+
+    if (!entry->folded)
+    {
+        return ACTION_DELETE;
+    }
+
+    // Windows with folded cycles are reported once the bucket lock is dropped
+    ec_hashtbl_del_generic_lockheld(hashTblp, entry, context);
+    list_add_tail(&entry->flush_list, &flush->list);
+
+    return ACTION_CONTINUE;
+}
+
+// Sends one summary write event per collected window and releases it.  Without a
+//  process_handle the owner is looked up, and the counts are lost if it is gone.
+static void __ec_file_coalesce_report(FILE_COALESCE_FLUSH *flush, ProcessHandle *process_handle, ProcessContext *context)
+{
+    FILE_COALESCE_VALUE *entry = NULL;
+    FILE_COALESCE_VALUE *tmp   = NULL;
+
+    list_for_each_entry_safe(entry, tmp, &flush->list, flush_list)
+    {
+        ProcessHandle *handle = process_handle;
+
+        if (!handle)
+        {
+            handle = ec_process_tracking_get_handle(entry->key.pid, context);
+            if (handle && ec_process_posix_identity(handle)->posix_details.start_time != entry->key.start_time)
+            {
+                ec_process_tracking_put_handle(handle, context);
+                handle = NULL;
+            }
+        }
+
+        if (handle && entry->path)
+        {
+            ec_event_send_file_coalesced(
+                handle,
+                CB_EVENT_TYPE_FILE_WRITE,
+                INTENT_REPORT,
+                entry->key.device,
+                entry->key.inode,
+                entry->path,
+                entry->folded,
+                context);
+            atomic64_inc(&s_file_coalesce_reported);
+        } else
+        {
+            atomic64_add(entry->folded, &s_file_coalesce_lost);
+        }
+
+        if (handle != process_handle)
+        {
+            ec_process_tracking_put_handle(handle, context);
+        }
+
+        list_del(&entry->flush_list);
+        ec_hashtbl_free_generic(s_file_coalesce_table, entry, context);
+    }
+}
+
+void ec_file_coalesce_flush_process(ProcessHandle *process_handle, ProcessContext *context)
+{
+    FILE_COALESCE_FLUSH  flush          = {};
+    PosixIdentity       *posix_identity = ec_process_posix_identity(process_handle);
+
+    CANCEL_VOID(posix_identity && posix_identity->has_coalesce_window);
+    CANCEL_VOID(s_file_coalesce_table && atomic64_read(&s_file_coalesce_table->tableInstance));
+
+    flush.pid        = posix_identity->posix_details.pid;
+    flush.start_time = posix_identity->posix_details.start_time;
+    INIT_LIST_HEAD(&flush.list);
+
+    ec_hashtbl_write_for_each_generic(s_file_coalesce_table, __ec_file_coalesce_collect, &flush, context);
+    __ec_file_coalesce_report(&flush, process_handle, context);
+}
+
+void ec_file_coalesce_flush_expired(ProcessContext *context)
+{
+    FILE_COALESCE_FLUSH flush = {};
+
+    CANCEL_VOID(s_file_coalesce_table && atomic64_read(&s_file_coalesce_table->tableInstance));
+
+    INIT_LIST_HEAD(&flush.list);
+
+    ec_hashtbl_write_for_each_generic(s_file_coalesce_table, __ec_file_coalesce_collect, &flush, context);
+    __ec_file_coalesce_report(&flush, NULL, context);
+}
+
+static void __ec_file_coalesce_flush_task(struct work_struct *work)
+{
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    ec_file_coalesce_flush_expired(&context);
+    schedule_delayed_work(&s_file_coalesce_work, FILE_COALESCE_FLUSH_DELAY);
+}
+
+void ec_file_coalesce_shutdown(ProcessContext *context)
+{
+    // Safe to call more than once, and the sync flavor also stops a work item that reschedules itself
+    cancel_delayed_work_sync(&s_file_coalesce_work);
+}
+
+void ec_file_coalesce_get_stats(uint64_t *reported, uint64_t *folded_writes, uint64_t *folded_closes, uint64_t *lost)
+{
+    if (reported)
+    {
+        *reported = atomic64_read(&s_file_coalesce_reported);
+    }
+    if (folded_writes)
+    {
+        *folded_writes = atomic64_read(&s_file_coalesce_folded_writes);
+    }
+    if (folded_closes)
+    {
+        *folded_closes = atomic64_read(&s_file_coalesce_folded_closes);
+    }
+    if (lost)
+    {
+        *lost = atomic64_read(&s_file_coalesce_lost);
+    }
+}
+
 int ec_file_track_show_table(struct seq_file *m, void *v)
 {
 
+    uint64_t hits   = atomic64_read(&s_path_intern_hits);
+    uint64_t misses = atomic64_read(&s_path_intern_misses);
+
     DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
 
+    seq_printf(m, "Path intern: %lld entries  Hits: %llu  Misses: %llu  Hit rate: %llu%%  Bytes saved: %lld\n",
+                   (long long)(s_path_intern_table ? atomic64_read(&s_path_intern_table->tableInstance) : 0),
+                   hits,
+                   misses,
+                   (hits + misses) ? (hits * 100) / (hits + misses) : 0,
+                   (long long)atomic64_read(&s_path_intern_bytes_saved));
+    seq_printf(m, "Write coalescing window: %u ms  Reported: %lld  Folded writes: %lld  Folded closes: %lld  Lost: %lld  Open windows: %lld\n\n",
+                   g_file_write_coalesce_ms,
+                   (long long)atomic64_read(&s_file_coalesce_reported),
+                   (long long)atomic64_read(&s_file_coalesce_folded_writes),
+                   (long long)atomic64_read(&s_file_coalesce_folded_closes),
+                   (long long)atomic64_read(&s_file_coalesce_lost),
+                   (long long)(s_file_coalesce_table ? atomic64_read(&s_file_coalesce_table->tableInstance) : 0));
+
     seq_printf(m, "%50s | %10s | %10s | %6s | %10s | %10s |\n",
                    "Path", "Device", "Inode", "PID", "Is Special", "File Pointer");
 
@@ -7,6 +7,7 @@
 #include <linux/types.h>
 #include "priv.h"
 #include "hash-table-generic.h"
+#include "process-tracking.h"
 
 typedef struct FILE_PROCESS_KEY {
     uint64_t            file;
@@ -19,6 +20,7 @@ typedef struct FILE_PROCESS_VALUE {
     uint64_t            device;
     uint64_t            inode;
     bool                isSpecialFile;
+    uint32_t            writeOpCount;   // 0 when the first write was folded into a coalescing window
     char               *path;
     atomic64_t          reference_count;
 } FILE_PROCESS_VALUE;
@@ -33,8 +35,33 @@ FILE_PROCESS_VALUE *ec_file_process_get(
 FILE_PROCESS_VALUE *ec_file_process_status_open(
     struct file    *file,
     uint32_t        pid,
-    char           *path,
     ProcessContext *context);
 void ec_file_process_status_close(
     struct file    *file,
     ProcessContext *context);
+
+// Path interning
+//  Paths are shared per (device, inode) as referenced mem-cache generic strings.
+//  Release the returned string with ec_mem_cache_put_generic.
+char *ec_file_path_intern_get(struct file *file, uint64_t device, uint64_t inode, ProcessContext *context);
+// Drops what is interned for a file that is about to be renamed or unlinked.  Renaming a
+//  directory makes every interned path stale.
+void ec_file_path_intern_invalidate(struct dentry *dentry, bool rename, ProcessContext *context);
+
+// Write coalescing
+//  Repeated open/write/close cycles of the same file by the same process are folded
+//  into a single write event while g_file_write_coalesce_ms is non-zero.  Windows are
+//  keyed on the process identity (pid and start time) of the writer.
+//
+//  ec_file_coalesce_write sets value->writeOpCount to the number of cycles the write
+//  event must report, or to 0 when the write was folded into an open window.
+//  ec_file_coalesce_close returns the number of folded cycles to report in a summary
+//  write event (0 if none) and whether the close event itself should be sent.
+//  Windows that expire without another write or close are reported by a periodic
+//  flush, and ec_file_coalesce_flush_process reports the windows of an exiting process.
+void ec_file_coalesce_write(FILE_PROCESS_VALUE *value, ProcessHandle *process_handle, ProcessContext *context);
+uint32_t ec_file_coalesce_close(FILE_PROCESS_VALUE *value, ProcessHandle *process_handle, bool *send_close, ProcessContext *context);
+void ec_file_coalesce_flush_process(ProcessHandle *process_handle, ProcessContext *context);
+void ec_file_coalesce_flush_expired(ProcessContext *context);
+void ec_file_coalesce_shutdown(ProcessContext *context);
+void ec_file_coalesce_get_stats(uint64_t *reported, uint64_t *folded_writes, uint64_t *folded_closes, uint64_t *lost);
@@ -18,6 +18,10 @@
 #include <linux/workqueue.h>
 #include <linux/jiffies.h>
 #include <linux/ioctl.h>
+#include <linux/log2.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)  //{
+#include <linux/sched/clock.h>
+#endif  //}
 
 #include "priv.h"
 #include "cb-banning.h"
@@ -26,6 +30,10 @@
 #include "process-tracking.h"
 #include "mem-cache.h"
 #include "cb-spinlock.h"
+#include "path-buffers.h"
+#include "prefix-trie.h"
+#include "trusted-path.h"
+#include "stall-event.h"
 
 #include "InodeState.h"
 
@@ -46,6 +54,9 @@ void __ec_get_tx_queue_to_serve(struct list_head **tx_queue, atomic64_t **tx_rea
 void __ec_decrease_holdoff_counter(atomic64_t *tx_ready);
 bool __ec_is_action_allowed(ModuleState moduleState, CB_EVENT_ACTION_TYPE action);
 bool __ec_is_ioctl_allowed(ModuleState module_state, unsigned int cmd);
+long __ec_set_name_list(ProcessContext *context, unsigned int cmd, CB_EVENT_DYNAMIC *dynControl);
+long __ec_set_banned_inode_list(ProcessContext *context, CB_EVENT_DYNAMIC *dynControl);
+long __ec_perm_response_list(ProcessContext *context, CB_EVENT_DYNAMIC *dynControl, bool abort);
 size_t __ec_get_memory_usage(ProcessContext *context);
 void __ec_apply_legacy_driver_config(uint32_t eventFilter);
 void __ec_apply_driver_config(CB_DRIVER_CONFIG *config);
@@ -161,16 +172,37 @@ static CB_EVENT_STATS s_event_stats;
 #define tx_queued_pri0      (s_event_stats.stats[atomic_read(&current_stat)][1])
 #define tx_queued_pri1      (s_event_stats.stats[atomic_read(&current_stat)][2])
 #define tx_queued_pri2      (s_event_stats.stats[atomic_read(&current_stat)][3])
-#define tx_dropped          (s_event_stats.stats[atomic_read(&current_stat)][4])
-#define tx_total            (s_event_stats.stats[atomic_read(&current_stat)][5])
-#define tx_process          (s_event_stats.stats[atomic_read(&current_stat)][6])
-#define tx_modload          (s_event_stats.stats[atomic_read(&current_stat)][7])
-#define tx_file             (s_event_stats.stats[atomic_read(&current_stat)][8])
-#define tx_net              (s_event_stats.stats[atomic_read(&current_stat)][9])
-#define tx_dns              (s_event_stats.stats[atomic_read(&current_stat)][10])
-#define tx_proxy            (s_event_stats.stats[atomic_read(&current_stat)][11])
-#define tx_block            (s_event_stats.stats[atomic_read(&current_stat)][12])
-#define tx_other            (s_event_stats.stats[atomic_read(&current_stat)][13])
+
+// The counters bumped for every event are kept per-cpu so that cpus do not fight over the
+//  same cache lines.  They only count up between resets, and are summed into the current
+//  interval when it rolls over or when the stats are read.
+#define PCPU_STATS_START         4
+#define PCPU_STATS_END           14
+
+// Time from ec_send_event until the event is read, bucketed by log2(ns) for each queue
+#define QUEUE_PRIORITIES         3
+#define QUEUE_LATENCY_BUCKETS    40
+
+typedef struct CB_EVENT_STATS_PCPU {
+    uint64_t        stats[PCPU_STATS_END];
+    uint64_t        queue_latency[QUEUE_PRIORITIES][QUEUE_LATENCY_BUCKETS];
+} CB_EVENT_STATS_PCPU;
+
+// Set by CB_DRIVER_REQUEST_SET_EVENT_TRAILER
+static bool s_event_trailer_enabled;
+
+static DEFINE_PER_CPU(CB_EVENT_STATS_PCPU, s_event_stats_pcpu);
+
+#define tx_dropped          (s_event_stats_pcpu.stats[4])
+#define tx_total            (s_event_stats_pcpu.stats[5])
+#define tx_process          (s_event_stats_pcpu.stats[6])
+#define tx_modload          (s_event_stats_pcpu.stats[7])
+#define tx_file             (s_event_stats_pcpu.stats[8])
+#define tx_net              (s_event_stats_pcpu.stats[9])
+#define tx_dns              (s_event_stats_pcpu.stats[10])
+#define tx_proxy            (s_event_stats_pcpu.stats[11])
+#define tx_block            (s_event_stats_pcpu.stats[12])
+#define tx_other            (s_event_stats_pcpu.stats[13])
 
 
 #define mem_user            (s_event_stats.stats[atomic_read(&current_stat)][14])
@@ -190,6 +222,106 @@ static struct delayed_work stats_work;
 void ec_stats_work_task(struct work_struct *work);
 static uint32_t g_stats_work_delay;
 
+// Not synchronized with cpus that are counting, so a few counts may be lost around a reset
+static void __ec_event_stats_reset_pcpu(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        memset(per_cpu_ptr(&s_event_stats_pcpu, cpu), 0, sizeof(CB_EVENT_STATS_PCPU));
+    }
+}
+
+static void __ec_event_stats_fold(uint32_t interval)
+{
+    uint64_t totals[PCPU_STATS_END] = { 0 };
+    int      cpu;
+    int      i;
+
+    for_each_possible_cpu(cpu)
+    {
+        CB_EVENT_STATS_PCPU *pcpu = per_cpu_ptr(&s_event_stats_pcpu, cpu);
+
+        for (i = PCPU_STATS_START; i < PCPU_STATS_END; ++i)
+        {
+            totals[i] += READ_ONCE(pcpu->stats[i]);
+        }
+    }
+
+    for (i = PCPU_STATS_START; i < PCPU_STATS_END; ++i)
+    {
+        atomic64_set(&s_event_stats.stats[interval][i], totals[i]);
+    }
+}
+
+static uint64_t __ec_queue_latency(CB_EVENT_NODE *eventNode)
+{
+    int64_t elapsed_ns = (int64_t)(local_clock() - eventNode->enqueue_ns);
+
+    // The event may have been queued on a cpu whose clock is a little ahead
+    return elapsed_ns > 0 ? elapsed_ns : 0;
+}
+
+static void __ec_queue_latency_record(CB_EVENT_NODE *eventNode)
+{
+    uint64_t elapsed_ns = __ec_queue_latency(eventNode);
+    int      bucket     = elapsed_ns ? min_t(int, ilog2(elapsed_ns), QUEUE_LATENCY_BUCKETS - 1) : 0;
+
+    this_cpu_inc(s_event_stats_pcpu.queue_latency[eventNode->priority % QUEUE_PRIORITIES][bucket]);
+}
+
+// Sums the queue latency histograms of every cpu for one priority, or all of them when
+//  priority is QUEUE_PRIORITIES.  Returns the number of events.
+static uint64_t __ec_queue_latency_sum(int priority, uint64_t *latency)
+{
+    uint64_t total = 0;
+    int      cpu;
+    int      pri;
+    int      i;
+
+    memset(latency, 0, QUEUE_LATENCY_BUCKETS * sizeof(uint64_t));
+    for_each_possible_cpu(cpu)
+    {
+        CB_EVENT_STATS_PCPU *pcpu = per_cpu_ptr(&s_event_stats_pcpu, cpu);
+
+        for (pri = 0; pri < QUEUE_PRIORITIES; ++pri)
+        {
+            if (priority != QUEUE_PRIORITIES && priority != pri)
+            {
+                continue;
+            }
+            for (i = 0; i < QUEUE_LATENCY_BUCKETS; ++i)
+            {
+                latency[i] += READ_ONCE(pcpu->queue_latency[pri][i]);
+            }
+        }
+    }
+    for (i = 0; i < QUEUE_LATENCY_BUCKETS; ++i)
+    {
+        total += latency[i];
+    }
+    return total;
+}
+
+// Returns the upper bound in ns of the bucket holding the given permille of events
+static uint64_t __ec_queue_latency_percentile(uint64_t *latency, uint64_t total, int permille)
+{
+    uint64_t target = DIV_ROUND_UP(total * permille, 1000);
+    uint64_t seen   = 0;
+    int      i;
+
+    for (i = 0; i < QUEUE_LATENCY_BUCKETS - 1; ++i)
+    {
+        seen += latency[i];
+        if (seen >= target)
+        {
+            break;
+        }
+    }
+    return 1ULL << (i + 1);
+}
+
 void ec_reader_init(void)
 {
     atomic_set(&reader_pid, 0);
@@ -235,6 +367,7 @@ bool ec_user_comm_initialize(ProcessContext *context)
         atomic64_set(&s_event_stats.stats[0][i],                0);
         atomic64_set(&s_event_stats.stats[MAX_INTERVALS - 1][i], 0);
     }
+    __ec_event_stats_reset_pcpu();
     getnstimeofday(&s_event_stats.time[0]);
     kernel_mem = __ec_get_memory_usage(context);
     atomic64_set(&mem_kernel,      kernel_mem);
@@ -350,6 +483,13 @@ int ec_send_event(struct CB_EVENT *msg, ProcessContext *context)
     // Should not happen but it can
     TRY(payload >= sizeof(struct CB_EVENT_UM));
 
+    eventNode->trailer = READ_ONCE(s_event_trailer_enabled);
+    if (eventNode->trailer)
+    {
+        payload += sizeof(CB_EVENT_TRAILER);
+    }
+    // The reader is told the size in 16 bits, a larger event would overrun its buffer
+    TRY_MSG(payload <= U16_MAX, DL_WARNING, "Dropping event %d with payload %d", msg->eventType, payload);
     eventNode->payload = (uint16_t)payload;
 
     switch (msg->eventType)
@@ -362,16 +502,19 @@ int ec_send_event(struct CB_EVENT *msg, ProcessContext *context)
         tx_queue       = &msg_queue_pri0;
         tx_ready       = &tx_ready_pri0;
         max_queue_size = g_max_queue_size_pri0;
+        eventNode->priority = 0;
         break;
     case CB_EVENT_TYPE_MODULE_LOAD:
         tx_queue       = &msg_queue_pri2;
         tx_ready       = &tx_ready_pri2;
         max_queue_size = g_max_queue_size_pri2;
+        eventNode->priority = 2;
         break;
     default:
         tx_queue       = &msg_queue_pri1;
         tx_ready       = &tx_ready_pri1;
         max_queue_size = g_max_queue_size_pri1;
+        eventNode->priority = 1;
         break;
     }
 
@@ -381,6 +524,7 @@ int ec_send_event(struct CB_EVENT *msg, ProcessContext *context)
         (readyCount < max_queue_size ||
          __ec_try_to_gain_capacity(tx_queue)))
     {
+        eventNode->enqueue_ns = local_clock();
         list_add_tail(&(eventNode->listEntry), tx_queue);
         atomic64_inc(tx_ready);
         TRACE(DL_VERBOSE, "send_event_atomic %p %llu", msg, readyCount);
@@ -404,7 +548,7 @@ CATCH_DEFAULT:
     if (msg)
     {
         // If we still have an event at this point free it now
-        atomic64_inc(&tx_dropped);
+        this_cpu_inc(tx_dropped);
         TRACE(DL_INFO, "Failed event insertion");
         ec_free_event(msg, context);
     }
@@ -504,6 +648,9 @@ ssize_t ec_device_read(struct file *f,  char __user *ubuf, size_t count, loff_t
 
     BEGIN_MODULE_DISABLE_CHECK_IF_DISABLED_GOTO(&context, CATCH_DEFAULT);
 
+    // Top up P0 with the next discovery chunk once the reader has worked through the last one
+    ec_process_tracking_discovery_continue(atomic64_read(&tx_ready_pri0), &context);
+
     // When userspace is ready to handle multiple events throw this into a loop
     xcode = __ec_copy_cbevent_to_user(ubuf, count, &context);
 
@@ -566,6 +713,11 @@ int ec_obtain_next_cbevent(struct CB_EVENT **cb_event, size_t count, ProcessCont
     }
     ec_write_unlock(&dev_spinlock, context);
 
+    if (xcode >= 0)
+    {
+        __ec_queue_latency_record(eventNode);
+    }
+
 CATCH_DEFAULT:
 
     return xcode;
@@ -578,6 +730,7 @@ int __ec_copy_cbevent_to_user(char __user *ubuf, size_t count, ProcessContext *c
     uint16_t payload;
     int xcode = -ENOMEM;
     struct CB_EVENT *msg = NULL;
+    CB_EVENT_NODE *eventNode = NULL;
     struct CB_EVENT_UM __user *msg_user = (struct CB_EVENT_UM __user *)ubuf;
 
     // You *must* ask for at least 1 packet
@@ -696,6 +849,20 @@ int __ec_copy_cbevent_to_user(char __user *ubuf, size_t count, ProcessContext *c
         break;
     }
 
+    eventNode = container_of(msg, CB_EVENT_NODE, data);
+    if (eventNode->trailer)
+    {
+        CB_EVENT_TRAILER trailer = {
+            .magic          = CB_EVENT_TRAILER_MAGIC,
+            .queue_priority = eventNode->priority,
+            .queue_ns       = __ec_queue_latency(eventNode),
+        };
+
+        rc = copy_to_user(p, &trailer, sizeof(trailer));
+        TRY_STEP(COPY_FAIL, !rc);
+        p += sizeof(trailer);
+    }
+
     if (p - ubuf != payload)
     {
         TRACE(DL_ERROR, "%s: Offset:%u Payload:%u", __func__,
@@ -706,18 +873,18 @@ int __ec_copy_cbevent_to_user(char __user *ubuf, size_t count, ProcessContext *c
 
     xcode = payload;
 
-    atomic64_inc(&tx_total);
+    this_cpu_inc(tx_total);
 
     switch (msg->eventType)
     {
     case CB_EVENT_TYPE_PROCESS_START:
     case CB_EVENT_TYPE_PROCESS_EXIT:
     case CB_EVENT_TYPE_PROCESS_LAST_EXIT:
-        atomic64_inc(&tx_process);
+        this_cpu_inc(tx_process);
         break;
 
     case CB_EVENT_TYPE_MODULE_LOAD:
-        atomic64_inc(&tx_modload);
+        this_cpu_inc(tx_modload);
         break;
 
     case CB_EVENT_TYPE_FILE_CREATE:
@@ -725,26 +892,26 @@ int __ec_copy_cbevent_to_user(char __user *ubuf, size_t count, ProcessContext *c
     case CB_EVENT_TYPE_FILE_WRITE:
     case CB_EVENT_TYPE_FILE_CLOSE:
     case CB_EVENT_TYPE_FILE_OPEN:
-        atomic64_inc(&tx_file);
+        this_cpu_inc(tx_file);
         break;
 
     case CB_EVENT_TYPE_NET_CONNECT_PRE:
     case CB_EVENT_TYPE_NET_CONNECT_POST:
     case CB_EVENT_TYPE_NET_ACCEPT:
-        atomic64_inc(&tx_net);
+        this_cpu_inc(tx_net);
         break;
 
     case CB_EVENT_TYPE_DNS_RESPONSE:
-        atomic64_inc(&tx_dns);
+        this_cpu_inc(tx_dns);
         break;
 
     case CB_EVENT_TYPE_WEB_PROXY:
-        atomic64_inc(&tx_proxy);
+        this_cpu_inc(tx_proxy);
         break;
 
     case CB_EVENT_TYPE_PROCESS_BLOCKED:
     case CB_EVENT_TYPE_PROCESS_NOT_BLOCKED:
-        atomic64_inc(&tx_block);
+        this_cpu_inc(tx_block);
         break;
 
     case CB_EVENT_TYPE_PROC_ANALYZE:
@@ -752,7 +919,7 @@ int __ec_copy_cbevent_to_user(char __user *ubuf, size_t count, ProcessContext *c
     case CB_EVENT_TYPE_MAX:
     case CB_EVENT_TYPE_UNKNOWN:
     default:
-        atomic64_inc(&tx_other);
+        this_cpu_inc(tx_other);
         break;
     }
 
@@ -846,6 +1013,8 @@ int ec_device_open(struct inode *inode, struct file *filp)
 
 int ec_device_release(struct inode *inode, struct file *filp)
 {
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
     TRACE(DL_INFO, "%s: releasing device from pid[%d]; reader_pid[%d]", __func__, ec_getpid(current), atomic_read(&reader_pid));
 
     if (!ec_disconnect_reader(ec_getpid(current)))
@@ -853,6 +1022,12 @@ int ec_device_release(struct inode *inode, struct file *filp)
         return -ECONNREFUSED;
     }
 
+    // The next reader has to ask for the trailer again
+    WRITE_ONCE(s_event_trailer_enabled, false);
+
+    // Nobody is left to pull the rest of the discovery
+    ec_process_tracking_discovery_stop(&context);
+
     return 0;
 }
 
@@ -860,6 +1035,15 @@ unsigned int ec_device_poll(struct file *filp, struct poll_table_struct *pts)
 {
     uint64_t qlen;
 
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    // The reader may have emptied the queue and be waiting here for the next discovery chunk
+    BEGIN_MODULE_DISABLE_CHECK_IF_DISABLED_GOTO(&context, CATCH_DISABLED);
+    ec_process_tracking_discovery_continue(atomic64_read(&tx_ready_pri0), &context);
+
+CATCH_DISABLED:
+    FINISH_MODULE_DISABLE_CHECK(&context);
+
     // Check if data is available and lets go
     qlen = atomic64_read(&tx_ready_pri0) + atomic64_read(&tx_ready_pri1) + atomic64_read(&tx_ready_pri2);
 
@@ -976,6 +1160,23 @@ long ec_device_unlocked_ioctl(struct file *filep, unsigned int cmd_in, unsigned
         }
         break;
 
+    case CB_DRIVER_REQUEST_CLR_IGNORED_UID:
+        {
+            uid_t uid = (uid_t)data.value;
+
+            TRACE(DL_INFO, "Received clear uid=%u", uid);
+            ec_banning_ClearIgnoredUid(&context, uid);
+        }
+        break;
+
+    case CB_DRIVER_REQUEST_SET_EVENT_TRAILER:
+        {
+            // Only events queued from now on change size
+            TRACE(DL_INFO, "Received event trailer=%u", data.value);
+            WRITE_ONCE(s_event_trailer_enabled, data.value != 0);
+        }
+        break;
+
     case CB_DRIVER_REQUEST_IGNORE_SERVER:
         {
             uid_t uid = (uid_t)data.value;
@@ -998,6 +1199,15 @@ long ec_device_unlocked_ioctl(struct file *filep, unsigned int cmd_in, unsigned
         }
         break;
 
+    case CB_DRIVER_REQUEST_CLR_IGNORED_PID:
+        {
+            pid_t pid = (pid_t)data.value;
+
+            TRACE(DL_INFO, "Received clear trusted pid=%u", pid);
+            ec_banning_ClearIgnoredProcess(&context, pid);
+        }
+        break;
+
     case CB_DRIVER_REQUEST_ISOLATION_MODE_CONTROL:
         {
             ec_ProcessIsolationIoctl(&context, IOCTL_SET_ISOLATION_MODE, (void *)data.dynControl.data, data.dynControl.size);
@@ -1083,6 +1293,24 @@ long ec_device_unlocked_ioctl(struct file *filep, unsigned int cmd_in, unsigned
         }
         break;
 
+    case CB_DRIVER_REQUEST_SET_BANNED_INODE_LIST:
+        {
+            return __ec_set_banned_inode_list(&context, &data.dynControl);
+        }
+        break;
+
+    case CB_DRIVER_REQUEST_PERM_RESPONSE_LIST:
+        {
+            return __ec_perm_response_list(&context, &data.dynControl, false);
+        }
+        break;
+
+    case CB_DRIVER_REQUEST_PERM_ABORT_LIST:
+        {
+            return __ec_perm_response_list(&context, &data.dynControl, true);
+        }
+        break;
+
     case CB_DRIVER_REQUEST_PROTECTION_ENABLED:
         {
             ec_banning_SetProtectionState(&context, (uint32_t)data.value);
@@ -1098,7 +1326,10 @@ long ec_device_unlocked_ioctl(struct file *filep, unsigned int cmd_in, unsigned
     case CB_DRIVER_REQUEST_SET_TRUSTED_PATH:
         {
             PCB_TRUSTED_PATH pathData = (PCB_TRUSTED_PATH)page;
+            int              xcode;
 
+            // The struct is one byte larger than the page, so keep the last byte for the terminator
+            size = min_t(size_t, size, PAGE_SIZE - 1);
             if (copy_from_user(page, (void *)arg, size))
             {
                 TRACE(DL_ERROR, "%s: failed to copy arg", __func__);
@@ -1106,8 +1337,21 @@ long ec_device_unlocked_ioctl(struct file *filep, unsigned int cmd_in, unsigned
                 return -ENOMEM;
             }
 
+            pathData->path[size] = 0;
             TRACE(DL_INFO, "pathData=%p path=%s", pathData, pathData->path);
+            xcode = ec_trusted_path_set(pathData->path, &context);
             free_page((unsigned long)page);
+            if (xcode < 0)
+            {
+                return xcode;
+            }
+        }
+        break;
+
+    case CB_DRIVER_REQUEST_SET_SPECIAL_FILES:
+    case CB_DRIVER_REQUEST_SET_INTERPRETER_NAMES:
+        {
+            return __ec_set_name_list(&context, cmd, &data.dynControl);
         }
         break;
 
@@ -1143,6 +1387,107 @@ long ec_device_unlocked_ioctl(struct file *filep, unsigned int cmd_in, unsigned
 }
 
 
+// Replaces one of the prefix matched name lists with a list of NUL terminated names.
+//  An empty list restores the built in defaults.
+long __ec_set_name_list(ProcessContext *context, unsigned int cmd, CB_EVENT_DYNAMIC *dynControl)
+{
+    long  xcode = 0;
+    char *list  = NULL;
+    bool  loaded;
+
+    TRY_SET_MSG(dynControl->size <= PREFIX_TRIE_MAX_LIST_SIZE, -EINVAL,
+                DL_ERROR, "%s: name list too large %zu", __func__, dynControl->size);
+
+    if (dynControl->size)
+    {
+        list = ec_mem_cache_alloc_generic(dynControl->size, context);
+        TRY_SET(list, -ENOMEM);
+
+        TRY_SET_MSG(!copy_from_user(list, (void *)dynControl->data, dynControl->size), -ENOMEM,
+                    DL_ERROR, "%s: failed to copy arg", __func__);
+    }
+
+    if (cmd == CB_DRIVER_REQUEST_SET_SPECIAL_FILES)
+    {
+        loaded = ec_special_files_set(list, dynControl->size, context);
+    } else
+    {
+        loaded = ec_process_tracking_set_interpreter_names(list, dynControl->size, context);
+    }
+    TRY_SET_MSG(loaded, -EINVAL, DL_ERROR, "%s: failed to load name list cmd=%d", __func__, cmd);
+
+    TRACE(DL_INFO, "%s: loaded name list cmd=%d size=%zu", __func__, cmd, dynControl->size);
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(list);
+    return xcode;
+}
+
+// Loads a CB_PROTECTION_LIST in one call instead of KERNMSG_MAX inodes per ioctl
+long __ec_set_banned_inode_list(ProcessContext *context, CB_EVENT_DYNAMIC *dynControl)
+{
+    long                xcode = 0;
+    PCB_PROTECTION_LIST list  = NULL;
+    int64_t             added;
+
+    TRY_SET_MSG(dynControl->size >= sizeof(CB_PROTECTION_LIST) &&
+                dynControl->size <= sizeof(CB_PROTECTION_LIST) + CB_PROTECTION_LIST_MAX * sizeof(protectionData),
+                -EINVAL, DL_ERROR, "%s: invalid ban list size %zu", __func__, dynControl->size);
+
+    list = ec_mem_cache_valloc_generic(dynControl->size, context);
+    TRY_SET(list, -ENOMEM);
+
+    TRY_SET_MSG(!copy_from_user(list, (void *)dynControl->data, dynControl->size), -ENOMEM,
+                DL_ERROR, "%s: failed to copy arg", __func__);
+
+    TRY_SET_MSG(list->count <= CB_PROTECTION_LIST_MAX &&
+                sizeof(CB_PROTECTION_LIST) + list->count * sizeof(protectionData) <= dynControl->size,
+                -EINVAL, DL_ERROR, "%s: ban list count %u does not fit size %zu", __func__, list->count, dynControl->size);
+
+    added = ec_banning_SetBannedProcessInodeList(context, list);
+    TRY_SET(added >= 0, added);
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(list);
+    return xcode;
+}
+
+// Resumes every stalled task in the list with one call instead of one call per decision,
+//  or aborts their stalls when userspace can not decide.  Returns the number of tasks woken up.
+long __ec_perm_response_list(ProcessContext *context, CB_EVENT_DYNAMIC *dynControl, bool abort)
+{
+    long                     xcode     = 0;
+    struct CB_PERM_RESPONSE *responses = NULL;
+    int                      count;
+
+    TRY_SET_MSG(dynControl->size &&
+                dynControl->size <= CB_PERM_RESPONSE_LIST_MAX * sizeof(struct CB_PERM_RESPONSE) &&
+                !(dynControl->size % sizeof(struct CB_PERM_RESPONSE)),
+                -EINVAL, DL_ERROR, "%s: invalid response list size %zu", __func__, dynControl->size);
+
+    count = dynControl->size / sizeof(struct CB_PERM_RESPONSE);
+
+    responses = ec_mem_cache_valloc_generic(dynControl->size, context);
+    TRY_SET(responses, -ENOMEM);
+
+    TRY_SET_MSG(!copy_from_user(responses, (void *)dynControl->data, dynControl->size), -ENOMEM,
+                DL_ERROR, "%s: failed to copy arg", __func__);
+
+    if (abort)
+    {
+        xcode = ec_stall_event_abort_batch(responses, count, context);
+    } else
+    {
+        xcode = ec_stall_event_resume_batch(responses, count, context);
+    }
+
+    TRACE(DL_INFO, "%s: %s %ld of %d stalled tasks", __func__, abort ? "aborted" : "resumed", xcode, count);
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(responses);
+    return xcode;
+}
+
 bool __ec_is_ioctl_allowed(ModuleState module_state, unsigned int cmd)
 {
     return (module_state == ModuleStateEnabled || cmd == CB_DRIVER_REQUEST_ACTION);
@@ -1290,6 +1635,7 @@ void ec_stats_work_task(struct work_struct *work)
     atomic64_add(ready0 + ready1, &tx_queued_t);
 
     // Copy over the current total to the next interval
+    __ec_event_stats_fold(curr);
     for (i = 0; i < NUM_STATS; ++i)
     {
         atomic64_set(&s_event_stats.stats[next][i], atomic64_read(&s_event_stats.stats[curr][i]));
@@ -1321,6 +1667,8 @@ int ec_proc_show_events_avg(struct seq_file *m, void *v)
 
     int         i;
 
+    __ec_event_stats_fold(curr % MAX_INTERVALS);
+
     if (valid == 0)
     {
         seq_puts(m, "No Data\n");
@@ -1352,6 +1700,27 @@ int ec_proc_show_events_avg(struct seq_file *m, void *v)
     return 0;
 }
 
+// Queue latency is counted from the last reset rather than per interval
+static void __ec_show_queue_latency(struct seq_file *m)
+{
+    uint64_t latency[QUEUE_LATENCY_BUCKETS];
+    uint64_t total = __ec_queue_latency_sum(QUEUE_PRIORITIES, latency);
+
+    seq_printf(m, "\n %19s | %12s | %12s | %12s | %12s | %12s |\n",
+               "Queue Latency", "Events", "P50(ns)", "P90(ns)", "P99(ns)", "P99.9(ns)");
+    if (!total)
+    {
+        seq_printf(m, " %19s | %12d | %12s | %12s | %12s | %12s |\n", "", 0, "-", "-", "-", "-");
+        return;
+    }
+    seq_printf(m, " %19s | %12llu | %12llu | %12llu | %12llu | %12llu |\n", "",
+               total,
+               __ec_queue_latency_percentile(latency, total, 500),
+               __ec_queue_latency_percentile(latency, total, 900),
+               __ec_queue_latency_percentile(latency, total, 990),
+               __ec_queue_latency_percentile(latency, total, 999));
+}
+
 int ec_proc_show_events_det(struct seq_file *m, void *v)
 {
     // I add MAX_INTERVALS to some of the items below so that when I subtract 1 it will
@@ -1362,9 +1731,12 @@ int ec_proc_show_events_det(struct seq_file *m, void *v)
     int         i;
     int         j;
 
+    __ec_event_stats_fold(curr);
+
     if (valid == 0)
     {
         seq_puts(m, "No Data\n");
+        __ec_show_queue_latency(m);
         return 0;
     }
     //seq_printf(m, "Curr = %d, valid = %d, start = %d\n", curr, valid, start - MAX_INTERVALS );
@@ -1389,6 +1761,63 @@ int ec_proc_show_events_det(struct seq_file *m, void *v)
         seq_puts(m, "\n");
     }
 
+    __ec_show_queue_latency(m);
+
+    return 0;
+}
+
+// Print how long events sat in each queue before being read.  The histogram columns hold
+//  events that waited at least the given time and less than twice that.
+int ec_proc_show_queue_latency(struct seq_file *m, void *v)
+{
+    static const char * const names[QUEUE_PRIORITIES] = { "P0", "P1", "P2" };
+    uint64_t latency[QUEUE_PRIORITIES][QUEUE_LATENCY_BUCKETS];
+    int      pri;
+    int      i;
+
+    seq_printf(m, " %5s | %12s | %12s | %12s | %12s | %12s | %12s |\n",
+               "Queue", "Events", "Queued", "P50(ns)", "P90(ns)", "P99(ns)", "P99.9(ns)");
+    for (pri = 0; pri < QUEUE_PRIORITIES; ++pri)
+    {
+        uint64_t total = __ec_queue_latency_sum(pri, latency[pri]);
+        uint64_t ready = atomic64_read(pri == 0 ? &tx_ready_pri0 : (pri == 1 ? &tx_ready_pri1 : &tx_ready_pri2));
+
+        if (!total)
+        {
+            seq_printf(m, " %5s | %12d | %12llu | %12s | %12s | %12s | %12s |\n",
+                       names[pri], 0, ready, "-", "-", "-", "-");
+            continue;
+        }
+        seq_printf(m, " %5s | %12llu | %12llu | %12llu | %12llu | %12llu | %12llu |\n",
+                   names[pri], total, ready,
+                   __ec_queue_latency_percentile(latency[pri], total, 500),
+                   __ec_queue_latency_percentile(latency[pri], total, 900),
+                   __ec_queue_latency_percentile(latency[pri], total, 990),
+                   __ec_queue_latency_percentile(latency[pri], total, 999));
+    }
+
+    seq_printf(m, "\n %12s |", "Waited(ns)");
+    for (pri = 0; pri < QUEUE_PRIORITIES; ++pri)
+    {
+        seq_printf(m, " %12s |", names[pri]);
+    }
+    seq_puts(m, "\n");
+
+    for (i = 0; i < QUEUE_LATENCY_BUCKETS; ++i)
+    {
+        if (!latency[0][i] && !latency[1][i] && !latency[2][i])
+        {
+            continue;
+        }
+
+        seq_printf(m, " %12llu |", i ? 1ULL << i : 0ULL);
+        for (pri = 0; pri < QUEUE_PRIORITIES; ++pri)
+        {
+            seq_printf(m, " %12llu |", latency[pri][i]);
+        }
+        seq_puts(m, "\n");
+    }
+
     return 0;
 }
 
@@ -1408,6 +1837,7 @@ ssize_t ec_proc_show_events_rst(struct file *file, const char *buf, size_t size,
         atomic64_set(&s_event_stats.stats[0][i],                0);
         atomic64_set(&s_event_stats.stats[MAX_INTERVALS - 1][i], 0);
     }
+    __ec_event_stats_reset_pcpu();
     getnstimeofday(&s_event_stats.time[0]);
 
     // Resatrt the job from now
@@ -1420,6 +1850,8 @@ int ec_proc_current_memory_avg(struct seq_file *m, void *v)
     // I add MAX_INTERVALS to some of the items below so that when I subtract 1 it will
     //  still be a positive number.  The modulus math will clean it up later.
     uint32_t    curr    = atomic_read(&s_event_stats.curr);
+    uint64_t    path_buffers_fast     = 0;
+    uint64_t    path_buffers_fallback = 0;
 
     int         i;
 
@@ -1435,6 +1867,9 @@ int ec_proc_current_memory_avg(struct seq_file *m, void *v)
 
     seq_puts(m, "\n");
 
+    ec_path_buffers_get_stats(&path_buffers_fast, &path_buffers_fallback);
+    seq_printf(m, "path buffers: %llu per-cpu %llu pool\n", path_buffers_fast, path_buffers_fallback);
+
     return 0;
 }
 
@@ -7,6 +7,12 @@
 #include "process-context.h"
 #include "priv.h"
 
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)  //{
+#include <linux/sched/clock.h>
+#endif  //}
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)  //{
 #define CURRENT_TIME_SEC ((struct timespec) { get_seconds(), 0 })
 #endif  //}
@@ -17,15 +23,38 @@ static struct ec_hook_tracking_node
     struct list_head  hook_list;
 } s_hook_tracking;
 
+typedef struct hook_latency {
+    uint64_t  total_ns;
+    uint64_t  buckets[HOOK_LATENCY_BUCKETS];
+} HookLatency;
+
+typedef struct hook_latency_table {
+    HookLatency  hooks[HOOK_LATENCY_MAX_HOOKS];
+} HookLatencyTable;
+
+// Slot 0 is never handed out so that a zero hook_latency_id means unassigned
+static HookLatencyTable __percpu *s_hook_latency;
+static const char               *s_hook_latency_names[HOOK_LATENCY_MAX_HOOKS];
+static int                       s_hook_latency_count = 1;
+
 bool ec_hook_tracking_initialize(ProcessContext *context)
 {
     INIT_LIST_HEAD(&(s_hook_tracking.hook_list));
     ec_spinlock_init(&s_hook_tracking.lock, context);
+
+    // Hooks still run without latency tracking if this fails
+    s_hook_latency = alloc_percpu(HookLatencyTable);
+    if (!s_hook_latency)
+    {
+        TRACE(DL_WARNING, "%s: failed to allocate the hook latency table", __func__);
+    }
     return true;
 }
 
 void ec_hook_tracking_shutdown(ProcessContext *context)
 {
+    free_percpu(s_hook_latency);
+    s_hook_latency = NULL;
     ec_spinlock_destroy(&s_hook_tracking.lock, context);
 }
 
@@ -49,9 +78,44 @@ void ec_hook_tracking_add_entry(ProcessContext *context, const char *hook_name)
         ec_write_unlock(&s_hook_tracking.lock, context);
     }
 
+    if (context->hook_latency_id && !*context->hook_latency_id)
+    {
+        ec_write_lock(&s_hook_tracking.lock, context);
+        // Hooks past the end of the table are not timed
+        if (!*context->hook_latency_id && s_hook_latency_count < HOOK_LATENCY_MAX_HOOKS)
+        {
+            s_hook_latency_names[s_hook_latency_count] = hook_name;
+            *context->hook_latency_id = s_hook_latency_count++;
+        }
+        ec_write_unlock(&s_hook_tracking.lock, context);
+    }
+
     atomic64_inc(&context->percpu_hook_tracking->count);
     atomic64_set(&context->percpu_hook_tracking->last_enter_time, CURRENT_TIME_SEC.tv_sec);
     atomic64_set(&context->percpu_hook_tracking->last_pid, context->pid);
+
+    // local_clock is cheap enough to leave on, but is only monotonic per cpu
+    context->hook_enter_ns = local_clock();
+}
+
+static inline int __ec_hook_latency_bucket(uint64_t elapsed_ns)
+{
+    return elapsed_ns ? min_t(int, ilog2(elapsed_ns), HOOK_LATENCY_BUCKETS - 1) : 0;
+}
+
+static void __ec_hook_latency_record(int id, uint64_t enter_ns)
+{
+    int64_t elapsed_ns = (int64_t)(local_clock() - enter_ns);
+
+    // We may have moved to a cpu whose clock is a little behind
+    if (elapsed_ns < 0)
+    {
+        elapsed_ns = 0;
+    }
+
+    // Counted on whichever cpu we finish on, the readers sum all of them
+    this_cpu_add(s_hook_latency->hooks[id].total_ns, elapsed_ns);
+    this_cpu_inc(s_hook_latency->hooks[id].buckets[__ec_hook_latency_bucket(elapsed_ns)]);
 }
 
 void ec_hook_tracking_del_entry(ProcessContext *context)
@@ -62,6 +126,15 @@ void ec_hook_tracking_del_entry(ProcessContext *context)
     ATOMIC64_DEC__CHECK_NEG(&context->percpu_hook_tracking->count);
     atomic64_set(&context->percpu_hook_tracking->last_enter_time, 0);
     atomic64_set(&context->percpu_hook_tracking->last_pid, 0);
+
+    if (context->hook_enter_ns)
+    {
+        if (s_hook_latency && context->hook_latency_id && *context->hook_latency_id)
+        {
+            __ec_hook_latency_record(*context->hook_latency_id, context->hook_enter_ns);
+        }
+        context->hook_enter_ns = 0;
+    }
 }
 
 // This will be called in the module disable logic when we need to wait for hooks
@@ -116,3 +189,130 @@ int ec_show_active_hooks(struct seq_file *seq_file, void *v)
 
     return 0;
 }
+
+// Returns the upper bound in ns of the bucket holding the given percentile
+static uint64_t __ec_hook_latency_percentile(uint64_t *latency, uint64_t total, int percent)
+{
+    uint64_t target = DIV_ROUND_UP(total * percent, 100);
+    uint64_t seen   = 0;
+    int      i;
+
+    for (i = 0; i < HOOK_LATENCY_BUCKETS; ++i)
+    {
+        seen += latency[i];
+        if (seen >= target)
+        {
+            break;
+        }
+    }
+    return 1ULL << (min_t(int, i, HOOK_LATENCY_BUCKETS - 1) + 1);
+}
+
+static void __ec_hook_latency_sum(int id, uint64_t *buckets, uint64_t *total_ns)
+{
+    int cpu;
+    int i;
+
+    memset(buckets, 0, HOOK_LATENCY_BUCKETS * sizeof(uint64_t));
+    *total_ns = 0;
+
+    for_each_possible_cpu(cpu)
+    {
+        HookLatency *latency = &per_cpu_ptr(s_hook_latency, cpu)->hooks[id];
+
+        *total_ns += latency->total_ns;
+        for (i = 0; i < HOOK_LATENCY_BUCKETS; ++i)
+        {
+            buckets[i] += latency->buckets[i];
+        }
+    }
+}
+
+void ec_hook_latency_get(ProcessContext *context, uint64_t *buckets, uint64_t *total_ns)
+{
+    CANCEL_VOID(context && buckets && total_ns);
+
+    memset(buckets, 0, HOOK_LATENCY_BUCKETS * sizeof(uint64_t));
+    *total_ns = 0;
+
+    if (s_hook_latency && context->hook_latency_id && *context->hook_latency_id)
+    {
+        __ec_hook_latency_sum(*context->hook_latency_id, buckets, total_ns);
+    }
+}
+
+// This is called when reading the hook-latency proc file
+int ec_show_hook_latency(struct seq_file *seq_file, void *v)
+{
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    uint64_t latency[HOOK_LATENCY_BUCKETS];
+    int      count;
+    int      id;
+
+    seq_printf(seq_file, "%25s | %10s | %10s | %10s | %10s | %10s\n",
+                "HOOK", "CALLS", "AVG(ns)", "P50(ns)", "P99(ns)", "MAX(ns)");
+
+    CANCEL(s_hook_latency, 0);
+
+    ec_read_lock(&s_hook_tracking.lock, &context);
+    count = s_hook_latency_count;
+    ec_read_unlock(&s_hook_tracking.lock, &context);
+
+    for (id = 1; id < count; ++id)
+    {
+        uint64_t total    = 0;
+        uint64_t total_ns = 0;
+        int      max      = 0;
+        int      i;
+
+        __ec_hook_latency_sum(id, latency, &total_ns);
+
+        for (i = 0; i < HOOK_LATENCY_BUCKETS; ++i)
+        {
+            total += latency[i];
+            max    = latency[i] ? i : max;
+        }
+        if (!total)
+        {
+            continue;
+        }
+
+        seq_printf(seq_file, "%25s | %10llu | %10llu | %10llu | %10llu | %10llu\n",
+                      s_hook_latency_names[id],
+                      total,
+                      total_ns / total,
+                      __ec_hook_latency_percentile(latency, total, 50),
+                      __ec_hook_latency_percentile(latency, total, 99),
+                      1ULL << (max + 1));
+
+        // The histogram is printed as "<bucket lower bound in ns>:<count>" for the used buckets
+        seq_printf(seq_file, "%25s |", "");
+        for (i = 0; i < HOOK_LATENCY_BUCKETS; ++i)
+        {
+            if (latency[i])
+            {
+                seq_printf(seq_file, " %llu:%llu", i ? 1ULL << i : 0ULL, latency[i]);
+            }
+        }
+        seq_puts(seq_file, "\n");
+    }
+
+    return 0;
+}
+
+// Any write to the hook-latency proc file clears the histograms
+ssize_t ec_reset_hook_latency(struct file *file, const char *buf, size_t size, loff_t *ppos)
+{
+    int cpu;
+
+    if (s_hook_latency)
+    {
+        for_each_possible_cpu(cpu)
+        {
+            memset(per_cpu_ptr(s_hook_latency, cpu), 0, sizeof(HookLatencyTable));
+        }
+    }
+
+    return size;
+}
@@ -19,3 +19,13 @@ void ec_hook_tracking_shutdown(ProcessContext *context);
 void ec_hook_tracking_add_entry(ProcessContext *context, const char *hook_name);
 void ec_hook_tracking_del_entry(ProcessContext *context);
 int ec_hook_tracking_print_active(ProcessContext *context);
+
+// Hook latency is bucketed by log2 of the nanoseconds spent in the hook, the last
+//  bucket collects everything slower.  The histograms live in one per-cpu table
+//  allocated at load and indexed by a per-hook id, so they do not take space from
+//  the static per-cpu reserve of the module.
+#define HOOK_LATENCY_BUCKETS    32
+#define HOOK_LATENCY_MAX_HOOKS  96
+
+// Sums the histogram of the hook that context was declared in over all cpus
+void ec_hook_latency_get(ProcessContext *context, uint64_t *buckets, uint64_t *total_ns);
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "id-set.h"
+
+#include <linux/jhash.h>
+#include <linux/rcupdate.h>
+
+// Ids are stored off by one so that 0 can mark an empty slot
+#define ID_SET_EMPTY      0ULL
+#define ID_SET_TOMBSTONE  U64_MAX
+#define ID_SET_VALUE(id)  ((uint64_t)(id) + 1)
+
+static inline uint32_t __ec_id_set_hash(uint32_t id)
+{
+    return jhash_1word(id, 0);
+}
+
+// Returns the slot holding value, or -1.  Probing stops at the first empty slot and never
+//  visits a slot twice.
+static int64_t __ec_id_set_find(atomic64_t *slots, uint32_t mask, uint64_t value)
+{
+    uint32_t start = __ec_id_set_hash((uint32_t)(value - 1));
+    uint32_t i;
+
+    for (i = 0; i <= mask; ++i)
+    {
+        uint32_t idx  = (start + i) & mask;
+        uint64_t slot = atomic64_read(&slots[idx]);
+
+        if (slot == value)
+        {
+            return idx;
+        } else if (slot == ID_SET_EMPTY)
+        {
+            break;
+        }
+    }
+    return -1;
+}
+
+// Caller holds set->lock.  There is always room because a set is never more than 3/4 full.
+static void __ec_id_set_insert(IdSet *set, atomic64_t *slots, uint64_t value)
+{
+    uint32_t start = __ec_id_set_hash((uint32_t)(value - 1));
+    uint32_t i;
+
+    for (i = 0; i <= set->mask; ++i)
+    {
+        uint32_t idx  = (start + i) & set->mask;
+        uint64_t slot = atomic64_read(&slots[idx]);
+
+        if (slot == ID_SET_EMPTY || slot == ID_SET_TOMBSTONE)
+        {
+            set->tombstones -= (slot == ID_SET_TOMBSTONE);
+            atomic64_set(&slots[idx], value);
+            return;
+        }
+    }
+}
+
+// Caller holds set->lock and set->rehash_lock, and must wait for an RCU grace period after
+//  dropping set->lock so that no reader is left on the old buffer before it is reused.
+static void __ec_id_set_rehash(IdSet *set)
+{
+    atomic64_t *old   = set->slots;
+    atomic64_t *slots = (old == set->buffers[0] ? set->buffers[1] : set->buffers[0]);
+    uint32_t    i;
+
+    for (i = 0; i <= set->mask; ++i)
+    {
+        atomic64_set(&slots[i], ID_SET_EMPTY);
+    }
+
+    set->tombstones = 0;
+    for (i = 0; i <= set->mask; ++i)
+    {
+        uint64_t slot = atomic64_read(&old[i]);
+
+        if (slot != ID_SET_EMPTY && slot != ID_SET_TOMBSTONE)
+        {
+            __ec_id_set_insert(set, slots, slot);
+        }
+    }
+
+    rcu_assign_pointer(set->slots, slots);
+}
+
+bool ec_id_set_contains(IdSet *set, uint32_t id)
+{
+    bool found;
+
+    if (!atomic_read(&set->count))
+    {
+        return false;
+    }
+
+    rcu_read_lock();
+    found = __ec_id_set_find(rcu_dereference(set->slots), set->mask, ID_SET_VALUE(id)) >= 0;
+    rcu_read_unlock();
+
+    return found;
+}
+
+bool ec_id_set_add(IdSet *set, uint32_t id)
+{
+    bool          result   = true;
+    bool          rehashed = false;
+    unsigned long flags;
+
+    mutex_lock(&set->rehash_lock);
+    spin_lock_irqsave(&set->lock, flags);
+
+    if (__ec_id_set_find(set->slots, set->mask, ID_SET_VALUE(id)) >= 0)
+    {
+        goto unlock;
+    }
+
+    if (atomic_read(&set->count) >= set->max_entries)
+    {
+        result = false;
+        goto unlock;
+    }
+
+    if ((atomic_read(&set->count) + set->tombstones + 1) * 4 > (set->mask + 1) * 3)
+    {
+        __ec_id_set_rehash(set);
+        rehashed = true;
+    }
+
+    __ec_id_set_insert(set, set->slots, ID_SET_VALUE(id));
+    atomic_inc(&set->count);
+
+unlock:
+    spin_unlock_irqrestore(&set->lock, flags);
+    if (rehashed)
+    {
+        synchronize_rcu();
+    }
+    mutex_unlock(&set->rehash_lock);
+
+    return result;
+}
+
+bool ec_id_set_remove(IdSet *set, uint32_t id)
+{
+    int64_t       idx;
+    unsigned long flags;
+
+    if (!atomic_read(&set->count))
+    {
+        return false;
+    }
+
+    spin_lock_irqsave(&set->lock, flags);
+
+    idx = __ec_id_set_find(set->slots, set->mask, ID_SET_VALUE(id));
+    if (idx >= 0)
+    {
+        uint32_t i = (uint32_t)idx;
+
+        // At the end of a probe chain the slot can go back to empty, along with any
+        //  tombstones directly before it.  Otherwise leave a tombstone so probes continue.
+        if (atomic64_read(&set->slots[(i + 1) & set->mask]) == ID_SET_EMPTY)
+        {
+            atomic64_set(&set->slots[i], ID_SET_EMPTY);
+            for (i = (i - 1) & set->mask;
+                 set->tombstones && atomic64_read(&set->slots[i]) == ID_SET_TOMBSTONE;
+                 i = (i - 1) & set->mask)
+            {
+                atomic64_set(&set->slots[i], ID_SET_EMPTY);
+                set->tombstones -= 1;
+            }
+        } else
+        {
+            atomic64_set(&set->slots[i], ID_SET_TOMBSTONE);
+            set->tombstones += 1;
+        }
+        atomic_dec(&set->count);
+    }
+
+    spin_unlock_irqrestore(&set->lock, flags);
+
+    return idx >= 0;
+}
+
+void ec_id_set_clear(IdSet *set)
+{
+    unsigned long flags;
+    uint32_t      i;
+
+    mutex_lock(&set->rehash_lock);
+    spin_lock_irqsave(&set->lock, flags);
+
+    atomic_set(&set->count, 0);
+    set->tombstones = 0;
+    for (i = 0; i <= set->mask; ++i)
+    {
+        atomic64_set(&set->slots[i], ID_SET_EMPTY);
+    }
+
+    spin_unlock_irqrestore(&set->lock, flags);
+    mutex_unlock(&set->rehash_lock);
+}
+
+uint32_t ec_id_set_count(IdSet *set)
+{
+    return atomic_read(&set->count);
+}
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#pragma once
+
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
+#include "process-context.h"
+
+// id-set is a small open addressed hash set of 32 bit ids (pids, uids) that hooks check on
+//  every event. Lookups take no lock. Removal only takes a spinlock so it is safe from any
+//  context, but ec_id_set_add and ec_id_set_clear may sleep.
+//
+// Storage is static and double buffered. A removed id leaves a tombstone behind, and when
+//  there are too many of them the live ids are rehashed into the other buffer, which is
+//  then published with RCU.
+
+typedef struct id_set {
+    const char   *name;
+    atomic64_t   *slots;       // active buffer
+    atomic64_t   *buffers[2];
+    uint32_t      mask;
+    uint32_t      max_entries;
+    uint32_t      tombstones;
+    atomic_t      count;
+    spinlock_t    lock;
+    struct mutex  rehash_lock;
+} IdSet;
+
+// MAX_ENTRIES must be a power of two. Twice as many slots are reserved to keep probes short.
+#define DEFINE_ID_SET(NAME, MAX_ENTRIES) \
+    static atomic64_t NAME##_slots[2][2 * (MAX_ENTRIES)]; \
+    static IdSet NAME = { \
+        .name        = #NAME, \
+        .slots       = NAME##_slots[0], \
+        .buffers     = { NAME##_slots[0], NAME##_slots[1] }, \
+        .mask        = 2 * (MAX_ENTRIES) - 1, \
+        .max_entries = (MAX_ENTRIES), \
+        .tombstones  = 0, \
+        .count       = ATOMIC_INIT(0), \
+        .lock        = __SPIN_LOCK_UNLOCKED(NAME.lock), \
+        .rehash_lock = __MUTEX_INITIALIZER(NAME.rehash_lock), \
+    }
+
+bool ec_id_set_contains(IdSet *set, uint32_t id);
+bool ec_id_set_add(IdSet *set, uint32_t id);
+bool ec_id_set_remove(IdSet *set, uint32_t id);
+void ec_id_set_clear(IdSet *set);
+uint32_t ec_id_set_count(IdSet *set);
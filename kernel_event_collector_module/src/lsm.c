@@ -47,6 +47,10 @@ extern int ec_lsm_socket_recvmsg(struct socket *sock, struct msghdr *msg, int si
 extern int ec_lsm_socket_post_create(struct socket *sock, int family, int type, int protocol, int kern);
 extern int ec_lsm_socket_bind(struct socket *sock, struct sockaddr *address, int addrlen);
 extern void ec_lsm_file_free_security(struct file *file);
+extern void ec_lsm_sk_free_security(struct sock *sk);
+extern int ec_lsm_inode_rename(struct inode *old_dir, struct dentry *old_dentry,
+                               struct inode *new_dir, struct dentry *new_dentry);
+extern int ec_lsm_inode_unlink(struct inode *dir, struct dentry *dentry);
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)  //{
 static unsigned int cblsm_hooks_count;
@@ -106,6 +110,9 @@ bool ec_do_lsm_initialize(ProcessContext *context, uint64_t enableHooks)
     CB_LSM_SETUP_HOOK(socket_sendmsg);
     CB_LSM_SETUP_HOOK(socket_recvmsg);  // incoming UDP/DNS - where we get the process context
     CB_LSM_SETUP_HOOK(file_free_security);
+    CB_LSM_SETUP_HOOK(sk_free_security);  // drops per sock UDP state
+    CB_LSM_SETUP_HOOK(inode_rename);  // drops interned paths
+    CB_LSM_SETUP_HOOK(inode_unlink);  // drops interned paths
 #undef CB_LSM_SETUP_HOOK
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 0, 0)  //{
@@ -153,6 +160,9 @@ bool ec_do_lsm_hooks_changed(ProcessContext *context, uint64_t enableHooks)
     if (enableHooks & CB__LSM_socket_sendmsg) changed |= secops->socket_sendmsg != ec_lsm_socket_sendmsg;
     if (enableHooks & CB__LSM_socket_recvmsg) changed |= secops->socket_recvmsg != ec_lsm_socket_recvmsg;
     if (enableHooks & CB__LSM_file_free_security) changed |= secops->file_free_security != ec_lsm_file_free_security;
+    if (enableHooks & CB__LSM_sk_free_security) changed |= secops->sk_free_security != ec_lsm_sk_free_security;
+    if (enableHooks & CB__LSM_inode_rename) changed |= secops->inode_rename != ec_lsm_inode_rename;
+    if (enableHooks & CB__LSM_inode_unlink) changed |= secops->inode_unlink != ec_lsm_inode_unlink;
 
     return changed;
 }
@@ -213,6 +223,9 @@ int ec_get_lsm_socket_post_create(struct seq_file *m, void *v)   { return __ec_g
 int ec_get_lsm_socket_sendmsg(struct seq_file *m, void *v)       { return __ec_getHook(CB__LSM_socket_sendmsg, m); }
 int ec_get_lsm_socket_recvmsg(struct seq_file *m, void *v)       { return __ec_getHook(CB__LSM_socket_recvmsg, m); }
 int ec_get_lsm_file_free_security(struct seq_file *m, void *v)   { return __ec_getHook(CB__LSM_file_free_security, m); }
+int ec_get_lsm_sk_free_security(struct seq_file *m, void *v)     { return __ec_getHook(CB__LSM_sk_free_security, m); }
+int ec_get_lsm_inode_rename(struct seq_file *m, void *v)         { return __ec_getHook(CB__LSM_inode_rename, m); }
+int ec_get_lsm_inode_unlink(struct seq_file *m, void *v)         { return __ec_getHook(CB__LSM_inode_unlink, m); }
 
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 10, 0)
@@ -238,6 +251,9 @@ LSM_HOOK(socket_post_create, "socket_post_create",   ec_lsm_socket_post_create)
 LSM_HOOK(socket_sendmsg, "socket_sendmsg",       ec_lsm_socket_sendmsg)
 LSM_HOOK(socket_recvmsg, "socket_recvmsg",       ec_lsm_socket_recvmsg)
 LSM_HOOK(file_free_security, "file_free_security", ec_lsm_file_free_security)
+LSM_HOOK(sk_free_security, "sk_free_security",   ec_lsm_sk_free_security)
+LSM_HOOK(inode_rename, "inode_rename",           ec_lsm_inode_rename)
+LSM_HOOK(inode_unlink, "inode_unlink",           ec_lsm_inode_unlink)
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 10, 0)
 LSM_HOOK(mmap_file, "mmap_file",            ec_lsm_mmap_file)
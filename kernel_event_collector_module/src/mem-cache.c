@@ -432,6 +432,26 @@ size_t ec_mem_cache_get_size_generic(const void *value)
     return size;
 }
 
+int64_t ec_mem_cache_ref_count_generic(const void *value)
+{
+    int64_t ref_count = 0;
+
+    if (value)
+    {
+        generic_buffer_t *generic_buffer = (generic_buffer_t *)((char *)value - sizeof(generic_buffer_t));
+
+        if (generic_buffer->magic == GENERIC_BUFFER_MAGIC)
+        {
+            ref_count = atomic64_read(&generic_buffer->ref_count);
+        } else
+        {
+            TRACE(DL_ERROR, "Generic MEM cache magic does not match: %p", value);
+            dump_stack();
+        }
+    }
+    return ref_count;
+}
+
 char *ec_mem_cache_strdup(const char *src, ProcessContext *context)
 {
     return ec_mem_cache_strdup_x(src, NULL, context);
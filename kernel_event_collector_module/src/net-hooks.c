@@ -6,6 +6,7 @@
 #include "module_state.h"
 #include "net-helper.h"
 #include "net-tracking.h"
+#include "net-hooks.h"
 #include "process-tracking.h"
 #include "event-factory.h"
 #include "cb-spinlock.h"
@@ -13,6 +14,7 @@
 #include "cb-banning.h"
 #include <linux/inet.h>
 #include <net/ip.h>
+#include <net/ipv6.h>
 #include <net/sock.h>
 #include <net/udp.h>
 
@@ -23,6 +25,13 @@
 //#include <linux/workqueue.h>
 //#include <linux/jiffies.h>
 #include <linux/file.h>
+#include <linux/sort.h>
+#include <linux/syscalls.h>
+#include <net/inet_sock.h>
+#include <net/net_namespace.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)  //{
+#include <linux/sched/clock.h>
+#endif  //}
 
 // Would be 'static' except symbol stripping by 'ld' makes it hard for 'perf'
 // and analyzing crash dumps.  So use 'LOCAL' as a hint to ease maintenance.
@@ -237,7 +246,7 @@ int __ec_checkIsolate(ProcessContext *context, u16 family, int protocol, struct
     return 0;
 }
 
-LOCAL int my_socket_recvmsg_hook_counted(ProcessContext *context, struct socket *sock, struct my_user_msghdr *msg, int size, int flags)
+LOCAL int my_socket_recvmsg_hook_counted(ProcessContext *context, struct socket *sock, struct my_user_msghdr *msg, int size, int flags, NET_PEER_CACHE_HOOK hook)
 {
     u16               family;
     CB_SOCK_ADDR      localAddr;
@@ -246,6 +255,7 @@ LOCAL int my_socket_recvmsg_hook_counted(ProcessContext *context, struct socket
     uint16_t          proto = 0;
     pid_t             pid   = ec_getpid(current);
     int               xcode = 0;
+    bool              is_new = false;
     struct cmsghdr   *cmsg_kernel = NULL;
 
     // The MSG_UDP_HOOK flag is used skip the LSM hook so we can call our logic manually.
@@ -270,6 +280,10 @@ LOCAL int my_socket_recvmsg_hook_counted(ProcessContext *context, struct socket
         ec_print_address("Isolate Connection", sock->sk, &localAddr.sa_addr, &remoteAddr.sa_addr);
     });
 
+    // A UDP socket usually keeps hearing from the same peer, so skip the process and
+    //  connection lookups if this one was reported recently.
+    TRY(proto != IPPROTO_UDP || !ec_net_tracking_peer_cache_check(context, sock->sk, pid, &remoteAddr, hook));
+
     process_handle = ec_get_procinfo_and_create_process_start_if_needed(pid, "RECV", context);
     TRY(process_handle);
 
@@ -296,7 +310,12 @@ LOCAL int my_socket_recvmsg_hook_counted(ProcessContext *context, struct socket
     // Track this connection in the local table
     //  If it is a new connection, add an entry and send an event (return value of true)
     //  If it is a tracked connection, update the time and skip sending an event (return value of false)
-    TRY(ec_net_tracking_check_cache(context, pid, &localAddr, &remoteAddr, proto, CONN_IN));
+    is_new = ec_net_tracking_check_cache(context, pid, &localAddr, &remoteAddr, proto, CONN_IN);
+    if (proto == IPPROTO_UDP)
+    {
+        ec_net_tracking_peer_cache_update(sock->sk, ec_getpid(current), pid, &localAddr, &remoteAddr);
+    }
+    TRY(is_new);
 
     ec_event_send_net(process_handle,
                    "RECV",
@@ -314,13 +333,13 @@ CATCH_DEFAULT:
     return xcode;
 }
 
-LOCAL int my_socket_recvmsg(ProcessContext *context, struct socket *sock, struct my_user_msghdr *msg, int size, int flags)
+LOCAL int my_socket_recvmsg(ProcessContext *context, struct socket *sock, struct my_user_msghdr *msg, int size, int flags, NET_PEER_CACHE_HOOK hook)
 {
     int ret = 0;
 
     BEGIN_MODULE_DISABLE_CHECK_IF_DISABLED_GOTO(context, CATCH_DEFAULT);
 
-    ret = my_socket_recvmsg_hook_counted(context, sock, msg, size, flags);
+    ret = my_socket_recvmsg_hook_counted(context, sock, msg, size, flags, hook);
 
 CATCH_DEFAULT:
     FINISH_MODULE_DISABLE_CHECK(context);
@@ -351,7 +370,7 @@ int ec_lsm_socket_recvmsg(struct socket *sock, struct my_user_msghdr *msg, int s
     //  in the receive hook that allows LSM to be skipped in those cases.
     TRY(CHECK_SOCKET(sock));
 
-    TRY_SET(-EPERM != my_socket_recvmsg_hook_counted(&context, sock, msg, 0, flags), -EPERM);
+    TRY_SET(-EPERM != my_socket_recvmsg_hook_counted(&context, sock, msg, 0, flags, NET_PEER_CACHE_LSM_RECVMSG), -EPERM);
 
 CATCH_DEFAULT:
     MODULE_PUT_AND_FINISH_MODULE_DISABLE_CHECK(&context);
@@ -368,7 +387,8 @@ static int64_t my_peek(
     void *msg_peek,  // my_user_msghdr or my_kernel_msghdr
     long sk_rcvtimeo_dlta,
     bool our_timeout,
-    unsigned int flags
+    unsigned int flags,
+    NET_PEER_CACHE_HOOK hook
 )
 {
     int32_t xcode;
@@ -399,7 +419,7 @@ static int64_t my_peek(
     TRY(sock && sock->sk);
 
     /* Call our local code to process the packet for event generation and isolation */
-    TRY_SET(-EPERM != my_socket_recvmsg(context, sock, msg_peek, 0, flags), -EPERM);
+    TRY_SET(-EPERM != my_socket_recvmsg(context, sock, msg_peek, 0, flags, hook), -EPERM);
 
     /* If we peeked at UDP message sk_rcvtimeo_dlta is what's left from original timeout value.
      * Unless a caller set original timeout value to 0 sk_rcvtimeo_dlta should be greater than 0 here
@@ -444,6 +464,163 @@ static unsigned int check_udp_peek(struct socket const *sock, unsigned const fla
     return ~MSG_UDP_HOOK & flags;
 }
 
+// The peek is only needed so that a blocked datagram never reaches the caller.  Without
+//  isolation the datagram is received once and reported afterwards.  A datagram that
+//  arrives while isolation is being turned on may still be delivered unchecked.
+static bool udp_peek_needed(ProcessContext *context)
+{
+    return ec_GetCurrentIsolationMode(context) == IsolationModeOn;
+}
+
+// Source of a received datagram, always taken from kernel memory.  The address the
+//  kernel writes back for the caller can not be used, the caller may rewrite it before
+//  we read it.
+typedef struct udp_peer {
+    int                  namelen;
+    struct sockaddr_in6  address;
+} UDP_PEER;
+
+// Without isolation a datagram is received once, through a kernel copy of the caller's
+//  msghdr.  The receive writes the source address to kernel memory, where it is taken
+//  for the report and then copied out to the caller's own buffer.  The iovec array is
+//  copied too, so the buffers checked here are the ones the receive writes to.
+typedef struct udp_kernel_msg {
+    struct sockaddr_storage   name;
+    void __user              *uname;
+    int                       unamelen;
+    struct iovec             *iov;
+} UDP_KERNEL_MSG;
+
+// Points msg, a kernel copy of the caller's msghdr, at kernel memory for the name and
+//  the iovec array
+static int udp_kernel_msg_init(UDP_KERNEL_MSG *kmsg, struct my_user_msghdr *msg, ProcessContext *context)
+{
+    int xcode = 0;
+    int i;
+
+    memset(kmsg, 0, sizeof(*kmsg));
+
+    TRY_SET(msg->msg_iovlen <= UIO_MAXIOV, -EMSGSIZE);
+    TRY_SET(!msg->msg_controllen || access_ok(VERIFY_WRITE, msg->msg_control, msg->msg_controllen), -EFAULT);
+
+    if (msg->msg_iovlen)
+    {
+        kmsg->iov = ec_mem_cache_alloc_generic(msg->msg_iovlen * sizeof(struct iovec), context);
+        TRY_SET(kmsg->iov, -ENOMEM);
+        TRY_SET(!copy_from_user(kmsg->iov, msg->msg_iov, msg->msg_iovlen * sizeof(struct iovec)), -EFAULT);
+    }
+    for (i = 0; i < msg->msg_iovlen; ++i)
+    {
+        TRY_SET(access_ok(VERIFY_WRITE, kmsg->iov[i].iov_base, kmsg->iov[i].iov_len), -EFAULT);
+    }
+
+    kmsg->uname      = msg->msg_name;
+    kmsg->unamelen   = msg->msg_namelen;
+    msg->msg_name    = &kmsg->name;
+    msg->msg_namelen = sizeof(kmsg->name);
+    msg->msg_iov     = kmsg->iov;
+
+CATCH_DEFAULT:
+    return xcode;
+}
+
+static void udp_kernel_msg_free(UDP_KERNEL_MSG *kmsg)
+{
+    ec_mem_cache_free_generic(kmsg->iov);
+    kmsg->iov = NULL;
+}
+
+// Copies a received source address out to the caller the way move_addr_to_user does
+static int udp_name_to_user(void *name, int klen, void __user *uaddr, int ulen, int __user *ulenp)
+{
+    int len = min(ulen, klen);
+
+    if (len < 0)
+    {
+        return -EINVAL;
+    }
+    if (len && copy_to_user(uaddr, name, len))
+    {
+        return -EFAULT;
+    }
+    return put_user(klen, ulenp);
+}
+
+// Gives the caller what the receive wrote to msg, the kernel copy of its msghdr umsg
+static int udp_kernel_msg_finish(UDP_KERNEL_MSG *kmsg, struct my_user_msghdr *msg, struct my_user_msghdr __user *umsg)
+{
+    int xcode = 0;
+
+    if (kmsg->uname)
+    {
+        xcode = udp_name_to_user(&kmsg->name, msg->msg_namelen, kmsg->uname, kmsg->unamelen, &umsg->msg_namelen);
+        TRY(!xcode);
+    }
+    TRY_SET(!put_user(msg->msg_flags, &umsg->msg_flags), -EFAULT);
+    TRY_SET(!put_user(msg->msg_controllen, &umsg->msg_controllen), -EFAULT);
+
+CATCH_DEFAULT:
+    return xcode;
+}
+
+static void udp_name_peer(void *name, int namelen, UDP_PEER *peer)
+{
+    memset(peer, 0, sizeof(*peer));
+    peer->namelen = clamp_t(int, namelen, 0, sizeof(peer->address));
+    memcpy(&peer->address, name, peer->namelen);
+}
+
+static void udp_report_name(ProcessContext *context, struct socket *sock, void *address, int namelen, unsigned int flags, NET_PEER_CACHE_HOOK hook)
+{
+    struct my_user_msghdr msg = {0};
+
+    if (namelen > 0)
+    {
+        msg.msg_name    = address;
+        msg.msg_namelen = namelen;
+    }
+
+    my_socket_recvmsg(context, sock, &msg, 0, ~MSG_UDP_HOOK & flags, hook);
+}
+
+// Orders peers so that datagrams from the same peer end up next to each other
+static int udp_peer_compare(const void *left, const void *right)
+{
+    const UDP_PEER *l = left;
+    const UDP_PEER *r = right;
+
+    if (l->namelen != r->namelen)
+    {
+        return l->namelen < r->namelen ? -1 : 1;
+    }
+    return memcmp(&l->address, &r->address, l->namelen);
+}
+
+// Reports the datagrams of a recvmmsg vector after they have been received.  Each
+//  distinct peer is reported once, so the cost per datagram is a compare instead of a
+//  full trip through the hook.  The peers are sorted in place.  Returns the number of
+//  peers reported.
+static int udp_report_received_batch(ProcessContext *context, struct socket *sock, UDP_PEER *peers, int count, unsigned int flags, NET_PEER_CACHE_HOOK hook)
+{
+    int reported = 0;
+    int i;
+
+    sort(peers, count, sizeof(UDP_PEER), udp_peer_compare, NULL);
+
+    for (i = 0; i < count; ++i)
+    {
+        if (i > 0 && !udp_peer_compare(&peers[i - 1], &peers[i]))
+        {
+            continue;
+        }
+
+        udp_report_name(context, sock, &peers[i].address, peers[i].namelen, flags, hook);
+        reported += 1;
+    }
+
+    return reported;
+}
+
 void __ec_udp_init_sockets(void);
 
 bool ec_network_hooks_initialize(ProcessContext *context)
@@ -605,6 +782,9 @@ int ec_lsm_socket_post_create(struct socket *sock, int family, int type, int pro
     if (sock->sk->sk_protocol == IPPROTO_UDP)
     {
         __ec_udp_configure_raddr(sock->sk);
+
+        // The sock may be a reused allocation, never trust a peer cached for it
+        ec_net_tracking_peer_cache_invalidate(sock->sk);
     }
 
 CATCH_DEFAULT:
@@ -612,6 +792,26 @@ CATCH_DEFAULT:
     return xcode;
 }
 
+// The sock is being freed, drop any UDP peer cached for it.  This runs after the socket
+//  file is gone, so it also covers socks that outlive their file.
+void ec_lsm_sk_free_security(struct sock *sk)
+{
+    DECLARE_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    MODULE_GET_AND_BEGIN_MODULE_DISABLE_CHECK_IF_DISABLED_GOTO(&context, CATCH_DEFAULT);
+
+    if (sk->sk_protocol == IPPROTO_UDP)
+    {
+        ec_net_tracking_peer_cache_invalidate(sk);
+    }
+
+CATCH_DEFAULT:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 0, 0)  //{
+    g_original_ops_ptr->sk_free_security(sk);
+#endif  //}
+    MODULE_PUT_AND_FINISH_MODULE_DISABLE_CHECK(&context);
+}
+
 // Not used for now
 int ec_socket_bind(struct socket *sock, struct sockaddr *address, int addrlen)
 {
@@ -1046,6 +1246,42 @@ static long call_ec_orig_sys_recvmsg(void *ab_arg)
     return ec_orig_sys_recvmsg(ab->fd, ab->msg, ab->flags);
 }
 
+// Receives a datagram once, into a kernel copy of msg, and reports its source
+static int udp_recvmsg_reported(ProcessContext *context, struct socket *sock, int fd, struct my_user_msghdr __user *msg,
+                                unsigned int flags, long sk_rcvtimeo_dlta, bool weSetTimeout)
+{
+    struct my_user_msghdr kmsg_hdr;
+    UDP_KERNEL_MSG        kmsg  = {};
+    int                   xcode = 0;
+    int                   ret;
+
+    TRY_SET(!copy_from_user(&kmsg_hdr, msg, sizeof(kmsg_hdr)), -EFAULT);
+    xcode = udp_kernel_msg_init(&kmsg, &kmsg_hdr, context);
+    TRY(!xcode);
+
+    {
+        struct recvmsg_argblock ab = {NULL, fd, &kmsg_hdr, flags};
+
+        xcode = my_timed_recv(call_ec_orig_sys_recvmsg, (void *)&ab, sock, sk_rcvtimeo_dlta, weSetTimeout);
+    }
+
+    if (xcode >= 0)
+    {
+        udp_report_name(context, sock, &kmsg.name, kmsg_hdr.msg_namelen, flags, NET_PEER_CACHE_SYS_RECVMSG);
+
+        // The datagram is gone from the queue either way
+        ret = udp_kernel_msg_finish(&kmsg, &kmsg_hdr, msg);
+        if (ret)
+        {
+            xcode = ret;
+        }
+    }
+
+CATCH_DEFAULT:
+    udp_kernel_msg_free(&kmsg);
+    return xcode;
+}
+
 asmlinkage long ec_sys_recvmsg(int fd, struct my_user_msghdr __user *msg, unsigned int flags)
 {
     int64_t        ycode;
@@ -1094,7 +1330,10 @@ asmlinkage long ec_sys_recvmsg(int fd, struct my_user_msghdr __user *msg, unsign
     // we zero it out prior to returning from this call which would allow a caller to bypass isolation.
     //
     // 1. TCP: call original syscall and check for isolation in the LSM hook.
-    // 2. UDP, MSG_ERRQUEUE flag is not set by a caller:
+    // 2. UDP, MSG_ERRQUEUE flag is not set by a caller, isolation is not on:
+    //    - Nothing has to be checked before the caller gets the data, so receive once with
+    //      the source address written to kernel memory, report it and copy it out
+    // 3. UDP, MSG_ERRQUEUE flag is not set by a caller, isolation is on:
     //    - Set MSG_UDP_HOOK flag to skip LSM hook
     //    - Set MSG_PEEK flag to peek at the data without consuming it
     //    - Allocate small buffer in kernel space and read data into it using original syscall
@@ -1104,7 +1343,7 @@ asmlinkage long ec_sys_recvmsg(int fd, struct my_user_msghdr __user *msg, unsign
     //      and user buffer
     //    - If a caller specified a timeout value calculate remaining time after exit from syscall
     //      with MSG_PEEK and pass it to the original syscall
-    // 3. UDP, MSG_ERRQUEUE flag is set by a caller:
+    // 4. UDP, MSG_ERRQUEUE flag is set by a caller:
     //    - Assumption is that data from sk->sk_error_queue can be passed to a caller and no
     //      check for isolation is needed, and no need to report this connection either
     //    - MSG_PEEK flag doesn't work in this case, data from error queue is always consumed
@@ -1117,7 +1356,11 @@ asmlinkage long ec_sys_recvmsg(int fd, struct my_user_msghdr __user *msg, unsign
     IF_MODULE_DISABLED_GOTO(&context, CATCH_DISABLED);
 
     _flags = check_udp_peek(sock, flags);
-    if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags))
+    if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags) && !udp_peek_needed(&context))
+    {
+        xcode = udp_recvmsg_reported(&context, sock, fd, msg, flags | MSG_UDP_HOOK, sk_rcvtimeo_dlta, weSetTimeout);
+        goto CATCH_DEFAULT;
+    } else if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags))
     {
         mm_segment_t oldfs;
         struct sockaddr_storage sock_addr_peek = {0};
@@ -1145,7 +1388,7 @@ asmlinkage long ec_sys_recvmsg(int fd, struct my_user_msghdr __user *msg, unsign
             struct recvmsg_argblock ab = {NULL, fd, &msg_peek, _flags};
 
             ycode = my_peek(&context, call_ec_orig_sys_recvmsg, (void *)&ab,
-                    sock, &msg_peek, sk_rcvtimeo_dlta, weSetTimeout, flags);
+                    sock, &msg_peek, sk_rcvtimeo_dlta, weSetTimeout, flags, NET_PEER_CACHE_SYS_RECVMSG);
 
             TRY_DO(ycode >= 0, { xcode = (int32_t)ycode; });
         }
@@ -1218,6 +1461,76 @@ static long call_ec_orig_sys_recvmmsg(void *ab_arg)
     return ec_orig_sys_recvmmsg(ab->fd, ab->mmsghdr, ab->vlen, ab->flags, ab->p_timeout);
 }
 
+// Receives a vector of datagrams once, into kernel copies of the caller's msghdrs, and
+//  reports each distinct source.  _timeout is the kernel copy of timeout.
+static int udp_recvmmsg_reported(ProcessContext *context, struct socket *sock, struct Bugbuf *bugbuf, int fd,
+                                 struct mmsghdr __user *msg, unsigned int vlen, unsigned int flags,
+                                 struct timespec __user *timeout, struct timespec *_timeout,
+                                 long sk_rcvtimeo_dlta, bool weSetTimeout)
+{
+    struct mmsghdr *kvec     = NULL;
+    UDP_KERNEL_MSG *kmsgs    = NULL;
+    UDP_PEER       *peers    = NULL;
+    int             received = 0;
+    int             xcode    = 0;
+    int             ret;
+    int             i;
+
+    vlen  = min_t(unsigned int, vlen, UIO_MAXIOV);
+    kvec  = ec_mem_cache_alloc_generic(vlen * sizeof(struct mmsghdr), context);
+    kmsgs = ec_mem_cache_alloc_generic(vlen * sizeof(UDP_KERNEL_MSG), context);
+    peers = ec_mem_cache_alloc_generic(vlen * sizeof(UDP_PEER), context);
+    TRY_SET(kvec && kmsgs && peers, -ENOMEM);
+
+    memset(kmsgs, 0, vlen * sizeof(UDP_KERNEL_MSG));
+    TRY_SET(!copy_from_user(kvec, msg, vlen * sizeof(struct mmsghdr)), -EFAULT);
+    for (i = 0; i < vlen; ++i)
+    {
+        xcode = udp_kernel_msg_init(&kmsgs[i], &kvec[i].msg_hdr, context);
+        TRY(!xcode);
+    }
+
+    {
+        struct recvmmsg_argblock ab = {bugbuf, fd, kvec, vlen, flags, timeout ? _timeout : NULL};
+
+        xcode = my_timed_recv(call_ec_orig_sys_recvmmsg, (void *)&ab, sock, sk_rcvtimeo_dlta, weSetTimeout);
+    }
+    received = max(xcode, 0);
+
+    // The datagrams are gone from the queue, so they are reported even if the caller can not
+    //  be given all of them
+    for (i = 0; i < received; ++i)
+    {
+        udp_name_peer(&kmsgs[i].name, kvec[i].msg_hdr.msg_namelen, &peers[i]);
+
+        ret = udp_kernel_msg_finish(&kmsgs[i], &kvec[i].msg_hdr, &msg[i].msg_hdr);
+        if (!ret && put_user(kvec[i].msg_len, &msg[i].msg_len))
+        {
+            ret = -EFAULT;
+        }
+        if (ret)
+        {
+            xcode = ret;
+        }
+    }
+    if (received && timeout && copy_to_user(timeout, _timeout, sizeof(*_timeout)))
+    {
+        xcode = -EFAULT;
+    }
+
+    udp_report_received_batch(context, sock, peers, received, flags, NET_PEER_CACHE_SYS_RECVMMSG);
+
+CATCH_DEFAULT:
+    for (i = 0; kmsgs && i < vlen; ++i)
+    {
+        udp_kernel_msg_free(&kmsgs[i]);
+    }
+    ec_mem_cache_free_generic(kvec);
+    ec_mem_cache_free_generic(kmsgs);
+    ec_mem_cache_free_generic(peers);
+    return xcode;
+}
+
 extern uint32_t ec_prsock_buflen;
 
 asmlinkage long ec_sys_recvmmsg(int fd, struct mmsghdr __user *msg,
@@ -1307,7 +1620,13 @@ asmlinkage long ec_sys_recvmmsg(int fd, struct mmsghdr __user *msg,
     IF_MODULE_DISABLED_GOTO(&context, CATCH_DISABLED);
 
     _flags = check_udp_peek(sock, flags);
-    if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags))
+    if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags) && !udp_peek_needed(&context) && vlen)
+    {
+        // Every datagram of the vector is inspected, but each peer is only reported once
+        xcode = udp_recvmmsg_reported(&context, sock, &bugbuf, fd, msg, vlen, flags | MSG_UDP_HOOK,
+                                      timeout, &_timeout, sk_rcvtimeo_dlta, weSetTimeout);
+        goto CATCH_DEFAULT;
+    } else if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags))
     {
         struct sockaddr_storage sock_addr_peek = {0};
         struct mmsghdr mmsg_peek = {{0}, 0};
@@ -1343,13 +1662,12 @@ asmlinkage long ec_sys_recvmmsg(int fd, struct mmsghdr __user *msg,
 
         // Peek at the message to determine remote IP address and port.
         // timeout value will be updated with remaining time if recvmmsg() receives a datagram
-        // We only need one message at this time as we're checking/reporting only the first received packet for now
-        // TODO: CB-11228 - we need to check/report every packet we received, not only the first one
+        // We only need one message at this time as we're checking/reporting only the first received packet.
         {
             struct recvmmsg_argblock ab = {&bugbuf, fd, &mmsg_peek, 1, _flags, p_timeout};
 
             ycode = my_peek(&context, call_ec_orig_sys_recvmmsg, (void *)&ab,
-                    sock, &mmsg_peek.msg_hdr, sk_rcvtimeo_dlta_peek, weSetTimeout, flags);
+                    sock, &mmsg_peek.msg_hdr, sk_rcvtimeo_dlta_peek, weSetTimeout, flags, NET_PEER_CACHE_SYS_RECVMMSG);
 
             TRY_DO(ycode >= 0, { xcode = (int32_t)ycode; });
         }
@@ -1429,6 +1747,44 @@ static long call_ec_orig_sys_recvfrom(void *ab_arg)
     return ec_orig_sys_recvfrom(ab->fd, ab->ubuf, ab->size, ab->flags, ab->addr, ab->addr_len);
 }
 
+// Receives a datagram once, with its source written to kernel memory, and reports it
+static int udp_recvfrom_reported(ProcessContext *context, struct socket *sock, int fd, void __user *ubuf, size_t size,
+                                 unsigned int flags, struct sockaddr __user *addr, int __user *addr_len,
+                                 long sk_rcvtimeo_dlta, bool weSetTimeout)
+{
+    struct sockaddr_storage name;
+    int                     namelen = sizeof(name);
+    int                     ulen    = 0;
+    int                     xcode   = 0;
+    int                     ret;
+
+    TRY_SET(access_ok(VERIFY_WRITE, ubuf, size), -EFAULT);
+    if (addr)
+    {
+        TRY_SET(!get_user(ulen, addr_len), -EFAULT);
+    }
+
+    {
+        struct recvfrom_argblock ab = {NULL, fd, ubuf, size, flags, (struct sockaddr *)&name, &namelen};
+
+        xcode = my_timed_recv(call_ec_orig_sys_recvfrom, (void *)&ab, sock, sk_rcvtimeo_dlta, weSetTimeout);
+    }
+
+    if (xcode >= 0)
+    {
+        udp_report_name(context, sock, &name, namelen, flags, NET_PEER_CACHE_SYS_RECVFROM);
+
+        ret = addr ? udp_name_to_user(&name, namelen, addr, ulen, addr_len) : 0;
+        if (ret)
+        {
+            xcode = ret;
+        }
+    }
+
+CATCH_DEFAULT:
+    return xcode;
+}
+
 asmlinkage long ec_sys_recvfrom(int fd, void __user *ubuf, size_t size, unsigned int flags,
                              struct sockaddr __user *addr, int __user *addr_len)
 {
@@ -1480,7 +1836,10 @@ asmlinkage long ec_sys_recvfrom(int fd, void __user *ubuf, size_t size, unsigned
     // for isolation.
     //
     // 1. TCP: call original syscall and check for isolation in the LSM hook.
-    // 2. UDP, MSG_ERRQUEUE flag is not set by a caller:
+    // 2. UDP, MSG_ERRQUEUE flag is not set by a caller, isolation is not on:
+    //    - Nothing has to be checked before the caller gets the data, so receive once with
+    //      the source address written to kernel memory, report it and copy it out
+    // 3. UDP, MSG_ERRQUEUE flag is not set by a caller, isolation is on:
     //    - Set MSG_UDP_HOOK flag to skip LSM hook
     //    - Set MSG_PEEK flag to peek at the data without consuming it
     //    - Allocate small buffer in kernel space and read data into it using kernel_recvmsg()
@@ -1490,13 +1849,13 @@ asmlinkage long ec_sys_recvfrom(int fd, void __user *ubuf, size_t size, unsigned
     //      and user buffer
     //    - If a caller specified a timeout value calculate remaining time after exit from syscall
     //      with MSG_PEEK and pass it to the original syscall
-    // 3. UDP, MSG_ERRQUEUE flag is set by a caller:
+    // 4. UDP, MSG_ERRQUEUE flag is set by a caller:
     //    - Assumption is that data from sk->sk_error_queue can be passed to a caller and no
     //      check for isolation is needed, and no need to report this connection either
     //    - MSG_PEEK flag doesn't work in this case, data from error queue is always consumed
     //    - Set MSG_UDP_HOOK flag to skip LSM hook
     //    - Call original syscall with original flags and user buffer
-    // 4. Only handle the type of sockets we are interested in recvmsg. So pass the rest to
+    // 5. Only handle the type of sockets we are interested in recvmsg. So pass the rest to
     //    the standard syscall. I need to do this because kernel_recvmsg logic below messes up some
     //    non-ip sockets (Specifically I noticed a problem with PF_NETLINK.)
 
@@ -1506,7 +1865,12 @@ asmlinkage long ec_sys_recvfrom(int fd, void __user *ubuf, size_t size, unsigned
     IF_MODULE_DISABLED_GOTO(&context, CATCH_DISABLED);
 
     _flags = check_udp_peek(sock, flags);
-    if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags))
+    if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags) && !udp_peek_needed(&context))
+    {
+        xcode = udp_recvfrom_reported(&context, sock, fd, ubuf, size, flags | MSG_UDP_HOOK,
+                                      addr, addr_len, sk_rcvtimeo_dlta, weSetTimeout);
+        goto CATCH_DEFAULT;
+    } else if ((MSG_UDP_HOOK & _flags) && !(MSG_ERRQUEUE & _flags))
     {
         // Unlike in the recvmsg and recvmmsg calls, we can not call the real syscall to get the packet
         //  because we need a struct my_user_msghdr object for our logic.  The code below has been adapted from
@@ -1530,7 +1894,7 @@ asmlinkage long ec_sys_recvfrom(int fd, void __user *ubuf, size_t size, unsigned
             struct kernel_recvmsg_argblock ab = {NULL, sock, &msg, (struct kvec *)&iov, 1, IOV_FOR_MSG_PEEK_SIZE, _flags};
 
             ycode = my_peek(&context, call_kernel_recvmsg, (void *)&ab,
-                    sock, &msg, sk_rcvtimeo_dlta, weSetTimeout, flags);
+                    sock, &msg, sk_rcvtimeo_dlta, weSetTimeout, flags, NET_PEER_CACHE_SYS_RECVFROM);
 
             TRY_DO(ycode >= 0, { xcode = (int32_t)ycode; });
         }
@@ -1560,6 +1924,250 @@ CATCH_DEFAULT:
     return xcode;
 }
 
+// Runtime check of the recvmmsg batch path.  Datagrams from two senders are received
+//  over loopback, once with the original syscall and once with the hook.  The hook must
+//  report each sender once, return each datagram with its own source and stay within a
+//  bounded multiple of the original per-datagram cost.  Other recvmmsg callers running
+//  at the same time add to the report count, so a failure should be confirmed by a rerun.
+#define NET_CHECK_DATAGRAMS       64
+#define NET_CHECK_SENDERS         2
+#define NET_CHECK_MAX_COST_RATIO  4
+#define NET_CHECK_COST_SLACK_NS   2000
+
+typedef struct net_check_vector {
+    struct mmsghdr      msgs[NET_CHECK_DATAGRAMS];
+    struct iovec        iovs[NET_CHECK_DATAGRAMS];
+    struct sockaddr_in  names[NET_CHECK_DATAGRAMS];
+    char                payloads[NET_CHECK_DATAGRAMS];
+} NET_CHECK_VECTOR;
+
+typedef struct net_check_result {
+    bool      passed;
+    long      received;
+    uint64_t  reports;
+    uint64_t  orig_ns;
+    uint64_t  hook_ns;
+} NET_CHECK_RESULT;
+
+static DEFINE_MUTEX(s_net_check_lock);
+static NET_CHECK_RESULT s_net_check_result;
+static uint64_t         s_net_check_runs;
+
+static int __ec_net_check_socket(struct socket **sock)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 2, 0)  //{
+    return sock_create_kern(&init_net, AF_INET, SOCK_DGRAM, IPPROTO_UDP, sock);
+#else  //}{
+    return sock_create_kern(AF_INET, SOCK_DGRAM, IPPROTO_UDP, sock);
+#endif  //}
+}
+
+// Gives the socket an fd so that it can be passed to the syscalls.  The fd owns the
+//  socket once this succeeds.
+static int __ec_net_check_map_fd(struct socket *sock)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 7, 0)  //{
+    struct file *file;
+    int          fd = get_unused_fd_flags(0);
+
+    if (fd < 0)
+    {
+        return fd;
+    }
+
+    file = sock_alloc_file(sock, 0, NULL);
+    if (IS_ERR(file))
+    {
+        put_unused_fd(fd);
+        return PTR_ERR(file);
+    }
+
+    fd_install(fd, file);
+    return fd;
+#else  //}{
+    return sock_map_fd(sock, 0);
+#endif  //}
+}
+
+static void __ec_net_check_close_fd(int fd)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 7, 0)  //{
+    __close_fd(current->files, fd);
+#else  //}{
+    sys_close(fd);
+#endif  //}
+}
+
+static bool __ec_net_check_send(struct socket **tx, struct sockaddr_in *rx_addr)
+{
+    int i;
+
+    for (i = 0; i < NET_CHECK_DATAGRAMS; ++i)
+    {
+        char          payload = (char)i;
+        struct kvec   iov     = { .iov_base = &payload, .iov_len = sizeof(payload) };
+        struct msghdr msg     = { .msg_name = rx_addr, .msg_namelen = sizeof(*rx_addr) };
+
+        if (kernel_sendmsg(tx[i % NET_CHECK_SENDERS], &msg, &iov, 1, sizeof(payload)) != sizeof(payload))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Receives the whole batch with one call and returns the time it took.  The vector lives
+//  in kernel memory.  The original syscall is passed MSG_UDP_HOOK so that the receive LSM
+//  hook stays out of the baseline.
+static long __ec_net_check_recv(bool hooked, int fd, NET_CHECK_VECTOR *vector, uint64_t *elapsed_ns)
+{
+    mm_segment_t oldfs;
+    uint64_t     start;
+    long         received;
+    int          i;
+
+    memset(vector, 0, sizeof(*vector));
+    for (i = 0; i < NET_CHECK_DATAGRAMS; ++i)
+    {
+        vector->iovs[i].iov_base            = &vector->payloads[i];
+        vector->iovs[i].iov_len             = sizeof(vector->payloads[i]);
+        vector->msgs[i].msg_hdr.msg_iov     = &vector->iovs[i];
+        vector->msgs[i].msg_hdr.msg_iovlen  = 1;
+        vector->msgs[i].msg_hdr.msg_name    = &vector->names[i];
+        vector->msgs[i].msg_hdr.msg_namelen = sizeof(vector->names[i]);
+    }
+
+    oldfs = get_fs();
+    set_fs(get_ds());
+    start = local_clock();
+    if (hooked)
+    {
+        received = ec_sys_recvmmsg(fd, vector->msgs, NET_CHECK_DATAGRAMS, MSG_DONTWAIT, NULL);
+    } else
+    {
+        received = ec_orig_sys_recvmmsg(fd, vector->msgs, NET_CHECK_DATAGRAMS, MSG_DONTWAIT | MSG_UDP_HOOK, NULL);
+    }
+    *elapsed_ns = local_clock() - start;
+    set_fs(oldfs);
+
+    return received;
+}
+
+bool ec_net_recvmmsg_batch_check(ProcessContext *context)
+{
+    NET_CHECK_RESULT    result  = { 0 };
+    struct socket      *rx      = NULL;
+    struct socket      *tx[NET_CHECK_SENDERS] = { NULL, };
+    struct sockaddr_in  rx_addr = { .sin_family = AF_INET };
+    NET_CHECK_VECTOR   *vector  = NULL;
+    uint64_t            lookups_before;
+    uint64_t            lookups_after;
+    uint64_t            hits;
+    uint64_t            elapsed_ns;
+    int                 fd = -1;
+    int                 i;
+
+    vector = ec_mem_cache_alloc_generic(sizeof(*vector), context);
+    TRY(vector);
+
+    TRY(__ec_net_check_socket(&rx) == 0);
+    rx_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TRY(kernel_bind(rx, (struct sockaddr *)&rx_addr, sizeof(rx_addr)) == 0);
+    rx_addr.sin_port = inet_sk(rx->sk)->inet_sport;
+
+    fd = __ec_net_check_map_fd(rx);
+    TRY(fd >= 0);
+    rx = NULL;
+
+    for (i = 0; i < NET_CHECK_SENDERS; ++i)
+    {
+        TRY(__ec_net_check_socket(&tx[i]) == 0);
+    }
+
+    TRY(__ec_net_check_send(tx, &rx_addr));
+    TRY(__ec_net_check_recv(false, fd, vector, &elapsed_ns) == NET_CHECK_DATAGRAMS);
+    result.orig_ns = elapsed_ns / NET_CHECK_DATAGRAMS;
+
+    TRY(__ec_net_check_send(tx, &rx_addr));
+    ec_net_tracking_peer_cache_get_stats(NET_PEER_CACHE_SYS_RECVMMSG, &lookups_before, &hits);
+    result.received = __ec_net_check_recv(true, fd, vector, &elapsed_ns);
+    ec_net_tracking_peer_cache_get_stats(NET_PEER_CACHE_SYS_RECVMMSG, &lookups_after, &hits);
+    result.reports = lookups_after - lookups_before;
+    result.hook_ns = elapsed_ns / NET_CHECK_DATAGRAMS;
+
+    TRY(result.received == NET_CHECK_DATAGRAMS);
+    TRY(result.reports == NET_CHECK_SENDERS);
+    TRY(result.hook_ns <= NET_CHECK_MAX_COST_RATIO * result.orig_ns + NET_CHECK_COST_SLACK_NS);
+
+    // The source the hook received into kernel memory is copied out to the caller
+    for (i = 0; i < NET_CHECK_DATAGRAMS; ++i)
+    {
+        TRY(vector->msgs[i].msg_hdr.msg_namelen == sizeof(vector->names[i]));
+        TRY(vector->names[i].sin_port == inet_sk(tx[i % NET_CHECK_SENDERS]->sk)->inet_sport);
+    }
+
+    result.passed = true;
+
+CATCH_DEFAULT:
+    for (i = 0; i < NET_CHECK_SENDERS; ++i)
+    {
+        if (tx[i])
+        {
+            sock_release(tx[i]);
+        }
+    }
+    if (fd >= 0)
+    {
+        __ec_net_check_close_fd(fd);
+    }
+    if (rx)
+    {
+        sock_release(rx);
+    }
+    ec_mem_cache_free_generic(vector);
+
+    TRACE(DL_INFO, "%s: %s, %ld datagrams, %llu reports, %llu/%llu ns per datagram (orig/hook)",
+          __func__, result.passed ? "passed" : "failed", result.received, result.reports,
+          result.orig_ns, result.hook_ns);
+
+    mutex_lock(&s_net_check_lock);
+    s_net_check_result = result;
+    ++s_net_check_runs;
+    mutex_unlock(&s_net_check_lock);
+
+    return result.passed;
+}
+
+int ec_net_recvmmsg_check_show(struct seq_file *m, void *v)
+{
+    NET_CHECK_RESULT result;
+    uint64_t         runs;
+
+    mutex_lock(&s_net_check_lock);
+    result = s_net_check_result;
+    runs   = s_net_check_runs;
+    mutex_unlock(&s_net_check_lock);
+
+    seq_printf(m, "%20s | %12llu |\n", "Runs", runs);
+    seq_printf(m, "%20s | %12s |\n", "Last result", !runs ? "none" : (result.passed ? "passed" : "failed"));
+    seq_printf(m, "%20s | %12ld |\n", "Received", result.received);
+    seq_printf(m, "%20s | %12llu |\n", "Reports", result.reports);
+    seq_printf(m, "%20s | %12llu |\n", "Orig ns/datagram", result.orig_ns);
+    seq_printf(m, "%20s | %12llu |\n", "Hook ns/datagram", result.hook_ns);
+
+    return 0;
+}
+
+// Any write runs the check.  The hook only reports while the module is enabled.
+ssize_t ec_net_recvmmsg_check_run(struct file *file, const char *buf, size_t size, loff_t *ppos)
+{
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    ec_net_recvmmsg_batch_check(&context);
+
+    return size;
+}
+
 #ifdef __NR_recv  //{
 #warning "The sys_recv call is used, and we have not provided a hook for it."
 #endif  //}
@@ -3,5 +3,8 @@
 
 #pragma once
 
+#include "net-tracking.h"
+
 bool ec_network_hooks_initialize(ProcessContext *context);
 void ec_network_hooks_shutdown(ProcessContext *context);
+bool ec_net_recvmmsg_batch_check(ProcessContext *context);
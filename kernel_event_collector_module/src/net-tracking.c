@@ -10,6 +10,7 @@
 
 #include <linux/workqueue.h>
 #include <linux/jiffies.h>
+#include <linux/hash.h>
 
 typedef struct table_key {
     uint32_t        pid;
@@ -50,6 +51,43 @@ static LIST_HEAD(s_net_age_list);
 #define NET_TBL_SIZE     262000
 #define NET_TBL_PURGE    200000
 
+// A hit refreshes last_seen of the tracked connection at most once per
+//  NET_PEER_CACHE_REFRESH, so a busy flow is not aged out of the table.
+#define NET_PEER_CACHE_BITS     10
+#define NET_PEER_CACHE_TTL      (30 * HZ)
+#define NET_PEER_CACHE_REFRESH  (10 * HZ)
+
+typedef struct peer_cache_entry {
+    spinlock_t         lock;
+    const struct sock *sk;
+    pid_t              pid;
+    sa_family_t        family;
+    struct in6_addr    addr;
+    unsigned long      expires;
+    unsigned long      refreshed;
+    NET_TBL_KEY        key;
+} NET_PEER_CACHE_ENTRY;
+
+typedef struct peer_cache_stats {
+    uint64_t  lookups[NET_PEER_CACHE_HOOKS];
+    uint64_t  hits[NET_PEER_CACHE_HOOKS];
+} NET_PEER_CACHE_STATS;
+
+static NET_PEER_CACHE_ENTRY s_peer_cache[1 << NET_PEER_CACHE_BITS];
+static DEFINE_PER_CPU(NET_PEER_CACHE_STATS, s_peer_cache_stats);
+static atomic64_t           s_peer_cache_invalidated = ATOMIC64_INIT(0);
+
+static const char * const s_peer_cache_hook_names[NET_PEER_CACHE_HOOKS] = {
+    "lsm-socket_recvmsg",
+    "syscall-recvmsg",
+    "syscall-recvmmsg",
+    "syscall-recvfrom",
+};
+
+static void __ec_net_tracking_peer_cache_init(void);
+static void __ec_net_tracking_peer_cache_flush(void);
+static void __ec_net_tracking_touch(NET_TBL_KEY *key, ProcessContext *context);
+
 
 bool ec_net_tracking_initialize(ProcessContext *context)
 {
@@ -71,6 +109,8 @@ bool ec_net_tracking_initialize(ProcessContext *context)
 
     ec_spinlock_init(&s_net_age_lock, context);
 
+    __ec_net_tracking_peer_cache_init();
+
     // Initialize a workque struct to police the hashtable
     INIT_DELAYED_WORK(&s_net_track_work, __ec_net_tracking_task);
     schedule_delayed_work(&s_net_track_work, s_ntt_delay);
@@ -164,6 +204,26 @@ CATCH_DEFAULT:
     return xcode;
 }
 
+// Updates the last seen time of a tracked connection without adding it
+static void __ec_net_tracking_touch(NET_TBL_KEY *key, ProcessContext *context)
+{
+    NET_TBL_NODE *node;
+
+    ec_write_lock(&s_net_age_lock, context);
+
+    node = ec_hashtbl_get_generic(s_net_hash_table, key, context);
+    if (node)
+    {
+        getnstimeofday(&node->value.last_seen);
+        ++node->value.count;
+
+        list_del(&(node->ageList));
+        list_add(&(node->ageList), &s_net_age_list);
+    }
+
+    ec_write_unlock(&s_net_age_lock, context);
+}
+
 struct priv_data {
     struct timespec time;
     uint32_t        count;
@@ -240,6 +300,9 @@ void ec_net_tracking_clean(ProcessContext *context, int sec)
 
     __ec_net_hash_table_cleanup(context, &data);
 
+    // Purged connections must be reported again the next time they are seen
+    __ec_net_tracking_peer_cache_flush();
+
     TRACE(DL_NET_TRACKING, "%s: Removed %d of %llu cached connections\n", __func__, data.count, total);
 }
 
@@ -263,6 +326,8 @@ ssize_t ec_net_track_purge_all(struct file *file, const char *buf, size_t size,
     INIT_LIST_HEAD(&s_net_age_list);
     ec_write_unlock(&s_net_age_lock, &context);
 
+    __ec_net_tracking_peer_cache_flush();
+
     return size;
 }
 
@@ -348,6 +413,182 @@ int ec_net_track_show_new(struct seq_file *m, void *v)
     return 0;
 }
 
+static void __ec_net_tracking_peer_cache_init(void)
+{
+    int cpu;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(s_peer_cache); ++i)
+    {
+        spin_lock_init(&s_peer_cache[i].lock);
+        s_peer_cache[i].sk = NULL;
+    }
+
+    for_each_possible_cpu(cpu)
+    {
+        memset(per_cpu_ptr(&s_peer_cache_stats, cpu), 0, sizeof(NET_PEER_CACHE_STATS));
+    }
+    atomic64_set(&s_peer_cache_invalidated, 0);
+}
+
+static void __ec_net_tracking_peer_cache_flush(void)
+{
+    unsigned long flags;
+    int           i;
+
+    for (i = 0; i < ARRAY_SIZE(s_peer_cache); ++i)
+    {
+        spin_lock_irqsave(&s_peer_cache[i].lock, flags);
+        s_peer_cache[i].sk = NULL;
+        spin_unlock_irqrestore(&s_peer_cache[i].lock, flags);
+    }
+}
+
+static inline NET_PEER_CACHE_ENTRY *__ec_net_tracking_peer_cache_entry(const struct sock *sk)
+{
+    return &s_peer_cache[hash_ptr((void *)sk, NET_PEER_CACHE_BITS)];
+}
+
+// The tracking table ignores the remote port for inbound connections, so only the
+//  address is compared here
+static bool __ec_net_tracking_peer_addr(CB_SOCK_ADDR *remoteAddr, sa_family_t *family, struct in6_addr *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    *family = remoteAddr->sa_addr.sa_family;
+
+    if (*family == AF_INET)
+    {
+        addr->s6_addr32[0] = remoteAddr->as_in4.sin_addr.s_addr;
+        return true;
+    } else if (*family == AF_INET6)
+    {
+        *addr = remoteAddr->as_in6.sin6_addr;
+        return true;
+    }
+    return false;
+}
+
+bool ec_net_tracking_peer_cache_check(ProcessContext *context, const struct sock *sk, pid_t pid, CB_SOCK_ADDR *remoteAddr, NET_PEER_CACHE_HOOK hook)
+{
+    NET_PEER_CACHE_ENTRY *entry;
+    sa_family_t           family;
+    struct in6_addr       addr;
+    NET_TBL_KEY           key;
+    unsigned long         flags;
+    bool                  hit     = false;
+    bool                  refresh = false;
+
+    CANCEL(sk && remoteAddr && hook < NET_PEER_CACHE_HOOKS, false);
+    CANCEL(__ec_net_tracking_peer_addr(remoteAddr, &family, &addr), false);
+
+    this_cpu_inc(s_peer_cache_stats.lookups[hook]);
+
+    entry = __ec_net_tracking_peer_cache_entry(sk);
+    spin_lock_irqsave(&entry->lock, flags);
+    hit = entry->sk == sk &&
+          entry->pid == pid &&
+          entry->family == family &&
+          ipv6_addr_equal(&entry->addr, &addr) &&
+          time_before(jiffies, entry->expires);
+    if (hit && time_after(jiffies, entry->refreshed + NET_PEER_CACHE_REFRESH))
+    {
+        entry->refreshed = jiffies;
+        key              = entry->key;
+        refresh          = true;
+    }
+    spin_unlock_irqrestore(&entry->lock, flags);
+
+    if (refresh)
+    {
+        __ec_net_tracking_touch(&key, context);
+    }
+
+    if (hit)
+    {
+        this_cpu_inc(s_peer_cache_stats.hits[hook]);
+    }
+    return hit;
+}
+
+void ec_net_tracking_peer_cache_update(const struct sock *sk, pid_t pid, pid_t exec_pid, CB_SOCK_ADDR *localAddr, CB_SOCK_ADDR *remoteAddr)
+{
+    NET_PEER_CACHE_ENTRY *entry;
+    sa_family_t           family;
+    struct in6_addr       addr;
+    unsigned long         flags;
+
+    CANCEL_VOID(sk && localAddr && remoteAddr);
+    CANCEL_VOID(__ec_net_tracking_peer_addr(remoteAddr, &family, &addr));
+
+    entry = __ec_net_tracking_peer_cache_entry(sk);
+    spin_lock_irqsave(&entry->lock, flags);
+    entry->sk        = sk;
+    entry->pid       = pid;
+    entry->family    = family;
+    entry->addr      = addr;
+    entry->expires   = jiffies + NET_PEER_CACHE_TTL;
+    entry->refreshed = jiffies;
+    __ec_net_tracking_set_key(&entry->key, exec_pid, localAddr, remoteAddr, IPPROTO_UDP, CONN_IN);
+    spin_unlock_irqrestore(&entry->lock, flags);
+}
+
+void ec_net_tracking_peer_cache_invalidate(const struct sock *sk)
+{
+    NET_PEER_CACHE_ENTRY *entry;
+    unsigned long         flags;
+
+    CANCEL_VOID(sk);
+
+    entry = __ec_net_tracking_peer_cache_entry(sk);
+    if (READ_ONCE(entry->sk) != sk)
+    {
+        return;
+    }
+
+    spin_lock_irqsave(&entry->lock, flags);
+    if (entry->sk == sk)
+    {
+        entry->sk = NULL;
+        atomic64_inc(&s_peer_cache_invalidated);
+    }
+    spin_unlock_irqrestore(&entry->lock, flags);
+}
+
+void ec_net_tracking_peer_cache_get_stats(NET_PEER_CACHE_HOOK hook, uint64_t *lookups, uint64_t *hits)
+{
+    int cpu;
+
+    *lookups = 0;
+    *hits    = 0;
+    for_each_possible_cpu(cpu)
+    {
+        NET_PEER_CACHE_STATS *stats = per_cpu_ptr(&s_peer_cache_stats, cpu);
+
+        *lookups += READ_ONCE(stats->lookups[hook]);
+        *hits    += READ_ONCE(stats->hits[hook]);
+    }
+}
+
+int ec_net_track_show_peer_cache(struct seq_file *m, void *v)
+{
+    int i;
+
+    seq_printf(m, "%20s | %12s | %12s | %6s |\n", "Hook", "Lookups", "Hits", "Hit %");
+    for (i = 0; i < NET_PEER_CACHE_HOOKS; ++i)
+    {
+        uint64_t lookups;
+        uint64_t hits;
+
+        ec_net_tracking_peer_cache_get_stats(i, &lookups, &hits);
+        seq_printf(m, "%20s | %12llu | %12llu | %6llu |\n",
+                   s_peer_cache_hook_names[i], lookups, hits,
+                   lookups ? (hits * 100) / lookups : 0);
+    }
+    seq_printf(m, "%20s | %12llu |\n", "Invalidated", (uint64_t)atomic64_read(&s_peer_cache_invalidated));
+
+    return 0;
+}
+
 void __ec_net_tracking_set_key(NET_TBL_KEY    *key,
                       pid_t           pid,
                       CB_SOCK_ADDR   *localAddr,
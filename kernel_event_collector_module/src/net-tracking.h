@@ -21,3 +21,22 @@ bool ec_net_tracking_check_cache(
     CB_SOCK_ADDR   *remoteAddr,
     uint16_t        proto,
     CONN_DIRECTION  conn_dir);
+
+// Remembers the last peer each UDP socket reported so that following datagrams from the
+//  same peer can skip the process lookup and the tracking table.  Hits still keep the
+//  tracked connection from aging out.  Entries are keyed by the struct sock and dropped
+//  when it is freed or reused.
+typedef enum _net_peer_cache_hook {
+    NET_PEER_CACHE_LSM_RECVMSG,
+    NET_PEER_CACHE_SYS_RECVMSG,
+    NET_PEER_CACHE_SYS_RECVMMSG,
+    NET_PEER_CACHE_SYS_RECVFROM,
+    NET_PEER_CACHE_HOOKS
+} NET_PEER_CACHE_HOOK;
+
+bool ec_net_tracking_peer_cache_check(ProcessContext *context, const struct sock *sk, pid_t pid, CB_SOCK_ADDR *remoteAddr, NET_PEER_CACHE_HOOK hook);
+void ec_net_tracking_peer_cache_update(const struct sock *sk, pid_t pid, pid_t exec_pid, CB_SOCK_ADDR *localAddr, CB_SOCK_ADDR *remoteAddr);
+void ec_net_tracking_peer_cache_invalidate(const struct sock *sk);
+
+// Lookups count each report that reached the cache, summed over all CPUs
+void ec_net_tracking_peer_cache_get_stats(NET_PEER_CACHE_HOOK hook, uint64_t *lookups, uint64_t *hits);
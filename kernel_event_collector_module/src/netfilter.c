@@ -5,7 +5,6 @@
 #include "priv.h"
 #include "net-helper.h"
 #include "mem-cache.h"
-#include "path-buffers.h"
 
 #include <linux/skbuff.h>
 #undef __KERNEL__
@@ -18,12 +17,20 @@
 #include <linux/ip.h>
 #include <linux/tcp.h>
 #include <linux/string.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <asm/unaligned.h>
 #include <net/ip.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)  //{
+#include <linux/sched/clock.h>
+#endif  //}
 
 #include "cb-isolation.h"
 #include "cb-spinlock.h"
 #include "event-factory.h"
 #include "dns-parser.h"
+#include "dns-stream.h"
+#include "dns-dedup.h"
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3, 10, 0)
     #define ec_ipv6_skip_exthdr(skb, ptr, pProtocol) (ptr = ipv6_skip_exthdr(skb, ptr, pProtocol))
@@ -37,7 +44,6 @@
 #define NUM_HOOKS     4
 static struct nf_hook_ops nfho_local_out[NUM_HOOKS];
 
-int __ec_find_char_offset(const struct sk_buff *skb, int offset, char target);
 int __ec_web_proxy_request_check(ProcessContext *context, struct sk_buff *skb);
 void __ec_process_dns_packet(
     struct sk_buff *skb,
@@ -239,6 +245,94 @@ CATCH_DEFAULT:
     return NF_ACCEPT;
 }
 
+static void __ec_send_dns_response(CB_EVENT_DNS_RESPONSE *response, ProcessContext *context)
+{
+    CANCEL_VOID(ec_dns_dedup_check(response));
+
+    ec_event_send_dns(
+        CB_EVENT_TYPE_DNS_RESPONSE,
+        response,
+        context);
+}
+
+static void __ec_send_dns_message(char *dns_data, int dns_data_len, void *priv, ProcessContext *context)
+{
+    CB_EVENT_DNS_RESPONSE response = { 0 };
+
+    TRY_MSG(!ec_dns_parse_data(dns_data, dns_data_len, &response, context),
+             DL_INFO, "No DNS record found");
+
+    __ec_send_dns_response(&response, context);
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(response.records);
+}
+
+static void __ec_dns_flow_key(struct sk_buff *skb, struct tcphdr *tcphdr, DNS_FLOW_KEY *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->sport = tcphdr->source;
+    key->dport = tcphdr->dest;
+
+    if (ip_hdr(skb)->version == 4)
+    {
+        key->family = AF_INET;
+        memcpy(key->saddr, &ip_hdr(skb)->saddr, sizeof(ip_hdr(skb)->saddr));
+        memcpy(key->daddr, &ip_hdr(skb)->daddr, sizeof(ip_hdr(skb)->daddr));
+    } else
+    {
+        key->family = AF_INET6;
+        memcpy(key->saddr, &ipv6_hdr(skb)->saddr, sizeof(ipv6_hdr(skb)->saddr));
+        memcpy(key->daddr, &ipv6_hdr(skb)->daddr, sizeof(ipv6_hdr(skb)->daddr));
+    }
+}
+
+// DNS over TCP.  The segment is handed to the per flow reassembly, which calls back for
+//  every response it completes.
+static void __ec_process_dns_tcp(struct sk_buff *skb, int payload_offset, ProcessContext *context)
+{
+    struct tcphdr  tcphdr;
+    DNS_FLOW_KEY   key;
+    char          *data   = NULL;
+    char          *copy   = NULL;
+    int            length = 0;
+
+    TRY_MSG(!skb_copy_bits(skb, payload_offset, &tcphdr, sizeof(tcphdr)),
+            DL_WARNING, "Error copying TCP packet bits");
+    TRY(ntohs(tcphdr.source) == 53);
+
+    payload_offset += tcphdr.doff * 4;
+    length          = (int)skb->len - payload_offset;
+
+    __ec_dns_flow_key(skb, &tcphdr, &key);
+
+    // A GRO segment can carry more than one message may hold.  Cutting it short would
+    //  leave the flow expecting data it never sees, so the flow is dropped instead.
+    TRY_DO(length <= DNS_MAX_MESSAGE, {
+        ec_dns_stream_input(&key, ntohl(tcphdr.seq), true, NULL, 0, __ec_send_dns_message, NULL, context);
+    });
+
+    if (length > 0)
+    {
+        // Only a payload that reaches into the paged data needs a copy
+        if (payload_offset + length > skb_headlen(skb))
+        {
+            copy = ec_mem_cache_alloc_generic(length, context);
+            TRY(copy);
+        }
+        data = skb_header_pointer(skb, payload_offset, length, copy);
+        TRY_MSG(data, DL_ERROR, "Error copying TCP DNS response data");
+    } else
+    {
+        length = 0;
+    }
+
+    ec_dns_stream_input(&key, ntohl(tcphdr.seq), tcphdr.fin || tcphdr.rst, data, length, __ec_send_dns_message, NULL, context);
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(copy);
+}
+
 // This hook only looks for DNS response packets.  If one is found, a message is sent to
 //  user space for processing.  NOTE: Process ID and such will be added to the event but
 //  it is not used by the daemon.  This is only used for internal caching.
@@ -249,15 +343,15 @@ void __ec_process_dns_packet(
     ProcessContext *context)
 {
     CB_EVENT_DNS_RESPONSE  response = { 0 };
-    char                  *dns_data = NULL;
     int                    port     = 0;
     size_t                 length   = 0;
 
-    // TODO: Add support for TCP
-    //  DNS can use TCP, though it generally does not use TCP for the records we care about.
-    //  I did spend some time attempting to get it working, but I had difficulty getting the payload
-    //  for the TCP packet.  I seemed to multiple packets with no payload, and then one with 108 bytes.
-    //  However I could never get any records when I parsed it.
+    if (protocol == IPPROTO_TCP)
+    {
+        __ec_process_dns_tcp(skb, payload_offset, context);
+        return;
+    }
+
     TRY(protocol == IPPROTO_UDP);
 
     {
@@ -268,191 +362,296 @@ void __ec_process_dns_packet(
                 DL_WARNING, "Error copying UDP packet bits");
 
         port           = ntohs(udphdr.source);
-        length         = min((size_t)PATH_MAX, (size_t)(ntohs(udphdr.len) - sizeof(struct udphdr)));
+        TRY(ntohs(udphdr.len) > sizeof(struct udphdr));
+        length         = min((size_t)DNS_MAX_MESSAGE, (size_t)(ntohs(udphdr.len) - sizeof(struct udphdr)));
         payload_offset = payload_offset + sizeof(udphdr);
     }
 
     if (port == 53)
     {
         TRY_MSG(length > 0, DL_WARNING, "invalid length:%ld for UDP response", length);
-        dns_data = ec_get_path_buffer(context);
-        if (dns_data)
-        {
-            TRY_MSG(!skb_copy_bits(skb, payload_offset, dns_data, length),
-                    DL_ERROR, "Error copying UDP DNS response data");
 
-            TRY_MSG(!ec_dns_parse_data(dns_data, length, &response, context),
-                     DL_INFO, "No DNS record found");
+        TRY_MSG(!ec_dns_parse_skb(skb, payload_offset, length, &response, context),
+                 DL_INFO, "No DNS record found");
 
-            ec_event_send_dns(
-                CB_EVENT_TYPE_DNS_RESPONSE,
-                &response,
-                context);
-        }
+        __ec_send_dns_response(&response, context);
     }
 
 
 CATCH_DEFAULT:
-    ec_put_path_buffer(dns_data);
     ec_mem_cache_free_generic(response.records);
 }
 
-int __ec_web_proxy_request_check(ProcessContext *context, struct sk_buff *skb)
+// Only the request line is looked at, a proxy request that does not fit is ignored
+#define HTTP_REQUEST_LINE_MAX   2048
+#define HTTP_VERSION_LEN        8
+
+// A connection is classified by its first payload segment, later ones are skipped
+#define PROXY_FLOW_BITS         12
+
+// The first four bytes of the payload as a little endian word
+#define HTTP_WORD(a, b, c, d)   ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+typedef struct http_method {
+    uint32_t      word;
+    const char   *name;
+    int           len;
+} HTTP_METHOD;
+
+static const HTTP_METHOD s_http_methods[] = {
+    { HTTP_WORD('G', 'E', 'T', ' '), "GET",     3 },
+    { HTTP_WORD('P', 'U', 'T', ' '), "PUT",     3 },
+    { HTTP_WORD('P', 'O', 'S', 'T'), "POST",    4 },
+    { HTTP_WORD('D', 'E', 'L', 'E'), "DELETE",  6 },
+    { HTTP_WORD('C', 'O', 'N', 'N'), "CONNECT", 7 },
+};
+
+typedef struct proxy_check_stats {
+    uint64_t  segments;
+    uint64_t  skipped;
+    uint64_t  rejected;
+    uint64_t  inspected;
+    uint64_t  reported;
+    uint64_t  inspect_ns;
+} PROXY_CHECK_STATS;
+
+// Lockless, a lost update only means a segment is looked at once more
+static unsigned long s_proxy_flows[1 << PROXY_FLOW_BITS];
+static DEFINE_PER_CPU(PROXY_CHECK_STATS, s_proxy_stats);
+
+static unsigned long __ec_proxy_flow_tag(struct sk_buff *skb, struct tcphdr *tcp_header, int family)
 {
-    char tmp[10];
-    char url[PROXY_SERVER_MAX_LEN + 1];
-
-    static const char * const HTTP_METHODS[] = {"GET", "PUT", "POST", "DELETE", "CONNECT"};
-    static const int HTTP_METHODS_LEN[] = {3, 3, 4, 6, 7};
-    static const int HTTP_METHOD_MAX_LEN = 7;
-    static const char * const HTTP_VERSION[] = {"HTTP/1.1", "HTTP/1.0"};
-    static const int HTTP_VERSION_LEN = 8;
-    int family;
-
-    int i;
-    int space_offset;
-    int url_len;
-    int payload_offset;
-    struct tcphdr *tcp_header;
-    CB_SOCK_ADDR      localAddr;
-    CB_SOCK_ADDR      remoteAddr;
+    uint32_t ports = ((uint32_t)tcp_header->source << 16) | tcp_header->dest;
+    uint32_t hash;
 
-    TRY(skb);
-    TRY(skb->sk);
+    // The socket alone is not enough, it may be reused for a new connection
+    if (family == AF_INET)
+    {
+        hash = jhash_2words(ip_hdr(skb)->daddr, ports, 0);
+    } else
+    {
+        hash = jhash(&ipv6_hdr(skb)->daddr, sizeof(struct in6_addr), ports);
+    }
 
-    family = skb->sk->sk_family;
+    // Never zero, so an empty slot does not match
+    return ((unsigned long)skb->sk ^ hash) | 1;
+}
 
-    // The skb_transport_offset will give me offset of the transport header, skipping any IPv6 extended headers.
-    payload_offset = skb_transport_offset(skb) + tcp_hdrlen(skb);
+// Finds target in at most limit bytes from offset.  Linear data is searched in place,
+//  paged data a chunk at a time.
+static int __ec_skb_memchr(const struct sk_buff *skb, int offset, int limit, char target)
+{
+    char  chunk[128];
+    int   end = min_t(int, skb->len, offset + limit);
 
-    if (skb_copy_bits(skb, payload_offset, tmp, HTTP_METHOD_MAX_LEN + 2) != 0)
+    while (offset < end)
     {
-        goto CATCH_DEFAULT;
-    }
+        int   len  = min_t(int, sizeof(chunk), end - offset);
+        char *data = skb_header_pointer(skb, offset, len, chunk);
+        char *hit;
 
-    for (i = 0; i < 5; i++)
-    {
-        if (strncmp(HTTP_METHODS[i], tmp, HTTP_METHODS_LEN[i]) != 0)
+        if (!data)
         {
-            continue;
+            return -1;
         }
 
-        if (tmp[HTTP_METHODS_LEN[i] + 1] == '/')
+        hit = memchr(data, target, len);
+        if (hit)
         {
-            goto CATCH_DEFAULT;
+            return offset + (hit - data);
         }
+        offset += len;
+    }
+    return -1;
+}
 
-        space_offset = __ec_find_char_offset(skb, payload_offset + HTTP_METHODS_LEN[i] + 2, ' ');
-        if (space_offset == -1)
-        {
-            goto CATCH_DEFAULT;
-        }
+static const HTTP_METHOD *__ec_http_method(struct sk_buff *skb, int payload_offset)
+{
+    char      tmp[sizeof(uint32_t)];
+    char     *head;
+    uint32_t  word;
+    int       i;
 
-        if (skb_copy_bits(skb, space_offset + 1,    tmp, HTTP_VERSION_LEN) != 0)
-        {
-            goto CATCH_DEFAULT;
-        }
+    head = skb_header_pointer(skb, payload_offset, sizeof(tmp), tmp);
+    if (!head)
+    {
+        return NULL;
+    }
+    word = get_unaligned_le32(head);
+
+    for (i = 0; i < ARRAY_SIZE(s_http_methods); ++i)
+    {
+        const HTTP_METHOD *method = &s_http_methods[i];
+        char               rest[8];
+        char              *tail;
 
-        if (strncmp(HTTP_VERSION[0], tmp, HTTP_VERSION_LEN) != 0 &&
-            strncmp(HTTP_VERSION[1], tmp, HTTP_VERSION_LEN) != 0)
+        if (word != method->word)
         {
-            goto CATCH_DEFAULT;
+            continue;
         }
 
-        url_len = space_offset - (payload_offset + HTTP_METHODS_LEN[i] + 1);
-        if (url_len >= PROXY_SERVER_MAX_LEN)
+        // The word already covers "GET " and "PUT "
+        if (method->len < 4)
         {
-            url_len = PROXY_SERVER_MAX_LEN - 1;
+            return method;
         }
 
-        if (skb_copy_bits(skb, payload_offset + HTTP_METHODS_LEN[i] + 1, url, url_len) != 0)
+        // Check whatever the word did not cover, and the space after the method
+        tail = skb_header_pointer(skb, payload_offset + 4, method->len + 1 - 4, rest);
+        if (tail &&
+            !memcmp(tail, method->name + 4, method->len - 4) &&
+            tail[method->len - 4] == ' ')
         {
-            goto CATCH_DEFAULT;
+            return method;
         }
+        return NULL;
+    }
+    return NULL;
+}
 
-        url[url_len] = 0;
+int __ec_web_proxy_request_check(ProcessContext *context, struct sk_buff *skb)
+{
+    char               tmp[HTTP_VERSION_LEN];
+    char              *version;
+    char               url[PROXY_SERVER_MAX_LEN + 1];
+    const char        *url_start;
+    const HTTP_METHOD *method;
+    unsigned long     *flow;
+    unsigned long      tag;
+    uint64_t           start;
+    int                family;
+    int                space_offset;
+    int                url_offset;
+    int                url_len;
+    int                payload_offset;
+    struct tcphdr     *tcp_header;
+    CB_SOCK_ADDR       localAddr;
+    CB_SOCK_ADDR       remoteAddr;
 
-        TRACE(DL_INFO, "%s: will send proxy event for pid %lld to %s\n", __func__, (uint64_t)ec_getpid(current), url);
+    TRY(skb);
+    TRY(skb->sk);
 
-        localAddr. sa_addr.sa_family = family;
-        remoteAddr.sa_addr.sa_family = family;
-        tcp_header                   = (struct tcphdr *) skb_transport_header(skb);
+    family     = skb->sk->sk_family;
+    tcp_header = (struct tcphdr *) skb_transport_header(skb);
 
-        if (family == AF_INET)
-        {
-            struct iphdr *ip_header = (struct iphdr *)skb_network_header(skb);
+    // The skb_transport_offset will give me offset of the transport header, skipping any IPv6 extended headers.
+    payload_offset = skb_transport_offset(skb) + tcp_hdrlen(skb);
 
-            remoteAddr.as_in4.sin_addr.s_addr = ip_header->daddr;
-            localAddr .as_in4.sin_addr.s_addr = ip_header->saddr;
+    // Most segments are bare ACKs
+    TRY(payload_offset < skb->len);
 
-            remoteAddr.as_in4.sin_port = tcp_header->dest;
-            localAddr .as_in4.sin_port = tcp_header->source;
-        } else {
-            struct ipv6hdr *ip_header = (struct ipv6hdr *)skb_network_header(skb);
+    this_cpu_inc(s_proxy_stats.segments);
 
-            memcpy(&remoteAddr.as_in6.sin6_addr, &ip_header->daddr, sizeof(struct in6_addr));
-            memcpy(&localAddr.as_in6.sin6_addr, &ip_header->saddr, sizeof(struct in6_addr));
+    tag  = __ec_proxy_flow_tag(skb, tcp_header, family);
+    flow = &s_proxy_flows[hash_long(tag, PROXY_FLOW_BITS)];
+    if (READ_ONCE(*flow) == tag)
+    {
+        this_cpu_inc(s_proxy_stats.skipped);
+        goto CATCH_DEFAULT;
+    }
+    WRITE_ONCE(*flow, tag);
 
-            remoteAddr.as_in6.sin6_port = tcp_header->dest;
-            localAddr .as_in6.sin6_port = tcp_header->source;
-        }
+    start = local_clock();
 
-        // We don't track the DNS events
-        ec_event_send_net_proxy(
-            NULL,
-            "PROXY",
-            CB_EVENT_TYPE_WEB_PROXY,
-            &localAddr,
-            &remoteAddr,
-            IPPROTO_TCP,
-            url,
-            0, //TODO: actual_port will be obained at cbdaemon based on actual_server url.
-            skb->sk,
-            context);
+    method = __ec_http_method(skb, payload_offset);
+    if (!method)
+    {
+        this_cpu_inc(s_proxy_stats.rejected);
+        goto CATCH_ACCOUNT;
     }
+    this_cpu_inc(s_proxy_stats.inspected);
+
+    url_offset = payload_offset + method->len + 1;
+
+    // A request to the server itself, not through a proxy
+    url_start = skb_header_pointer(skb, url_offset, 1, tmp);
+    TRY_STEP(ACCOUNT, url_start && *url_start != '/');
+
+    space_offset = __ec_skb_memchr(skb, url_offset + 1, HTTP_REQUEST_LINE_MAX, ' ');
+    TRY_STEP(ACCOUNT, space_offset != -1);
+
+    version = skb_header_pointer(skb, space_offset + 1, HTTP_VERSION_LEN, tmp);
+    TRY_STEP(ACCOUNT, version);
+    TRY_STEP(ACCOUNT, !memcmp(version, "HTTP/1.1", HTTP_VERSION_LEN) ||
+                      !memcmp(version, "HTTP/1.0", HTTP_VERSION_LEN));
+
+    url_len = min(space_offset - url_offset, PROXY_SERVER_MAX_LEN - 1);
+    TRY_STEP(ACCOUNT, !skb_copy_bits(skb, url_offset, url, url_len));
+    url[url_len] = 0;
+
+    TRACE(DL_INFO, "%s: will send proxy event for pid %lld to %s\n", __func__, (uint64_t)ec_getpid(current), url);
+
+    localAddr. sa_addr.sa_family = family;
+    remoteAddr.sa_addr.sa_family = family;
+
+    if (family == AF_INET)
+    {
+        struct iphdr *ip_header = (struct iphdr *)skb_network_header(skb);
+
+        remoteAddr.as_in4.sin_addr.s_addr = ip_header->daddr;
+        localAddr .as_in4.sin_addr.s_addr = ip_header->saddr;
+
+        remoteAddr.as_in4.sin_port = tcp_header->dest;
+        localAddr .as_in4.sin_port = tcp_header->source;
+    } else {
+        struct ipv6hdr *ip_header = (struct ipv6hdr *)skb_network_header(skb);
+
+        memcpy(&remoteAddr.as_in6.sin6_addr, &ip_header->daddr, sizeof(struct in6_addr));
+        memcpy(&localAddr.as_in6.sin6_addr, &ip_header->saddr, sizeof(struct in6_addr));
+
+        remoteAddr.as_in6.sin6_port = tcp_header->dest;
+        localAddr .as_in6.sin6_port = tcp_header->source;
+    }
+
+    this_cpu_inc(s_proxy_stats.reported);
+
+    // We don't track the DNS events
+    ec_event_send_net_proxy(
+        NULL,
+        "PROXY",
+        CB_EVENT_TYPE_WEB_PROXY,
+        &localAddr,
+        &remoteAddr,
+        IPPROTO_TCP,
+        url,
+        0, //TODO: actual_port will be obained at cbdaemon based on actual_server url.
+        skb->sk,
+        context);
+
+CATCH_ACCOUNT:
+    this_cpu_add(s_proxy_stats.inspect_ns, local_clock() - start);
 
 CATCH_DEFAULT:
     return 0;
 }
 
-int __ec_find_char_offset(const struct sk_buff *skb, int offset, char target)
+int ec_net_proxy_show(struct seq_file *m, void *v)
 {
-    char *ptr;
-    char *frag_addr;
-    int frag_len;
-    int current_offset;
-    int i;
-
-    //There is data inside skb, so search the remaining data before search fragments.
-    if (skb->len - skb->data_len > offset)
-    {
-        current_offset = offset;
-        for (ptr = (char *)skb->data + offset; ptr < (char *) skb_tail_pointer(skb); ptr++)
-        {
-            if (*ptr == target)
-            {
-                return current_offset;
-            }
-            current_offset++;
-        }
-    } else {
-        current_offset = skb->len - skb->data_len;
-    }
+    PROXY_CHECK_STATS total = { 0 };
+    int               cpu;
 
-    for (i = skb_shinfo(skb)->nr_frags - 1; i >= 0; i--)
+    for_each_possible_cpu(cpu)
     {
-        frag_addr = skb_frag_address_safe(&skb_shinfo(skb)->frags[i]);
-        frag_len = skb_frag_size(&skb_shinfo(skb)->frags[i]);
-        for (ptr = frag_addr; ptr <= frag_addr + frag_len; ptr++)
-        {
-            if (current_offset >= offset && *ptr == target)
-            {
-                return current_offset;
-            }
-            current_offset++;
-        }
+        PROXY_CHECK_STATS *stats = per_cpu_ptr(&s_proxy_stats, cpu);
+
+        total.segments   += READ_ONCE(stats->segments);
+        total.skipped    += READ_ONCE(stats->skipped);
+        total.rejected   += READ_ONCE(stats->rejected);
+        total.inspected  += READ_ONCE(stats->inspected);
+        total.reported   += READ_ONCE(stats->reported);
+        total.inspect_ns += READ_ONCE(stats->inspect_ns);
     }
-    return -1;
+
+    seq_printf(m, "%16s | %12llu |\n", "Segments", total.segments);
+    seq_printf(m, "%16s | %12llu |\n", "Flow skipped", total.skipped);
+    seq_printf(m, "%16s | %12llu |\n", "Fast rejected", total.rejected);
+    seq_printf(m, "%16s | %12llu |\n", "Inspected", total.inspected);
+    seq_printf(m, "%16s | %12llu |\n", "Reported", total.reported);
+    seq_printf(m, "%16s | %12llu |\n", "Check ns", total.inspect_ns);
+    seq_printf(m, "%16s | %12llu |\n", "Avg check ns",
+               (total.rejected + total.inspected) ? total.inspect_ns / (total.rejected + total.inspected) : 0);
+
+    return 0;
 }
 
 bool ec_netfilter_initialize(ProcessContext *context, uint64_t enableHooks)
@@ -2,36 +2,124 @@
 // Copyright (c) 2019-2020 VMware, Inc. All rights reserved.
 // Copyright (c) 2016-2019 Carbon Black, Inc. All rights reserved.
 
+#include "priv.h"
 #include "path-buffers.h"
 #include "mem-cache.h"
 #include "process-context.h"
 #include "task-helper.h"
 
+#include <linux/delay.h>
 #include <linux/limits.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
 
 struct STRING_NODE {
     struct list_head  listEntry;
+
+    // Set on the per-cpu scratch buffers, which are claimed with in_use
+    //  instead of being returned to s_string_pool
+    bool      is_percpu;
+    atomic_t  in_use;
+
     char  path[PATH_MAX+1];
 };
 
 static CB_MEM_CACHE s_string_pool;
 
+// Each cpu owns one preallocated buffer. It is claimed by whoever gets there first, so a
+//  nested user (interrupt or a task preempted on the same cpu) falls back to the pool.
+//  The claim is not tied to preemption, so the holder is free to sleep or migrate.
+static DEFINE_PER_CPU(struct STRING_NODE *, s_percpu_path_buffer);
+static DEFINE_PER_CPU(uint64_t, s_path_buffer_fast);
+static DEFINE_PER_CPU(uint64_t, s_path_buffer_fallback);
+
 bool ec_path_buffers_init(ProcessContext *context)
 {
-    return ec_mem_cache_create(&s_string_pool, "path_string_pool", sizeof(struct STRING_NODE), context);
+    int cpu;
+
+    TRY(ec_mem_cache_create(&s_string_pool, "path_string_pool", sizeof(struct STRING_NODE), context));
+
+    for_each_possible_cpu(cpu)
+    {
+        struct STRING_NODE *node = ec_mem_cache_alloc_generic(sizeof(struct STRING_NODE), context);
+
+        // The pool still works without the scratch buffer for this cpu
+        if (node)
+        {
+            node->is_percpu = true;
+            atomic_set(&node->in_use, 0);
+        }
+        per_cpu(s_percpu_path_buffer, cpu)   = node;
+        per_cpu(s_path_buffer_fast, cpu)     = 0;
+        per_cpu(s_path_buffer_fallback, cpu) = 0;
+    }
+
+    return true;
+
+CATCH_DEFAULT:
+    return false;
 }
 
 void ec_path_buffers_shutdown(ProcessContext *context)
 {
+    int cpu;
+
+    // Claim every scratch buffer so that new users fall back to the pool.  A holder may
+    //  be sleeping or running on another cpu, so wait for it to release the buffer.
+    for_each_possible_cpu(cpu)
+    {
+        struct STRING_NODE *node = per_cpu(s_percpu_path_buffer, cpu);
+
+        if (node && atomic_cmpxchg(&node->in_use, 0, 1) != 0)
+        {
+            TRACE(DL_WARNING, "Path buffer for cpu %d still in use at shutdown, waiting", cpu);
+            while (atomic_cmpxchg(&node->in_use, 0, 1) != 0)
+            {
+                msleep(1);
+            }
+        }
+    }
+
+    // A user may have read the buffer pointer without trying to claim it yet
+    synchronize_rcu();
+
+    for_each_possible_cpu(cpu)
+    {
+        ec_mem_cache_free_generic(per_cpu(s_percpu_path_buffer, cpu));
+        per_cpu(s_percpu_path_buffer, cpu) = NULL;
+    }
+
     ec_mem_cache_destroy(&s_string_pool, context, NULL);
 }
 
-// Get a string buffer from the the list, or alloc a new one.
+// Get this cpu's scratch buffer, or a string buffer from the pool when it is taken.
 char *ec_get_path_buffer(ProcessContext *context)
 {
     struct STRING_NODE *node   = NULL;
 
-    node = (struct STRING_NODE *)ec_mem_cache_alloc(&s_string_pool, context);
+    // The read side lets shutdown wait for a claim in progress before freeing the buffer
+    rcu_read_lock();
+    node = per_cpu(s_percpu_path_buffer, get_cpu());
+    if (node && atomic_cmpxchg(&node->in_use, 0, 1) != 0)
+    {
+        node = NULL;
+    }
+    put_cpu();
+    rcu_read_unlock();
+
+    if (node)
+    {
+        this_cpu_inc(s_path_buffer_fast);
+    } else
+    {
+        node = (struct STRING_NODE *)ec_mem_cache_alloc(&s_string_pool, context);
+        if (node)
+        {
+            node->is_percpu = false;
+        }
+        this_cpu_inc(s_path_buffer_fallback);
+    }
+
     if (node)
     {
         node->path[0]        = 0;
@@ -46,6 +134,31 @@ void ec_put_path_buffer(char *buffer)
 
     if (buffer)
     {
-        ec_mem_cache_free(&s_string_pool, container_of((void *)buffer, struct STRING_NODE, path), &context);
+        struct STRING_NODE *node = container_of((void *)buffer, struct STRING_NODE, path);
+
+        if (node->is_percpu)
+        {
+            // Possibly from another cpu if we migrated while holding it
+            smp_mb();
+            atomic_set(&node->in_use, 0);
+        } else
+        {
+            ec_mem_cache_free(&s_string_pool, node, &context);
+        }
+    }
+}
+
+void ec_path_buffers_get_stats(uint64_t *fast, uint64_t *fallback)
+{
+    int cpu;
+
+    CANCEL_VOID(fast && fallback);
+
+    *fast     = 0;
+    *fallback = 0;
+    for_each_possible_cpu(cpu)
+    {
+        *fast     += per_cpu(s_path_buffer_fast, cpu);
+        *fallback += per_cpu(s_path_buffer_fallback, cpu);
     }
 }
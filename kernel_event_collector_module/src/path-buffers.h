@@ -11,3 +11,4 @@ bool ec_path_buffers_init(ProcessContext *context);
 void ec_path_buffers_shutdown(ProcessContext *context);
 char *ec_get_path_buffer(ProcessContext *context);
 void ec_put_path_buffer(char *buffer);
+void ec_path_buffers_get_stats(uint64_t *fast, uint64_t *fallback);
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "prefix-trie.h"
+#include "mem-cache.h"
+
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+
+#define PREFIX_TRIE_NONE      0
+#define PREFIX_TRIE_MAX_NODES U16_MAX
+
+// Serializes replacing the trie of any holder.  Readers only use RCU.
+static DEFINE_MUTEX(s_prefix_trie_update_lock);
+
+// Nodes are stored in one flat array. The root is node 0, which can never be a child,
+//  so 0 doubles as "no node" for the child and sibling links.
+struct prefix_trie_node {
+    char      c;
+    bool      terminal;     // a name ends here
+    uint16_t  child;        // first child
+    uint16_t  sibling;      // next child of our parent
+};
+
+struct prefix_trie {
+    int                      name_count;
+    int                      node_count;
+    struct prefix_trie_node  nodes[];
+};
+
+static uint16_t __ec_prefix_trie_find_child(PrefixTrie *trie, uint16_t node, char c)
+{
+    uint16_t child = trie->nodes[node].child;
+
+    while (child != PREFIX_TRIE_NONE && trie->nodes[child].c != c)
+    {
+        child = trie->nodes[child].sibling;
+    }
+    return child;
+}
+
+PrefixTrie *ec_prefix_trie_build(const char * const *names, int count, ProcessContext *context)
+{
+    PrefixTrie *trie      = NULL;
+    size_t      max_nodes = 1;
+    int         i;
+
+    CANCEL(names || count == 0, NULL);
+
+    // Worst case is one node per character plus the root
+    for (i = 0; i < count; ++i)
+    {
+        max_nodes += (names[i] ? strlen(names[i]) : 0);
+    }
+    CANCEL_MSG(max_nodes <= PREFIX_TRIE_MAX_NODES, NULL,
+               DL_WARNING, "%s: name list is too large (%zu nodes)", __func__, max_nodes);
+
+    trie = ec_mem_cache_alloc_generic(sizeof(PrefixTrie) + max_nodes * sizeof(struct prefix_trie_node), context);
+    CANCEL(trie, NULL);
+
+    memset(trie->nodes, 0, max_nodes * sizeof(struct prefix_trie_node));
+    trie->name_count = 0;
+    trie->node_count = 1;
+
+    for (i = 0; i < count; ++i)
+    {
+        const char *name = names[i];
+        uint16_t    node = 0;
+
+        // An empty name would match everything
+        if (!name || !name[0])
+        {
+            continue;
+        }
+
+        for (; *name; ++name)
+        {
+            uint16_t child = __ec_prefix_trie_find_child(trie, node, *name);
+
+            if (child == PREFIX_TRIE_NONE)
+            {
+                child = (uint16_t)trie->node_count++;
+                trie->nodes[child].c       = *name;
+                trie->nodes[child].sibling = trie->nodes[node].child;
+                trie->nodes[node].child    = child;
+            }
+            node = child;
+        }
+
+        if (!trie->nodes[node].terminal)
+        {
+            trie->nodes[node].terminal = true;
+            trie->name_count += 1;
+        }
+    }
+
+    return trie;
+}
+
+void ec_prefix_trie_free(PrefixTrie *trie)
+{
+    ec_mem_cache_free_generic(trie);
+}
+
+int ec_prefix_trie_count(PrefixTrie *trie)
+{
+    return trie ? trie->name_count : 0;
+}
+
+bool ec_prefix_trie_match(PrefixTrie *trie, const char *str, int len)
+{
+    uint16_t node = 0;
+    int      i;
+
+    CANCEL(trie && str, false);
+
+    for (i = 0; i < len && str[i]; ++i)
+    {
+        node = __ec_prefix_trie_find_child(trie, node, str[i]);
+        if (node == PREFIX_TRIE_NONE)
+        {
+            return false;
+        }
+
+        // The shortest matching name is enough
+        if (trie->nodes[node].terminal)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ec_prefix_trie_holder_load(PrefixTrieHolder *holder, const char * const *names, int count, ProcessContext *context)
+{
+    PrefixTrie *trie = NULL;
+    PrefixTrie *old  = NULL;
+
+    CANCEL(holder, false);
+
+    trie = ec_prefix_trie_build(names, count, context);
+    CANCEL(trie, false);
+
+    mutex_lock(&s_prefix_trie_update_lock);
+    old = rcu_dereference_protected(holder->trie, lockdep_is_held(&s_prefix_trie_update_lock));
+    rcu_assign_pointer(holder->trie, trie);
+    mutex_unlock(&s_prefix_trie_update_lock);
+
+    // Wait for any hook still walking the old trie
+    synchronize_rcu();
+    ec_prefix_trie_free(old);
+
+    return true;
+}
+
+bool ec_prefix_trie_holder_load_list(PrefixTrieHolder *holder, const char *list, size_t size, ProcessContext *context)
+{
+    const char **names = NULL;
+    bool         result = false;
+    int          count = 0;
+    size_t       i;
+
+    CANCEL(holder && list, false);
+    CANCEL_MSG(size > 0 && size <= PREFIX_TRIE_MAX_LIST_SIZE && list[size - 1] == 0, false,
+               DL_WARNING, "%s: invalid name list of size %zu", __func__, size);
+
+    for (i = 0; i < size; ++i)
+    {
+        count += (list[i] == 0);
+    }
+
+    names = ec_mem_cache_alloc_generic(count * sizeof(char *), context);
+    CANCEL(names, false);
+
+    count = 0;
+    for (i = 0; i < size; i += strlen(&list[i]) + 1)
+    {
+        names[count++] = &list[i];
+    }
+
+    result = ec_prefix_trie_holder_load(holder, names, count, context);
+    ec_mem_cache_free_generic(names);
+
+    return result;
+}
+
+void ec_prefix_trie_holder_clear(PrefixTrieHolder *holder)
+{
+    PrefixTrie *old = NULL;
+
+    CANCEL_VOID(holder);
+
+    mutex_lock(&s_prefix_trie_update_lock);
+    old = rcu_dereference_protected(holder->trie, lockdep_is_held(&s_prefix_trie_update_lock));
+    RCU_INIT_POINTER(holder->trie, NULL);
+    mutex_unlock(&s_prefix_trie_update_lock);
+
+    synchronize_rcu();
+    ec_prefix_trie_free(old);
+}
+
+bool ec_prefix_trie_holder_match(PrefixTrieHolder *holder, const char *str, int len)
+{
+    bool result = false;
+
+    CANCEL(holder, false);
+
+    rcu_read_lock();
+    result = ec_prefix_trie_match(rcu_dereference(holder->trie), str, len);
+    rcu_read_unlock();
+
+    return result;
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#pragma once
+
+#include "process-context.h"
+
+// prefix-trie answers "does this string start with any of these names" with one walk
+//  over the string instead of one strncmp per name. A trie is built once from a list
+//  and is read only afterwards.
+//
+// A PrefixTrieHolder publishes a trie with RCU so that it can be replaced at runtime
+//  (for example from an ioctl) while hooks keep matching against it without a lock.
+//
+// Matching is prefix only: a name matches any string that starts with it, there is
+//  no wildcard or suffix matching.
+
+typedef struct prefix_trie PrefixTrie;
+
+typedef struct prefix_trie_holder {
+    PrefixTrie __rcu *trie;
+} PrefixTrieHolder;
+
+// Upper bound for a user supplied list of NUL separated names
+#define PREFIX_TRIE_MAX_LIST_SIZE  (16 * 1024)
+
+PrefixTrie *ec_prefix_trie_build(const char * const *names, int count, ProcessContext *context);
+void ec_prefix_trie_free(PrefixTrie *trie);
+bool ec_prefix_trie_match(PrefixTrie *trie, const char *str, int len);
+int ec_prefix_trie_count(PrefixTrie *trie);
+
+// Replace the holder's trie.  These may sleep and must not be called from a hook.
+bool ec_prefix_trie_holder_load(PrefixTrieHolder *holder, const char * const *names, int count, ProcessContext *context);
+bool ec_prefix_trie_holder_load_list(PrefixTrieHolder *holder, const char *list, size_t size, ProcessContext *context);
+void ec_prefix_trie_holder_clear(PrefixTrieHolder *holder);
+
+// Safe from any context.  Returns false when no trie is loaded.
+bool ec_prefix_trie_holder_match(PrefixTrieHolder *holder, const char *str, int len);
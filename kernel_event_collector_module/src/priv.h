@@ -38,8 +38,9 @@ extern const char DRIVER_NAME[];
 
 #define INITTASK 1    // used by protection software to prevent catastrophic issues
 
-#define CB_SENSOR_MAX_PIDS  5
-#define CB_SENSOR_MAX_UIDS  5
+// Capacity of the ignored pid and uid sets, must be powers of two
+#define CB_SENSOR_MAX_PIDS  1024
+#define CB_SENSOR_MAX_UIDS  256
 
 #define ROUND_TO_BASE(x, base) ((((size_t)(x)) + base-1) & (~(base-1)))
 #define ROUND_TO_NEXT_CACHE_LINE(x) (ROUND_TO_BASE(x, 64))
@@ -47,14 +48,12 @@ extern const char DRIVER_NAME[];
 
 extern CB_DRIVER_CONFIG g_driver_config;
 extern uid_t    g_edr_server_uid;
-extern int64_t  g_cb_ignored_pid_count;
-extern int64_t  g_cb_ignored_uid_count;
-extern pid_t    g_cb_ignored_pids[CB_SENSOR_MAX_PIDS];
-extern uid_t    g_cb_ignored_uids[CB_SENSOR_MAX_UIDS];
 extern bool     g_exiting;
 extern uint32_t g_max_queue_size_pri0;
 extern uint32_t g_max_queue_size_pri1;
 extern uint32_t g_max_queue_size_pri2;
+extern uint32_t g_file_write_coalesce_ms;
+extern uint32_t g_dns_dedup_ms;
 
 #define MSG_QUEUE_SIZE  8192
 #define DEFAULT_P0_QUEUE_SIZE  (MSG_QUEUE_SIZE * 3)
@@ -98,6 +97,9 @@ extern uint32_t g_max_queue_size_pri2;
 #define CB__LSM_socket_sendmsg            0x0020000000000000
 #define CB__LSM_socket_recvmsg            0x0040000000000000
 #define CB__LSM_file_free_security        0x0080000000000000
+#define CB__LSM_sk_free_security          0x0100000000000000
+#define CB__LSM_inode_rename              0x0200000000000000
+#define CB__LSM_inode_unlink              0x0400000000000000
 
 #define SAFE_STRING(PATH) (PATH) ? (PATH) : "<unknown>"
 
@@ -144,11 +146,16 @@ bool ec_stats_proc_initialize(ProcessContext *context);
 void ec_stats_proc_shutdown(ProcessContext *context);
 int ec_proc_track_show_table(struct seq_file *m, void *v);
 int ec_proc_track_show_stats(struct seq_file *m, void *v);
+ssize_t ec_proc_track_set_stats(struct file *file, const char *buf, size_t size, loff_t *ppos);
+int ec_proc_track_show_discovery(struct seq_file *m, void *v);
+int ec_show_task_enumeration(struct seq_file *m, void *v);
 int ec_file_track_show_table(struct seq_file *m, void *v);
 
 int ec_proc_current_memory_avg(struct seq_file *m, void *v);
 int ec_proc_current_memory_det(struct seq_file *m, void *v);
 int ec_show_active_hooks(struct seq_file *m, void *v);
+int ec_show_hook_latency(struct seq_file *m, void *v);
+ssize_t ec_reset_hook_latency(struct file *file, const char *buf, size_t size, loff_t *ppos);
 
 // ------------------------------------------------
 // Logging
@@ -196,10 +203,19 @@ time_t ec_get_null_time(void);
 extern int     ec_proc_show_events_avg(struct seq_file *m, void *v);
 extern int     ec_proc_show_events_det(struct seq_file *m, void *v);
 extern ssize_t ec_proc_show_events_rst(struct file *file, const char *buf, size_t size, loff_t *ppos);
+extern int     ec_proc_show_queue_latency(struct seq_file *m, void *v);
 extern ssize_t ec_net_track_purge_age(struct file *file, const char *buf, size_t size, loff_t *ppos);
 extern ssize_t ec_net_track_purge_all(struct file *file, const char *buf, size_t size, loff_t *ppos);
 extern int     ec_net_track_show_new(struct seq_file *m, void *v);
 extern int     ec_net_track_show_old(struct seq_file *m, void *v);
+extern int     ec_net_track_show_peer_cache(struct seq_file *m, void *v);
+extern int     ec_net_proxy_show(struct seq_file *m, void *v);
+extern int     ec_net_recvmmsg_check_show(struct seq_file *m, void *v);
+extern ssize_t ec_net_recvmmsg_check_run(struct file *file, const char *buf, size_t size, loff_t *ppos);
+extern int     ec_stall_verdict_show(struct seq_file *m, void *v);
+extern ssize_t ec_stall_verdict_clear(struct file *file, const char *buf, size_t size, loff_t *ppos);
+extern int     ec_stall_latency_show(struct seq_file *m, void *v);
+extern ssize_t ec_stall_latency_reset(struct file *file, const char *buf, size_t size, loff_t *ppos);
 
 extern int ec_get_syscall_clone(struct seq_file *m, void *v);
 extern ssize_t ec_set_syscall_clone(struct file *file, const char *buf, size_t size, loff_t *ppos);
@@ -231,6 +247,7 @@ int ec_get_lsm_socket_sock_rcv_skb(struct seq_file *m, void *v);
 int ec_get_lsm_socket_post_create(struct seq_file *m, void *v);
 int ec_get_lsm_socket_sendmsg(struct seq_file *m, void *v);
 int ec_get_lsm_socket_recvmsg(struct seq_file *m, void *v);
+int ec_get_lsm_sk_free_security(struct seq_file *m, void *v);
 
 ssize_t ec_set_lsm_bprm_check_security(struct file *file, const char *buf, size_t size, loff_t *ppos);
 ssize_t ec_set_lsm_inode_create(struct file *file, const char *buf, size_t size, loff_t *ppos);
@@ -244,6 +261,7 @@ ssize_t ec_set_lsm_socket_sock_rcv_skb(struct file *file, const char *buf, size_
 ssize_t ec_set_lsm_socket_post_create(struct file *file, const char *buf, size_t size, loff_t *ppos);
 ssize_t ec_set_lsm_socket_sendmsg(struct file *file, const char *buf, size_t size, loff_t *ppos);
 ssize_t ec_set_lsm_socket_recvmsg(struct file *file, const char *buf, size_t size, loff_t *ppos);
+ssize_t ec_set_lsm_sk_free_security(struct file *file, const char *buf, size_t size, loff_t *ppos);
 
 #if KERNEL_VERSION(3, 10, 0) < LINUX_VERSION_CODE
 int     ec_get_lsm_mmap_file(struct seq_file *m, void *v);
@@ -272,6 +290,11 @@ umode_t ec_get_mode_from_file(struct file const *file);
 extern struct super_block const *ec_get_sb_from_file(struct file const *file);
 extern bool ec_is_interesting_file(struct file *file);
 extern int ec_is_special_file(char *pathname, int len);
+extern bool ec_special_files_initialize(ProcessContext *context);
+extern void ec_special_files_shutdown(ProcessContext *context);
+extern bool ec_special_files_set(const char *list, size_t size, ProcessContext *context);
+extern const char * const g_special_file_names[];
+extern const int g_special_file_names_count;
 extern bool ec_may_skip_unsafe_vfs_calls(struct file const *file);
 
 // schedulers
@@ -411,6 +434,9 @@ typedef struct _CB_EVENT_NODE {
     struct CB_EVENT    data;
     uint16_t           payload; // precomputed size of event data to be sent to userspace
     void              *process_data;
+    uint64_t           enqueue_ns; // local_clock() when queued for userspace
+    uint8_t            priority;   // queue the event was placed in
+    bool               trailer;    // payload includes a CB_EVENT_TRAILER
 } CB_EVENT_NODE;
 
 // Define the actual storage varaible
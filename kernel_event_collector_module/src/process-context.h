@@ -56,6 +56,8 @@ typedef struct process_context {
     bool             allow_send_events;
     struct list_head list;
     bool             decr_active_call_count_on_exit;
+    uint64_t         hook_enter_ns;
+    int              *hook_latency_id;
     atomic64_t       *percpu_module_inuse;
     atomic64_t       *percpu_module_active_inuse;
     HookTracking     *percpu_hook_tracking;
@@ -68,6 +70,8 @@ typedef struct process_context {
     .allow_wake_up         = true,                                             \
     .allow_send_events     = true,                                             \
     .decr_active_call_count_on_exit = false,                                   \
+    .hook_enter_ns         = 0,                                                \
+    .hook_latency_id       = &hook_latency_id,                                 \
     .percpu_module_inuse = _safe_percpu_ptr(&module_inuse),                    \
     .percpu_module_active_inuse = _safe_percpu_ptr(&module_active_inuse),      \
     .percpu_hook_tracking = _safe_percpu_ptr(&hook_tracking)                   \
@@ -75,8 +79,10 @@ typedef struct process_context {
 
 #define CB_ATOMIC        (GFP_ATOMIC | GFP_NOWAIT)
 
+// hook_latency_id is this hook's slot in the shared latency table, see hook-tracking.h
 #define DECLARE_CONTEXT(name, mode, pid)                               \
     static DEFINE_PER_CPU(HookTracking, hook_tracking);                \
+    static int hook_latency_id;                                        \
     ProcessContext name = __CONTEXT_INITIALIZER(name, mode, pid)
 
 #define DECLARE_ATOMIC_CONTEXT(name, pid) DECLARE_CONTEXT(name, CB_ATOMIC, pid)
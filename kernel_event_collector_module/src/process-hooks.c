@@ -88,7 +88,8 @@ void ec_exit_hook(struct task_struct *task, ProcessContext *context)
         TRACE(DL_INFO, "reader process has exited, and has been disconnected; pid=%d", pid);
     }
 
-    CANCEL_VOID(!ec_banning_IgnoreProcess(context, pid));
+    // Forget an ignored pid when it exits so that a process which later reuses it is not ignored
+    CANCEL_VOID(!ec_banning_ClearIgnoredProcess(context, pid));
 
     CANCEL_VOID_MSG(ec_process_tracking_report_exit(pid, context),
         DL_PROC_TRACKING, "remove process failed to find pid=%d\n", pid);
@@ -300,8 +301,7 @@ int ec_lsm_bprm_check_security(struct linux_binprm *bprm)
                 ec_process_exec_identity(process_handle)->exec_details.inode = inode;
                 ec_process_exec_identity(process_handle)->exec_details.device = device;
 
-                ec_process_posix_identity(process_handle)->posix_details.inode = inode;
-                ec_process_posix_identity(process_handle)->posix_details.device = device;
+                ec_process_tracking_set_posix_inode(process_handle, device, inode, &context);
             }
         }
     }
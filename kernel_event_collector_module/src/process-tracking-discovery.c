@@ -8,7 +8,214 @@
 #include "priv.h"
 #include "cb-spinlock.h"
 
-void __ec_send_process_discovery(void *data, void *priv, ProcessContext *context);
+#include <linux/sort.h>
+
+// Discovery sends a start event for every tracked process, oldest first, so that a
+//  parent is always sent before its children.  Rather than sorting the whole table up
+//  front, it keeps a cursor at the (start time, pid) of the last process sent and each
+//  chunk walks the table for the next DISCOVERY_CHUNK processes after it.  The reader
+//  pulls the next chunk in once P0 has drained below DISCOVERY_LOW_WATER, so memory is
+//  bounded by one chunk and the queue never holds much more than that.  The price is
+//  one table walk per chunk.
+#define DISCOVERY_CHUNK      512
+#define DISCOVERY_LOW_WATER  (DISCOVERY_CHUNK / 4)
+
+typedef struct discovery_entry {
+    time_t   start_time;
+    pid_t    pid;
+} DISCOVERY_ENTRY;
+
+typedef struct discovery_state {
+    struct mutex     lock;
+    bool             active;
+
+    // Processes started after the request get their own fork and exec events
+    time_t           cutoff;
+    DISCOVERY_ENTRY  cursor;
+    bool             have_cursor;
+
+    // Max-heap of the oldest processes after the cursor seen so far by the current walk
+    DISCOVERY_ENTRY *chunk;
+    int              chunk_count;
+
+    uint64_t         total;
+    uint64_t         sent;
+    uint64_t         exited;
+    uint64_t         chunks;
+    uint64_t         requests;
+    uint64_t         peak_bytes;
+} DISCOVERY_STATE;
+
+static DISCOVERY_STATE s_discovery = {
+    .lock = __MUTEX_INITIALIZER(s_discovery.lock),
+};
+
+static int __ec_discovery_compare(const DISCOVERY_ENTRY *left, const DISCOVERY_ENTRY *right)
+{
+    if (left->start_time != right->start_time)
+    {
+        return left->start_time < right->start_time ? -1 : 1;
+    }
+    if (left->pid != right->pid)
+    {
+        return left->pid < right->pid ? -1 : 1;
+    }
+    return 0;
+}
+
+static int __ec_discovery_sort_compare(const void *left, const void *right)
+{
+    return __ec_discovery_compare(left, right);
+}
+
+static void __ec_discovery_sift_down(DISCOVERY_ENTRY *heap, int count, int i)
+{
+    while (true)
+    {
+        int largest = i;
+        int left    = 2 * i + 1;
+        int right   = 2 * i + 2;
+
+        if (left < count && __ec_discovery_compare(&heap[left], &heap[largest]) > 0)
+        {
+            largest = left;
+        }
+        if (right < count && __ec_discovery_compare(&heap[right], &heap[largest]) > 0)
+        {
+            largest = right;
+        }
+        if (largest == i)
+        {
+            break;
+        }
+        swap(heap[i], heap[largest]);
+        i = largest;
+    }
+}
+
+static void __ec_discovery_sift_up(DISCOVERY_ENTRY *heap, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+
+        if (__ec_discovery_compare(&heap[i], &heap[parent]) <= 0)
+        {
+            break;
+        }
+        swap(heap[i], heap[parent]);
+        i = parent;
+    }
+}
+
+// Called with the bucket read lock held, so this only records the pid
+static int __ec_discovery_collect(HashTbl *hashTblp, HashTableNode *nodep, void *priv, ProcessContext *context)
+{
+    PosixIdentity   *posix_identity = (PosixIdentity *)nodep;
+    DISCOVERY_STATE *state          = (DISCOVERY_STATE *)priv;
+    DISCOVERY_ENTRY  entry;
+
+    IF_MODULE_DISABLED_GOTO(context, CATCH_DISABLED);
+
+    // posix_identity will be null for the last call after iterating
+    if (!posix_identity)
+    {
+        return ACTION_CONTINUE;
+    }
+
+    entry.start_time = posix_identity->posix_details.start_time;
+    entry.pid        = posix_identity->pt_key.pid;
+
+    if (entry.start_time > state->cutoff ||
+        (state->have_cursor && __ec_discovery_compare(&entry, &state->cursor) <= 0))
+    {
+        return ACTION_CONTINUE;
+    }
+
+    if (state->chunk_count < DISCOVERY_CHUNK)
+    {
+        state->chunk[state->chunk_count] = entry;
+        __ec_discovery_sift_up(state->chunk, state->chunk_count);
+        state->chunk_count += 1;
+    } else if (__ec_discovery_compare(&entry, &state->chunk[0]) < 0)
+    {
+        // Replace the newest process in the chunk
+        state->chunk[0] = entry;
+        __ec_discovery_sift_down(state->chunk, state->chunk_count, 0);
+    }
+
+    return ACTION_CONTINUE;
+
+CATCH_DISABLED:
+    return ACTION_STOP;
+}
+
+// Caller holds s_discovery.lock
+static void __ec_discovery_finish(ProcessContext *context)
+{
+    if (s_discovery.active)
+    {
+        TRACE(DL_INFO, "%s: sent %llu of %llu processes in %llu chunks",
+              __func__, s_discovery.sent, s_discovery.total, s_discovery.chunks);
+    }
+
+    s_discovery.active = false;
+    ec_mem_cache_free_generic(s_discovery.chunk);
+    s_discovery.chunk = NULL;
+}
+
+// Caller holds s_discovery.lock
+static void __ec_discovery_send_chunk(ProcessContext *context)
+{
+    int i;
+
+    s_discovery.chunk_count = 0;
+    ec_hashtbl_read_for_each_generic(g_process_tracking_data.table, __ec_discovery_collect, &s_discovery, context);
+
+    if (!s_discovery.chunk_count)
+    {
+        __ec_discovery_finish(context);
+        return;
+    }
+
+    // The heap root is the newest process in the chunk
+    s_discovery.cursor      = s_discovery.chunk[0];
+    s_discovery.have_cursor = true;
+
+    sort(s_discovery.chunk, s_discovery.chunk_count, sizeof(DISCOVERY_ENTRY), __ec_discovery_sort_compare, NULL);
+
+    // The table lock is not held here, so waking the reader is safe.  Batch the wake up
+    //  anyway so the reader sees the whole chunk at once.
+    DISABLE_WAKE_UP(context);
+    for (i = 0; i < s_discovery.chunk_count; ++i)
+    {
+        ProcessHandle *handle = ec_process_tracking_get_handle(s_discovery.chunk[i].pid, context);
+
+        if (handle)
+        {
+            ec_event_send_start(handle,
+                            ec_process_tracking_should_track_user() ? ec_process_posix_identity(handle)->uid : (uid_t)-1,
+                            CB_PROCESS_START_BY_DISCOVER,
+                            context);
+            ec_process_tracking_put_handle(handle, context);
+            s_discovery.sent += 1;
+        } else
+        {
+            s_discovery.exited += 1;
+        }
+    }
+    ENABLE_WAKE_UP(context);
+
+    s_discovery.chunks     += 1;
+
+    // A short chunk means the walk found everything that was left
+    if (s_discovery.chunk_count < DISCOVERY_CHUNK)
+    {
+        __ec_discovery_finish(context);
+    }
+
+    ec_fops_comm_wake_up_reader(context);
+}
 
 void ec_process_tracking_send_process_discovery(ProcessContext *context)
 {
@@ -18,40 +225,81 @@ void ec_process_tracking_send_process_discovery(ProcessContext *context)
     // disabling the driver while this function is in progress.
     MODULE_GET_AND_BEGIN_MODULE_DISABLE_CHECK_IF_DISABLED_GOTO(context, CATCH_DEFAULT);
 
-    // The call below will evqueue events while holding the hash table lack.  We
-    //  observeved a deadlock with this logic in the following condition.
-    //    The user agent triggers a process discover via the ioctl. (This code is called.)
-    //      During this, we are holding a lock on the hash table.
-    //    Meanwhile, we observe a fork and attempt to lock the hash table. But the
-    //      discovery code holds the lock, so the clone hook is blocked.
-    //    The discovery enqueues an event, and attempts to wake up the reader.
-    //      This deadlocks because the clone hook has the scheduler frozen, but is
-    //      waiting on us to release the lock.
-    //    The fix is to ensure that we do not wake up the reader with the lock held.
-    //    We explicitly wake up the reader after we have relased the lock, and
-    //      enable the wake up logic.
-    DISABLE_WAKE_UP(context);
-    ec_sorted_tracking_table_for_each(__ec_send_process_discovery, NULL, context);
-    ENABLE_WAKE_UP(context);
+    mutex_lock(&s_discovery.lock);
 
-    ec_fops_comm_wake_up_reader(context);
+    // A new request starts over from the oldest process
+    if (!s_discovery.chunk)
+    {
+        s_discovery.chunk = ec_mem_cache_alloc_generic(DISCOVERY_CHUNK * sizeof(DISCOVERY_ENTRY), context);
+    }
+
+    if (s_discovery.chunk)
+    {
+        s_discovery.active      = true;
+        s_discovery.cutoff      = ec_get_current_time();
+        s_discovery.have_cursor = false;
+        s_discovery.total       = atomic64_read(&g_process_tracking_data.table->tableInstance);
+        s_discovery.sent        = 0;
+        s_discovery.exited      = 0;
+        s_discovery.chunks      = 0;
+        s_discovery.requests   += 1;
+        s_discovery.peak_bytes  = max_t(uint64_t, s_discovery.peak_bytes, DISCOVERY_CHUNK * sizeof(DISCOVERY_ENTRY));
+
+        __ec_discovery_send_chunk(context);
+    } else
+    {
+        TRACE(DL_ERROR, "%s: unable to allocate discovery buffer", __func__);
+    }
+
+    mutex_unlock(&s_discovery.lock);
 
 CATCH_DEFAULT:
     MODULE_PUT_AND_FINISH_MODULE_DISABLE_CHECK(context);
 }
 
-void __ec_send_process_discovery(void *data, void *priv, ProcessContext *context)
+// Called from the reader before it takes the next event
+void ec_process_tracking_discovery_continue(uint64_t queued_p0, ProcessContext *context)
 {
-    ProcessHandle *handle = ec_sorted_tracking_table_get_handle(data, context);
+    if (!READ_ONCE(s_discovery.active) || queued_p0 >= DISCOVERY_LOW_WATER)
+    {
+        return;
+    }
 
-    TRY(handle);
+    // Somebody else is already sending the next chunk
+    if (!mutex_trylock(&s_discovery.lock))
+    {
+        return;
+    }
 
-    ec_event_send_start(handle,
-                    ec_process_tracking_should_track_user() ? ec_process_posix_identity(handle)->uid : (uid_t)-1,
-                    CB_PROCESS_START_BY_DISCOVER,
-                    context);
+    if (s_discovery.active)
+    {
+        __ec_discovery_send_chunk(context);
+    }
 
-CATCH_DEFAULT:
-    ec_process_tracking_put_handle(handle, context);
-    return;
+    mutex_unlock(&s_discovery.lock);
+}
+
+void ec_process_tracking_discovery_stop(ProcessContext *context)
+{
+    mutex_lock(&s_discovery.lock);
+    __ec_discovery_finish(context);
+    mutex_unlock(&s_discovery.lock);
+}
+
+int ec_proc_track_show_discovery(struct seq_file *m, void *v)
+{
+    mutex_lock(&s_discovery.lock);
+
+    seq_printf(m, "%22s | %6s |\n",   "State",          s_discovery.active ? "active" : "idle");
+    seq_printf(m, "%22s | %6llu |\n", "Requests",       s_discovery.requests);
+    seq_printf(m, "%22s | %6llu |\n", "Tracked At Start", s_discovery.total);
+    seq_printf(m, "%22s | %6llu |\n", "Sent",           s_discovery.sent);
+    seq_printf(m, "%22s | %6llu |\n", "Exited",         s_discovery.exited);
+    seq_printf(m, "%22s | %6llu |\n", "Chunks",         s_discovery.chunks);
+    seq_printf(m, "%22s | %6d |\n",   "Chunk Size",     DISCOVERY_CHUNK);
+    seq_printf(m, "%22s | %6llu |\n", "Peak Bytes",     s_discovery.peak_bytes);
+
+    mutex_unlock(&s_discovery.lock);
+
+    return 0;
 }
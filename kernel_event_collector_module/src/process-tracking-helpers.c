@@ -155,11 +155,72 @@ void ec_process_tracking_set_exec_identity(ProcessHandle *process_handle, ExecId
     }
 }
 
+static DEFINE_PER_CPU(PtHandleCache, s_pt_handle_cache);
+
+// The this_cpu operations are safe against preemption, so a handle is either taken by
+//  exactly one caller or left in its slot.
+static ProcessHandle *__ec_process_handle_cache_get(void)
+{
+    int i;
+
+    for (i = 0; i < PT_HANDLE_CACHE_SLOTS; ++i)
+    {
+        ProcessHandle *process_handle = this_cpu_xchg(s_pt_handle_cache.slot[i], NULL);
+
+        if (process_handle)
+        {
+            PT_OP_INC(handle_cached);
+            return process_handle;
+        }
+    }
+    return NULL;
+}
+
+static bool __ec_process_handle_cache_put(ProcessHandle *process_handle)
+{
+    int i;
+
+    for (i = 0; i < PT_HANDLE_CACHE_SLOTS; ++i)
+    {
+        if (!this_cpu_cmpxchg(s_pt_handle_cache.slot[i], NULL, process_handle))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called at shutdown once nothing can take or release a handle
+void ec_process_handle_cache_drain(ProcessContext *context)
+{
+    int cpu;
+    int i;
+
+    for_each_possible_cpu(cpu)
+    {
+        PtHandleCache *cache = per_cpu_ptr(&s_pt_handle_cache, cpu);
+
+        for (i = 0; i < PT_HANDLE_CACHE_SLOTS; ++i)
+        {
+            ec_mem_cache_free_generic(xchg(&cache->slot[i], NULL));
+        }
+    }
+}
+
 ProcessHandle *ec_process_handle_alloc(PosixIdentity *posix_identity, ProcessContext *context)
 {
-    ProcessHandle *process_handle = ec_mem_cache_alloc_generic(
-        sizeof(ProcessHandle),
-        context);
+    ProcessHandle *process_handle = __ec_process_handle_cache_get();
+
+    if (!process_handle)
+    {
+        process_handle = ec_mem_cache_alloc_generic(
+            sizeof(ProcessHandle),
+            context);
+        if (process_handle)
+        {
+            PT_OP_INC(handle_alloc);
+        }
+    }
 
     if (process_handle)
     {
@@ -184,7 +245,10 @@ void ec_process_tracking_put_handle(ProcessHandle *process_handle, ProcessContex
     {
         ec_process_tracking_put_exec_handle(&process_handle->exec_handle, context);
         ec_hashtbl_put_generic(g_process_tracking_data.table, process_handle->posix_identity, context);
-        ec_mem_cache_free_generic(process_handle);
+        if (!__ec_process_handle_cache_put(process_handle))
+        {
+            ec_mem_cache_free_generic(process_handle);
+        }
     }
 }
 
@@ -349,13 +413,63 @@ void ec_process_tracking_store_exit_event(PosixIdentity *posix_identity, PCB_EVE
     ec_process_tracking_put_exec_identity(exec_identity, context);
 }
 
-int __ec_hashtbl_search_callback(HashTbl * hashTblp, HashTableNode * nodep, void *priv, ProcessContext *context);
-
+// Collects a handle for every tracked process running the binary (device, inode). The pids come
+//  from the inode index, and each one is checked against its tracking entry because the index
+//  can briefly hold a process that has already exited.
+//  It is the responsibility of the caller to put the handles and free the list elements when done.
 void ec_is_process_tracked_get_state_by_inode(RUNNING_BANNED_INODE_S *psRunningInodesToBan, ProcessContext *context)
 {
-    ec_hashtbl_read_for_each_generic(g_process_tracking_data.table, __ec_hashtbl_search_callback, psRunningInodesToBan, context);
+    pid_t *pids  = NULL;
+    int    count = 0;
+    int    max   = 0;
+    int    i;
+
+    CANCEL_VOID(psRunningInodesToBan);
+
+    count = ec_process_inode_index_get_pids(psRunningInodesToBan->device, psRunningInodesToBan->inode, NULL, 0, context);
+    CANCEL_VOID(count > 0);
+
+    // Leave some room for processes that start while we allocate.  Any we miss will be stopped
+    //  by the exec check since the ban is already in place.
+    max  = count + 16;
+    pids = ec_mem_cache_alloc_generic(max * sizeof(pid_t), context);
+    TRY_MSG(pids, DL_ERROR, "%s:%d Out of memory!\n", __func__, __LINE__);
+
+    count = min(max, ec_process_inode_index_get_pids(psRunningInodesToBan->device, psRunningInodesToBan->inode, pids, max, context));
+
+    for (i = 0; i < count; ++i)
+    {
+        RUNNING_PROCESSES_TO_BAN *temp = NULL;
+        ProcessHandle *process_handle = ec_process_tracking_get_handle(pids[i], context);
+
+        if (!process_handle)
+        {
+            continue;
+        }
+
+        if (ec_process_posix_identity(process_handle)->posix_details.device != psRunningInodesToBan->device ||
+            ec_process_posix_identity(process_handle)->posix_details.inode != psRunningInodesToBan->inode)
+        {
+            ec_process_tracking_put_handle(process_handle, context);
+            continue;
+        }
+
+        //Allocate a new list element for banning to hold this process pointer
+        temp = (RUNNING_PROCESSES_TO_BAN *)ec_mem_cache_alloc_generic(sizeof(RUNNING_PROCESSES_TO_BAN), context);
+        TRY_DO(temp,
+        {
+            TRACE(DL_ERROR, "%s:%d Out of memory!\n", __func__, __LINE__);
+            ec_process_tracking_put_handle(process_handle, context);
+        });
+
+        //Update our structure
+        temp->process_handle = process_handle;
+        list_add(&(temp->list), &(psRunningInodesToBan->BanList.list));
+        psRunningInodesToBan->count++;
+    }
 
-    return;
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(pids);
 }
 
 bool ec_process_tracking_has_active_process(PosixIdentity *posix_identity, ProcessContext *context)
@@ -372,117 +486,139 @@ CATCH_DEFAULT:
     return result;
 }
 
-// Note: This function is used as a callback by ec_hashtbl_read_for_each_generic called from
-//       ec_is_process_tracked_get_state_by_inode also note that it is called from inside a spinlock.
-//       Therefore, in the future if modifications are required be aware that any function call that may
-//       sleep should be avoided.
-//       We also allocate an array of pointers and it is the responsibility of the caller to free them when done.
-int __ec_hashtbl_search_callback(HashTbl *hashTblp, HashTableNode *nodep, void *priv, ProcessContext *context)
+void ec_process_tracking_op_counters(PtOpCounters *totals)
 {
-    PosixIdentity *posix_identity = NULL;
-    RUNNING_BANNED_INODE_S *psRunningInodesToBan = NULL;
-    RUNNING_PROCESSES_TO_BAN *temp = NULL;
+    int cpu;
+
+    memset(totals, 0, sizeof(*totals));
+    for_each_possible_cpu(cpu)
+    {
+        PtOpCounters *counters = per_cpu_ptr(&g_pt_op_counters, cpu);
+
+        totals->op_cnt         += READ_ONCE(counters->op_cnt);
+        totals->create         += READ_ONCE(counters->create);
+        totals->exit           += READ_ONCE(counters->exit);
+        totals->create_by_fork += READ_ONCE(counters->create_by_fork);
+        totals->create_by_exec += READ_ONCE(counters->create_by_exec);
+        totals->handle_alloc   += READ_ONCE(counters->handle_alloc);
+        totals->handle_cached  += READ_ONCE(counters->handle_cached);
+    }
+}
 
-    TRY(nodep);
+// Returns the stats for this process, allocating them on first use.  Returns NULL when
+//  stats are disabled or the allocation fails.
+static PosixIdentityStats *__ec_process_tracking_get_stats(PosixIdentity *posix_identity, ProcessContext *context)
+{
+    PosixIdentityStats *stats = READ_ONCE(posix_identity->stats);
 
-    // Saftey first
-    // TRY_DO(priv,
-    // {
-    //     TRACE( DL_ERROR, "%s:%d NULL ptr provided as function argument [%p=nodep %p=priv]. Bailing...",
-    //                      __func__, __LINE__, nodep, priv);
-    // });
+    if (stats || !READ_ONCE(g_process_tracking_data.stats_enabled))
+    {
+        return stats;
+    }
 
-    posix_identity = (PosixIdentity *)nodep;
-    psRunningInodesToBan = (RUNNING_BANNED_INODE_S *)priv;
+    stats = ec_mem_cache_alloc(&g_process_tracking_data.stats_cache, context);
+    CANCEL(stats, NULL);
+    memset(stats, 0, sizeof(*stats));
 
-    //Did we match based on inode?
-    if (posix_identity->posix_details.device == psRunningInodesToBan->device &&
-        posix_identity->posix_details.inode == psRunningInodesToBan->inode)
+    // Another thread of this process may have beaten us to it
+    if (cmpxchg(&posix_identity->stats, NULL, stats) != NULL)
     {
-        //Allocate a new list element for banning to hold this process pointer
-        temp = (RUNNING_PROCESSES_TO_BAN *)ec_mem_cache_alloc_generic(sizeof(RUNNING_PROCESSES_TO_BAN), context);
-        TRY_DO(temp,
-        {
-            TRACE(DL_ERROR, "%s:%d Out of memory!\n", __func__, __LINE__);
-        });
+        ec_mem_cache_free(&g_process_tracking_data.stats_cache, stats, context);
+        return READ_ONCE(posix_identity->stats);
+    }
 
-        //Update our structure
-        temp->process_handle = ec_hashtbl_get_generic_ref(hashTblp, nodep, context);
-        list_add(&(temp->list), &(psRunningInodesToBan->BanList.list));
-        psRunningInodesToBan->count++;
+    atomic64_inc(&g_process_tracking_data.stats_count);
+    return stats;
+}
+
+void ec_process_tracking_free_stats(PosixIdentity *posix_identity, ProcessContext *context)
+{
+    PosixIdentityStats *stats = xchg(&posix_identity->stats, NULL);
+
+    if (stats)
+    {
+        ec_mem_cache_free(&g_process_tracking_data.stats_cache, stats, context);
+        atomic64_dec(&g_process_tracking_data.stats_count);
     }
-CATCH_DEFAULT:
-    return ACTION_CONTINUE;
 }
 
-void ec_process_tracking_update_op_cnts(PosixIdentity *posix_identity, CB_EVENT_TYPE event_type, int action)
+void ec_process_tracking_update_op_cnts(PosixIdentity *posix_identity, CB_EVENT_TYPE event_type, int action, ProcessContext *context)
 {
-    switch (event_type)
+    PosixIdentityStats *stats = NULL;
+
+    if (event_type == CB_EVENT_TYPE_PROCESS_START)
     {
-    case CB_EVENT_TYPE_PROCESS_START:
-        posix_identity->process_op_cnt += 1;
-        posix_identity->process_create += 1;
         if (action == CB_PROCESS_START_BY_FORK)
         {
-            g_process_tracking_data.create_by_fork += 1;
+            PT_OP_INC(create_by_fork);
         } else if (action == CB_PROCESS_START_BY_EXEC)
         {
-            g_process_tracking_data.create_by_exec += 1;
+            PT_OP_INC(create_by_exec);
         }
+    }
+
+    stats = __ec_process_tracking_get_stats(posix_identity, context);
+    CANCEL_VOID(stats);
+
+    switch (event_type)
+    {
+    case CB_EVENT_TYPE_PROCESS_START:
+        stats->process_op_cnt += 1;
+        stats->process_create += 1;
         break;
 
     case CB_EVENT_TYPE_PROCESS_EXIT:
     case CB_EVENT_TYPE_PROCESS_LAST_EXIT:
-        posix_identity->process_op_cnt += 1;
-        posix_identity->process_exit += 1;
+        stats->process_op_cnt += 1;
+        stats->process_exit += 1;
         break;
 
     case CB_EVENT_TYPE_MODULE_LOAD:
-        posix_identity->file_op_cnt += 1;
-        posix_identity->file_map_exec += 1;
+        stats->file_op_cnt += 1;
+        stats->file_map_exec += 1;
         break;
 
     case CB_EVENT_TYPE_FILE_CREATE:
-        posix_identity->file_op_cnt += 1;
-        posix_identity->file_create += 1;
+        stats->file_op_cnt += 1;
+        stats->file_create += 1;
         break;
 
     case CB_EVENT_TYPE_FILE_DELETE:
-        posix_identity->file_op_cnt += 1;
-        posix_identity->file_delete += 1;
+        stats->file_op_cnt += 1;
+        stats->file_delete += 1;
         break;
 
     case CB_EVENT_TYPE_FILE_WRITE:
-        posix_identity->file_op_cnt += 1;
-        if (posix_identity->file_write == 0)
+        stats->file_op_cnt += 1;
+        if (stats->file_write == 0)
         {
-            posix_identity->file_open += 1;
+            stats->file_open += 1;
         }
-        posix_identity->file_write += 1;
+        stats->file_write += 1;
 
     case CB_EVENT_TYPE_FILE_CLOSE:
-        posix_identity->file_op_cnt += 1;
-        posix_identity->file_close += 1;
+        stats->file_op_cnt += 1;
+        stats->file_close += 1;
         break;
 
     case CB_EVENT_TYPE_NET_CONNECT_PRE:
-        posix_identity->net_op_cnt += 1;
-        posix_identity->net_connect += 1;
+        stats->net_op_cnt += 1;
+        stats->net_connect += 1;
         break;
 
     case CB_EVENT_TYPE_NET_CONNECT_POST:
-        posix_identity->net_op_cnt  += 1;
-        posix_identity->net_connect += 1;
+        stats->net_op_cnt  += 1;
+        stats->net_connect += 1;
         break;
 
     case CB_EVENT_TYPE_NET_ACCEPT:
-        posix_identity->net_op_cnt += 1;
-        posix_identity->net_accept += 1;
+        stats->net_op_cnt += 1;
+        stats->net_accept += 1;
         break;
 
     case CB_EVENT_TYPE_DNS_RESPONSE:
-        posix_identity->net_op_cnt += 1;
-        posix_identity->net_dns += 1;
+        stats->net_op_cnt += 1;
+        stats->net_dns += 1;
         break;
 
     default:
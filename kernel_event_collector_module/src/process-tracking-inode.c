@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "process-tracking-private.h"
+#include "cb-test.h"
+#include "priv.h"
+
+// The inode index maps the (device, inode) of an exec'd binary to the tracked processes
+//  running it, so that banning does not need to walk the whole tracking table.
+//
+// A process is added when it is inserted in the tracking table, moved when it execs, and
+//  removed when its PosixIdentity is freed. Between exit and free a stale member can still
+//  be found, so callers must check the tracking entry for any pid returned from here.
+
+typedef struct inode_index_key {
+    uint64_t device;
+    uint64_t inode;
+} INODE_INDEX_KEY;
+
+typedef struct inode_index_entry {
+    HashTableNode     link;
+    INODE_INDEX_KEY   key;
+    struct list_head  members;
+    uint32_t          count;
+} INODE_INDEX_ENTRY;
+
+typedef struct inode_index_member {
+    struct list_head  list;
+    PosixIdentity    *posix_identity;  // Only compared, never dereferenced
+    pid_t             pid;
+} INODE_INDEX_MEMBER;
+
+static HashTbl      *s_inode_index_table;
+static CB_MEM_CACHE  s_inode_index_member_cache;
+static atomic64_t    s_inode_index_members;
+
+void __ec_inode_index_delete_callback(void *data, ProcessContext *context);
+
+bool ec_process_inode_index_initialize(ProcessContext *context)
+{
+    atomic64_set(&s_inode_index_members, 0);
+
+    TRY(ec_mem_cache_create(&s_inode_index_member_cache, "pt_inode_index_member", sizeof(INODE_INDEX_MEMBER), context));
+
+    s_inode_index_table = ec_hashtbl_init_generic(
+        context,
+        8192,
+        sizeof(INODE_INDEX_ENTRY),
+        0,
+        "pt_inode_index",
+        sizeof(INODE_INDEX_KEY),
+        offsetof(INODE_INDEX_ENTRY, key),
+        offsetof(INODE_INDEX_ENTRY, link),
+        HASHTBL_DISABLE_REF_COUNT,
+        __ec_inode_index_delete_callback,
+        NULL);
+    TRY(s_inode_index_table);
+
+    return true;
+
+CATCH_DEFAULT:
+    ec_process_inode_index_shutdown(context);
+    return false;
+}
+
+void ec_process_inode_index_shutdown(ProcessContext *context)
+{
+    if (s_inode_index_table)
+    {
+        ec_hashtbl_shutdown_generic(s_inode_index_table, context);
+        s_inode_index_table = NULL;
+    }
+
+    ec_mem_cache_destroy(&s_inode_index_member_cache, context, NULL);
+}
+
+void __ec_inode_index_delete_callback(void *data, ProcessContext *context)
+{
+    INODE_INDEX_ENTRY  *entry = (INODE_INDEX_ENTRY *)data;
+    INODE_INDEX_MEMBER *member;
+    INODE_INDEX_MEMBER *next;
+
+    CANCEL_VOID(entry);
+
+    list_for_each_entry_safe(member, next, &entry->members, list)
+    {
+        list_del(&member->list);
+        ec_mem_cache_free(&s_inode_index_member_cache, member, context);
+        atomic64_dec(&s_inode_index_members);
+    }
+}
+
+static bool __ec_inode_index_append(INODE_INDEX_KEY *key, INODE_INDEX_MEMBER *member, ProcessContext *context)
+{
+    INODE_INDEX_ENTRY *entry = NULL;
+    HashTableBkt      *bkt   = NULL;
+
+    if (ec_hashtbl_write_bkt_lock(s_inode_index_table, key, (void **)&entry, &bkt, context))
+    {
+        list_add(&member->list, &entry->members);
+        entry->count += 1;
+        ec_hashtbl_write_bkt_unlock(bkt, context);
+        return true;
+    }
+    return false;
+}
+
+void ec_process_inode_index_add(PosixIdentity *posix_identity, ProcessContext *context)
+{
+    INODE_INDEX_KEY     key;
+    INODE_INDEX_ENTRY  *entry  = NULL;
+    INODE_INDEX_MEMBER *member = NULL;
+
+    CANCEL_VOID(s_inode_index_table && posix_identity);
+
+    key.device = posix_identity->posix_details.device;
+    key.inode  = posix_identity->posix_details.inode;
+
+    // Nothing can be banned by an unknown inode
+    CANCEL_VOID(key.device || key.inode);
+
+    member = ec_mem_cache_alloc(&s_inode_index_member_cache, context);
+    CANCEL_VOID(member);
+
+    member->posix_identity = posix_identity;
+    member->pid            = posix_identity->pt_key.pid;
+
+    if (!__ec_inode_index_append(&key, member, context))
+    {
+        entry = ec_hashtbl_alloc_generic(s_inode_index_table, context);
+        TRY(entry);
+
+        entry->key   = key;
+        entry->count = 1;
+        INIT_LIST_HEAD(&entry->members);
+        list_add(&member->list, &entry->members);
+
+        if (ec_hashtbl_add_generic_safe(s_inode_index_table, entry, context) < 0)
+        {
+            // Someone else added this inode first, so join their entry instead
+            list_del(&member->list);
+            ec_hashtbl_free_generic(s_inode_index_table, entry, context);
+            TRY(__ec_inode_index_append(&key, member, context));
+        }
+    }
+
+    atomic64_inc(&s_inode_index_members);
+    return;
+
+CATCH_DEFAULT:
+    ec_mem_cache_free(&s_inode_index_member_cache, member, context);
+}
+
+void ec_process_inode_index_remove(PosixIdentity *posix_identity, ProcessContext *context)
+{
+    INODE_INDEX_KEY     key;
+    INODE_INDEX_ENTRY  *entry  = NULL;
+    INODE_INDEX_MEMBER *member = NULL;
+    INODE_INDEX_MEMBER *found  = NULL;
+    HashTableBkt       *bkt    = NULL;
+    bool                empty  = false;
+
+    CANCEL_VOID(s_inode_index_table && posix_identity);
+
+    key.device = posix_identity->posix_details.device;
+    key.inode  = posix_identity->posix_details.inode;
+
+    CANCEL_VOID(key.device || key.inode);
+
+    if (ec_hashtbl_write_bkt_lock(s_inode_index_table, &key, (void **)&entry, &bkt, context))
+    {
+        list_for_each_entry(member, &entry->members, list)
+        {
+            if (member->posix_identity == posix_identity)
+            {
+                found = member;
+                list_del(&found->list);
+                entry->count -= 1;
+                break;
+            }
+        }
+
+        empty = (entry->count == 0);
+        if (empty)
+        {
+            ec_hashtbl_del_generic_lockheld(s_inode_index_table, entry, context);
+        }
+        ec_hashtbl_write_bkt_unlock(bkt, context);
+    }
+
+    if (empty)
+    {
+        ec_hashtbl_free_generic(s_inode_index_table, entry, context);
+    }
+    if (found)
+    {
+        ec_mem_cache_free(&s_inode_index_member_cache, found, context);
+        atomic64_dec(&s_inode_index_members);
+    }
+}
+
+// Copies up to max pids of processes indexed under (device, inode) and returns the total number
+//  indexed, which may be larger than max.
+int ec_process_inode_index_get_pids(uint64_t device, uint64_t inode, pid_t *pids, int max, ProcessContext *context)
+{
+    INODE_INDEX_KEY     key    = { device, inode };
+    INODE_INDEX_ENTRY  *entry  = NULL;
+    INODE_INDEX_MEMBER *member = NULL;
+    HashTableBkt       *bkt    = NULL;
+    int                 count  = 0;
+
+    CANCEL(s_inode_index_table, 0);
+
+    if (ec_hashtbl_read_bkt_lock(s_inode_index_table, &key, (void **)&entry, &bkt, context))
+    {
+        list_for_each_entry(member, &entry->members, list)
+        {
+            if (pids && count < max)
+            {
+                pids[count] = member->pid;
+            }
+            count += 1;
+        }
+        ec_hashtbl_read_bkt_unlock(bkt, context);
+    }
+
+    return count;
+}
+
+uint64_t ec_process_inode_index_size(void)
+{
+    return atomic64_read(&s_inode_index_members);
+}
+
+// Update the binary a tracked process is running and move it in the index to match
+void ec_process_tracking_set_posix_inode(ProcessHandle *process_handle, uint64_t device, uint64_t inode, ProcessContext *context)
+{
+    PosixIdentity *posix_identity = ec_process_posix_identity(process_handle);
+
+    CANCEL_VOID(posix_identity);
+
+    if (posix_identity->posix_details.device == device &&
+        posix_identity->posix_details.inode == inode)
+    {
+        return;
+    }
+
+    ec_process_inode_index_remove(posix_identity, context);
+
+    posix_identity->posix_details.device = device;
+    posix_identity->posix_details.inode  = inode;
+
+    ec_process_inode_index_add(posix_identity, context);
+}
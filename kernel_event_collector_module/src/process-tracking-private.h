@@ -6,20 +6,50 @@
 
 #include "process-tracking.h"
 
-typedef struct posix_identity_data {
+// Table wide operation counts, kept per-cpu and summed when read
+typedef struct pt_op_counters {
     uint64_t      op_cnt;
     uint64_t      create;
     uint64_t      exit;
     uint64_t      create_by_fork;
     uint64_t      create_by_exec;
 
+    // Handles taken from the heap and from the per-cpu handle cache
+    uint64_t      handle_alloc;
+    uint64_t      handle_cached;
+} PtOpCounters;
+
+DECLARE_PER_CPU(PtOpCounters, g_pt_op_counters);
+
+// Every lookup returns a ProcessHandle.  Released handles are parked here so the next
+//  lookup on this cpu can reuse one instead of going back to the allocator.  A handle
+//  may be released on a different cpu than it was taken on.
+#define PT_HANDLE_CACHE_SLOTS  4
+
+typedef struct pt_handle_cache {
+    ProcessHandle *slot[PT_HANDLE_CACHE_SLOTS];
+} PtHandleCache;
+
+#define PT_OP_INC(FIELD)  this_cpu_inc(g_pt_op_counters.FIELD)
+
+typedef struct posix_identity_data {
     HashTbl      *table;
     CB_MEM_CACHE  exec_identity_cache;
+
+    // PosixIdentityStats are only allocated while this is set
+    bool          stats_enabled;
+    CB_MEM_CACHE  stats_cache;
+    atomic64_t    stats_count;
+
+    // Used to turn the handle counters into a rate
+    unsigned long start_jiffies;
 } process_tracking_data;
 
 extern process_tracking_data g_process_tracking_data;
 
-void ec_process_tracking_update_op_cnts(PosixIdentity *posix_identity, CB_EVENT_TYPE event_type, int action);
+void ec_process_tracking_op_counters(PtOpCounters *totals);
+void ec_process_tracking_update_op_cnts(PosixIdentity *posix_identity, CB_EVENT_TYPE event_type, int action, ProcessContext *context);
+void ec_process_tracking_free_stats(PosixIdentity *posix_identity, ProcessContext *context);
 void ec_sorted_tracking_table_for_each(for_rbtree_node callback, void *priv, ProcessContext *context);
 ProcessHandle *ec_sorted_tracking_table_get_handle(void *data, ProcessContext *context);
 const char *ec_process_tracking_get_proc_name(const char *path);
@@ -29,9 +59,18 @@ void ec_process_posix_identity_set_exec_identity(PosixIdentity *posix_identity,
 void ec_process_tracking_set_temp_exec_handle(ProcessHandle *process_handle, ExecHandle *exec_handle, ProcessContext *context);
 void ec_process_tracking_set_exec_identity(ProcessHandle *process_handle, ExecIdentity *exec_identity, ProcessContext *context);
 ProcessHandle *ec_process_handle_alloc(PosixIdentity *posix_identity, ProcessContext *context);
+void ec_process_handle_cache_drain(ProcessContext *context);
 void ec_process_exec_handle_set_exec_identity(ExecHandle *exec_handle, ExecIdentity *exec_identity, ProcessContext *context);
 void ec_process_tracking_put_path(char *path, ProcessContext *context);
 
+// Inode index
+bool ec_process_inode_index_initialize(ProcessContext *context);
+void ec_process_inode_index_shutdown(ProcessContext *context);
+void ec_process_inode_index_add(PosixIdentity *posix_identity, ProcessContext *context);
+void ec_process_inode_index_remove(PosixIdentity *posix_identity, ProcessContext *context);
+int ec_process_inode_index_get_pids(uint64_t device, uint64_t inode, pid_t *pids, int max, ProcessContext *context);
+uint64_t ec_process_inode_index_size(void);
+
 #ifdef _REF_DEBUGGING
     #define TRACE_IF_REF_DEBUGGING(...)  TRACE(__VA_ARGS__)
 #else
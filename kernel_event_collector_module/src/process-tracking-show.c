@@ -73,11 +73,51 @@ CATCH_DEFAULT:
 
 int ec_proc_track_show_stats(struct seq_file *m, void *v)
 {
-    seq_printf(m, "%22s | %6llu |\n", "Total Changes",   g_process_tracking_data.op_cnt);
-    seq_printf(m, "%22s | %6llu |\n", "Process Creates", g_process_tracking_data.create);
-    seq_printf(m, "%22s | %6llu |\n", "Process Forks",   g_process_tracking_data.create_by_fork);
-    seq_printf(m, "%22s | %6llu |\n", "Process Execs",   g_process_tracking_data.create_by_exec);
-    seq_printf(m, "%22s | %6llu |\n", "Process Exits",   g_process_tracking_data.exit);
+    PtOpCounters totals;
+    uint64_t     tracked     = 0;
+    uint64_t     stats_count = atomic64_read(&g_process_tracking_data.stats_count);
+    uint64_t     elapsed     = (jiffies - g_process_tracking_data.start_jiffies) / HZ;
+
+    // Each entry used to carry its stats inline, padded to a 256 byte cache object
+    uint64_t     inline_size = max_t(uint64_t, 256, sizeof(PosixIdentity) - sizeof(PosixIdentityStats *) + sizeof(PosixIdentityStats));
+
+    if (g_process_tracking_data.table)
+    {
+        tracked = atomic64_read(&g_process_tracking_data.table->tableInstance);
+    }
+
+    ec_process_tracking_op_counters(&totals);
+
+    seq_printf(m, "%22s | %6llu |\n", "Total Changes",   totals.op_cnt);
+    seq_printf(m, "%22s | %6llu |\n", "Process Creates", totals.create);
+    seq_printf(m, "%22s | %6llu |\n", "Process Forks",   totals.create_by_fork);
+    seq_printf(m, "%22s | %6llu |\n", "Process Execs",   totals.create_by_exec);
+    seq_printf(m, "%22s | %6llu |\n", "Process Exits",   totals.exit);
+
+    seq_printf(m, "%22s | %6llu |\n", "Handle Allocs",   totals.handle_alloc);
+    seq_printf(m, "%22s | %6llu |\n", "Handle Reuses",   totals.handle_cached);
+    seq_printf(m, "%22s | %6llu |\n", "Handle Allocs/sec",
+               elapsed ? totals.handle_alloc / elapsed : totals.handle_alloc);
+
+    seq_printf(m, "%22s | %6s |\n",   "Process Stats",   g_process_tracking_data.stats_enabled ? "on" : "off");
+    seq_printf(m, "%22s | %6llu |\n", "Tracked Processes", tracked);
+    seq_printf(m, "%22s | %6llu |\n", "Stats Allocated", stats_count);
+    seq_printf(m, "%22s | %6llu |\n", "Identity Bytes",  (uint64_t)sizeof(PosixIdentity));
+    seq_printf(m, "%22s | %6llu |\n", "Stats Bytes",     (uint64_t)sizeof(PosixIdentityStats));
+    seq_printf(m, "%22s | %6llu |\n", "Inline Bytes/Proc", inline_size);
+    seq_printf(m, "%22s | %6llu |\n", "Bytes/Proc",
+               tracked ? (tracked * sizeof(PosixIdentity) + stats_count * sizeof(PosixIdentityStats)) / tracked : 0);
 
     return 0;
 }
+
+// Write 1 to collect per process stats and 0 to stop.  Stats already allocated are kept
+//  until their process goes away.
+ssize_t ec_proc_track_set_stats(struct file *file, const char *buf, size_t size, loff_t *ppos)
+{
+    if (size && (buf[0] == '0' || buf[0] == '1'))
+    {
+        WRITE_ONCE(g_process_tracking_data.stats_enabled, buf[0] == '1');
+    }
+    return size;
+}
@@ -12,6 +12,8 @@
 #include "event-factory.h"
 #include "path-buffers.h"
 #include "cb-spinlock.h"
+#include "prefix-trie.h"
+#include "trusted-path.h"
 
 void ec_hashtbl_delete_callback(void *posix_identity, ProcessContext *context);
 void *ec_hashtbl_handle_callback(void *posix_identity, ProcessContext *context);
@@ -22,18 +24,18 @@ void ec_process_tracking_init_exec_identity(ExecIdentity *exec_identity, Process
 ProcessHandle *ec_process_tracking_add_process(PosixIdentity *posix_identity, ProcessContext *context);
 
 process_tracking_data g_process_tracking_data = { 0, };
+DEFINE_PER_CPU(PtOpCounters, g_pt_op_counters);
 
-// TODO set this list dynamically via ioctl
-// For now, the interpreter list is set from this static array.
+// Default interpreter list, which the agent can replace with CB_DRIVER_REQUEST_SET_INTERPRETER_NAMES.
 char  *static_interpreter_names[] = {
     "bash", "sh", "csh", "zsh", "ksh", "perl", "python", "ruby", "java", "js", "node", "firefox", "chrome", "lua",
     "php", "tcl", "dash", "pwsh", "env"};
 char **g_interpreter_names = static_interpreter_names;
 int    g_interpreter_names_count = sizeof(static_interpreter_names)/sizeof(char *);
 
-bool g_print_proc_on_delete;
+static PrefixTrieHolder s_interpreter_names;
 
-#define CB_PT_CACHE_OBJ_SZ  256
+bool g_print_proc_on_delete;
 
 bool ec_process_tracking_should_track_user(void)
 {
@@ -43,11 +45,15 @@ bool ec_process_tracking_should_track_user(void)
 bool ec_process_tracking_initialize(ProcessContext *context)
 {
     g_print_proc_on_delete = false;
+
+    // The index must outlive the tracking table because the table delete callback updates it
+    TRY(ec_process_inode_index_initialize(context));
+
     g_process_tracking_data.table = ec_hashtbl_init_generic(
                                                     context,
                                                     8192,
                                                     sizeof(PosixIdentity),
-                                                    CB_PT_CACHE_OBJ_SZ,
+                                                    0,
                                                     "pt_cache",
                                                     sizeof(PT_TBL_KEY),
                                                     offsetof(PosixIdentity, pt_key),
@@ -59,6 +65,12 @@ bool ec_process_tracking_initialize(ProcessContext *context)
 
     TRY(ec_mem_cache_create(&g_process_tracking_data.exec_identity_cache, "pt_exec_identity_cache", sizeof(ExecIdentity), context));
 
+    atomic64_set(&g_process_tracking_data.stats_count, 0);
+    g_process_tracking_data.start_jiffies = jiffies;
+    TRY(ec_mem_cache_create(&g_process_tracking_data.stats_cache, "pt_stats_cache", sizeof(PosixIdentityStats), context));
+
+    TRY(ec_prefix_trie_holder_load(&s_interpreter_names, (const char * const *)g_interpreter_names, g_interpreter_names_count, context));
+
     return true;
 
 CATCH_DEFAULT:
@@ -70,6 +82,8 @@ void ec_process_tracking_shutdown(ProcessContext *context)
 {
     g_print_proc_on_delete = true;
 
+    ec_process_tracking_discovery_stop(context);
+
     if (g_process_tracking_data.table)
     {
         ec_hashtbl_shutdown_generic(g_process_tracking_data.table, context);
@@ -78,6 +92,15 @@ void ec_process_tracking_shutdown(ProcessContext *context)
 
     ec_mem_cache_destroy(&g_process_tracking_data.exec_identity_cache, context, __ec_process_exec_identity_print_callback);
 
+    // The table delete callback has already freed all of these
+    ec_mem_cache_destroy(&g_process_tracking_data.stats_cache, context, NULL);
+
+    ec_process_handle_cache_drain(context);
+
+    ec_process_inode_index_shutdown(context);
+
+    ec_prefix_trie_holder_clear(&s_interpreter_names);
+
     g_print_proc_on_delete = false;
 }
 
@@ -99,24 +122,25 @@ bool ec_process_tracking_is_interpreter(ExecHandle *exec_handle, ProcessContext
     if (path)
     {
         const char *proc_name = ec_process_tracking_get_proc_name(path);
-        int i;
 
-        for (i = 0; i < g_interpreter_names_count; i++)
-        {
-            char *found = strstr(proc_name, g_interpreter_names[i]);
-            // Does process filename start with the interpreter name? This includes e.g. python3/perl5 but
-            // does not include every filename containing 'sh' anywhere, e.g. ssh
-            if (found && found == proc_name)
-            {
-                result = true;
-                break;
-            }
-        }
+        // Does process filename start with the interpreter name? This includes e.g. python3/perl5 but
+        // does not include every filename containing 'sh' anywhere, e.g. ssh
+        result = ec_prefix_trie_holder_match(&s_interpreter_names, proc_name, strlen(proc_name));
     }
 
     return result;
 }
 
+// An empty list restores the defaults
+bool ec_process_tracking_set_interpreter_names(const char *list, size_t size, ProcessContext *context)
+{
+    if (!size)
+    {
+        return ec_prefix_trie_holder_load(&s_interpreter_names, (const char * const *)g_interpreter_names, g_interpreter_names_count, context);
+    }
+    return ec_prefix_trie_holder_load_list(&s_interpreter_names, list, size, context);
+}
+
 ProcessHandle *ec_process_tracking_create_process(
         pid_t               pid,
         pid_t               parent,
@@ -195,6 +219,7 @@ ProcessHandle *ec_process_tracking_create_process(
 
         // Call this after setting the handle
         exec_identity->is_interpreter = ec_process_tracking_is_interpreter(&exec_handle, context);
+        exec_identity->trusted_path   = ec_trusted_path_check(ec_exec_path(&exec_handle));
 
         // Release the reference to the exec_identity here
         ec_process_tracking_put_exec_identity(exec_identity, context);
@@ -208,22 +233,7 @@ ProcessHandle *ec_process_tracking_create_process(
         posix_identity->uid                        = uid;
         posix_identity->euid                       = euid;
         posix_identity->action                     = action;
-        posix_identity->process_op_cnt             =
-            posix_identity->process_create         =
-            posix_identity->process_create_by_fork =
-            posix_identity->process_create_by_exec =
-            posix_identity->childproc_cnt          =
-            posix_identity->file_op_cnt            =
-            posix_identity->file_map_exec          =
-            posix_identity->file_create            =
-            posix_identity->file_delete            =
-            posix_identity->file_open              =
-            posix_identity->file_write             =
-            posix_identity->file_close             =
-            posix_identity->net_op_cnt             =
-            posix_identity->net_connect            =
-            posix_identity->net_accept             =
-            posix_identity->net_dns                = 0;
+        posix_identity->stats                      = NULL;
         posix_identity->is_real_start              = is_real_start;
         posix_identity->exec_identity              = NULL;
         posix_identity->exec_blocked               = false;
@@ -238,15 +248,15 @@ ProcessHandle *ec_process_tracking_create_process(
         posix_identity->posix_grandparent_details = posix_grandparent_details;
         atomic64_set(&posix_identity->reference_count, 1);
 
-        g_process_tracking_data.op_cnt += 1;
-        g_process_tracking_data.create += 1;
+        PT_OP_INC(op_cnt);
+        PT_OP_INC(create);
 
         if (action == CB_PROCESS_START_BY_FORK)
         {
-            g_process_tracking_data.create_by_fork += 1;
+            PT_OP_INC(create_by_fork);
         } else if (action == CB_PROCESS_START_BY_EXEC)
         {
-            g_process_tracking_data.create_by_exec += 1;
+            PT_OP_INC(create_by_exec);
         }
 
         // We do not lock the tracking table at this point because it is not inserted yet
@@ -255,6 +265,7 @@ ProcessHandle *ec_process_tracking_create_process(
         process_handle = ec_process_tracking_add_process(posix_identity, context);
         TRY(process_handle);
 
+        ec_process_inode_index_add(ec_process_posix_identity(process_handle), context);
 
         // We have recorded this in the tracking table, so mark it as active
         atomic64_inc(&ec_process_exec_identity(process_handle)->active_process_count);
@@ -413,13 +424,12 @@ ProcessHandle *ec_process_tracking_update_process(
 
     // This needs the updated exec_handle
     exec_identity->is_interpreter = ec_process_tracking_is_interpreter(ec_process_exec_handle(process_handle), context);
+    exec_identity->trusted_path   = ec_trusted_path_check(ec_process_path(process_handle));
 
     // Mark us as an active process
     atomic64_inc(&exec_identity->active_process_count);
 
-    ec_process_posix_identity(process_handle)->posix_details.inode   = inode;
-    ec_process_posix_identity(process_handle)->posix_details.device  = device;
-    ec_process_posix_identity(process_handle)->posix_details.inode   = inode;
+    ec_process_tracking_set_posix_inode(process_handle, device, inode, context);
 
     ec_process_posix_identity(process_handle)->tid            = tid;
     ec_process_posix_identity(process_handle)->uid            = uid;
@@ -434,7 +444,7 @@ ProcessHandle *ec_process_tracking_update_process(
         ec_process_tracking_set_temp_exec_handle(process_handle, &parent_exec_handle, context);
     }
 
-    ec_process_tracking_update_op_cnts(ec_process_posix_identity(process_handle), event_type, action);
+    ec_process_tracking_update_op_cnts(ec_process_posix_identity(process_handle), event_type, action, context);
 
     if (MAY_TRACE_LEVEL(DL_PROC_TRACKING))
     {
@@ -462,14 +472,23 @@ void ec_process_tracking_remove_process(ProcessHandle *process_handle, ProcessCo
 {
     if (process_handle)
     {
-        g_process_tracking_data.op_cnt += 1;
-        g_process_tracking_data.exit += 1;
+        PT_OP_INC(op_cnt);
+        PT_OP_INC(exit);
 
-        TRACE(DL_PROC_TRACKING, "TRACK-DEL pid=%d opcnt=%llu create=%llu exit=%llu",
-               ec_process_posix_identity(process_handle)->posix_details.pid,
-               g_process_tracking_data.op_cnt,
-               g_process_tracking_data.create,
-               g_process_tracking_data.exit);
+        if (MAY_TRACE_LEVEL(DL_PROC_TRACKING))
+        {
+            PtOpCounters totals;
+
+            ec_process_tracking_op_counters(&totals);
+            TRACE(DL_PROC_TRACKING, "TRACK-DEL pid=%d opcnt=%llu create=%llu exit=%llu",
+                   ec_process_posix_identity(process_handle)->posix_details.pid,
+                   totals.op_cnt,
+                   totals.create,
+                   totals.exit);
+        }
+
+        // Drop it from the inode index now rather than when the last reference goes away
+        ec_process_inode_index_remove(ec_process_posix_identity(process_handle), context);
 
         // In the exec-other and some pid wrap cases this entry may not exist in
         //  hash table.  In this case, it will be a no-op.
@@ -506,6 +525,8 @@ bool ec_process_tracking_report_exit(pid_t pid, ProcessContext *context)
 
     IF_ATOMIC64_DEC_AND_TEST__CHECK_NEG(&ec_process_exec_identity(process_handle)->active_process_count, { was_last_active_process = true; });
 
+    // Report write cycles still folded into open windows before the exit event
+    ec_file_coalesce_flush_process(process_handle, context);
     ec_event_send_exit(process_handle, was_last_active_process, context);
     ec_process_tracking_remove_process(process_handle, context);
     result = true;
@@ -634,6 +655,8 @@ void ec_process_tracking_init_exec_identity(ExecIdentity *exec_identity, Process
         exec_identity->path               = NULL;
         exec_identity->cmdline            = NULL;
         exec_identity->is_interpreter     = false;
+        exec_identity->trusted_path       = 0;
+        atomic_set(&exec_identity->cmdline_pending, 0);
 
         // TODO: Add lock here
     }
@@ -712,6 +735,10 @@ void ec_hashtbl_delete_callback(void *data, ProcessContext *context)
         // We do not need to lock here because it is done in the delete callback (from the last reference)
         ec_process_posix_identity_set_exec_identity(posix_identity, NULL, context);
 
+        ec_process_inode_index_remove(posix_identity, context);
+
+        ec_process_tracking_free_stats(posix_identity, context);
+
         // Just in case, this should have been unset by ec_process_tracking_set_event_info
         ec_process_tracking_put_exec_handle(&posix_identity->temp_exec_handle, context);
     }
@@ -40,10 +40,16 @@ typedef struct exec_identity {
     char             *cmdline;
     bool              path_found;
 
+    // Set for processes found at load, their cmdline is read on first use
+    atomic_t          cmdline_pending;
+
     // Processes with this set report file open events
     bool              is_interpreter;
     uint64_t          exec_count;
 
+    // Cached trusted path match, see trusted-path.h
+    uint64_t          trusted_path;
+
     // This list contains all the open files tracked by the kernel for this process.
     //  Manipulation of this list is only done in file-process-tracking, and is protected
     //  by a mutex
@@ -69,24 +75,10 @@ typedef struct ExecIdentity_handle {
     char         *cmdline;
 } ExecHandle;
 
-typedef struct posix_identity {
-    HashTableNode     pt_link;
-    PT_TBL_KEY        pt_key;
-
-    // This tracks the owners of this struct (can be more than the number of active processes)
-    atomic64_t        reference_count;
-
-    ProcessDetails    posix_details;
-    ProcessDetails    posix_parent_details;
-    ProcessDetails    posix_grandparent_details;
-
-    pid_t       tid;
-    uid_t       uid;
-    uid_t       euid;
-    int         action;   // How did we start
-
-    bool        exec_blocked;
-    bool        is_real_start;
+// Per process operation counts.  These are only collected when enabled through the
+//  proc-track-stats proc file, and are allocated on the first operation of a process.
+//  Only the process itself normally updates them, so they are plain counters.
+typedef struct posix_identity_stats {
     uint64_t    op_cnt;
 
     uint64_t    net_op_cnt;
@@ -110,6 +102,36 @@ typedef struct posix_identity {
     uint64_t    process_create_by_exec;
 
     uint64_t    childproc_cnt;
+} PosixIdentityStats;
+
+typedef struct posix_identity {
+    HashTableNode     pt_link;
+    PT_TBL_KEY        pt_key;
+
+    pid_t       tid;
+    uid_t       uid;
+    uid_t       euid;
+    int         action;   // How did we start
+
+    bool        exec_blocked;
+    bool        is_real_start;
+
+    // Set once this process opens a write coalescing window so that only such
+    //  processes flush the coalescing table when they exit
+    bool        has_coalesce_window;
+
+    // Kernel start time of a task found at load.  Its memory is read after the task
+    //  is tracked, and this tells a pid that has since been reused apart from it.
+    uint64_t    task_start_ns;
+
+    // This tracks the owners of this struct (can be more than the number of active processes)
+    atomic64_t        reference_count;
+
+    ProcessDetails    posix_details;
+    ProcessDetails    posix_parent_details;
+    ProcessDetails    posix_grandparent_details;
+
+    PosixIdentityStats *stats;
 
     ExecIdentity   *exec_identity;
 
@@ -169,6 +191,8 @@ void ec_process_tracking_set_proc_cmdline(ProcessHandle *process_handle, char *c
 
 // Discovery
 void ec_process_tracking_send_process_discovery(ProcessContext *context);
+void ec_process_tracking_discovery_continue(uint64_t queued_p0, ProcessContext *context);
+void ec_process_tracking_discovery_stop(ProcessContext *context);
 
 // Hook Helpers
 void ec_process_tracking_mark_as_blocked(ProcessHandle *process_handle);
@@ -187,6 +211,7 @@ void ec_process_tracking_set_event_info(ProcessHandle *process_handle, CB_INTENT
 void ec_process_tracking_store_exit_event(PosixIdentity *posix_identity, PCB_EVENT event, ProcessContext *context);
 bool ec_process_tracking_should_track_user(void);
 bool ec_process_tracking_has_active_process(PosixIdentity *posix_identity, ProcessContext *context);
+void ec_process_tracking_set_posix_inode(ProcessHandle *process_handle, uint64_t device, uint64_t inode, ProcessContext *context);
 
 // File helpers
 typedef void (*process_tracking_for_each_tree_callback)(void *tree, void *priv, ProcessContext *context);
@@ -200,7 +225,9 @@ char *ec_process_cmdline(ProcessHandle *process_handle);
 ExecIdentity *ec_exec_identity(ExecHandle *exec_handle);
 char *ec_exec_path(ExecHandle *exec_handle);
 
-// List of interpreters. The ExecIdentity::is_interpreter flag
-// is set for any process whose path contains a name in this list.
+// Default list of interpreters. The ExecIdentity::is_interpreter flag
+// is set for any process whose name starts with a name in the active list.
 extern char **g_interpreter_names;
 extern int    g_interpreter_names_count;
+bool ec_process_tracking_is_interpreter(ExecHandle *exec_handle, ProcessContext *context);
+bool ec_process_tracking_set_interpreter_names(const char *list, size_t size, ProcessContext *context);
@@ -4,6 +4,13 @@
 #include "priv.h"
 #include "mem-cache.h"
 #include "hash-table-generic.h"
+#include "stall-event.h"
+
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)  //{
+#include <linux/sched/clock.h>
+#endif  //}
 
 struct stall_event_key {
     uint64_t perm_id;
@@ -24,6 +31,9 @@ struct stall_event {
     u8 mode;
     int response;
     wait_queue_head_t waitq;
+    uint64_t start_ns;
+    bool has_file;
+    STALL_FILE_ID file;
 };
 
 // Data from struct stall_event that we care about
@@ -31,13 +41,60 @@ struct stall_event {
 struct stall_data {
     u8 mode;
     int response;
+    uint64_t start_ns;
 };
 
+// Time from enqueue until the task is released, bucketed by log2(ns)
+#define STALL_LATENCY_BUCKETS  40
+
+typedef struct stall_stats_pcpu {
+    uint64_t outcome[CB_EVENT_TYPE_MAX][STALL_OUTCOMES];
+    uint64_t latency[CB_EVENT_TYPE_MAX][STALL_LATENCY_BUCKETS];
+} STALL_STATS_PCPU;
+
+// Too big for the static per-cpu area modules get, so it is allocated
+static STALL_STATS_PCPU __percpu *stall_stats;
+
 
 static bool enabled;
 static atomic64_t perm_id = ATOMIC64_INIT(0);
 static HashTbl *stall_tbl;
 
+// Verdicts userspace asked us to remember, so the next event for the same file
+// does not have to stall at all. Only filled and used once a hook stalls on a file.
+#define STALL_VERDICT_MAX  8192
+
+struct verdict_key {
+    uint64_t device;
+    uint64_t inode;
+    CB_EVENT_TYPE eventType;
+};
+
+struct verdict_entry {
+    HashTableNode link;
+    struct verdict_key key;
+    int response;
+    uint32_t cacheFlags;
+    uint64_t mtime;
+    uint64_t ctime;
+    unsigned long expires;
+};
+
+static HashTbl *verdict_tbl;
+static unsigned long verdict_last_purge;
+
+static atomic64_t verdict_lookups = ATOMIC64_INIT(0);
+static atomic64_t verdict_hits = ATOMIC64_INIT(0);
+static atomic64_t verdict_inserts = ATOMIC64_INIT(0);
+static atomic64_t verdict_dropped = ATOMIC64_INIT(0);
+
+// Time tasks with a known file actually spent stalled, to estimate what a hit saves
+static atomic64_t verdict_stalls = ATOMIC64_INIT(0);
+static atomic64_t verdict_stall_ns = ATOMIC64_INIT(0);
+
+static void __ec_stall_verdict_insert(STALL_FILE_ID *file, CB_EVENT_TYPE eventType, int response,
+                                      uint32_t cacheFlags, ProcessContext *context);
+
 bool ec_current_task_may_stall(void)
 {
 // defined in linux/preempt.h
@@ -67,9 +124,26 @@ bool ec_stall_events_initialize(ProcessContext *context)
                                         HASHTBL_DISABLE_REF_COUNT,
                                         ec_stall_tbl_delete_callback,
                                         NULL);
+
+    verdict_tbl = ec_hashtbl_init_generic(context, BIT(10),
+                                          sizeof(struct verdict_entry),
+                                          sizeof(struct verdict_entry),
+                                          "stall_verdict_tbl",
+                                          sizeof(struct verdict_key),
+                                          offsetof(struct verdict_entry, key),
+                                          offsetof(struct verdict_entry, link),
+                                          HASHTBL_DISABLE_REF_COUNT,
+                                          NULL,
+                                          NULL);
+    stall_stats = alloc_percpu(STALL_STATS_PCPU);
     enabled = false;
 
-    return (stall_tbl != NULL);
+    if (!stall_tbl || !verdict_tbl || !stall_stats)
+    {
+        ec_stall_events_shutdown(context);
+        return false;
+    }
+    return true;
 }
 
 void ec_wake_stalled_task(struct stall_event *stall_event)
@@ -128,6 +202,9 @@ void ec_disable_stall_events(ProcessContext *context)
     {
         enabled = false;
         __ec_stall_events_flush(context);
+
+        // Verdicts only hold for the policy that gave them
+        ec_hashtbl_clear_generic(verdict_tbl, context);
     }
 }
 
@@ -137,6 +214,12 @@ void ec_stall_events_shutdown(ProcessContext *context)
 
     ec_hashtbl_shutdown_generic(stall_tbl, context);
     stall_tbl = NULL;
+
+    ec_hashtbl_shutdown_generic(verdict_tbl, context);
+    verdict_tbl = NULL;
+
+    free_percpu(stall_stats);
+    stall_stats = NULL;
 }
 
 uint64_t ec_next_perm_id(void)
@@ -161,19 +244,54 @@ void ec_free_stall_event(struct stall_event *stall_event, ProcessContext *contex
     }
 }
 
-int ec_stall_event_abort(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, ProcessContext *context)
+// local_clock is only monotonic per cpu and the stall may end on another one, so a short
+//  stall can look like it ended before it started
+static uint64_t __ec_stall_elapsed_ns(uint64_t start_ns)
 {
-    int ret = -ENOENT;
-    int response = 0;
-    struct stall_event *stall_event = NULL;
-    struct stall_event_key key = {};
-    HashTableBkt *bkt = NULL;
-    bool found;
+    uint64_t now = local_clock();
 
-    if (!ec_stall_events_enabled())
+    return now > start_ns ? now - start_ns : 0;
+}
+
+// Map a userspace response to the errno value the stalled task returns
+static int __ec_perm_response_errno(uint8_t perm_response, int *response)
+{
+    switch (perm_response)
     {
+    case CB_PERM_RESPONSE_TYPE_ALLOW:
+        *response = 0;
+        break;
+
+    case CB_PERM_RESPONSE_TYPE_EACCES:
+        *response = -EACCES;
+        break;
+
+    case CB_PERM_RESPONSE_TYPE_EPERM:
+        *response = -EPERM;
+        break;
+
+    case CB_PERM_RESPONSE_TYPE_ENOENT:
+        *response = -ENOENT;
+        break;
+
+    default:
         return -EINVAL;
     }
+    return 0;
+}
+
+// Caller has checked that stall events are enabled.  Returns 1 if the task was woken up
+//  and 0 if something else already woke it.
+static int __ec_stall_event_wake(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, int response, u8 mode,
+                                 uint32_t cacheFlags, ProcessContext *context)
+{
+    struct stall_event *stall_event = NULL;
+    struct stall_event_key key = {};
+    HashTableBkt *bkt = NULL;
+    STALL_FILE_ID file;
+    bool has_file = false;
+    bool woken = false;
+    bool found;
 
     key.perm_id = perm_id;
     key.tid = tid;
@@ -181,28 +299,55 @@ int ec_stall_event_abort(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, P
 
     // Update entry data - so use write lock
     found = ec_hashtbl_write_bkt_lock(stall_tbl, &key, (void **)&stall_event, &bkt, context);
-    if (found)
+    if (!found)
     {
-        if (stall_event->mode == EC_STALL_MODE_STALL)
+        return -ENOENT;
+    }
+
+    if (stall_event->mode == EC_STALL_MODE_STALL)
+    {
+        // Only a real answer from userspace says anything about the file
+        if (stall_event->has_file && !(mode & EC_STALL_MODE_ABORT))
         {
-            stall_event->response = response;
-            stall_event->mode = EC_STALL_MODE_WAKEUP|EC_STALL_MODE_ABORT;
-            ec_wake_stalled_task(stall_event);
+            file = stall_event->file;
+            has_file = true;
+            atomic64_inc(&verdict_stalls);
+            atomic64_add(__ec_stall_elapsed_ns(stall_event->start_ns), &verdict_stall_ns);
         }
-        ec_hashtbl_write_bkt_unlock(bkt, context);
-        ret = 0;
+
+        stall_event->response = response;
+        stall_event->mode = mode;
+        ec_wake_stalled_task(stall_event);
+        woken = true;
     }
-    return ret;
+    ec_hashtbl_write_bkt_unlock(bkt, context);
+
+    // The cache allocates, so wait until the bucket is unlocked
+    if (has_file && (cacheFlags & CB_PERM_CACHE_TTL_MASK))
+    {
+        __ec_stall_verdict_insert(&file, eventType, response, cacheFlags, context);
+    }
+
+    return woken ? 1 : 0;
+}
+
+int ec_stall_event_abort(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, ProcessContext *context)
+{
+    int ret;
+
+    if (!ec_stall_events_enabled())
+    {
+        return -EINVAL;
+    }
+
+    ret = __ec_stall_event_wake(perm_id, tid, eventType, 0, EC_STALL_MODE_WAKEUP|EC_STALL_MODE_ABORT, 0, context);
+    return ret < 0 ? ret : 0;
 }
 
 int ec_stall_event_resume(struct CB_PERM_RESPONSE *perm_response, ProcessContext *context)
 {
-    struct stall_event *stall_event = NULL;
-    struct stall_event_key key = {};
-    int ret = -ENOENT;
     int response = -EPERM;
-    HashTableBkt *bkt = NULL;
-    bool found;
+    int ret;
 
     if (!ec_stall_events_enabled())
     {
@@ -214,52 +359,108 @@ int ec_stall_event_resume(struct CB_PERM_RESPONSE *perm_response, ProcessContext
         return -EINVAL;
     }
 
-    // map to errno values
-    switch (perm_response->response)
+    if (__ec_perm_response_errno(perm_response->response, &response))
     {
-    case CB_PERM_RESPONSE_TYPE_ALLOW:
-        response = 0;
-        break;
+        return -EINVAL;
+    }
 
-    case CB_PERM_RESPONSE_TYPE_EACCES:
-        response = -EACCES;
-        break;
+    ret = __ec_stall_event_wake(perm_response->perm_id, perm_response->tid, perm_response->eventType,
+                                response, EC_STALL_MODE_WAKEUP, perm_response->cacheFlags, context);
+    return ret < 0 ? ret : 0;
+}
 
-    case CB_PERM_RESPONSE_TYPE_EPERM:
-        response = -EPERM;
-        break;
+int ec_stall_event_resume_batch(struct CB_PERM_RESPONSE *perm_responses, int count, ProcessContext *context)
+{
+    int woken = 0;
+    int i;
 
-    case CB_PERM_RESPONSE_TYPE_ENOENT:
-        response = -ENOENT;
-        break;
+    if (!ec_stall_events_enabled())
+    {
+        return -EINVAL;
+    }
 
-    default:
+    if (!perm_responses || count < 0)
+    {
         return -EINVAL;
     }
 
-    key.perm_id = perm_response->perm_id;
-    key.tid = perm_response->tid;
-    key.eventType = perm_response->eventType;
+    for (i = 0; i < count; ++i)
+    {
+        struct CB_PERM_RESPONSE *perm_response = &perm_responses[i];
+        int response;
 
-    // Update entry data - so use write lock
-    found = ec_hashtbl_write_bkt_lock(stall_tbl, &key, (void **)&stall_event, &bkt, context);
-    if (found)
+        // One bad entry should not hold up the rest of the tasks
+        if (__ec_perm_response_errno(perm_response->response, &response))
+        {
+            TRACE(DL_WARNING, "%s: invalid response:%u tid:%d eventType:%d", __func__,
+                  perm_response->response, perm_response->tid, perm_response->eventType);
+            continue;
+        }
+
+        if (__ec_stall_event_wake(perm_response->perm_id, perm_response->tid, perm_response->eventType,
+                                  response, EC_STALL_MODE_WAKEUP, perm_response->cacheFlags, context) > 0)
+        {
+            woken += 1;
+        }
+    }
+
+    return woken;
+}
+
+int ec_stall_event_abort_batch(struct CB_PERM_RESPONSE *perm_responses, int count, ProcessContext *context)
+{
+    int woken = 0;
+    int i;
+
+    if (!ec_stall_events_enabled())
     {
-        if (stall_event->mode == EC_STALL_MODE_STALL)
+        return -EINVAL;
+    }
+
+    if (!perm_responses || count < 0)
+    {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        if (__ec_stall_event_wake(perm_responses[i].perm_id, perm_responses[i].tid, perm_responses[i].eventType,
+                                  0, EC_STALL_MODE_WAKEUP|EC_STALL_MODE_ABORT, 0, context) > 0)
         {
-            stall_event->response = response;
-            stall_event->mode = EC_STALL_MODE_WAKEUP;
-            ec_wake_stalled_task(stall_event);
+            woken += 1;
         }
-        ec_hashtbl_write_bkt_unlock(bkt, context);
-        ret = 0;
     }
 
-    return ret;
+    return woken;
+}
+
+bool ec_stall_event_pending(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, ProcessContext *context)
+{
+    struct stall_event *stall_event = NULL;
+    struct stall_event_key key = {};
+    HashTableBkt *bkt = NULL;
+    bool pending = false;
+
+    if (!ec_stall_events_enabled())
+    {
+        return false;
+    }
+
+    key.perm_id = perm_id;
+    key.tid = tid;
+    key.eventType = eventType;
+
+    if (ec_hashtbl_read_bkt_lock(stall_tbl, &key, (void **)&stall_event, &bkt, context))
+    {
+        pending = stall_event->mode == EC_STALL_MODE_STALL;
+        ec_hashtbl_read_bkt_unlock(bkt, context);
+    }
+
+    return pending;
 }
 
 struct stall_event *ec_alloc_stall_event(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType,
-                                         ProcessContext *context)
+                                         const STALL_FILE_ID *file, ProcessContext *context)
 {
     struct stall_event *stall_event = NULL;
 
@@ -277,6 +478,11 @@ struct stall_event *ec_alloc_stall_event(uint64_t perm_id, pid_t tid, CB_EVENT_T
         stall_event->key.eventType = eventType;
         stall_event->mode = EC_STALL_MODE_STALL;
         stall_event->response = 0;
+        stall_event->has_file = (file != NULL);
+        if (file)
+        {
+            stall_event->file = *file;
+        }
     }
 
     return stall_event;
@@ -291,7 +497,7 @@ int ec_stall_event_enqueue(struct stall_event *stall_event, ProcessContext *cont
         return -EINVAL;
     }
 
-    // Set timestamp here to track duration of stalls
+    stall_event->start_ns = local_clock();
 
     ret = ec_hashtbl_add_generic_safe(stall_tbl, stall_event, context);
     if (ret < 0)
@@ -323,6 +529,7 @@ bool __ec_get_stall_data_and_release(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE
         {
             stall_data->mode = stall_event->mode;
             stall_data->response = stall_event->response;
+            stall_data->start_ns = stall_event->start_ns;
         }
 
         // Do not call this unless you know what you are doing
@@ -343,7 +550,35 @@ bool __ec_get_stall_data_and_release(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE
     return found;
 }
 
-int ec_wait_stall_event_killable(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, ProcessContext *context)
+static STALL_OUTCOME __ec_stall_outcome(u8 mode)
+{
+    if (mode & EC_STALL_MODE_ABORT)
+    {
+        return STALL_ABORTED;
+    }
+    if (mode & EC_STALL_MODE_FLUSH)
+    {
+        return STALL_FLUSHED;
+    }
+    return STALL_RESUMED;
+}
+
+static void __ec_stall_record(CB_EVENT_TYPE eventType, STALL_OUTCOME outcome, struct stall_data *stall_data)
+{
+    uint64_t elapsed_ns = __ec_stall_elapsed_ns(stall_data->start_ns);
+    int      bucket     = elapsed_ns ? min_t(int, ilog2(elapsed_ns), STALL_LATENCY_BUCKETS - 1) : 0;
+
+    if (!stall_stats || (unsigned int)eventType >= CB_EVENT_TYPE_MAX)
+    {
+        return;
+    }
+
+    this_cpu_inc(stall_stats->outcome[eventType][outcome]);
+    this_cpu_inc(stall_stats->latency[eventType][bucket]);
+}
+
+int ec_wait_stall_event_killable(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, const STALL_FILE_ID *file,
+                                 ProcessContext *context)
 {
     int ret;
     int response = 0;
@@ -356,7 +591,7 @@ int ec_wait_stall_event_killable(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE even
         return -EINVAL;
     }
 
-    stall_event = ec_alloc_stall_event(perm_id, tid, eventType, context);
+    stall_event = ec_alloc_stall_event(perm_id, tid, eventType, file, context);
 
     ret = ec_stall_event_enqueue(stall_event, context);
     if (ret)
@@ -377,8 +612,10 @@ int ec_wait_stall_event_killable(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE even
     if (ret == 0)
     {
         response = stall_data.response;
+        __ec_stall_record(eventType, __ec_stall_outcome(stall_data.mode), &stall_data);
     } else // signal interrupted
     {
+        __ec_stall_record(eventType, STALL_KILLED, &stall_data);
         TRACE(DL_INFO, "%s: Signaled:%d - tid:%d eventType:%d mode:%#x", __func__, ret,
               tid, eventType, stall_data.mode);
     }
@@ -386,8 +623,8 @@ int ec_wait_stall_event_killable(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE even
     return response;
 }
 
-int ec_wait_stall_event_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, unsigned int ms,
-                                ProcessContext *context)
+int ec_wait_stall_event_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, const STALL_FILE_ID *file,
+                                unsigned int ms, ProcessContext *context)
 {
     int ret;
     int response = 0;
@@ -400,7 +637,7 @@ int ec_wait_stall_event_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE event
         return -EINVAL;
     }
 
-    stall_event = ec_alloc_stall_event(perm_id, tid, eventType, context);
+    stall_event = ec_alloc_stall_event(perm_id, tid, eventType, file, context);
 
     ret = ec_stall_event_enqueue(stall_event, context);
     if (ret)
@@ -421,8 +658,10 @@ int ec_wait_stall_event_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE event
     if (ret >= 1)
     {
         response = stall_data.response;
+        __ec_stall_record(eventType, __ec_stall_outcome(stall_data.mode), &stall_data);
     } else
     {
+        __ec_stall_record(eventType, STALL_TIMED_OUT, &stall_data);
         TRACE(DL_INFO, "%s: Timedout:%d - tid:%d eventType:%d mode:%#x", __func__, ret,
               tid, eventType, stall_data.mode);
     }
@@ -430,8 +669,8 @@ int ec_wait_stall_event_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE event
     return response;
 }
 
-int ec_wait_stall_event_killable_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType, unsigned int ms,
-                                         ProcessContext *context)
+int ec_wait_stall_event_killable_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType,
+                                         const STALL_FILE_ID *file, unsigned int ms, ProcessContext *context)
 {
 // defined in linux/wait.h
 #ifdef wait_event_killable_timeout
@@ -446,7 +685,7 @@ int ec_wait_stall_event_killable_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_T
         return -EINVAL;
     }
 
-    stall_event = ec_alloc_stall_event(perm_id, tid, eventType, context);
+    stall_event = ec_alloc_stall_event(perm_id, tid, eventType, file, context);
 
     ret = ec_stall_event_enqueue(stall_event, context);
     if (ret)
@@ -467,14 +706,310 @@ int ec_wait_stall_event_killable_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_T
     if (ret >= 1)
     {
         response = stall_data.response;
+        __ec_stall_record(eventType, __ec_stall_outcome(stall_data.mode), &stall_data);
     } else // signal interrupted (-ERESTARTSYS) or timed out (0)
     {
+        __ec_stall_record(eventType, ret ? STALL_KILLED : STALL_TIMED_OUT, &stall_data);
         TRACE(DL_INFO, "%s: Signaled or Timedout:%d - tid:%d eventType:%d mode:%#x", __func__, ret,
               tid, eventType, stall_data.mode);
     }
 
     return response;
 #else
-    return ec_wait_stall_event_timeout(perm_id, tid, eventType, ms, context);
+    return ec_wait_stall_event_timeout(perm_id, tid, eventType, file, ms, context);
 #endif  /* ! wait_event_killable_timeout */
 }
+
+static void __ec_verdict_key(struct verdict_key *key, const STALL_FILE_ID *file, CB_EVENT_TYPE eventType)
+{
+    // The hash covers the padding too
+    memset(key, 0, sizeof(*key));
+    key->device = file->device;
+    key->inode = file->inode;
+    key->eventType = eventType;
+}
+
+static void __ec_verdict_set(struct verdict_entry *entry, const STALL_FILE_ID *file, int response,
+                             uint32_t cacheFlags)
+{
+    entry->response = response;
+    entry->cacheFlags = cacheFlags;
+    entry->mtime = file->mtime;
+    entry->ctime = file->ctime;
+    entry->expires = jiffies + (cacheFlags & CB_PERM_CACHE_TTL_MASK) * HZ;
+}
+
+static int __ec_verdict_expired_callback(HashTbl *hashTblp, HashTableNode *nodep, void *priv, ProcessContext *context)
+{
+    struct verdict_entry *entry = (struct verdict_entry *)nodep;
+
+    return (entry && time_after(jiffies, entry->expires)) ? ACTION_DELETE : ACTION_CONTINUE;
+}
+
+static void __ec_stall_verdict_insert(STALL_FILE_ID *file, CB_EVENT_TYPE eventType, int response,
+                                      uint32_t cacheFlags, ProcessContext *context)
+{
+    struct verdict_entry *entry = NULL;
+    struct verdict_key key;
+    HashTableBkt *bkt = NULL;
+
+    __ec_verdict_key(&key, file, eventType);
+
+    // A newer answer for the same file replaces the old one
+    if (ec_hashtbl_write_bkt_lock(verdict_tbl, &key, (void **)&entry, &bkt, context))
+    {
+        __ec_verdict_set(entry, file, response, cacheFlags);
+        ec_hashtbl_write_bkt_unlock(bkt, context);
+        atomic64_inc(&verdict_inserts);
+        return;
+    }
+
+    if (atomic64_read(&verdict_tbl->tableInstance) >= STALL_VERDICT_MAX &&
+        time_after(jiffies, READ_ONCE(verdict_last_purge) + HZ))
+    {
+        WRITE_ONCE(verdict_last_purge, jiffies);
+        ec_hashtbl_write_for_each_generic(verdict_tbl, __ec_verdict_expired_callback, NULL, context);
+    }
+    if (atomic64_read(&verdict_tbl->tableInstance) >= STALL_VERDICT_MAX)
+    {
+        atomic64_inc(&verdict_dropped);
+        return;
+    }
+
+    entry = ec_hashtbl_alloc_generic(verdict_tbl, context);
+    if (!entry)
+    {
+        atomic64_inc(&verdict_dropped);
+        return;
+    }
+
+    entry->key = key;
+    __ec_verdict_set(entry, file, response, cacheFlags);
+
+    // Lost a race with another response for the same file, either answer will do
+    if (ec_hashtbl_add_generic_safe(verdict_tbl, entry, context) < 0)
+    {
+        ec_hashtbl_free_generic(verdict_tbl, entry, context);
+        return;
+    }
+    atomic64_inc(&verdict_inserts);
+}
+
+static bool __ec_verdict_stale(struct verdict_entry *entry, const STALL_FILE_ID *file)
+{
+    if (time_after(jiffies, entry->expires))
+    {
+        return true;
+    }
+
+    // The file changed since userspace looked at it
+    return (entry->cacheFlags & CB_PERM_CACHE_MATCH_TIMES) &&
+           (entry->mtime != file->mtime || entry->ctime != file->ctime);
+}
+
+bool ec_stall_verdict_lookup(const STALL_FILE_ID *file, CB_EVENT_TYPE eventType, int *response,
+                             ProcessContext *context)
+{
+    struct verdict_entry *entry = NULL;
+    struct verdict_key key;
+    HashTableBkt *bkt = NULL;
+    bool hit = false;
+    bool stale = false;
+
+    if (!ec_stall_events_enabled() || !verdict_tbl || !file || !response)
+    {
+        return false;
+    }
+
+    __ec_verdict_key(&key, file, eventType);
+    atomic64_inc(&verdict_lookups);
+
+    if (ec_hashtbl_read_bkt_lock(verdict_tbl, &key, (void **)&entry, &bkt, context))
+    {
+        if (__ec_verdict_stale(entry, file))
+        {
+            stale = true;
+        } else
+        {
+            *response = entry->response;
+            hit = true;
+        }
+        ec_hashtbl_read_bkt_unlock(bkt, context);
+    }
+
+    // A new answer may have refreshed the entry since it was read, so look again
+    //  before dropping it
+    if (stale && ec_hashtbl_write_bkt_lock(verdict_tbl, &key, (void **)&entry, &bkt, context))
+    {
+        if (__ec_verdict_stale(entry, file))
+        {
+            ec_hashtbl_del_generic_lockheld(verdict_tbl, entry, context);
+        } else
+        {
+            entry = NULL;
+        }
+        ec_hashtbl_write_bkt_unlock(bkt, context);
+
+        ec_hashtbl_free_generic(verdict_tbl, entry, context);
+    }
+
+    if (hit)
+    {
+        atomic64_inc(&verdict_hits);
+    }
+    return hit;
+}
+
+int ec_stall_verdict_show(struct seq_file *m, void *v)
+{
+    uint64_t lookups = atomic64_read(&verdict_lookups);
+    uint64_t hits = atomic64_read(&verdict_hits);
+    uint64_t stalls = atomic64_read(&verdict_stalls);
+    uint64_t stall_ns = atomic64_read(&verdict_stall_ns);
+    uint64_t avg_ns = stalls ? stall_ns / stalls : 0;
+
+    seq_printf(m, "%16s | %12llu |\n", "Lookups", lookups);
+    seq_printf(m, "%16s | %12llu |\n", "Hits", hits);
+    seq_printf(m, "%16s | %12llu |\n", "Hit %", lookups ? (hits * 100) / lookups : 0);
+    seq_printf(m, "%16s | %12llu |\n", "Inserts", (uint64_t)atomic64_read(&verdict_inserts));
+    seq_printf(m, "%16s | %12llu |\n", "Dropped", (uint64_t)atomic64_read(&verdict_dropped));
+    seq_printf(m, "%16s | %12llu |\n", "Entries", verdict_tbl ? (uint64_t)atomic64_read(&verdict_tbl->tableInstance) : 0);
+    seq_printf(m, "%16s | %12llu |\n", "Avg stall us", avg_ns / NSEC_PER_USEC);
+    seq_printf(m, "%16s | %12llu |\n", "Avoided ms", (hits * avg_ns) / NSEC_PER_MSEC);
+
+    return 0;
+}
+
+ssize_t ec_stall_verdict_clear(struct file *file, const char *buf, size_t size, loff_t *ppos)
+{
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    ec_hashtbl_clear_generic(verdict_tbl, &context);
+
+    atomic64_set(&verdict_lookups, 0);
+    atomic64_set(&verdict_hits, 0);
+    atomic64_set(&verdict_inserts, 0);
+    atomic64_set(&verdict_dropped, 0);
+    atomic64_set(&verdict_stalls, 0);
+    atomic64_set(&verdict_stall_ns, 0);
+
+    return size;
+}
+
+uint64_t ec_stall_outcome_count(CB_EVENT_TYPE eventType, STALL_OUTCOME outcome)
+{
+    uint64_t count = 0;
+    int cpu;
+
+    if (!stall_stats || (unsigned int)eventType >= CB_EVENT_TYPE_MAX || (unsigned int)outcome >= STALL_OUTCOMES)
+    {
+        return 0;
+    }
+
+    for_each_possible_cpu(cpu)
+    {
+        count += READ_ONCE(per_cpu_ptr(stall_stats, cpu)->outcome[eventType][outcome]);
+    }
+    return count;
+}
+
+// Returns the upper bound in ns of the bucket holding the given permille of stalls
+static uint64_t __ec_stall_latency_percentile(uint64_t *latency, uint64_t total, int permille)
+{
+    uint64_t target = DIV_ROUND_UP(total * permille, 1000);
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < STALL_LATENCY_BUCKETS - 1; ++i)
+    {
+        seen += latency[i];
+        if (seen >= target)
+        {
+            break;
+        }
+    }
+    return 1ULL << (i + 1);
+}
+
+// Print how each stall ended and how long tasks were stalled for, per event type.
+// Only event types that have stalled show up.
+int ec_stall_latency_show(struct seq_file *m, void *v)
+{
+    uint64_t outcome[STALL_OUTCOMES];
+    uint64_t latency[STALL_LATENCY_BUCKETS];
+    int type;
+    int cpu;
+    int i;
+
+    seq_printf(m, " %4s | %10s | %10s | %10s | %10s | %10s | %10s | %12s | %12s | %12s |\n",
+               "Type", "Stalls", "Resumed", "Aborted", "Flushed", "Timed out", "Killed",
+               "P50(ns)", "P90(ns)", "P99(ns)");
+
+    if (!stall_stats)
+    {
+        return 0;
+    }
+
+    for (type = 0; type < CB_EVENT_TYPE_MAX; ++type)
+    {
+        uint64_t total = 0;
+
+        memset(outcome, 0, sizeof(outcome));
+        memset(latency, 0, sizeof(latency));
+        for_each_possible_cpu(cpu)
+        {
+            STALL_STATS_PCPU *pcpu = per_cpu_ptr(stall_stats, cpu);
+
+            for (i = 0; i < STALL_OUTCOMES; ++i)
+            {
+                outcome[i] += READ_ONCE(pcpu->outcome[type][i]);
+            }
+            for (i = 0; i < STALL_LATENCY_BUCKETS; ++i)
+            {
+                latency[i] += READ_ONCE(pcpu->latency[type][i]);
+            }
+        }
+        for (i = 0; i < STALL_OUTCOMES; ++i)
+        {
+            total += outcome[i];
+        }
+        if (!total)
+        {
+            continue;
+        }
+
+        seq_printf(m, " %4d | %10llu | %10llu | %10llu | %10llu | %10llu | %10llu | %12llu | %12llu | %12llu |\n",
+                   type, total,
+                   outcome[STALL_RESUMED], outcome[STALL_ABORTED], outcome[STALL_FLUSHED],
+                   outcome[STALL_TIMED_OUT], outcome[STALL_KILLED],
+                   __ec_stall_latency_percentile(latency, total, 500),
+                   __ec_stall_latency_percentile(latency, total, 900),
+                   __ec_stall_latency_percentile(latency, total, 990));
+
+        seq_printf(m, " %4s | %10s |", "", "Stalled(ns)");
+        for (i = 0; i < STALL_LATENCY_BUCKETS; ++i)
+        {
+            if (latency[i])
+            {
+                seq_printf(m, " %llu:%llu", i ? 1ULL << i : 0ULL, latency[i]);
+            }
+        }
+        seq_puts(m, "\n");
+    }
+
+    return 0;
+}
+
+ssize_t ec_stall_latency_reset(struct file *file, const char *buf, size_t size, loff_t *ppos)
+{
+    int cpu;
+
+    if (stall_stats)
+    {
+        for_each_possible_cpu(cpu)
+        {
+            memset(per_cpu_ptr(stall_stats, cpu), 0, sizeof(STALL_STATS_PCPU));
+        }
+    }
+    return size;
+}
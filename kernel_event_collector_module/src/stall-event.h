@@ -3,6 +3,24 @@
 
 #pragma once
 
+// Identifies the file a stall decision is about. mtime and ctime only have to
+// match when userspace cached the verdict with CB_PERM_CACHE_MATCH_TIMES.
+typedef struct stall_file_id {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t mtime;
+    uint64_t ctime;
+} STALL_FILE_ID;
+
+// How a stall ended, from the point of view of the stalled task
+typedef enum stall_outcome {
+    STALL_RESUMED,
+    STALL_ABORTED,
+    STALL_FLUSHED,
+    STALL_TIMED_OUT,
+    STALL_KILLED,
+    STALL_OUTCOMES
+} STALL_OUTCOME;
 
 // Basic Setup/Tear Down
 extern bool ec_stall_events_initialize(ProcessContext *context);
@@ -33,18 +51,45 @@ extern int ec_stall_event_abort(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE event
 extern int ec_stall_event_resume(struct CB_PERM_RESPONSE *perm_response,
                                  ProcessContext *context);
 
+// Same as above for a whole array of replies, entries that do not match a task that
+// is still stalled are skipped. Returns the number of tasks woken up.
+extern int ec_stall_event_resume_batch(struct CB_PERM_RESPONSE *perm_responses, int count,
+                                       ProcessContext *context);
 
-// Different ways we will want to stall tasks
+// Aborts the stalls in the array the same way, only perm_id, tid and eventType are used
+extern int ec_stall_event_abort_batch(struct CB_PERM_RESPONSE *perm_responses, int count,
+                                      ProcessContext *context);
+
+// True while a task is stalled on the event and nothing has woken it yet
+extern bool ec_stall_event_pending(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType,
+                                   ProcessContext *context);
+
+
+// Check before sending a stall event, a cached verdict means there is no need to stall.
+// Returns true and sets response if one applies. The verdict cache is infrastructure
+// only for now: no hook stalls on a file, so only the self-tests call this. A producer
+// that passes a STALL_FILE_ID to the waits below must call this first.
+extern bool ec_stall_verdict_lookup(const STALL_FILE_ID *file, CB_EVENT_TYPE eventType,
+                                    int *response, ProcessContext *context);
+
+
+// Different ways we will want to stall tasks. file may be NULL, without it the
+// response can not be cached.
 extern int ec_wait_stall_event_killable(uint64_t perm_id, pid_t tid,
-                                        CB_EVENT_TYPE eventType, ProcessContext *context);
+                                        CB_EVENT_TYPE eventType, const STALL_FILE_ID *file,
+                                        ProcessContext *context);
 
 extern int ec_wait_stall_event_timeout(uint64_t perm_id, pid_t tid, CB_EVENT_TYPE eventType,
-                                       unsigned int ms, ProcessContext *context);
+                                       const STALL_FILE_ID *file, unsigned int ms,
+                                       ProcessContext *context);
 
 // RHEL8+ Only
 extern int ec_wait_stall_event_killable_timeout(uint64_t perm_id, pid_t tid,
-                                                CB_EVENT_TYPE eventType, unsigned int ms,
-                                                ProcessContext *context);
+                                                CB_EVENT_TYPE eventType, const STALL_FILE_ID *file,
+                                                unsigned int ms, ProcessContext *context);
 
 // Helper to know if we can even stall from this context
 extern bool ec_current_task_may_stall(void);
+
+// Number of stalls of eventType that ended the given way, summed over all cpus
+extern uint64_t ec_stall_outcome_count(CB_EVENT_TYPE eventType, STALL_OUTCOME outcome);
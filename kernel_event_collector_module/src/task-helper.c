@@ -8,6 +8,9 @@
 #include "path-buffers.h"
 
 #include <linux/binfmts.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+#include <linux/workqueue.h>
 
 struct file *__ec_get_file_from_mm(struct mm_struct *mm);
 
@@ -84,7 +87,7 @@ void ec_get_starttime(struct timespec *start_time)
     set_normalized_timespec(start_time, current_time.tv_sec, current_time.tv_nsec);
 }
 
-bool ec_task_get_path(struct task_struct const *task, char *buffer, unsigned int buflen, char **pathname)
+static bool __ec_task_get_path_from_mm(struct task_struct const *task, struct mm_struct *mm, char *buffer, unsigned int buflen, char **pathname)
 {
     bool ret = true;
 
@@ -92,7 +95,7 @@ bool ec_task_get_path(struct task_struct const *task, char *buffer, unsigned int
     CANCEL(buffer, false);
     CANCEL(pathname, false);
 
-    ret = ec_file_get_path(__ec_get_file_from_mm(task->mm), buffer, buflen, pathname);
+    ret = ec_file_get_path(__ec_get_file_from_mm(mm), buffer, buflen, pathname);
 
     if (!ret)
     {
@@ -104,6 +107,22 @@ bool ec_task_get_path(struct task_struct const *task, char *buffer, unsigned int
     return ret;
 }
 
+bool ec_task_get_path(struct task_struct const *task, char *buffer, unsigned int buflen, char **pathname)
+{
+    CANCEL(task, false);
+
+    return __ec_task_get_path_from_mm(task, task->mm, buffer, buflen, pathname);
+}
+
+static uint64_t __ec_task_start_ns(struct task_struct const *task)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 17, 0)  //{
+    return task->start_time;
+#else  //}{
+    return timespec_to_ns(&task->start_time);
+#endif  //}
+}
+
 void ec_get_devinfo_from_task(struct task_struct const *task, uint64_t *device, uint64_t *inode)
 {
     CANCEL_VOID(task);
@@ -132,14 +151,23 @@ bool __ec_get_cmdline(struct task_struct const *task,
                          char *cmdLine,
                          size_t              cmdLineSize);
 
-bool __ec_get_cmdline_from_task(struct task_struct const *task, char *cmdLine, size_t cmdLineSize)
+bool __ec_get_cmdline_from_task(struct task_struct *task, char *cmdLine, size_t cmdLineSize)
 {
-    CANCEL(task && task->mm, false);
+    struct mm_struct *mm;
+    bool              ret;
+
+    // This is not the current task, so it may exit and drop its mm while we read it
+    CANCEL(task, false);
+    mm = get_task_mm(task);
+    CANCEL(mm, false);
 
     // This will be bound only by the size of the target buffer and memory range
     //  defined in the mm struct.
     // Note that `arg_end` is not valid during exec hooks
-    return __ec_get_cmdline(task, task->mm->arg_start, task->mm->arg_end, 0xFFFF, cmdLine, cmdLineSize);
+    ret = __ec_get_cmdline(task, mm->arg_start, mm->arg_end, 0xFFFF, cmdLine, cmdLineSize);
+
+    mmput(mm);
+    return ret;
 }
 
 bool ec_get_cmdline_from_binprm(struct linux_binprm const *bprm, char *cmdLine, size_t cmdLineSize)
@@ -298,12 +326,54 @@ struct task_stack {
 // FIRST_TASK and NEXT_TASK provide local dereferenced pointers so we don't need to dereference here
 #define HAS_MORE_TASKS(stack)  (!list_empty((stack)->child->sibling.next) && (&(stack)->child->sibling != &(stack)->task->children))
 
-bool __ec_add_tracking_for_child_and_update_stack(
+// Each task found by the walk is recorded here and tracked after the walk.  The depth
+//  in the process tree lets the tracking run in parallel one level at a time, since a
+//  task's parent is always on the level above it.
+typedef struct enum_task {
+    struct task_struct *task;
+    pid_t               pid;
+    time_t              start_time;
+    int                 depth;
+    bool                is_exec;
+} ENUM_TASK;
+
+typedef struct enum_worker {
+    struct work_struct  work;
+    ENUM_TASK          *tasks;
+    int                 count;
+} ENUM_WORKER;
+
+typedef struct enum_stats {
+    uint64_t  tasks;
+    uint64_t  levels;
+    uint64_t  workers;
+    uint64_t  collect_ns;
+    uint64_t  track_ns;
+    uint64_t  total_ns;
+    uint64_t  cmdline_ns;
+    uint64_t  cmdline_background;
+} ENUM_STATS;
+
+// Levels smaller than this are tracked by the caller without handing out work
+#define ENUM_MIN_PARALLEL    64
+#define ENUM_MAX_WORKERS     8
+
+static ENUM_STATS         s_enum_stats;
+static atomic64_t         s_cmdline_filled = ATOMIC64_INIT(0);
+
+// After the walk the exec'ed tasks stay here until the background work reads their cmdlines
+static ENUM_TASK         *s_cmdline_tasks;
+static int                s_cmdline_count;
+
+static void __ec_fill_cmdlines_work(struct work_struct *work);
+static DECLARE_WORK(s_cmdline_work, __ec_fill_cmdlines_work);
+
+bool __ec_collect_child_and_update_stack(
     struct task_stack *top,
     struct task_stack *next,
-    char              *path_buffer,
+    ENUM_TASK         *entry,
     time_t             start_time,
-    ProcessContext *context);
+    int                depth);
 void __ec_add_tracking_for_task(
     struct task_struct *task,
     time_t              start_time,
@@ -313,19 +383,18 @@ void __ec_add_tracking_for_task(
 // Assuming no system will have > 10000 processes, break out of the loop if we exceed this.
 #define MAX_ENUMERATE_LOOPS 10000
 
-void ec_enumerate_and_track_all_tasks(ProcessContext *context)
+static uint64_t __ec_enum_now_ns(void)
 {
-    struct task_stack *stack = NULL;
-    char *path_buffer = NULL;
-    time_t             start_time = 0;
-    int                index = 0;
-    int num_loops = 0;
+    return ktime_to_ns(ktime_get());
+}
 
-    // Allocate stack space for walking the process tree
-    //  We allocate one more than we need, so that the logic never accesses invalid memory
-    stack       = ec_mem_cache_alloc_generic((MAX_TASK_STACK + 1) * sizeof(struct task_stack), context);
-    path_buffer = ec_get_path_buffer(context);
-    start_time  = ec_get_current_time() - TO_WIN_SEC(2);
+// Returns the number of tasks recorded in tasks, each holding a task reference
+static int __ec_collect_all_tasks(ENUM_TASK *tasks, struct task_stack *stack, ProcessContext *context)
+{
+    time_t start_time = ec_get_current_time() - TO_WIN_SEC(2);
+    int    count      = 0;
+    int    index      = 0;
+    int    num_loops  = 0;
 
     // I would prefer to hold the tasklist_lock here, but it causes a softlok
     rcu_read_lock();
@@ -336,8 +405,6 @@ void ec_enumerate_and_track_all_tasks(ProcessContext *context)
     //  onto the stack.  (This causes the inner loop to start looping over the children.)
     // Once the children are exhausted, it will exit the inner loop.  The outer loop will
     //  pop a layer off the stack and resume enumerating the previous list of children.
-    TRY(path_buffer && stack);
-
     stack[0].task  = &init_task;
     stack[0].child = FIRST_TASK(&stack[0]);
 
@@ -349,12 +416,14 @@ void ec_enumerate_and_track_all_tasks(ProcessContext *context)
         // TODO: the infinite looping problem should be fixed, it we don't see it any more remove MAX_ENUMERATE_LOOPS.
         while (num_loops < MAX_ENUMERATE_LOOPS && NEXT_TASK(&stack[index]) && HAS_MORE_TASKS(&stack[index]))
         {
-            if (__ec_add_tracking_for_child_and_update_stack(&stack[index],
-                                                        &stack[index + 1],
-                                                        path_buffer,
-                                                        start_time++,
-                                                        context))
+            if (__ec_collect_child_and_update_stack(&stack[index],
+                                                    &stack[index + 1],
+                                                    &tasks[count],
+                                                    start_time++,
+                                                    index))
             {
+                ++count;
+
                 // If the process tree goes too deep, we print a warning and continue
                 //  enumerating.
                 index++;
@@ -386,29 +455,280 @@ void ec_enumerate_and_track_all_tasks(ProcessContext *context)
     //  end the loop.  Otherwise we pop off the stack.
     while (index > 0 && index--);
 
-CATCH_DEFAULT:
     rcu_read_unlock();
+
+    return count;
+}
+
+static void __ec_track_tasks(ENUM_TASK *tasks, int count, ProcessContext *context)
+{
+    char *path_buffer = ec_get_path_buffer(context);
+    int   i;
+
+    for (i = 0; i < count; ++i)
+    {
+        __ec_add_tracking_for_task(tasks[i].task, tasks[i].start_time, path_buffer, context);
+    }
+
     ec_put_path_buffer(path_buffer);
+}
+
+static void __ec_track_tasks_work(struct work_struct *work)
+{
+    ENUM_WORKER *worker = container_of(work, ENUM_WORKER, work);
+
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    __ec_track_tasks(worker->tasks, worker->count, &context);
+}
+
+// Splits one level of the tree between the workers and waits for them
+static void __ec_track_level(ENUM_TASK *tasks, int count, ENUM_WORKER *workers, int max_workers, ProcessContext *context)
+{
+    int per_worker;
+    int started = 0;
+    int i;
+
+    if (count < ENUM_MIN_PARALLEL || max_workers < 2)
+    {
+        __ec_track_tasks(tasks, count, context);
+        return;
+    }
+
+    per_worker = DIV_ROUND_UP(count, max_workers);
+    for (i = 0; i < max_workers && i * per_worker < count; ++i)
+    {
+        workers[i].tasks = &tasks[i * per_worker];
+        workers[i].count = min(per_worker, count - i * per_worker);
+        INIT_WORK(&workers[i].work, __ec_track_tasks_work);
+        queue_work(system_unbound_wq, &workers[i].work);
+        ++started;
+    }
+
+    for (i = 0; i < started; ++i)
+    {
+        flush_work(&workers[i].work);
+    }
+}
+
+static int __ec_compare_enum_task(const void *left, const void *right)
+{
+    const ENUM_TASK *l = left;
+    const ENUM_TASK *r = right;
+
+    if (l->depth != r->depth)
+    {
+        return l->depth < r->depth ? -1 : 1;
+    }
+    return l->start_time < r->start_time ? -1 : (l->start_time > r->start_time);
+}
+
+static void __ec_fill_cmdlines_work(struct work_struct *work)
+{
+    uint64_t start = __ec_enum_now_ns();
+    uint64_t filled = 0;
+    int      i;
+
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    for (i = 0; i < s_cmdline_count; ++i)
+    {
+        ProcessHandle *handle = ec_process_tracking_get_handle(s_cmdline_tasks[i].pid, &context);
+
+        if (handle && atomic_read(&ec_process_exec_identity(handle)->cmdline_pending))
+        {
+            ec_task_fill_pending_cmdline(handle, &context);
+            ++filled;
+        }
+        ec_process_tracking_put_handle(handle, &context);
+        cond_resched();
+    }
+
+    s_enum_stats.cmdline_ns         = __ec_enum_now_ns() - start;
+    s_enum_stats.cmdline_background = filled;
+
+    ec_mem_cache_free_generic(s_cmdline_tasks);
+    s_cmdline_tasks = NULL;
+    s_cmdline_count = 0;
+
+    TRACE(DL_INIT, "%s: read %llu cmdlines in %llu us", __func__, filled, s_enum_stats.cmdline_ns / NSEC_PER_USEC);
+}
+
+// Tracks every task that was running before the module was enabled.  The tree is walked
+//  under RCU only long enough to take a reference on each task, then tracked one level at
+//  a time by up to ENUM_MAX_WORKERS workers.  Reading cmdlines needs to page in the
+//  memory of each process, so that is left to a background work item and to the first
+//  start event that needs one.
+void ec_enumerate_and_track_all_tasks(ProcessContext *context)
+{
+    struct task_stack *stack   = NULL;
+    ENUM_TASK         *tasks   = NULL;
+    ENUM_WORKER       *workers = NULL;
+    int                count   = 0;
+    int                exec_count = 0;
+    int                max_workers;
+    int                level_start;
+    int                i;
+    uint64_t           start = __ec_enum_now_ns();
+    uint64_t           collected;
+
+    // Anything still waiting from a previous enable is stale
+    ec_task_enumeration_shutdown(context);
+
+    memset(&s_enum_stats, 0, sizeof(s_enum_stats));
+    max_workers = min_t(int, num_online_cpus(), ENUM_MAX_WORKERS);
+
+    // Allocate stack space for walking the process tree
+    //  We allocate one more than we need, so that the logic never accesses invalid memory
+    stack   = ec_mem_cache_alloc_generic((MAX_TASK_STACK + 1) * sizeof(struct task_stack), context);
+    tasks   = ec_mem_cache_valloc_generic(MAX_ENUMERATE_LOOPS * sizeof(ENUM_TASK), context);
+    workers = ec_mem_cache_alloc_generic(ENUM_MAX_WORKERS * sizeof(ENUM_WORKER), context);
+    TRY(stack && tasks && workers);
+
+    count = __ec_collect_all_tasks(tasks, stack, context);
+    collected = __ec_enum_now_ns();
+
+    sort(tasks, count, sizeof(ENUM_TASK), __ec_compare_enum_task, NULL);
+
+    for (level_start = 0, i = 1; i <= count; ++i)
+    {
+        if (i == count || tasks[i].depth != tasks[level_start].depth)
+        {
+            __ec_track_level(&tasks[level_start], i - level_start, workers, max_workers, context);
+            s_enum_stats.levels += 1;
+            level_start = i;
+        }
+    }
+
+    // Only the pids of exec'ed tasks are needed from here on
+    for (i = 0; i < count; ++i)
+    {
+        put_task_struct(tasks[i].task);
+        tasks[i].task = NULL;
+        if (tasks[i].is_exec)
+        {
+            tasks[exec_count++] = tasks[i];
+        }
+    }
+
+    s_enum_stats.tasks      = count;
+    s_enum_stats.workers    = max_workers;
+    s_enum_stats.collect_ns = collected - start;
+    s_enum_stats.track_ns   = __ec_enum_now_ns() - collected;
+    s_enum_stats.total_ns   = __ec_enum_now_ns() - start;
+
+    TRACE(DL_INIT, "%s: tracked %d tasks in %llu us (walk %llu us, track %llu us, %llu levels, %d workers)",
+          __func__, count,
+          s_enum_stats.total_ns / NSEC_PER_USEC,
+          s_enum_stats.collect_ns / NSEC_PER_USEC,
+          s_enum_stats.track_ns / NSEC_PER_USEC,
+          s_enum_stats.levels, max_workers);
+
+    if (exec_count)
+    {
+        s_cmdline_tasks = tasks;
+        s_cmdline_count = exec_count;
+        tasks           = NULL;
+        queue_work(system_unbound_wq, &s_cmdline_work);
+    }
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(tasks);
+    ec_mem_cache_free_generic(workers);
     ec_mem_cache_free_generic(stack);
 }
 
-bool __ec_add_tracking_for_child_and_update_stack(
+void ec_task_enumeration_shutdown(ProcessContext *context)
+{
+    // If the work never ran it leaves the list for us to free
+    cancel_work_sync(&s_cmdline_work);
+    ec_mem_cache_free_generic(s_cmdline_tasks);
+    s_cmdline_tasks = NULL;
+    s_cmdline_count = 0;
+}
+
+// Reads the cmdline of a process found at load.  This pages in the memory of the
+//  process, so in atomic context it is left for later.
+void ec_task_fill_pending_cmdline(ProcessHandle *process_handle, ProcessContext *context)
+{
+    ExecIdentity       *exec_identity  = NULL;
+    PosixIdentity      *posix_identity = NULL;
+    struct task_struct *task           = NULL;
+    char               *buffer         = NULL;
+
+    CANCEL_VOID(process_handle);
+    exec_identity = ec_process_exec_identity(process_handle);
+    CANCEL_VOID(exec_identity && atomic_read(&exec_identity->cmdline_pending));
+    CANCEL_VOID(IS_NON_ATOMIC(context));
+    CANCEL_VOID(atomic_xchg(&exec_identity->cmdline_pending, 0));
+
+    posix_identity = ec_process_posix_identity(process_handle);
+    rcu_read_lock();
+    task = CB_RESOLVED(find_task_by_vpid)(posix_identity->pt_key.pid);
+    if (task)
+    {
+        get_task_struct(task);
+    }
+    rcu_read_unlock();
+    TRY(task);
+
+    // The tracked process may have exited and its pid been reused
+    TRY_MSG(__ec_task_start_ns(task) == posix_identity->task_start_ns,
+            DL_INFO, "%s: pid %d was reused, not reading its cmdline", __func__, posix_identity->pt_key.pid);
+
+    buffer = ec_get_path_buffer(context);
+    if (buffer && __ec_get_cmdline_from_task(task, buffer, PATH_MAX))
+    {
+        ec_process_tracking_set_proc_cmdline(process_handle, buffer, context);
+        atomic64_inc(&s_cmdline_filled);
+    }
+
+CATCH_DEFAULT:
+    ec_put_path_buffer(buffer);
+    if (task)
+    {
+        put_task_struct(task);
+    }
+}
+
+int ec_show_task_enumeration(struct seq_file *m, void *v)
+{
+    seq_printf(m, "%22s | %8llu |\n", "Tasks",          s_enum_stats.tasks);
+    seq_printf(m, "%22s | %8llu |\n", "Tree Levels",    s_enum_stats.levels);
+    seq_printf(m, "%22s | %8llu |\n", "Workers",        s_enum_stats.workers);
+    seq_printf(m, "%22s | %8llu |\n", "Walk (us)",      s_enum_stats.collect_ns / NSEC_PER_USEC);
+    seq_printf(m, "%22s | %8llu |\n", "Track (us)",     s_enum_stats.track_ns / NSEC_PER_USEC);
+    seq_printf(m, "%22s | %8llu |\n", "Load Total (us)", s_enum_stats.total_ns / NSEC_PER_USEC);
+    seq_printf(m, "%22s | %8llu |\n", "Cmdline (us)",   s_enum_stats.cmdline_ns / NSEC_PER_USEC);
+    seq_printf(m, "%22s | %8llu |\n", "Cmdline Background", s_enum_stats.cmdline_background);
+    seq_printf(m, "%22s | %8llu |\n", "Cmdline Total",  (uint64_t)atomic64_read(&s_cmdline_filled));
+
+    return 0;
+}
+
+bool __ec_collect_child_and_update_stack(
     struct task_stack *top,
     struct task_stack *next,
-    char              *path_buffer,
+    ENUM_TASK         *entry,
     time_t             start_time,
-    ProcessContext *context)
+    int                depth)
 {
     bool found_child = false;
 
-    if (top && top->child && next && path_buffer)
+    if (top && top->child && next && entry)
     {
         if (top->child->mm != NULL &&
             top->child->state != TASK_DEAD &&
             top->child->exit_state == 0 &&
             ec_getpid(top->child) == ec_gettid(top->child))
         {
-            __ec_add_tracking_for_task(top->child, start_time, path_buffer, context);
+            // The reference keeps the task around for tracking after we leave RCU
+            get_task_struct(top->child);
+            entry->task       = top->child;
+            entry->pid        = ec_getpid(top->child);
+            entry->start_time = start_time;
+            entry->depth      = depth;
+            entry->is_exec    = !(top->child->flags & PF_FORKNOEXEC) || ec_getppid(top->child) == 1;
 
             // initialize the next stack entry so we can enumerate the children
             // of this task
@@ -433,6 +753,12 @@ void __ec_add_tracking_for_task(
     ProcessHandle *handle;
     char *path = NULL;
     bool             path_found = false;
+    struct mm_struct *mm;
+
+    // We only hold a reference on the task, so pin its mm while reading from it.  A task
+    //  that has already dropped its mm is exiting and does not need to be tracked.
+    mm = get_task_mm(task);
+    CANCEL_VOID(mm);
 
     if (path_buffer)
     {
@@ -442,7 +768,7 @@ void __ec_add_tracking_for_task(
         //
         // The `path` variable will point to the start of the string, so we will
         //  use that directly later to copy into the tracking entry and event.
-        path_found = ec_task_get_path(task, path_buffer, PATH_MAX, &path);
+        path_found = __ec_task_get_path_from_mm(task, mm, path_buffer, PATH_MAX, &path);
         path_buffer[PATH_MAX] = 0;
     }
 
@@ -463,7 +789,7 @@ void __ec_add_tracking_for_task(
         uint64_t device;
         uint64_t inode;
 
-        ec_get_devinfo_from_task(task, &device, &inode);
+        ec_get_devinfo_from_file(__ec_get_file_from_mm(mm), &device, &inode);
         handle = ec_process_tracking_update_process(
                 ec_getpid(task),
                 ec_gettid(task),
@@ -480,12 +806,10 @@ void __ec_add_tracking_for_task(
                 FAKE_START,
                 context);
 
-        if (handle && path_buffer)
+        // See ec_task_fill_pending_cmdline
+        if (handle)
         {
-            if (__ec_get_cmdline_from_task(task, path_buffer, PATH_MAX))
-            {
-                ec_process_tracking_set_proc_cmdline(handle, path_buffer, context);
-            }
+            atomic_set(&ec_process_exec_identity(handle)->cmdline_pending, 1);
         }
     } else
     {
@@ -502,5 +826,11 @@ void __ec_add_tracking_for_task(
                 context);
     }
 
+    if (handle)
+    {
+        ec_process_posix_identity(handle)->task_start_ns = __ec_task_start_ns(task);
+    }
+
     ec_process_tracking_put_handle(handle, context);
+    mmput(mm);
 }
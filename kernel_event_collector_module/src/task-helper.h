@@ -33,5 +33,9 @@ void ec_get_devinfo_from_task(struct task_struct const *task, uint64_t *device,
 struct inode const *ec_get_inode_from_task(struct task_struct const *task);
 bool ec_get_cmdline_from_binprm(struct linux_binprm const *bprm, char *cmdLine, size_t cmdLineSize);
 void ec_enumerate_and_track_all_tasks(ProcessContext *context);
+void ec_task_enumeration_shutdown(ProcessContext *context);
+
+struct process_handle;
+void ec_task_fill_pending_cmdline(struct process_handle *process_handle, ProcessContext *context);
 
 #define IS_CURRENT_TASK(a)   (strcmp(current->comm, (a)) == 0)
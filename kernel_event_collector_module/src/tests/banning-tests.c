@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "run-tests.h"
+#include "cb-banning.h"
+#include "InodeState.h"
+
+#define BANNING_TEST_COUNT   4096
+#define BANNING_TEST_DEVICE  0xfeed
+
+static PCB_PROTECTION_LIST __init __banning_test_list(uint32_t flags, uint64_t first_inode, ProcessContext *context)
+{
+    PCB_PROTECTION_LIST list = ec_mem_cache_valloc_generic(sizeof(CB_PROTECTION_LIST) + BANNING_TEST_COUNT * sizeof(protectionData), context);
+    uint32_t i;
+
+    if (list)
+    {
+        list->flags = flags;
+        list->count = BANNING_TEST_COUNT;
+        for (i = 0; i < BANNING_TEST_COUNT; ++i)
+        {
+            list->data[i].action = InodeBanned;
+            list->data[i].device = BANNING_TEST_DEVICE;
+            list->data[i].inode  = first_inode + i;
+        }
+    }
+    return list;
+}
+
+// This test verifies:
+//      - a bulk list is loaded in one call and every inode in it is banned
+//      - inodes outside the list are not banned
+//      - a replace drops every ban from the previous list
+bool __init test__banning_bulk_replace(ProcessContext *context)
+{
+    bool passed = false;
+    PCB_PROTECTION_LIST list = NULL;
+    uint64_t i;
+
+    list = __banning_test_list(CB_PROTECTION_LIST_REPLACE, 1000, context);
+    ASSERT_TRY(list);
+    ASSERT_TRY(ec_banning_SetBannedProcessInodeList(context, list) == BANNING_TEST_COUNT);
+
+    for (i = 0; i < BANNING_TEST_COUNT; ++i)
+    {
+        ASSERT_TRY(ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE, 1000 + i));
+    }
+    ASSERT_TRY(!ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE, 999));
+    ASSERT_TRY(!ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE + 1, 1000));
+
+    // Adding without replace keeps the current bans
+    ec_mem_cache_free_generic(list);
+    list = __banning_test_list(0, 1000 + BANNING_TEST_COUNT, context);
+    ASSERT_TRY(list);
+    ASSERT_TRY(ec_banning_SetBannedProcessInodeList(context, list) == BANNING_TEST_COUNT);
+    ASSERT_TRY(ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE, 1000));
+    ASSERT_TRY(ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE, 1000 + BANNING_TEST_COUNT));
+
+    // Replace with a disjoint list
+    ec_mem_cache_free_generic(list);
+    list = __banning_test_list(CB_PROTECTION_LIST_REPLACE, 100000, context);
+    ASSERT_TRY(list);
+    ASSERT_TRY(ec_banning_SetBannedProcessInodeList(context, list) == BANNING_TEST_COUNT);
+
+    for (i = 0; i < 2 * BANNING_TEST_COUNT; ++i)
+    {
+        ASSERT_TRY(!ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE, 1000 + i));
+    }
+    ASSERT_TRY(ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE, 100000));
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(list);
+    ec_banning_ClearAllBans(context);
+    if (passed)
+    {
+        passed = !ec_banning_KillBannedProcessByInode(context, BANNING_TEST_DEVICE, 100000);
+    }
+    return passed;
+}
+
+#define IGNORE_TEST_PID_BASE  0x40000000
+#define IGNORE_TEST_LOOKUPS   100000
+
+// This test verifies:
+//      - the ignored pid set holds CB_SENSOR_MAX_PIDS entries and rejects one more
+//      - removed pids are no longer ignored, including across tombstone rehashes
+// and reports the cost of a hit and a miss with the set full.
+bool __init test__banning_ignore_set(ProcessContext *context)
+{
+    bool passed = false;
+    u64 hit_ns;
+    u64 miss_ns;
+    int found = 0;
+    int i;
+    int round;
+
+    for (i = 0; i < CB_SENSOR_MAX_PIDS; ++i)
+    {
+        ec_banning_SetIgnoredProcess(context, IGNORE_TEST_PID_BASE + i);
+    }
+    for (i = 0; i < CB_SENSOR_MAX_PIDS; ++i)
+    {
+        ASSERT_TRY(ec_banning_IgnoreProcess(context, IGNORE_TEST_PID_BASE + i));
+    }
+    ec_banning_SetIgnoredProcess(context, IGNORE_TEST_PID_BASE + CB_SENSOR_MAX_PIDS);
+    ASSERT_TRY(!ec_banning_IgnoreProcess(context, IGNORE_TEST_PID_BASE + CB_SENSOR_MAX_PIDS));
+
+    hit_ns  = TEST_LOOP_NS(i, IGNORE_TEST_LOOKUPS,
+                           found += ec_banning_IgnoreProcess(context, IGNORE_TEST_PID_BASE + (i % CB_SENSOR_MAX_PIDS)));
+    miss_ns = TEST_LOOP_NS(i, IGNORE_TEST_LOOKUPS,
+                           found += ec_banning_IgnoreProcess(context, IGNORE_TEST_PID_BASE - 1 - i));
+
+    ASSERT_TRY(found == IGNORE_TEST_LOOKUPS);
+    TRACE(DL_INFO, "%s: %d pids, hit %llu ns/check, miss %llu ns/check", __func__, CB_SENSOR_MAX_PIDS,
+          hit_ns / IGNORE_TEST_LOOKUPS, miss_ns / IGNORE_TEST_LOOKUPS);
+
+    // Churn half of the set so that tombstones force a few rehashes
+    for (round = 0; round < 8; ++round)
+    {
+        for (i = 0; i < CB_SENSOR_MAX_PIDS; i += 2)
+        {
+            ASSERT_TRY(ec_banning_ClearIgnoredProcess(context, IGNORE_TEST_PID_BASE + i));
+        }
+        for (i = 0; i < CB_SENSOR_MAX_PIDS; ++i)
+        {
+            ASSERT_TRY(ec_banning_IgnoreProcess(context, IGNORE_TEST_PID_BASE + i) == (i % 2 == 1));
+        }
+        for (i = 0; i < CB_SENSOR_MAX_PIDS; i += 2)
+        {
+            ec_banning_SetIgnoredProcess(context, IGNORE_TEST_PID_BASE + i);
+        }
+    }
+
+    passed = true;
+
+CATCH_DEFAULT:
+    for (i = 0; i <= CB_SENSOR_MAX_PIDS; ++i)
+    {
+        ec_banning_ClearIgnoredProcess(context, IGNORE_TEST_PID_BASE + i);
+    }
+    if (passed)
+    {
+        passed = !ec_banning_IgnoreProcess(context, IGNORE_TEST_PID_BASE);
+    }
+    return passed;
+}
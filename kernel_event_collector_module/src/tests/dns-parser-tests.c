@@ -0,0 +1,349 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "run-tests.h"
+#include "dns-parser.h"
+#include "dns-stream.h"
+#include "dns-dedup.h"
+#include "mem-cache.h"
+
+#include <linux/delay.h>
+#include <linux/skbuff.h>
+
+// Response to "example.com IN A" captured from a resolver
+static const uint8_t s_example_response[] __initconst = {
+    0x1a, 0x2b, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x07, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x03, 0x63, 0x6f, 0x6d,
+    0x00, 0x00, 0x01, 0x00, 0x01,
+    0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x04,
+    0x5d, 0xb8, 0xd8, 0x22,
+};
+
+#define EXAMPLE_HEADER_LEN    12
+#define EXAMPLE_QUESTION_LEN  17
+#define EXAMPLE_ANSWER_LEN    16
+
+// OPT pseudo record advertising a 4096 byte UDP payload
+static const uint8_t s_edns0_opt[] __initconst = {
+    0x00, 0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+#define EDNS0_ANSWERS  40
+
+// The same name asked for AAAA, and www.example.com answered with a CNAME and an A
+static const uint8_t s_example_aaaa_response[] __initconst = {
+    0x1a, 0x2e, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x07, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x03, 0x63, 0x6f, 0x6d,
+    0x00, 0x00, 0x1c, 0x00, 0x01,
+    0xc0, 0x0c, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x10,
+    0x26, 0x06, 0x28, 0x00, 0x02, 0x20, 0x00, 0x01, 0x02, 0x48, 0x18, 0x93,
+    0x25, 0xc8, 0x19, 0x46,
+};
+
+static const uint8_t s_www_cname_response[] __initconst = {
+    0x1a, 0x2d, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+    0x03, 0x77, 0x77, 0x77, 0x07, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65,
+    0x03, 0x63, 0x6f, 0x6d, 0x00, 0x00, 0x01, 0x00, 0x01,
+    0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x02,
+    0xc0, 0x10,
+    0xc0, 0x10, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x04,
+    0x5d, 0xb8, 0xd8, 0x22,
+};
+
+#define BENCH_ITERATIONS  10000
+
+// Split puts everything past that offset in a page fragment, 0 keeps the skb linear
+static struct sk_buff * __init __test_dns_skb(const uint8_t *payload, int len, int split)
+{
+    struct sk_buff *skb  = alloc_skb(len, GFP_KERNEL);
+    struct page    *page = NULL;
+
+    if (!skb)
+    {
+        return NULL;
+    }
+
+    if (!split)
+    {
+        memcpy(skb_put(skb, len), payload, len);
+        return skb;
+    }
+
+    page = alloc_page(GFP_KERNEL);
+    if (!page)
+    {
+        kfree_skb(skb);
+        return NULL;
+    }
+
+    memcpy(skb_put(skb, split), payload, split);
+    memcpy(page_address(page), payload + split, len - split);
+    skb_fill_page_desc(skb, 0, page, 0, len - split);
+    skb->len      += len - split;
+    skb->data_len += len - split;
+    skb->truesize += PAGE_SIZE;
+
+    return skb;
+}
+
+static int __init __test_dns_parse_once(struct sk_buff *skb, int len, int expect_records, ProcessContext *context)
+{
+    CB_EVENT_DNS_RESPONSE response = { 0 };
+    int                   xcode    = ec_dns_parse_skb(skb, 0, len, &response, context);
+
+    ec_mem_cache_free_generic(response.records);
+    return xcode == 0 && response.record_count == expect_records;
+}
+
+// Average cost of ec_dns_parse_skb for one packet
+static uint64_t __init __test_dns_parse_cost(const uint8_t *payload, int len, int split, int expect_records, ProcessContext *context)
+{
+    struct sk_buff *skb     = __test_dns_skb(payload, len, split);
+    uint64_t        cost_ns = 0;
+    uint64_t        elapsed_ns;
+    int             parsed  = 0;
+    int             i;
+
+    ASSERT_TRY(skb);
+
+    elapsed_ns = TEST_LOOP_NS(i, BENCH_ITERATIONS, parsed += __test_dns_parse_once(skb, len, expect_records, context));
+    ASSERT_TRY(parsed == BENCH_ITERATIONS);
+    cost_ns = elapsed_ns / BENCH_ITERATIONS;
+
+CATCH_DEFAULT:
+    if (skb)
+    {
+        kfree_skb(skb);
+    }
+    return cost_ns;
+}
+
+static bool __init __test_check_example(char *dns_data, int len, uint32_t expect_addr, ProcessContext *context)
+{
+    bool                   passed   = false;
+    CB_EVENT_DNS_RESPONSE  response = { 0 };
+
+    ASSERT_TRY(ec_dns_parse_data(dns_data, len, &response, context) == 0);
+    ASSERT_TRY(strcmp(response.qname, "example.com") == 0);
+    ASSERT_TRY(response.record_count >= 1);
+    ASSERT_TRY(response.records[0].dnstype == QT_A);
+    ASSERT_TRY(response.records[0].A.as_in4.sin_addr.s_addr == expect_addr);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(response.records);
+    return passed;
+}
+
+bool __init test__dns_parse_udp_response(ProcessContext *context)
+{
+    bool                   passed    = false;
+    CB_EVENT_DNS_RESPONSE  truncated = { 0 };
+    char                   dns_data[sizeof(s_example_response)];
+
+    memcpy(dns_data, s_example_response, sizeof(dns_data));
+    ASSERT_TRY(__test_check_example(dns_data, sizeof(dns_data), htonl(0x5db8d822), context));
+
+    // A response cut short inside the answer must not parse
+    ASSERT_TRY(ec_dns_parse_data(dns_data, sizeof(dns_data) - 2, &truncated, context) != 0);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(truncated.records);
+    return passed;
+}
+
+// The captured answer repeated with a different address each time, well past the
+//  512 bytes of a classic UDP response
+bool __init test__dns_parse_edns0_response(ProcessContext *context)
+{
+    bool                   passed   = false;
+    CB_EVENT_DNS_RESPONSE  response = { 0 };
+    int                    len      = EXAMPLE_HEADER_LEN + EXAMPLE_QUESTION_LEN + EDNS0_ANSWERS * EXAMPLE_ANSWER_LEN + sizeof(s_edns0_opt);
+    char                  *dns_data = NULL;
+    char                  *pos;
+    int                    i;
+
+    dns_data = ec_mem_cache_alloc_generic(len, context);
+    ASSERT_TRY(dns_data);
+
+    pos = dns_data;
+    memcpy(pos, s_example_response, EXAMPLE_HEADER_LEN + EXAMPLE_QUESTION_LEN);
+    pos[7]  = EDNS0_ANSWERS;
+    pos[11] = 1;
+    pos += EXAMPLE_HEADER_LEN + EXAMPLE_QUESTION_LEN;
+
+    for (i = 0; i < EDNS0_ANSWERS; ++i)
+    {
+        memcpy(pos, &s_example_response[EXAMPLE_HEADER_LEN + EXAMPLE_QUESTION_LEN], EXAMPLE_ANSWER_LEN);
+        pos[EXAMPLE_ANSWER_LEN - 1] = i;
+        pos += EXAMPLE_ANSWER_LEN;
+    }
+    memcpy(pos, s_edns0_opt, sizeof(s_edns0_opt));
+    ASSERT_TRY(len > 512);
+
+    ASSERT_TRY(ec_dns_parse_data(dns_data, len, &response, context) == 0);
+    ASSERT_TRY(response.record_count == EDNS0_ANSWERS);
+    ASSERT_TRY(response.records[EDNS0_ANSWERS - 1].A.as_in4.sin_addr.s_addr == htonl(0x5db8d800 | (EDNS0_ANSWERS - 1)));
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_mem_cache_free_generic(response.records);
+    ec_mem_cache_free_generic(dns_data);
+    return passed;
+}
+
+static void __init __test_count_message(char *dns_data, int dns_data_len, void *priv, ProcessContext *context)
+{
+    if (__test_check_example(dns_data, dns_data_len, htonl(0x5db8d822), context))
+    {
+        *(int *)priv += 1;
+    }
+}
+
+// The captured response framed for TCP and fed in the segments a server might send
+bool __init test__dns_tcp_reassembly(ProcessContext *context)
+{
+    bool          passed   = false;
+    int           messages = 0;
+    int           flows    = ec_dns_stream_flow_count();
+    int           framed   = sizeof(s_example_response) + 2;
+    uint32_t      seq      = 1000;
+    DNS_FLOW_KEY  key      = { .family = AF_INET, .sport = htons(53), .dport = htons(40000) };
+    DNS_FLOW_KEY  other    = { .family = AF_INET, .sport = htons(53), .dport = htons(40001) };
+    char          stream[2 * (sizeof(s_example_response) + 2)];
+
+    stream[0] = 0;
+    stream[1] = sizeof(s_example_response);
+    memcpy(&stream[2], s_example_response, sizeof(s_example_response));
+    memcpy(&stream[framed], stream, framed);
+
+    // The length prefix itself is split
+    ec_dns_stream_input(&key, seq, false, stream, 1, __test_count_message, &messages, context);
+    ASSERT_TRY(ec_dns_stream_flow_count() == flows + 1);
+    ec_dns_stream_input(&key, seq + 1, false, &stream[1], 19, __test_count_message, &messages, context);
+    ASSERT_TRY(messages == 0);
+
+    // A retransmit adds nothing
+    ec_dns_stream_input(&key, seq + 1, false, &stream[1], 19, __test_count_message, &messages, context);
+    ASSERT_TRY(messages == 0);
+
+    ec_dns_stream_input(&key, seq + 20, false, &stream[20], framed - 20, __test_count_message, &messages, context);
+    ASSERT_TRY(messages == 1);
+
+    // Two whole messages in one segment are passed straight through
+    seq += framed;
+    ec_dns_stream_input(&key, seq, false, stream, 2 * framed, __test_count_message, &messages, context);
+    ASSERT_TRY(messages == 3);
+
+    // FIN drops the flow
+    seq += 2 * framed;
+    ec_dns_stream_input(&key, seq, true, NULL, 0, __test_count_message, &messages, context);
+    ASSERT_TRY(ec_dns_stream_flow_count() == flows);
+
+    // A missing segment loses the message boundaries, so the flow is dropped
+    ec_dns_stream_input(&other, seq, false, stream, 10, __test_count_message, &messages, context);
+    ASSERT_TRY(ec_dns_stream_flow_count() == flows + 1);
+    ec_dns_stream_input(&other, seq + 20, false, &stream[20], framed - 20, __test_count_message, &messages, context);
+    ASSERT_TRY(ec_dns_stream_flow_count() == flows);
+    ASSERT_TRY(messages == 3);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_dns_stream_shutdown(context);
+    return passed;
+}
+
+// Repeats of the captured response inside the window are dropped and counted on the
+//  next event for the name
+bool __init test__dns_dedup(ProcessContext *context)
+{
+    bool                   passed    = false;
+    uint32_t               orig_ms   = g_dns_dedup_ms;
+    CB_EVENT_DNS_RESPONSE  response  = { 0 };
+    char                   dns_data[sizeof(s_example_response)];
+    int                    i;
+
+    memcpy(dns_data, s_example_response, sizeof(dns_data));
+    ASSERT_TRY(ec_dns_parse_data(dns_data, sizeof(dns_data), &response, context) == 0);
+
+    ec_dns_dedup_clear();
+
+    // Off by default
+    g_dns_dedup_ms = 0;
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+
+    g_dns_dedup_ms = 200;
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+    ASSERT_TRY(response.suppressed_count == 0);
+    for (i = 0; i < 3; ++i)
+    {
+        ASSERT_TRY(!ec_dns_dedup_check(&response));
+    }
+
+    // A different answer for the same name is always reported and carries the repeats
+    //  of the previous one
+    response.records[0].A.as_in4.sin_addr.s_addr ^= htonl(1);
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+    ASSERT_TRY(response.suppressed_count == 3);
+    response.records[0].A.as_in4.sin_addr.s_addr ^= htonl(1);
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+    ASSERT_TRY(response.suppressed_count == 0);
+    ASSERT_TRY(!ec_dns_dedup_check(&response));
+
+    msleep(400);
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+    ASSERT_TRY(response.suppressed_count == 1);
+
+    // An answer that has expired at the resolver is never held back
+    response.records[0].ttl = 0;
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+    ASSERT_TRY(ec_dns_dedup_check(&response));
+
+    passed = true;
+
+CATCH_DEFAULT:
+    g_dns_dedup_ms = orig_ms;
+    ec_dns_dedup_clear();
+    ec_mem_cache_free_generic(response.records);
+    return passed;
+}
+
+// Per packet parse cost for typical responses read in place and through the copy that
+//  paged data needs
+bool __init test__dns_parse_skb_benchmark(ProcessContext *context)
+{
+    static const struct {
+        const char    *name;
+        const uint8_t *payload;
+        int            len;
+        int            records;
+    } responses[] __initconst = {
+        { "A",     s_example_response,      sizeof(s_example_response),      1 },
+        { "AAAA",  s_example_aaaa_response, sizeof(s_example_aaaa_response), 1 },
+        { "CNAME", s_www_cname_response,    sizeof(s_www_cname_response),    2 },
+    };
+    bool passed = false;
+    int  i;
+
+    for (i = 0; i < ARRAY_SIZE(responses); ++i)
+    {
+        uint64_t linear_ns = __test_dns_parse_cost(responses[i].payload, responses[i].len, 0, responses[i].records, context);
+        uint64_t paged_ns  = __test_dns_parse_cost(responses[i].payload, responses[i].len, 20, responses[i].records, context);
+
+        ASSERT_TRY(linear_ns && paged_ns);
+        TRACE(DL_INFO, "%s: %-5s %llu ns/packet in place, %llu ns/packet copied",
+              __func__, responses[i].name, linear_ns, paged_ns);
+    }
+
+    passed = true;
+
+CATCH_DEFAULT:
+    return passed;
+}
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "file-process-tracking.h"
+#include "process-tracking.h"
+#include "run-tests.h"
+
+#include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/namei.h>
+#include <linux/version.h>
+
+extern void __ec_do_file_event(ProcessContext *context, struct file *file, CB_EVENT_TYPE eventType);
+
+#define COALESCE_TEST_WINDOW_MS  (60 * 1000)
+#define COALESCE_TEST_CYCLES     5
+#define COALESCE_TEST_PATH       "/tmp/.ec_file_coalesce_self_test"
+
+// Remove the test file while it is still open so no lookup by name is needed
+static void __init __unlink_test_file(struct file *file)
+{
+    struct dentry *dentry = dget(file->f_path.dentry);
+    struct dentry *parent = dget_parent(dentry);
+    struct inode  *dir    = parent->d_inode;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0)  //{
+    inode_lock_nested(dir, I_MUTEX_PARENT);
+#else  //}{
+    mutex_lock_nested(&dir->i_mutex, I_MUTEX_PARENT);
+#endif  //}
+
+    if (dentry->d_parent == parent && !d_unlinked(dentry))
+    {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)  //{
+        vfs_unlink(&init_user_ns, dir, dentry, NULL);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3, 13, 0)  //}{
+        vfs_unlink(dir, dentry, NULL);
+#else  //}{
+        vfs_unlink(dir, dentry);
+#endif  //}
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0)  //{
+    inode_unlock(dir);
+#else  //}{
+    mutex_unlock(&dir->i_mutex);
+#endif  //}
+
+    dput(parent);
+    dput(dentry);
+}
+
+// Shrink the window so that any open window is expired
+static void __init __expire_window(void)
+{
+    g_file_write_coalesce_ms = 1;
+    msleep(20);
+}
+
+static ProcessHandle * __init __create_test_process(ProcessContext *context)
+{
+    return ec_process_tracking_create_process(
+        ec_getpid(current),
+        ec_getppid(current),
+        ec_gettid(current),
+        0,
+        0,
+        0,
+        CB_PROCESS_START_BY_FORK,
+        current,
+        REAL_START,
+        context);
+}
+
+static void __init __remove_test_process(ProcessHandle *handle, ProcessContext *context)
+{
+    if (handle)
+    {
+        ec_process_tracking_remove_process(handle, context);
+        ec_process_tracking_put_handle(handle, context);
+    }
+}
+
+bool __init test__file_write_coalesce(ProcessContext *context)
+{
+    bool passed = false;
+    uint32_t orig_window = g_file_write_coalesce_ms;
+    ProcessHandle *handle = NULL;
+    FILE_PROCESS_VALUE value = {};
+    bool send_close = false;
+    uint64_t reported_before, reported;
+    int i;
+
+    handle = __create_test_process(context);
+    ASSERT_TRY(handle);
+
+    value.device = 1;
+    value.inode  = 0xC0A1E5CE;
+    value.path   = ec_mem_cache_strdup(COALESCE_TEST_PATH, context);
+    ASSERT_TRY(value.path);
+
+    g_file_write_coalesce_ms = COALESCE_TEST_WINDOW_MS;
+
+    // The first cycle opens the window and is reported as usual
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == 1);
+    ASSERT_TRY(ec_file_coalesce_close(&value, handle, &send_close, context) == 0);
+    ASSERT_TRY(send_close);
+
+    // Every following cycle inside the window is folded, close included
+    for (i = 1; i < COALESCE_TEST_CYCLES; i++)
+    {
+        ec_file_coalesce_write(&value, handle, context);
+        ASSERT_TRY(value.writeOpCount == 0);
+        ASSERT_TRY(ec_file_coalesce_close(&value, handle, &send_close, context) == 0);
+        ASSERT_TRY(!send_close);
+    }
+
+    // The first write after the window reports the folded cycles plus itself
+    __expire_window();
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == COALESCE_TEST_CYCLES);
+
+    // A close after the window drains the folded cycles without another write
+    g_file_write_coalesce_ms = COALESCE_TEST_WINDOW_MS;
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == 0);
+    __expire_window();
+    ASSERT_TRY(ec_file_coalesce_close(&value, handle, &send_close, context) == 1);
+    ASSERT_TRY(send_close);
+
+    // With the window drained the next write starts from scratch
+    g_file_write_coalesce_ms = 0;
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == 1);
+
+    // An expired window nobody writes to again is reported by the flush
+    g_file_write_coalesce_ms = COALESCE_TEST_WINDOW_MS;
+    ec_file_coalesce_write(&value, handle, context);
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == 0);
+    __expire_window();
+    ec_file_coalesce_get_stats(&reported_before, NULL, NULL, NULL);
+    ec_file_coalesce_flush_expired(context);
+    ec_file_coalesce_get_stats(&reported, NULL, NULL, NULL);
+    ASSERT_TRY(reported - reported_before == 1);
+
+    // An exiting process reports its folded cycles even though the window is still open
+    g_file_write_coalesce_ms = COALESCE_TEST_WINDOW_MS;
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == 1);
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == 0);
+    ec_file_coalesce_flush_process(handle, context);
+    ec_file_coalesce_get_stats(&reported, NULL, NULL, NULL);
+    ASSERT_TRY(reported - reported_before == 3);
+    ec_file_coalesce_write(&value, handle, context);
+    ASSERT_TRY(value.writeOpCount == 1);
+    ec_file_coalesce_flush_process(handle, context);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    g_file_write_coalesce_ms = orig_window;
+    ec_mem_cache_put_generic(value.path);
+    __remove_test_process(handle, context);
+    return passed;
+}
+
+// Drives the file hook internals through repeated open/write/close cycles of the
+// same file and checks how many write and close events were reported.
+bool __init test__file_hooks_coalesce(ProcessContext *context)
+{
+    bool passed = false;
+    uint32_t orig_window = g_file_write_coalesce_ms;
+    ProcessHandle *handle = NULL;
+    struct file *file = NULL;
+    uint64_t reported_before, folded_writes_before, folded_closes_before;
+    uint64_t reported, folded_writes, folded_closes;
+    int i;
+
+    handle = __create_test_process(context);
+    ASSERT_TRY(handle);
+
+    file = filp_open(COALESCE_TEST_PATH, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    ASSERT_TRY(!IS_ERR_OR_NULL(file));
+
+    g_file_write_coalesce_ms = COALESCE_TEST_WINDOW_MS;
+    ec_file_coalesce_get_stats(&reported_before, &folded_writes_before, &folded_closes_before, NULL);
+
+    for (i = 0; i < COALESCE_TEST_CYCLES; i++)
+    {
+        __ec_do_file_event(context, file, CB_EVENT_TYPE_FILE_WRITE);
+        __ec_do_file_event(context, file, CB_EVENT_TYPE_FILE_CLOSE);
+    }
+
+    // One write reported and the rest folded
+    ec_file_coalesce_get_stats(&reported, &folded_writes, &folded_closes, NULL);
+    ASSERT_TRY(reported - reported_before == 1);
+    ASSERT_TRY(folded_writes - folded_writes_before == COALESCE_TEST_CYCLES - 1);
+    ASSERT_TRY(folded_closes - folded_closes_before == COALESCE_TEST_CYCLES - 1);
+
+    // One more cycle after the window emits the summary and clears the window
+    __expire_window();
+    __ec_do_file_event(context, file, CB_EVENT_TYPE_FILE_WRITE);
+    __ec_do_file_event(context, file, CB_EVENT_TYPE_FILE_CLOSE);
+
+    ec_file_coalesce_get_stats(&reported, &folded_writes, &folded_closes, NULL);
+    ASSERT_TRY(reported - reported_before == 2);
+    ASSERT_TRY(folded_writes - folded_writes_before == COALESCE_TEST_CYCLES - 1);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    g_file_write_coalesce_ms = orig_window;
+    if (!IS_ERR_OR_NULL(file))
+    {
+        ec_file_process_status_close(file, context);
+        __unlink_test_file(file);
+        filp_close(file, NULL);
+    }
+    ec_file_coalesce_flush_process(handle, context);
+    __remove_test_process(handle, context);
+
+    return passed;
+}
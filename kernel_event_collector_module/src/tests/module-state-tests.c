@@ -1,5 +1,7 @@
 /* Copyright 2020 VMWare, Inc.  All rights reserved. */
 
+#include <linux/delay.h>
+
 #include "cb-spinlock.h"
 #include "run-tests.h"
 
@@ -74,3 +76,39 @@ bool __init test__hook_tracking_add_del(ProcessContext *context)
 CATCH_DEFAULT:
     return passed;
 }
+
+bool __init test__hook_latency_histogram(ProcessContext *context)
+{
+    bool passed = false;
+    uint64_t recorded = 0;
+    uint64_t latency[HOOK_LATENCY_BUCKETS];
+    uint64_t total_ns;
+    int i;
+    // ignore the passed in context for this test
+    DECLARE_NON_ATOMIC_CONTEXT(test_context, ec_getpid(current));
+
+    ec_hook_tracking_add_entry(&test_context, __func__);
+    ASSERT_TRY(test_context.hook_enter_ns != 0);
+    udelay(10);
+    ec_hook_tracking_del_entry(&test_context);
+    ASSERT_TRY(test_context.hook_enter_ns == 0);
+    ASSERT_TRY(*test_context.hook_latency_id != 0);
+
+    // 10us lands in the 8us (2^13 ns) bucket or above
+    ec_hook_latency_get(&test_context, latency, &total_ns);
+    for (i = 13; i < HOOK_LATENCY_BUCKETS; ++i)
+    {
+        recorded += latency[i];
+    }
+    ASSERT_TRY(recorded == 1);
+    ASSERT_TRY(total_ns >= 10 * NSEC_PER_USEC);
+
+    ec_reset_hook_latency(NULL, NULL, 0, NULL);
+    ec_hook_latency_get(&test_context, latency, &total_ns);
+    ASSERT_TRY(total_ns == 0);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    return passed;
+}
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "run-tests.h"
+#include "net-hooks.h"
+
+// Runs the recvmmsg batch check that is also available from the net-recvmmsg-check
+//  proc entry.  It checks the reports, the sources and the per-datagram cost.
+bool __init test__net_recvmmsg_batch(ProcessContext *context)
+{
+    bool        passed;
+    ModuleState module_state = g_module_state_info.module_state;
+
+    // The report path is skipped entirely while the module is disabled
+    g_module_state_info.module_state = ModuleStateEnabled;
+    passed = ec_net_recvmmsg_batch_check(context);
+    g_module_state_info.module_state = module_state;
+
+    return passed;
+}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "run-tests.h"
+#include "prefix-trie.h"
+#include "process-tracking.h"
+
+#define PREFIX_TRIE_TEST_LOOPS  10000
+
+static const char *s_sample_paths[] __initdata = {
+    "/var/log/messages",
+    "/var/log/messages.1",
+    "/var/logs/app.txt",
+    "/var/lib/cb/store.db",
+    "/var/lib/cbx",
+    "/var/lib/c",
+    "/var/li",
+    "/srv/bit9/data/file",
+    "/srv/bit9/dat",
+    "/sys/kernel/debug",
+    "/system.img",
+    "/proc/1/status",
+    "/pro",
+    "/var/opt/carbonblack/sensor.log",
+    "/home/user/.bashrc",
+    "/usr/bin/python3",
+    "/",
+    "",
+};
+
+static const char *s_sample_names[] __initdata = {
+    "bash", "bas", "sh", "ssh", "shasum", "python3", "pythonw", "pytho",
+    "perl5.30", "java", "javac", "nodejs", "no", "env", "envsubst", "vim",
+    "firefox-bin", "chromium", "lua5.3", "zsh", "dash", "pwsh-preview", "",
+};
+
+// The matching loops that the trie replaced, kept here as the reference result
+static bool __init __special_file_linear(const char *path, int len)
+{
+    int i;
+
+    for (i = 0; i < g_special_file_names_count; i++)
+    {
+        int name_len = strlen(g_special_file_names[i]);
+
+        if (name_len <= len && strncmp(path, g_special_file_names[i], name_len) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool __init __interpreter_linear(const char *proc_name)
+{
+    int i;
+
+    for (i = 0; i < g_interpreter_names_count; i++)
+    {
+        char *found = strstr(proc_name, g_interpreter_names[i]);
+
+        if (found && found == proc_name)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Matches every sample with the trie, or with the reference loop when trie is NULL
+static int __init __match_sample_paths(PrefixTrie *trie)
+{
+    int matches = 0;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(s_sample_paths); i++)
+    {
+        int len = strlen(s_sample_paths[i]);
+
+        matches += trie ? ec_prefix_trie_match(trie, s_sample_paths[i], len) : __special_file_linear(s_sample_paths[i], len);
+    }
+    return matches;
+}
+
+static int __init __match_sample_names(PrefixTrie *trie)
+{
+    int matches = 0;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(s_sample_names); i++)
+    {
+        int len = strlen(s_sample_names[i]);
+
+        matches += trie ? ec_prefix_trie_match(trie, s_sample_names[i], len) : __interpreter_linear(s_sample_names[i]);
+    }
+    return matches;
+}
+
+bool __init test__prefix_trie_special_files(ProcessContext *context)
+{
+    bool passed = false;
+    PrefixTrie *trie = NULL;
+    u64 linear_ns;
+    u64 trie_ns;
+    int matches = 0;
+    int i;
+    int loop;
+
+    trie = ec_prefix_trie_build(g_special_file_names, g_special_file_names_count, context);
+    ASSERT_TRY(trie);
+
+    for (i = 0; i < ARRAY_SIZE(s_sample_paths); i++)
+    {
+        int len = strlen(s_sample_paths[i]);
+        bool expected = __special_file_linear(s_sample_paths[i], len);
+
+        TRY_MSG(ec_prefix_trie_match(trie, s_sample_paths[i], len) == expected,
+                DL_ERROR, "%s: mismatch for '%s' expected %d", __func__, s_sample_paths[i], expected);
+        ASSERT_TRY((ec_is_special_file((char *)s_sample_paths[i], len) != 0) == expected);
+        matches += expected;
+    }
+    ASSERT_TRY(matches > 0 && matches < ARRAY_SIZE(s_sample_paths));
+
+    linear_ns = TEST_LOOP_NS(loop, PREFIX_TRIE_TEST_LOOPS, matches += __match_sample_paths(NULL));
+    trie_ns   = TEST_LOOP_NS(loop, PREFIX_TRIE_TEST_LOOPS, matches += __match_sample_paths(trie));
+
+    TRACE(DL_INFO, "%s: %d lookups linear %llu ns trie %llu ns (%d)", __func__,
+          PREFIX_TRIE_TEST_LOOPS * (int)ARRAY_SIZE(s_sample_paths), linear_ns, trie_ns, matches);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_prefix_trie_free(trie);
+    return passed;
+}
+
+bool __init test__prefix_trie_interpreters(ProcessContext *context)
+{
+    bool passed = false;
+    PrefixTrie *trie = NULL;
+    u64 linear_ns;
+    u64 trie_ns;
+    int matches = 0;
+    int i;
+    int loop;
+
+    trie = ec_prefix_trie_build((const char * const *)g_interpreter_names, g_interpreter_names_count, context);
+    ASSERT_TRY(trie);
+
+    for (i = 0; i < ARRAY_SIZE(s_sample_names); i++)
+    {
+        bool expected = __interpreter_linear(s_sample_names[i]);
+
+        TRY_MSG(ec_prefix_trie_match(trie, s_sample_names[i], strlen(s_sample_names[i])) == expected,
+                DL_ERROR, "%s: mismatch for '%s' expected %d", __func__, s_sample_names[i], expected);
+        matches += expected;
+    }
+    ASSERT_TRY(matches > 0 && matches < ARRAY_SIZE(s_sample_names));
+
+    linear_ns = TEST_LOOP_NS(loop, PREFIX_TRIE_TEST_LOOPS, matches += __match_sample_names(NULL));
+    trie_ns   = TEST_LOOP_NS(loop, PREFIX_TRIE_TEST_LOOPS, matches += __match_sample_names(trie));
+
+    TRACE(DL_INFO, "%s: %d lookups linear %llu ns trie %llu ns (%d)", __func__,
+          PREFIX_TRIE_TEST_LOOPS * (int)ARRAY_SIZE(s_sample_names), linear_ns, trie_ns, matches);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_prefix_trie_free(trie);
+    return passed;
+}
+
+// Replace the special file list the way the ioctl does and then restore the defaults
+bool __init test__prefix_trie_reload(ProcessContext *context)
+{
+    bool passed = false;
+    static const char list[] __initconst = "/tmp/a\0/opt/b";
+    static const char bad_list[] __initconst = { '/', 't', 'm', 'p' };
+
+    ASSERT_TRY(ec_special_files_set(list, sizeof(list), context));
+    ASSERT_TRY(ec_is_special_file("/tmp/a/file", 11));
+    ASSERT_TRY(ec_is_special_file("/opt/b", 6));
+    ASSERT_TRY(!ec_is_special_file("/proc/1/status", 14));
+
+    // A list that is not NUL terminated is rejected and the current list is kept
+    ASSERT_TRY(!ec_special_files_set(bad_list, sizeof(bad_list), context));
+    ASSERT_TRY(ec_is_special_file("/tmp/a/file", 11));
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_special_files_set(NULL, 0, context);
+    if (passed)
+    {
+        passed = ec_is_special_file("/proc/1/status", 14) && !ec_is_special_file("/tmp/a/file", 11);
+    }
+    return passed;
+}
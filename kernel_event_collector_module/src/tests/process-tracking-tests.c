@@ -1,6 +1,7 @@
 /* Copyright 2020 VMWare, Inc.  All rights reserved. */
 
 #include "process-tracking.h"
+#include "process-tracking-private.h"
 #include "run-tests.h"
 
 // NOTE: On kernel 3.10 and up this test produces a WARN because we don't
@@ -46,3 +47,195 @@ CATCH_DEFAULT:
 
     return passed;
 }
+
+#define INODE_INDEX_TEST_PROCS  64
+#define INODE_INDEX_TEST_PID    4190000
+#define INODE_INDEX_TEST_DEVICE 0xfeed
+#define INODE_INDEX_TEST_INODE  0xbeef
+
+typedef struct inode_walk_data {
+    uint64_t device;
+    uint64_t inode;
+    int      count;
+} INODE_WALK_DATA;
+
+// The full table walk that the inode index replaced, used as the reference result
+static int __init __inode_walk_callback(HashTbl *hashTblp, HashTableNode *nodep, void *priv, ProcessContext *context)
+{
+    INODE_WALK_DATA *data = (INODE_WALK_DATA *)priv;
+
+    if (nodep &&
+        ((PosixIdentity *)nodep)->posix_details.device == data->device &&
+        ((PosixIdentity *)nodep)->posix_details.inode == data->inode)
+    {
+        data->count += 1;
+    }
+    return ACTION_CONTINUE;
+}
+
+static int __init __inode_walk_count(uint64_t device, uint64_t inode, ProcessContext *context)
+{
+    INODE_WALK_DATA data = { device, inode, 0 };
+
+    ec_hashtbl_read_for_each_generic(g_process_tracking_data.table, __inode_walk_callback, &data, context);
+    return data.count;
+}
+
+static int __init __inode_ban_list_count(uint64_t device, uint64_t inode, ProcessContext *context)
+{
+    RUNNING_BANNED_INODE_S ban = { 0 };
+    RUNNING_PROCESSES_TO_BAN *temp = NULL;
+    RUNNING_PROCESSES_TO_BAN *next = NULL;
+    int count = 0;
+
+    ban.device = device;
+    ban.inode  = inode;
+    INIT_LIST_HEAD(&ban.BanList.list);
+
+    ec_is_process_tracked_get_state_by_inode(&ban, context);
+
+    list_for_each_entry_safe(temp, next, &ban.BanList.list, list)
+    {
+        ProcessHandle *process_handle = (ProcessHandle *)temp->process_handle;
+
+        if (ec_process_posix_identity(process_handle)->posix_details.device == device &&
+            ec_process_posix_identity(process_handle)->posix_details.inode == inode)
+        {
+            count += 1;
+        }
+        ec_process_tracking_put_handle(process_handle, context);
+        list_del(&temp->list);
+        ec_mem_cache_free_generic(temp);
+    }
+
+    return (count == ban.count ? count : -1);
+}
+
+// This test verifies:
+//      - processes are added to the inode index when tracked and moved when their binary changes
+//      - the index agrees with a walk of the tracking table
+//      - processes leave the index when they are removed from tracking
+bool __init test__proc_track_inode_index(ProcessContext *context)
+{
+    bool passed = false;
+    ProcessHandle *handles[INODE_INDEX_TEST_PROCS] = { 0 };
+    uint64_t inode_a = INODE_INDEX_TEST_INODE;
+    uint64_t inode_b = INODE_INDEX_TEST_INODE + 1;
+    uint64_t start_size = ec_process_inode_index_size();
+    u64 index_ns;
+    u64 walk_ns;
+    int i;
+
+    for (i = 0; i < INODE_INDEX_TEST_PROCS; ++i)
+    {
+        handles[i] = ec_process_tracking_create_process(
+            INODE_INDEX_TEST_PID + i,
+            1,
+            INODE_INDEX_TEST_PID + i,
+            0,
+            0,
+            0,
+            CB_PROCESS_START_BY_FORK,
+            NULL,
+            REAL_START,
+            context);
+        ASSERT_TRY(handles[i]);
+
+        ec_process_tracking_set_posix_inode(handles[i], INODE_INDEX_TEST_DEVICE, (i % 2 ? inode_b : inode_a), context);
+    }
+
+    ASSERT_TRY(ec_process_inode_index_get_pids(INODE_INDEX_TEST_DEVICE, inode_a, NULL, 0, context) == INODE_INDEX_TEST_PROCS / 2);
+    ASSERT_TRY(ec_process_inode_index_get_pids(INODE_INDEX_TEST_DEVICE, inode_b, NULL, 0, context) == INODE_INDEX_TEST_PROCS / 2);
+    ASSERT_TRY(__inode_walk_count(INODE_INDEX_TEST_DEVICE, inode_a, context) == INODE_INDEX_TEST_PROCS / 2);
+    ASSERT_TRY(__inode_ban_list_count(INODE_INDEX_TEST_DEVICE, inode_a, context) == INODE_INDEX_TEST_PROCS / 2);
+
+    // Move one process over as an exec would
+    ec_process_tracking_set_posix_inode(handles[0], INODE_INDEX_TEST_DEVICE, inode_b, context);
+    ASSERT_TRY(__inode_ban_list_count(INODE_INDEX_TEST_DEVICE, inode_a, context) == INODE_INDEX_TEST_PROCS / 2 - 1);
+    ASSERT_TRY(__inode_ban_list_count(INODE_INDEX_TEST_DEVICE, inode_b, context) == INODE_INDEX_TEST_PROCS / 2 + 1);
+    ASSERT_TRY(__inode_walk_count(INODE_INDEX_TEST_DEVICE, inode_b, context) == INODE_INDEX_TEST_PROCS / 2 + 1);
+
+    index_ns = TEST_LOOP_NS(i, 100, __inode_ban_list_count(INODE_INDEX_TEST_DEVICE, inode_b, context));
+    walk_ns  = TEST_LOOP_NS(i, 100, __inode_walk_count(INODE_INDEX_TEST_DEVICE, inode_b, context));
+
+    TRACE(DL_INFO, "%s: 100 lookups with %lld tracked processes: index %llu ns, table walk %llu ns",
+          __func__, (long long)atomic64_read(&g_process_tracking_data.table->tableInstance), index_ns, walk_ns);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    for (i = 0; i < INODE_INDEX_TEST_PROCS; ++i)
+    {
+        if (handles[i])
+        {
+            ec_process_tracking_remove_process(handles[i], context);
+            ec_process_tracking_put_handle(handles[i], context);
+        }
+    }
+
+    if (passed)
+    {
+        passed = ec_process_inode_index_get_pids(INODE_INDEX_TEST_DEVICE, inode_a, NULL, 0, context) == 0 &&
+                 ec_process_inode_index_get_pids(INODE_INDEX_TEST_DEVICE, inode_b, NULL, 0, context) == 0 &&
+                 ec_process_inode_index_size() == start_size;
+    }
+
+    return passed;
+}
+
+#define HANDLE_CACHE_TEST_PID      4191000
+#define HANDLE_CACHE_TEST_LOOKUPS  1000
+
+// This test verifies:
+//      - released handles are reused by later lookups instead of being allocated again
+//      - a reused handle still points at the right process
+bool __init test__proc_track_handle_cache(ProcessContext *context)
+{
+    bool passed = false;
+    PtOpCounters before;
+    PtOpCounters after;
+    int i;
+
+    ProcessHandle *handle = ec_process_tracking_create_process(
+        HANDLE_CACHE_TEST_PID,
+        1,
+        HANDLE_CACHE_TEST_PID,
+        0,
+        0,
+        0,
+        CB_PROCESS_START_BY_FORK,
+        NULL,
+        REAL_START,
+        context);
+
+    ASSERT_TRY(handle);
+
+    ec_process_tracking_op_counters(&before);
+    for (i = 0; i < HANDLE_CACHE_TEST_LOOKUPS; ++i)
+    {
+        ProcessHandle *lookup = ec_process_tracking_get_handle(HANDLE_CACHE_TEST_PID, context);
+
+        ASSERT_TRY(lookup);
+        ASSERT_TRY(ec_process_posix_identity(lookup) == ec_process_posix_identity(handle));
+        ec_process_tracking_put_handle(lookup, context);
+    }
+    ec_process_tracking_op_counters(&after);
+
+    TRACE(DL_INFO, "%s: %d lookups, %llu allocated, %llu reused",
+          __func__, HANDLE_CACHE_TEST_LOOKUPS,
+          after.handle_alloc - before.handle_alloc,
+          after.handle_cached - before.handle_cached);
+
+    // Other cpus may be allocating at the same time, so only check that most were reused
+    ASSERT_TRY(after.handle_cached - before.handle_cached >= HANDLE_CACHE_TEST_LOOKUPS / 2);
+
+    passed = true;
+CATCH_DEFAULT:
+    if (handle)
+    {
+        ec_process_tracking_remove_process(handle, context);
+        ec_process_tracking_put_handle(handle, context);
+    }
+
+    return passed;
+}
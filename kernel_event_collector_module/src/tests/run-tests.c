@@ -32,9 +32,12 @@ bool __init run_tests(ProcessContext *context)
     RUN_TEST(test__hashtbl_add_duplicate(context));
 
     RUN_TEST(test__proc_track_report_double_exit(context));
+    RUN_TEST(test__proc_track_inode_index(context));
+    RUN_TEST(test__proc_track_handle_cache(context));
 
     RUN_TEST(test__begin_finish_macros(context));
     RUN_TEST(test__hook_tracking_add_del(context));
+    RUN_TEST(test__hook_latency_histogram(context));
 
     RUN_TEST(test__stall_enable(context));
     RUN_TEST(test__perm_id(context));
@@ -45,6 +48,29 @@ bool __init run_tests(ProcessContext *context)
     RUN_TEST(test__kthread_may_stall());
     RUN_TEST(test__insmod_may_stall());
     RUN_TEST(test__stall_event_abort(context));
+    RUN_TEST(test__stall_event_resume_batch(context));
+    RUN_TEST(test__stall_outcome_stats(context));
+    RUN_TEST(test__stall_verdict_cache(context));
+
+    RUN_TEST(test__file_write_coalesce(context));
+    RUN_TEST(test__file_hooks_coalesce(context));
+
+    RUN_TEST(test__prefix_trie_special_files(context));
+    RUN_TEST(test__prefix_trie_interpreters(context));
+    RUN_TEST(test__prefix_trie_reload(context));
+
+    RUN_TEST(test__banning_bulk_replace(context));
+    RUN_TEST(test__banning_ignore_set(context));
+
+    RUN_TEST(test__trusted_path_match(context));
+
+    RUN_TEST(test__net_recvmmsg_batch(context));
+
+    RUN_TEST(test__dns_parse_udp_response(context));
+    RUN_TEST(test__dns_parse_edns0_response(context));
+    RUN_TEST(test__dns_tcp_reassembly(context));
+    RUN_TEST(test__dns_dedup(context));
+    RUN_TEST(test__dns_parse_skb_benchmark(context));
 
     g_traceLevel = origTraceLevel;
     return all_passed;
@@ -7,6 +7,10 @@
 #include "process-context.h"
 #include "priv.h"
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)  //{
+#include <linux/sched/clock.h>
+#endif  //}
+
 //
 // run_tests provides a way to write consumption tests that exercise and verify
 // components of the kernel module. These tests may crash the kernel and should
@@ -28,9 +32,12 @@ bool test__hashtbl_refcount(ProcessContext *context) __init;
 bool test__hashtbl_add_duplicate(ProcessContext *context) __init;
 
 bool test__proc_track_report_double_exit(ProcessContext *context) __init;
+bool test__proc_track_inode_index(ProcessContext *context) __init;
+bool test__proc_track_handle_cache(ProcessContext *context) __init;
 
 bool test__begin_finish_macros(ProcessContext *context) __init;
 bool test__hook_tracking_add_del(ProcessContext *context) __init;
+bool test__hook_latency_histogram(ProcessContext *context) __init;
 
 bool test__stall_enable(ProcessContext *context) __init;
 
@@ -42,5 +49,38 @@ bool test__stall_one_during_disable(ProcessContext *context) __init;
 bool test__kthread_may_stall(void) __init;
 bool test__insmod_may_stall(void) __init;
 bool test__stall_event_abort(ProcessContext *context) __init;
+bool test__stall_event_resume_batch(ProcessContext *context) __init;
+bool test__stall_outcome_stats(ProcessContext *context) __init;
+bool test__stall_verdict_cache(ProcessContext *context) __init;
+
+bool test__file_write_coalesce(ProcessContext *context) __init;
+bool test__file_hooks_coalesce(ProcessContext *context) __init;
+
+bool test__prefix_trie_special_files(ProcessContext *context) __init;
+bool test__prefix_trie_interpreters(ProcessContext *context) __init;
+bool test__prefix_trie_reload(ProcessContext *context) __init;
+
+bool test__banning_bulk_replace(ProcessContext *context) __init;
+bool test__banning_ignore_set(ProcessContext *context) __init;
+
+bool test__trusted_path_match(ProcessContext *context) __init;
+
+bool test__net_recvmmsg_batch(ProcessContext *context) __init;
+
+bool test__dns_parse_udp_response(ProcessContext *context) __init;
+bool test__dns_parse_edns0_response(ProcessContext *context) __init;
+bool test__dns_tcp_reassembly(ProcessContext *context) __init;
+bool test__dns_dedup(ProcessContext *context) __init;
+bool test__dns_parse_skb_benchmark(ProcessContext *context) __init;
+
+// Nanoseconds taken to run stmt iterations times, with index counting the runs
+#define TEST_LOOP_NS(index, iterations, stmt) ({                \
+    u64 __loop_start = local_clock();                           \
+    for ((index) = 0; (index) < (iterations); ++(index))        \
+    {                                                           \
+        stmt;                                                   \
+    }                                                           \
+    local_clock() - __loop_start;                               \
+})
 
 #define ASSERT_TRY(stmt) TRY_MSG(stmt, DL_ERROR, "ASSERT FAILED %s:%d -- %s", __FILE__, __LINE__, #stmt)
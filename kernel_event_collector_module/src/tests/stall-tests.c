@@ -6,6 +6,9 @@
 #include "stall-event.h"
 
 #include <linux/kthread.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)  //{
+#include <linux/sched/clock.h>
+#endif  //}
 
 bool __init test__stall_enable(ProcessContext *context)
 {
@@ -43,7 +46,7 @@ bool __init test__stall_timedout(ProcessContext *context)
     ec_enable_stall_events();
 
     start = now_milli();
-    ret = ec_wait_stall_event_timeout(0, 0, CB_EVENT_TYPE_MODULE_LOAD, ms_wait, context);
+    ret = ec_wait_stall_event_timeout(0, 0, CB_EVENT_TYPE_MODULE_LOAD, NULL, ms_wait, context);
     diff = now_milli() - start;
     TRACE(DL_INFO, "diff:%llu  max wait time:%u ms", diff, ms_wait);
     ASSERT_TRY((unsigned int)diff >= ms_wait -1); // diff might be truncated a bit
@@ -142,7 +145,7 @@ bool __init test__stall_event_EPERM(ProcessContext *context)
     start = now_milli();
     wake_up_process(task);
 
-    ret = ec_wait_stall_event_timeout(perm_id, tid, CB_EVENT_TYPE_MODULE_LOAD, ms_wait, context);
+    ret = ec_wait_stall_event_timeout(perm_id, tid, CB_EVENT_TYPE_MODULE_LOAD, NULL, ms_wait, context);
     diff = now_milli() - start;
     TRACE(DL_INFO, "diff:%llu  max wait time:%u ms", diff, ms_wait);
     ASSERT_TRY(ret == -EPERM);
@@ -179,7 +182,7 @@ bool __init test__stall_one_during_disable(ProcessContext *context)
     start = now_milli();
     task = kthread_run(&defer_stall_disable, NULL, "defer_disable");
     ASSERT_TRY(!IS_ERR(task));
-    ret = ec_wait_stall_event_timeout(0, 0, CB_EVENT_TYPE_MODULE_LOAD, ms_wait, context);
+    ret = ec_wait_stall_event_timeout(0, 0, CB_EVENT_TYPE_MODULE_LOAD, NULL, ms_wait, context);
     diff = now_milli() - start;
     TRACE(DL_INFO, "diff:%llu  max wait time:%u ms", diff, ms_wait);
     ASSERT_TRY(0 == ret);
@@ -293,7 +296,7 @@ bool __init test__stall_event_abort(ProcessContext *context)
     wake_up_process(task);
 
     response = ec_wait_stall_event_timeout(abort_args.perm_id, abort_args.tid, abort_args.eventType,
-                                           ms_wait, context);
+                                           NULL, ms_wait, context);
     diff = now_milli() - start;
     TRACE(DL_INFO, "diff:%llu  max wait time:%u ms", diff, ms_wait);
 
@@ -307,3 +310,251 @@ CATCH_DEFAULT:
     ec_disable_stall_events(context);
     return passed;
 }
+
+#define STALL_BATCH_TASKS  64
+
+struct batch_args {
+    struct CB_PERM_RESPONSE response;
+    unsigned int ms;
+    int exp_result;
+    int result;
+};
+
+static struct batch_args batch_args[STALL_BATCH_TASKS];
+static struct CB_PERM_RESPONSE batch_responses[STALL_BATCH_TASKS];
+static atomic_t batch_started;
+static atomic_t batch_done;
+static DECLARE_WAIT_QUEUE_HEAD(batch_waitq);
+
+// Polls until the first count batch tasks are all in the stall table, so nothing is
+//  resumed before it has stalled
+static bool __init stall_batch_wait_pending(int count, unsigned int ms_wait, ProcessContext *context)
+{
+    unsigned long deadline = jiffies + msecs_to_jiffies(ms_wait);
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        struct CB_PERM_RESPONSE *response = &batch_args[i].response;
+
+        while (!ec_stall_event_pending(response->perm_id, response->tid, response->eventType, context))
+        {
+            if (time_after(jiffies, deadline))
+            {
+                return false;
+            }
+            usleep_range(100, 200);
+        }
+    }
+    return true;
+}
+
+static int stall_batch_task(void *data)
+{
+    struct batch_args *args = (struct batch_args *)data;
+    DECLARE_NON_ATOMIC_CONTEXT(context, ec_getpid(current));
+
+    atomic_inc(&batch_started);
+    wake_up(&batch_waitq);
+    args->result = ec_wait_stall_event_timeout(args->response.perm_id, args->response.tid,
+                                               args->response.eventType, NULL, args->ms, &context);
+    atomic_inc(&batch_done);
+    wake_up(&batch_waitq);
+    return 0;
+}
+
+// Stall a batch of tasks and release all of them with a single call
+bool __init test__stall_event_resume_batch(ProcessContext *context)
+{
+    bool passed = false;
+    int i;
+    int woken;
+    int started = 0;
+    uint64_t start;
+    uint64_t diff;
+    unsigned int ms_wait = 1000;
+
+    ec_enable_stall_events();
+    memset(batch_args, 0, sizeof(batch_args));
+    atomic_set(&batch_started, 0);
+    atomic_set(&batch_done, 0);
+
+    for (i = 0; i < STALL_BATCH_TASKS; ++i)
+    {
+        struct task_struct *task = kthread_create(&stall_batch_task, &batch_args[i], "stall_batch-%d", i);
+
+        ASSERT_TRY(!IS_ERR(task));
+
+        batch_args[i].response.perm_id = ec_next_perm_id();
+        batch_args[i].response.tid = task->pid;
+        batch_args[i].response.eventType = CB_EVENT_TYPE_MODULE_LOAD;
+        batch_args[i].response.response = (i & 1) ? CB_PERM_RESPONSE_TYPE_EPERM : CB_PERM_RESPONSE_TYPE_ALLOW;
+        batch_args[i].ms = 2000;
+        batch_args[i].exp_result = (i & 1) ? -EPERM : 0;
+        batch_args[i].result = 0xBEEF;
+        batch_responses[i] = batch_args[i].response;
+
+        wake_up_process(task);
+        started += 1;
+    }
+
+    wait_event_timeout(batch_waitq, atomic_read(&batch_started) == STALL_BATCH_TASKS, msecs_to_jiffies(ms_wait));
+    ASSERT_TRY(atomic_read(&batch_started) == STALL_BATCH_TASKS);
+    ASSERT_TRY(stall_batch_wait_pending(STALL_BATCH_TASKS, ms_wait, context));
+
+    start = local_clock();
+    woken = ec_stall_event_resume_batch(batch_responses, STALL_BATCH_TASKS, context);
+
+    // The tasks may not have run yet, but they are no longer stalled
+    ASSERT_TRY(0 == ec_stall_event_resume_batch(batch_responses, STALL_BATCH_TASKS, context));
+    ASSERT_TRY(0 == ec_stall_event_abort_batch(batch_responses, STALL_BATCH_TASKS, context));
+
+    wait_event_timeout(batch_waitq, atomic_read(&batch_done) == STALL_BATCH_TASKS, msecs_to_jiffies(ms_wait));
+    diff = local_clock() - start;
+
+    TRACE(DL_INFO, "%s: woke %d of %d stalled tasks in %llu us", __func__, woken, STALL_BATCH_TASKS,
+          diff / NSEC_PER_USEC);
+
+    ASSERT_TRY(woken == STALL_BATCH_TASKS);
+    ASSERT_TRY(atomic_read(&batch_done) == STALL_BATCH_TASKS);
+    for (i = 0; i < STALL_BATCH_TASKS; ++i)
+    {
+        ASSERT_TRY(batch_args[i].result == batch_args[i].exp_result);
+    }
+
+    // Nothing is left to resume
+    ASSERT_TRY(0 == ec_stall_event_resume_batch(batch_responses, STALL_BATCH_TASKS, context));
+
+    passed = true;
+
+CATCH_DEFAULT:
+    // Do not leave anything stalled behind if we bailed out early
+    ec_disable_stall_events(context);
+    wait_event_timeout(batch_waitq, atomic_read(&batch_done) == started, msecs_to_jiffies(ms_wait));
+    return passed;
+}
+
+// One task each is resumed, aborted and left to time out
+#define STALL_OUTCOME_TASKS  3
+
+// Every way a stall ends is counted once per stall
+bool __init test__stall_outcome_stats(ProcessContext *context)
+{
+    bool passed = false;
+    uint64_t before[STALL_OUTCOMES];
+    uint64_t expected[STALL_OUTCOMES] = {
+        [STALL_RESUMED] = 1,
+        [STALL_ABORTED] = 1,
+        [STALL_TIMED_OUT] = 1,
+    };
+    int started = 0;
+    int i;
+    unsigned int ms_wait = 1000;
+
+    ec_enable_stall_events();
+    memset(batch_args, 0, sizeof(batch_args));
+    atomic_set(&batch_started, 0);
+    atomic_set(&batch_done, 0);
+
+    for (i = 0; i < STALL_OUTCOMES; ++i)
+    {
+        before[i] = ec_stall_outcome_count(CB_EVENT_TYPE_MODULE_LOAD, i);
+    }
+
+    for (i = 0; i < STALL_OUTCOME_TASKS; ++i)
+    {
+        struct task_struct *task = kthread_create(&stall_batch_task, &batch_args[i], "stall_outcome-%d", i);
+
+        ASSERT_TRY(!IS_ERR(task));
+
+        batch_args[i].response.perm_id = ec_next_perm_id();
+        batch_args[i].response.tid = task->pid;
+        batch_args[i].response.eventType = CB_EVENT_TYPE_MODULE_LOAD;
+        batch_args[i].response.response = CB_PERM_RESPONSE_TYPE_ALLOW;
+        batch_args[i].ms = (i == STALL_OUTCOME_TASKS - 1) ? 100 : 2000;
+
+        wake_up_process(task);
+        started += 1;
+    }
+
+    wait_event_timeout(batch_waitq, atomic_read(&batch_started) == STALL_OUTCOME_TASKS, msecs_to_jiffies(ms_wait));
+    ASSERT_TRY(atomic_read(&batch_started) == STALL_OUTCOME_TASKS);
+    ASSERT_TRY(stall_batch_wait_pending(STALL_OUTCOME_TASKS, ms_wait, context));
+
+    ASSERT_TRY(0 == ec_stall_event_resume(&batch_args[0].response, context));
+    ASSERT_TRY(0 == ec_stall_event_abort(batch_args[1].response.perm_id, batch_args[1].response.tid,
+                                         batch_args[1].response.eventType, context));
+
+    wait_event_timeout(batch_waitq, atomic_read(&batch_done) == STALL_OUTCOME_TASKS, msecs_to_jiffies(ms_wait));
+    ASSERT_TRY(atomic_read(&batch_done) == STALL_OUTCOME_TASKS);
+
+    for (i = 0; i < STALL_OUTCOMES; ++i)
+    {
+        uint64_t count = ec_stall_outcome_count(CB_EVENT_TYPE_MODULE_LOAD, i);
+
+        TRACE(DL_INFO, "%s: outcome %d counted %llu times", __func__, i, count - before[i]);
+        ASSERT_TRY(count - before[i] == expected[i]);
+    }
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_disable_stall_events(context);
+    wait_event_timeout(batch_waitq, atomic_read(&batch_done) == started, msecs_to_jiffies(ms_wait));
+    return passed;
+}
+
+static struct CB_PERM_RESPONSE cb_perm_cached;
+
+// A cached verdict resolves the next event for the file without a stall
+bool __init test__stall_verdict_cache(ProcessContext *context)
+{
+    bool passed = false;
+    int ret;
+    int response = 0xBEEF;
+    struct task_struct *task;
+    STALL_FILE_ID file = {
+        .device = 0xDE,
+        .inode = 0xAD,
+        .mtime = 1000,
+        .ctime = 2000,
+    };
+    STALL_FILE_ID changed = file;
+    unsigned int ms_wait = 1000;
+
+    ec_enable_stall_events();
+
+    ASSERT_TRY(!ec_stall_verdict_lookup(&file, CB_EVENT_TYPE_MODULE_LOAD, &response, context));
+
+    task = kthread_create(&defer_stall_event_resume, &cb_perm_cached, "defer_cached");
+    ASSERT_TRY(!IS_ERR(task));
+
+    memset(&cb_perm_cached, 0, sizeof(cb_perm_cached));
+    cb_perm_cached.tid = task->pid;
+    cb_perm_cached.eventType = CB_EVENT_TYPE_MODULE_LOAD;
+    cb_perm_cached.response = CB_PERM_RESPONSE_TYPE_EACCES;
+    cb_perm_cached.cacheFlags = 60 | CB_PERM_CACHE_MATCH_TIMES;
+    cb_perm_cached.perm_id = ec_next_perm_id();
+
+    wake_up_process(task);
+    ret = ec_wait_stall_event_timeout(cb_perm_cached.perm_id, cb_perm_cached.tid, CB_EVENT_TYPE_MODULE_LOAD,
+                                      &file, ms_wait, context);
+    ASSERT_TRY(ret == -EACCES);
+
+    ASSERT_TRY(ec_stall_verdict_lookup(&file, CB_EVENT_TYPE_MODULE_LOAD, &response, context));
+    ASSERT_TRY(response == -EACCES);
+
+    // Only for the event type that was answered
+    ASSERT_TRY(!ec_stall_verdict_lookup(&file, CB_EVENT_TYPE_PROCESS_START_EXEC, &response, context));
+
+    // A modified file has to be looked at again, and the old verdict goes away
+    changed.mtime += 1;
+    ASSERT_TRY(!ec_stall_verdict_lookup(&changed, CB_EVENT_TYPE_MODULE_LOAD, &response, context));
+    ASSERT_TRY(!ec_stall_verdict_lookup(&file, CB_EVENT_TYPE_MODULE_LOAD, &response, context));
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_disable_stall_events(context);
+    return passed;
+}
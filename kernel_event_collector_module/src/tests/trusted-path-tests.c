@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "run-tests.h"
+#include "trusted-path.h"
+
+// Load a directory and an exact path the way the ioctl does and check what they match
+bool __init test__trusted_path_match(ProcessContext *context)
+{
+    bool passed = false;
+    uint64_t unchecked;
+    uint64_t state;
+
+    unchecked = ec_trusted_path_check("/opt/backup/bin/agent");
+    ASSERT_TRY((uint32_t)unchecked == 0);
+
+    ASSERT_TRY(ec_trusted_path_set("/opt/backup/", context) == 0);
+    ASSERT_TRY(ec_trusted_path_set("/usr/bin/rsync", context) == 0);
+    ASSERT_TRY(ec_trusted_path_set("/usr/bin/rsync", context) == 0);
+    ASSERT_TRY(ec_trusted_path_count() == 2);
+
+    // Any change to the list has to invalidate what was cached before it
+    state = ec_trusted_path_check("/opt/backup/bin/agent");
+    ASSERT_TRY((state >> 32) != (unchecked >> 32));
+    ASSERT_TRY((uint32_t)state == 1);
+
+    ASSERT_TRY((uint32_t)ec_trusted_path_check("/usr/bin/rsync") == 2);
+    ASSERT_TRY((uint32_t)ec_trusted_path_check("/usr/bin/rsync2") == 0);
+    ASSERT_TRY((uint32_t)ec_trusted_path_check("/usr/bin/rsyn") == 0);
+    ASSERT_TRY((uint32_t)ec_trusted_path_check("/opt/backup") == 0);
+    ASSERT_TRY((uint32_t)ec_trusted_path_check("/opt/backups/agent") == 0);
+    ASSERT_TRY(ec_trusted_path_check(NULL) == 0);
+
+    // An empty path clears the list
+    ASSERT_TRY(ec_trusted_path_set("", context) == 0);
+    ASSERT_TRY(ec_trusted_path_count() == 0);
+    ASSERT_TRY((uint32_t)ec_trusted_path_check("/usr/bin/rsync") == 0);
+
+    passed = true;
+
+CATCH_DEFAULT:
+    ec_trusted_path_clear(context);
+    return passed;
+}
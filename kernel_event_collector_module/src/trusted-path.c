@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-2.0
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#include "priv.h"
+#include "trusted-path.h"
+#include "mem-cache.h"
+
+#include <linux/rcupdate.h>
+
+// Entries are only ever appended, and a reader only looks at the first s_trusted_path_count
+//  of them. Clearing the list drops the count to zero and waits for readers before the
+//  path strings are freed, so readers only need rcu_read_lock.
+typedef struct trusted_path_entry {
+    char       *path;
+    size_t      len;
+    atomic64_t  suppressed;
+} TrustedPathEntry;
+
+static TrustedPathEntry s_trusted_paths[CB_TRUSTED_PATH_MAX];
+static atomic_t         s_trusted_path_count      = ATOMIC_INIT(0);
+static atomic_t         s_trusted_path_generation = ATOMIC_INIT(1);
+static DEFINE_MUTEX(s_trusted_path_lock);
+
+// The cached value is (generation << 32) | (index + 1), where index 0 means no match.
+//  A zero generation never matches, so a new ExecIdentity is always checked.
+#define TRUSTED_PATH_STATE(GEN, IDX)  (((uint64_t)(GEN) << 32) | (uint32_t)(IDX))
+#define TRUSTED_PATH_GEN(STATE)       ((uint32_t)((STATE) >> 32))
+#define TRUSTED_PATH_IDX(STATE)       ((uint32_t)(STATE))
+
+static bool __ec_trusted_path_match(TrustedPathEntry *entry, const char *path, size_t len)
+{
+    if (entry->path[entry->len - 1] == '/')
+    {
+        return len >= entry->len && strncmp(path, entry->path, entry->len) == 0;
+    }
+    return len == entry->len && strncmp(path, entry->path, len) == 0;
+}
+
+// Caller holds rcu_read_lock or s_trusted_path_lock
+static uint32_t __ec_trusted_path_find(const char *path, size_t len)
+{
+    uint32_t count = atomic_read(&s_trusted_path_count);
+    uint32_t i;
+
+    smp_rmb();
+    for (i = 0; i < count; ++i)
+    {
+        if (__ec_trusted_path_match(&s_trusted_paths[i], path, len))
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+int ec_trusted_path_set(const char *path, ProcessContext *context)
+{
+    int      xcode  = -ENOMEM;
+    uint32_t count;
+    uint32_t i;
+    size_t   len;
+    char    *copy;
+
+    CANCEL(path, -EINVAL);
+
+    len = strlen(path);
+    if (!len)
+    {
+        ec_trusted_path_clear(context);
+        return 0;
+    }
+
+    mutex_lock(&s_trusted_path_lock);
+
+    count = atomic_read(&s_trusted_path_count);
+
+    // Duplicates are harmless but would split the counts
+    for (i = 0; i < count; ++i)
+    {
+        TRY_DO(s_trusted_paths[i].len != len || strcmp(s_trusted_paths[i].path, path) != 0, { xcode = 0; });
+    }
+
+    TRY_SET_MSG(count < CB_TRUSTED_PATH_MAX, -ENOSPC, DL_ERROR, "%s: trusted path list is full, dropping %s", __func__, path);
+
+    copy = ec_mem_cache_strdup(path, context);
+    TRY(copy);
+
+    s_trusted_paths[count].path = copy;
+    s_trusted_paths[count].len  = len;
+    atomic64_set(&s_trusted_paths[count].suppressed, 0);
+
+    smp_wmb();
+    atomic_set(&s_trusted_path_count, count + 1);
+    atomic_inc(&s_trusted_path_generation);
+    xcode = 0;
+
+    TRACE(DL_INFO, "%s: trusted path %u %s", __func__, count, path);
+
+CATCH_DEFAULT:
+    mutex_unlock(&s_trusted_path_lock);
+    return xcode;
+}
+
+void ec_trusted_path_clear(ProcessContext *context)
+{
+    uint32_t count;
+    uint32_t i;
+
+    mutex_lock(&s_trusted_path_lock);
+
+    count = atomic_read(&s_trusted_path_count);
+    if (count)
+    {
+        atomic_set(&s_trusted_path_count, 0);
+        atomic_inc(&s_trusted_path_generation);
+
+        // Wait for anyone still comparing against the old entries
+        synchronize_rcu();
+
+        for (i = 0; i < count; ++i)
+        {
+            ec_mem_cache_free_generic(s_trusted_paths[i].path);
+            s_trusted_paths[i].path = NULL;
+            s_trusted_paths[i].len  = 0;
+        }
+    }
+
+    mutex_unlock(&s_trusted_path_lock);
+}
+
+uint32_t ec_trusted_path_count(void)
+{
+    return atomic_read(&s_trusted_path_count);
+}
+
+uint64_t ec_trusted_path_check(const char *path)
+{
+    uint32_t generation;
+    uint32_t idx = 0;
+
+    // Leave the state unchecked until we know the path
+    CANCEL(path, 0);
+
+    generation = atomic_read(&s_trusted_path_generation);
+    if (atomic_read(&s_trusted_path_count))
+    {
+        rcu_read_lock();
+        idx = __ec_trusted_path_find(path, strlen(path));
+        rcu_read_unlock();
+    }
+
+    return TRUSTED_PATH_STATE(generation, idx);
+}
+
+static bool __ec_trusted_path_event_type(CB_INTENT_TYPE intentType, CB_EVENT_TYPE eventType)
+{
+    if (intentType != INTENT_REPORT)
+    {
+        return false;
+    }
+
+    switch (eventType)
+    {
+    case CB_EVENT_TYPE_FILE_CREATE:
+    case CB_EVENT_TYPE_FILE_DELETE:
+    case CB_EVENT_TYPE_FILE_WRITE:
+    case CB_EVENT_TYPE_FILE_CLOSE:
+    case CB_EVENT_TYPE_FILE_OPEN:
+    case CB_EVENT_TYPE_NET_CONNECT_PRE:
+    case CB_EVENT_TYPE_NET_CONNECT_POST:
+    case CB_EVENT_TYPE_NET_ACCEPT:
+    case CB_EVENT_TYPE_DNS_RESPONSE:
+    case CB_EVENT_TYPE_WEB_PROXY:
+        return true;
+
+    default:
+        break;
+    }
+    return false;
+}
+
+bool ec_trusted_path_should_suppress(ProcessHandle *process_handle, CB_INTENT_TYPE intentType, CB_EVENT_TYPE eventType)
+{
+    ExecIdentity *exec_identity = NULL;
+    uint64_t      state;
+    uint32_t      idx;
+    bool          suppress = false;
+
+    if (!atomic_read(&s_trusted_path_count) || !__ec_trusted_path_event_type(intentType, eventType))
+    {
+        return false;
+    }
+
+    exec_identity = ec_process_exec_identity(process_handle);
+    CANCEL(exec_identity, false);
+
+    // Held across the count so that a clear can not reuse the entry under us
+    rcu_read_lock();
+
+    // The list changed since this process was checked
+    state = READ_ONCE(exec_identity->trusted_path);
+    if (TRUSTED_PATH_GEN(state) != (uint32_t)atomic_read(&s_trusted_path_generation))
+    {
+        state = ec_trusted_path_check(ec_process_path(process_handle));
+        WRITE_ONCE(exec_identity->trusted_path, state);
+    }
+
+    idx = TRUSTED_PATH_IDX(state);
+    if (idx && idx <= atomic_read(&s_trusted_path_count))
+    {
+        atomic64_inc(&s_trusted_paths[idx - 1].suppressed);
+        suppress = true;
+    }
+
+    rcu_read_unlock();
+
+    return suppress;
+}
+
+int ec_trusted_path_show(struct seq_file *m, void *v)
+{
+    uint32_t count;
+    uint32_t i;
+
+    seq_printf(m, "%12s | %s\n", "Suppressed", "Path");
+
+    // Hold the lock so the list can not be cleared under us
+    mutex_lock(&s_trusted_path_lock);
+    count = atomic_read(&s_trusted_path_count);
+    for (i = 0; i < count; ++i)
+    {
+        seq_printf(m, "%12llu | %s\n",
+                   (uint64_t)atomic64_read(&s_trusted_paths[i].suppressed),
+                   s_trusted_paths[i].path);
+    }
+    mutex_unlock(&s_trusted_path_lock);
+
+    return 0;
+}
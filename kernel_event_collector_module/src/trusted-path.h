@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+// Copyright (c) 2021 VMware, Inc. All rights reserved.
+
+#pragma once
+
+#include <linux/seq_file.h>
+
+#include "process-context.h"
+#include "process-tracking.h"
+
+// Trusted paths suppress file and network reports from processes whose exec path
+//  matches. A path ending in '/' matches everything below that directory, any other
+//  path must match exactly. Process lifecycle and blocking events are always reported.
+//
+// The match is decided when a process execs and cached on its ExecIdentity as a
+//  (generation, index) pair. Any change to the list bumps the generation, so running
+//  processes are checked again on their next event.
+#define CB_TRUSTED_PATH_MAX  64
+
+// Adds path to the list, an empty path clears it.  Returns -ENOSPC when the list is full.
+int ec_trusted_path_set(const char *path, ProcessContext *context);
+void ec_trusted_path_clear(ProcessContext *context);
+uint32_t ec_trusted_path_count(void);
+
+// Returns the value to cache in ExecIdentity::trusted_path for a process running path
+uint64_t ec_trusted_path_check(const char *path);
+bool ec_trusted_path_should_suppress(ProcessHandle *process_handle, CB_INTENT_TYPE intentType, CB_EVENT_TYPE eventType);
+
+int ec_trusted_path_show(struct seq_file *m, void *v);